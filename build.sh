@@ -34,7 +34,7 @@ echo -e "${GREEN}$0${OFF}: building e9patch and e9tool..."
 (cd contrib/libdw; make clean; make -j `nproc`)
 (cd contrib/zydis; make clean; make -j `nproc`)
 make clean
-make -j `nproc` tool release
+make -j `nproc` tool release e9tracedump
 
 echo -e "${GREEN}$0${OFF}: done...!"
 
@@ -131,9 +131,10 @@ then
         echo >&2
         echo "EXPLANATION:" >&2
         echo >&2
-        echo "    E9Tool's call instrumentation does not save/restore the extended CPU state." >&2
-        echo "    This can lead to subtle bugs if this state is clobbered by the trampoline" >&2
-        echo "    code.  This warning can be ignored if you know what you are doing." >&2
+        echo "    By default, E9Tool's call instrumentation does not save/restore the" >&2
+        echo "    extended CPU state.  E9Tool will detect this and select a more expensive" >&2
+        echo "    save mode (see the <sse> and <xsave> call options) for this binary." >&2
+        echo "    This warning can be ignored if you know what you are doing." >&2
         echo "    (define NO_SIMD_CHECK=1 to disable)." >&2
         echo >&2
     fi
@@ -63,6 +63,9 @@
  *                                   in addresses used by the RedFat
  *                                   runtime.  Not needed for PIE.
  *
+ *  E9Tool also copies the inline fast path (check.inline below) into each
+ *  trampoline, so check() is only called if the fast path fails.
+ *
  * TESTING
  *    To test the instrumentation, use the REDFAT_TEST=N environment variable:
  *
@@ -221,6 +224,48 @@ void check(const void *loc, const void *base, const void *access, size_t sz,
     abort();
 }
 
+/*
+ * Inline fast path for check():
+ *  - %rdi = loc, %rsi = base, %rdx = access, %rcx = sz, %r8 = _asm.
+ *
+ * E9Tool copies this code directly into each trampoline before the call to
+ * check(), so the common case (a valid access) avoids the call altogether.
+ * The fast path returns non-zero if the access is valid (or the pointer is
+ * not a RedFat pointer), else zero, in which case check() is called to
+ * report the error.  The fast path may only clobber %rax, %rflags, and the
+ * argument registers (see the E9Tool user guide).
+ */
+asm (
+    ".globl check.inline\n"
+    ".type check.inline,@function\n"
+    "check.inline:\n"
+    "\tmov %rdx,%rdi\n"                 // %rdi = access
+    "\tmov %rdx,%rax\n"
+    "\tshr $35,%rax\n"                  // %rax = redfat_index(access)
+    "\tmov 0x100000(,%rax,8),%r8\n"     // %r8  = redfat_size(access)
+    "\tmov 0x180000(,%rax,8),%rax\n"
+    "\tmul %rsi\n"
+    "\timul %r8,%rdx\n"                 // %rdx = meta = redfat_base(...)
+    "\tmov $1,%eax\n"
+    "\ttest %rdx,%rdx\n"
+    "\tjz 1f\n"                         // Not a RedFat pointer
+    "\tmov (%rdx),%rsi\n"               // %rsi = size
+    "\txor %eax,%eax\n"
+    "\tcmp %r8,%rsi\n"
+    "\tjae 1f\n"                        // size >= redfat_size(access)
+    "\tlea 16(%rdx),%r8\n"              // %r8  = lb
+    "\tcmp %r8,%rdi\n"
+    "\tjb 1f\n"                         // access < lb
+    "\tadd %r8,%rsi\n"                  // %rsi = ub
+    "\tadd %rdi,%rcx\n"
+    "\tcmp %rsi,%rcx\n"
+    "\tja 1f\n"                         // access + sz > ub
+    "\tinc %eax\n"
+    "1:\n"
+    "\tret\n"
+    ".size check.inline,.-check.inline\n"
+);
+
 /*
  * Init.
  */
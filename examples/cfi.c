@@ -15,9 +15,11 @@
  *  $ DEBUG=1 ./a.out
  *
  * INPUT:
- *  This example program parses the "a.out.TARGETs.csv" and 
- *  "a.out.DISASM.csv" files.  Use E9Tool's --dump-all option to generate
- *  these files.
+ *  This example program maps the "a.out.TARGETs.bitmap" file, which is a
+ *  bitmap of all indirect jump/call targets (one bit per byte of code).  Use
+ *  E9Tool's --dump-all option to generate this file.  Since the bitmap is
+ *  generated at rewrite time, the startup cost is a single mmap(), and each
+ *  check is a single load and bit test.
  *
  * LIMITATIONS:
  *  - Only addresses within the instrumented binary are checked.
@@ -36,15 +38,18 @@ static bool option_debug = false;
 #define MAGENTA     (option_tty? "\33[35m": "")
 #define OFF         (option_tty? "\33[0m" : "")
 
+/*
+ * Indirect target bitmap (see E9Tool's --dump-all option).
+ */
 typedef struct
 {
-    uintptr_t *data;
-    uintptr_t lb;
-    uintptr_t ub;
-    size_t size;
-    size_t max;
-} INFO;
-static INFO TARGETs = {0};                      // All targets.
+    char magic[8];                              // "E9BITMAP"
+    uint64_t lb;                                // Lowest address
+    uint64_t ub;                                // Highest address (+size)
+    uint64_t reserved;
+    uint8_t bits[];                             // Bit per byte in [lb..ub)
+} BITMAP;
+static const BITMAP *TARGETs = NULL;            // All indirect targets.
 
 typedef enum
 {
@@ -65,51 +70,15 @@ typedef enum
 #define message(msg, ...)                                       \
     fprintf(stderr, msg "\n", ##__VA_ARGS__);                   \
 
-/*
- * Target push.
- */
-static void target_push(uintptr_t target)
-{
-    if (TARGETs.size >= TARGETs.max)
-    {
-        TARGETs.lb   = (TARGETs.max == 0? UINTPTR_MAX: TARGETs.lb);
-        TARGETs.max  = (TARGETs.max == 0? 16: 2 * TARGETs.max);
-        TARGETs.data = (uintptr_t *)realloc(TARGETs.data,
-            TARGETs.max * sizeof(uintptr_t));
-        if (TARGETs.data == NULL)
-            error("failed to allocate memory: %s", strerror(errno));
-    }
-    TARGETs.data[TARGETs.size++] = target;
-}
-
-/*
- * Target range.
- */
-static void target_range(uintptr_t lb, uintptr_t ub)
-{
-    TARGETs.lb = (lb < TARGETs.lb? lb: TARGETs.lb);
-    TARGETs.ub = (ub > TARGETs.ub? ub: TARGETs.ub);
-}
-
 /*
  * Target check.
  */
 static RESULT target_check(uintptr_t target)
 {
-    if (target < TARGETs.lb || target > TARGETs.ub)
+    if (target < TARGETs->lb || target >= TARGETs->ub)
         return UNKNOWN;
-    ssize_t lo = 0, hi = TARGETs.size-1;
-    while (lo <= hi)
-    {
-        ssize_t mid = (lo + hi) / 2;
-        if (TARGETs.data[mid] < target)
-            lo = mid+1;
-        else if (TARGETs.data[mid] > target)
-            hi = mid-1;
-        else
-            return VALID;
-    }
-    return INVALID;
+    uintptr_t offset = target - TARGETs->lb;
+    return ((TARGETs->bits[offset / 8] >> (offset % 8)) & 0x1? VALID: INVALID);
 }
 
 /*
@@ -159,42 +128,32 @@ void init(int argc, char **argv, char **envp)
     const char *progname = argv[0];
 
     char *input;
-    if (asprintf(&input, "%s.TARGETs.csv", progname) < 0)
-        error("failed to create input filename: %s", strerror(errno));
-    FILE *stream = fopen(input, "r");
-    if (stream == NULL)
-        error("failed to open \"%s%s%s\" for reading: %s", YELLOW, input,
-            OFF, strerror(errno));
-    char c;
-    while ((c = getc(stream)) != '\n' && c != EOF)
-        ;
-    uintptr_t target, direct, indirect, func;
-    while (fscanf(stream, "%zx,%zu,%zu,%zu", &target, &direct, &indirect, &func)
-        == 4)
-    {
-        if (indirect)
-            target_push(target);
-    }
-    TARGETs.max = TARGETs.size;
-    TARGETs.data = (uintptr_t *)realloc(TARGETs.data,
-        TARGETs.max * sizeof(uintptr_t));
-    if (TARGETs.data == NULL)
-        error("failed to allocate memory: %s", strerror(errno));
-    fclose(stream);
-    free(input);
-
-    if (asprintf(&input, "%s.DISASM.csv", progname) < 0)
+    if (asprintf(&input, "%s.TARGETs.bitmap", progname) < 0)
         error("failed to create input filename: %s", strerror(errno));
-    stream = fopen(input, "r");
-    if (stream == NULL)
+    int fd = open(input, O_RDONLY);
+    if (fd < 0)
         error("failed to open \"%s%s%s\" for reading: %s", YELLOW, input,
             OFF, strerror(errno));
-    while ((c = getc(stream)) != '\n' && c != EOF)
-        ;
-    uintptr_t addr, offset, size;
-    while (fscanf(stream, "%zx,%zu,%zu", &addr, &offset, &size) == 3)
-        target_range(addr, addr+size);
-    fclose(stream);
+    struct stat buf;
+    if (fstat(fd, &buf) < 0)
+        error("failed to stat \"%s%s%s\": %s", YELLOW, input, OFF,
+            strerror(errno));
+    if ((size_t)buf.st_size < sizeof(BITMAP))
+        error("failed to read \"%s%s%s\": file is too small", YELLOW, input,
+            OFF);
+    const BITMAP *bitmap = (const BITMAP *)mmap(NULL, buf.st_size, PROT_READ,
+        MAP_PRIVATE, fd, 0);
+    if (bitmap == MAP_FAILED)
+        error("failed to map \"%s%s%s\": %s", YELLOW, input, OFF,
+            strerror(errno));
+    close(fd);
+    if (memcmp(bitmap->magic, "E9BITMAP", sizeof(bitmap->magic)) != 0 ||
+            bitmap->lb > bitmap->ub ||
+            sizeof(BITMAP) + (bitmap->ub - bitmap->lb + 7) / 8 >
+                (size_t)buf.st_size)
+        error("failed to read \"%s%s%s\": invalid bitmap file", YELLOW,
+            input, OFF);
+    TARGETs = bitmap;
     free(input);
 }
 
@@ -26,6 +26,11 @@
  * NOTES:
  *  The output file will NOT be generated if the program crashes or calls fast
  *  exit (e.g., _Exit()).
+ *
+ *  Edges are counted in a lock-free open-addressing hash table keyed by the
+ *  raw (from, to) pair, so entry() never takes a lock or searches the
+ *  basic-block list.  Jump/call targets are almost always basic-block
+ *  starts, so mapping "to" to its basic block is deferred to fini().
  */
 
 #include "stdlib.c"
@@ -44,8 +49,20 @@ typedef struct
     size_t count;
 } ENTRY;
 
-static void *COV = NULL;                    // Global state.
-static mutex_t mutex = MUTEX_INITIALIZER;   // Global mutex.
+typedef struct
+{
+    uintptr_t from;                         // 0 = empty slot
+    uintptr_t to;                           // (16-byte aligned with from)
+    size_t count;
+    size_t pad;
+} SLOT;
+
+#define PROBE_MAX   64                  // Max probes before overflow.
+
+static SLOT *TABLE = NULL;                  // Edge hash table.
+static size_t MASK = 0;                     // Edge hash table size - 1.
+static void *COV = NULL;                    // Overflow state.
+static mutex_t mutex = MUTEX_INITIALIZER;   // Overflow mutex.
 
 static char *output = NULL;                 // Output filename.
 static FILE *stream = NULL;                 // Output stream.
@@ -113,18 +130,22 @@ static int compare(const void *n, const void *m)
 }
 
 /*
- * Entry point.
+ * Edge hash.
  */
-void entry(const void *bb, const void *next)
+static size_t hash(uintptr_t from, uintptr_t to)
 {
-    uintptr_t to   = (uintptr_t)next;
-    uintptr_t from = (uintptr_t)bb;
-    to = bb_lookup(to);
-    ENTRY key = {from, to, 0};  
-
-    if (!LOCK())
-        return;
+    uint64_t h = (uint64_t)from * 0x9E3779B97F4A7C15ull ^
+                 (uint64_t)to   * 0xC2B2AE3D27D4EB4Full;
+    h ^= h >> 29;
+    return (size_t)h;
+}
 
+/*
+ * Find (or create) the tree entry for an edge.  Assumes the lock is held.
+ */
+static ENTRY *find(uintptr_t from, uintptr_t to)
+{
+    ENTRY key = {from, to, 0};
     void *node   = tfind(&key, &COV, compare);
     ENTRY *entry = (node != NULL? *(ENTRY **)node: NULL);
     if (entry == NULL)
@@ -135,11 +156,68 @@ void entry(const void *bb, const void *next)
         memcpy(entry, &key, sizeof(ENTRY));
         (void)tsearch(entry, &COV, compare);
     }
-    entry->count++;
+    return entry;
+}
 
+/*
+ * Overflow path (too many collisions).
+ */
+static void overflow(uintptr_t from, uintptr_t to)
+{
+    if (!LOCK())
+        return;
+    find(from, bb_lookup(to))->count++;
     UNLOCK();
 }
 
+/*
+ * Claim an empty slot for the key (from, to).  Both halves of the key are
+ * published by a single 16-byte CAS, so a signal handler that re-enters
+ * entry() never sees a half-claimed slot.  On failure, the current key is
+ * returned in (from_0, to_0).
+ */
+static bool claim(SLOT *slot, uintptr_t from, uintptr_t to,
+    uintptr_t *from_0, uintptr_t *to_0)
+{
+    uintptr_t lo = 0, hi = 0;
+    bool ok;
+    asm volatile (
+        "lock cmpxchg16b %1\n"
+        "sete %0\n"
+        : "=q"(ok), "+m"(*slot), "+a"(lo), "+d"(hi)
+        : "b"(from), "c"(to)
+        : "memory", "cc");
+    *from_0 = lo;
+    *to_0   = hi;
+    return ok;
+}
+
+/*
+ * Entry point.
+ */
+void entry(const void *bb, const void *next)
+{
+    uintptr_t to   = (uintptr_t)next;
+    uintptr_t from = (uintptr_t)bb;
+    size_t i = hash(from, to);
+    for (size_t n = 0; n < PROBE_MAX; n++, i++)
+    {
+        SLOT *slot = TABLE + (i & MASK);
+        uintptr_t from_0 = *(volatile uintptr_t *)&slot->from;
+        uintptr_t to_0   = *(volatile uintptr_t *)&slot->to;
+        if (from_0 == 0 && claim(slot, from, to, &from_0, &to_0))
+        {
+            __sync_fetch_and_add(&slot->count, 1);
+            return;
+        }
+        if (from_0 != from || to_0 != to)
+            continue;
+        __sync_fetch_and_add(&slot->count, 1);
+        return;
+    }
+    overflow(from, to);
+}
+
 /*
  * Init.
  */
@@ -186,6 +264,15 @@ void init(int argc, char **argv, char **envp)
         GREEN, OFF, YELLOW, BBs.size-1, OFF, YELLOW, input, OFF);
     free(input);
 
+    size_t size = 1 << 16;
+    while (size < 8 * BBs.size && size < (1 << 24))
+        size *= 2;
+    TABLE = (SLOT *)mmap(NULL, size * sizeof(SLOT), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (TABLE == MAP_FAILED)
+        error("failed to allocate edge table: %s", strerror(errno));
+    MASK = size - 1;
+
     if (asprintf(&output, "%s.COV.csv", progname) < 0)
         error("failed to create output filename: %s", strerror(errno));
 }
@@ -196,6 +283,16 @@ void init(int argc, char **argv, char **envp)
 void fini(void)
 {
     LOCK();
+
+    // Merge the table into the tree, mapping "to" to its basic block:
+    for (size_t i = 0; i <= MASK; i++)
+    {
+        const SLOT *slot = TABLE + i;
+        if (slot->from == 0)
+            continue;
+        find(slot->from, bb_lookup(slot->to))->count += slot->count;
+    }
+
     stream = fopen(output, "w");
     if (stream == NULL)
         error("failed to open file \"%s%s%s\" for writing: %s",
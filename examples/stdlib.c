@@ -2158,10 +2158,359 @@ static bool malloc_mem_realloc(struct malloc_pool_s *pool, uint32_t base,
     return malloc_mem_grow(pool, hi);
 }
 
+/*
+ * Small objects (<= MA_SMALL_MAX bytes) from the default pool are allocated
+ * from size-class spans in a separate arena, and are cached in per-thread
+ * free-lists (keyed by mutex_gettid()), so that the common case takes no
+ * lock.  Larger objects (and custom pools) use the interval-tree allocator
+ * above.  Define MALLOC_NO_CACHE to disable.
+ *
+ * The thread caches follow the same rules as the mutex implementation:
+ *
+ *  (1) a signal during a cache operation may cause a re-entrant call, so
+ *      each cache has a `busy' flag, and re-entrant calls bypass the cache
+ *      and use the locked central free-lists instead (which fail in the
+ *      same way as a locked malloc()).  The owner TID and the `busy' flag
+ *      share one word, so a cache is only ever acquired (by its owner, or
+ *      by a thread reclaiming it) with a single CAS, even if the TID of an
+ *      exited owner is recycled.
+ *  (2) a thread killed during a cache operation leaves its cache `busy',
+ *      which merely disables that cache.  After fork(), the child has a
+ *      new TID and hence a new cache.
+ *
+ * Freed objects are returned to the freeing thread's cache, and caches that
+ * grow beyond MA_CACHE_MAX objects return a batch to the central lists.
+ * The caches of exited threads (including the parent's threads after
+ * fork()) are returned to the central lists when a new thread probes them.
+ * The unlocked variants (malloc_unlocked(), etc.) bypass the caches and use
+ * the central lists without locking.
+ */
+#define MA_SMALL_MAX                1024
+#define MA_CLASSES                  20
+#define MA_SPAN_SIZE                (64 * 1024ull)
+#define MA_SPAN_HDR                 64
+#define MA_SPAN_MAGIC               0x5A9E7C31
+#define MA_ARENA_SIZE               (4ull << 30)
+#define MA_CACHES                   4096
+#define MA_CACHE_PROBES             8
+#define MA_CACHE_MAX                64
+#define MA_CACHE_BATCH              32
+
+static const uint16_t malloc_class_size[MA_CLASSES] =
+{
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448,
+    512, 640, 768, 896, 1024
+};
+
+#define MA_CACHE_STATE(tid, busy)   \
+    ((uint64_t)(uint32_t)(tid) | ((uint64_t)(busy) << 32))
+#define MA_CACHE_TID(state)         ((pid_t)(uint32_t)(state))
+#define MA_CACHE_BUSY(state)        ((bool)((state) >> 32))
+
+struct malloc_cache_s
+{
+    uint64_t state;                 // Owner thread (0 = unused, -1 = reclaim)
+                                    // + busy flag (see MA_CACHE_STATE())
+    uint16_t count[MA_CLASSES];     // Free-list lengths
+    void *head[MA_CLASSES];         // Free-lists
+};
+
+struct malloc_small_s
+{
+    mutex_t mutex;                  // Central mutex
+    uint8_t *base;                  // Arena base
+    uint8_t *next;                  // Next unused span
+    struct malloc_cache_s *caches;  // Thread caches
+    void *head[MA_CLASSES];         // Central free-lists
+    uint8_t *ptr[MA_CLASSES];       // Current span (next object)
+    uint8_t *end[MA_CLASSES];       // Current span (end)
+};
+
+static struct malloc_small_s malloc_small = {MUTEX_INITIALIZER, 0};
+
+static unsigned malloc_class(size_t size)
+{
+    if (size <= 128)
+        return (unsigned)((size + 15) / 16) - 1;
+    unsigned cls = 8;
+    while (malloc_class_size[cls] < size)
+        cls++;
+    return cls;
+}
+
+static bool malloc_small_init(bool lock)
+{
+    if (*(uint8_t * volatile *)&malloc_small.base != NULL)
+        return true;
+    if (lock && mutex_lock(&malloc_small.mutex) < 0)
+        return false;
+    if (malloc_small.base != NULL)
+    {
+        if (lock) mutex_unlock(&malloc_small.mutex);
+        return true;
+    }
+    uintptr_t hint = 0xbbb00000000ull;
+    (void)getrandom(&hint, sizeof(uint32_t), 0);
+    hint &= ~(MA_SPAN_SIZE-1);
+    uint8_t *ptr = (uint8_t *)mmap((void *)hint,
+        MA_ARENA_SIZE + MA_SPAN_SIZE, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        if (lock) mutex_unlock(&malloc_small.mutex);
+        return false;
+    }
+    uint8_t *base = (uint8_t *)(((uintptr_t)ptr + MA_SPAN_SIZE-1) &
+        ~(MA_SPAN_SIZE-1));
+    size_t size = MA_CACHES * sizeof(struct malloc_cache_s);
+    size += (size % MA_SPAN_SIZE? MA_SPAN_SIZE - size % MA_SPAN_SIZE: 0);
+    if (mmap(base, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != base)
+        panic("mmap() failed");
+    malloc_small.caches = (struct malloc_cache_s *)base;
+    malloc_small.next   = base + size;
+    asm volatile ("" ::: "memory");
+    malloc_small.base   = base;
+    if (lock) mutex_unlock(&malloc_small.mutex);
+    return true;
+}
+
+static bool malloc_small_owns(const void *ptr)
+{
+    const uint8_t *base = *(uint8_t * volatile *)&malloc_small.base;
+    return (base != NULL && (const uint8_t *)ptr >= base &&
+        (const uint8_t *)ptr < base + MA_ARENA_SIZE);
+}
+
+/*
+ * Get an object from the central free-lists.  Assumes the lock is held.
+ */
+static void *malloc_central_pop(unsigned cls)
+{
+    void *ptr = malloc_small.head[cls];
+    if (ptr != NULL)
+    {
+        malloc_small.head[cls] = *(void **)ptr;
+        return ptr;
+    }
+    size_t size = malloc_class_size[cls];
+    if (malloc_small.ptr[cls] + size > malloc_small.end[cls])
+    {
+        uint8_t *span = malloc_small.next;
+        if (span + MA_SPAN_SIZE > malloc_small.base + MA_ARENA_SIZE)
+        {
+            errno = ENOMEM;
+            return NULL;
+        }
+        if (mmap(span, MA_SPAN_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != span)
+        {
+            errno = ENOMEM;
+            return NULL;
+        }
+        malloc_small.next += MA_SPAN_SIZE;
+        ((uint32_t *)span)[0]  = MA_SPAN_MAGIC;
+        ((uint32_t *)span)[1]  = cls;
+        malloc_small.ptr[cls] = span + MA_SPAN_HDR;
+        malloc_small.end[cls] = span + MA_SPAN_SIZE;
+    }
+    ptr = malloc_small.ptr[cls];
+    malloc_small.ptr[cls] += size;
+    return ptr;
+}
+
+/*
+ * Return the caches of exited threads near the probe sequence for `self' to
+ * the central free-lists, and mark them unused.  Since TIDs are usually
+ * allocated sequentially, this includes the preceding caches.  A cache left
+ * `busy' by a killed thread may be inconsistent, so is left alone.
+ */
+static void malloc_cache_reclaim(pid_t self)
+{
+    int saved_errno = errno;
+    pid_t pid = getpid();
+    for (unsigned i = 0; i < 2 * MA_CACHE_PROBES; i++)
+    {
+        struct malloc_cache_s *cache = malloc_small.caches +
+            ((unsigned)self + MA_CACHES - MA_CACHE_PROBES + i) % MA_CACHES;
+        uint64_t state = *(volatile uint64_t *)&cache->state;
+        pid_t tid = MA_CACHE_TID(state);
+        if (tid <= 0 || tid == self)
+            continue;
+        if (syscall(SYS_tgkill, pid, tid, 0) == 0 || errno != ESRCH)
+            continue;               // Owner still exists
+        if (MA_CACHE_BUSY(state))
+            continue;               // Killed mid-operation (or TID recycled)
+        if (!__sync_bool_compare_and_swap(&cache->state, state,
+                MA_CACHE_STATE(-1, true)))
+            continue;               // TID recycled (or another reclaimer)
+        if (mutex_lock(&malloc_small.mutex) < 0)
+        {
+            *(volatile uint64_t *)&cache->state = state;
+            continue;
+        }
+        for (unsigned cls = 0; cls < MA_CLASSES; cls++)
+        {
+            while (cache->head[cls] != NULL)
+            {
+                void *obj = cache->head[cls];
+                cache->head[cls] = *(void **)obj;
+                *(void **)obj = malloc_small.head[cls];
+                malloc_small.head[cls] = obj;
+            }
+            cache->count[cls] = 0;
+        }
+        mutex_unlock(&malloc_small.mutex);
+        asm volatile ("" ::: "memory");
+        *(volatile uint64_t *)&cache->state = MA_CACHE_STATE(0, false);
+    }
+    errno = saved_errno;
+}
+
+/*
+ * Get and mark busy the calling thread's cache (or NULL if unavailable/busy).
+ * The cache must be released with malloc_cache_put().
+ */
+static struct malloc_cache_s *malloc_cache_get(void)
+{
+#ifdef MALLOC_NO_CACHE
+    return NULL;
+#else
+    pid_t self = mutex_gettid();
+    for (unsigned j = 0; j < 2; j++)
+    {
+        for (unsigned i = 0; i < MA_CACHE_PROBES; i++)
+        {
+            struct malloc_cache_s *cache =
+                malloc_small.caches + ((unsigned)self + i) % MA_CACHES;
+            uint64_t state = *(volatile uint64_t *)&cache->state;
+            pid_t tid = MA_CACHE_TID(state);
+            if (tid == self)
+                return (__sync_bool_compare_and_swap(&cache->state,
+                    MA_CACHE_STATE(self, false), MA_CACHE_STATE(self, true))?
+                        cache: NULL);
+            if (tid == 0 && __sync_bool_compare_and_swap(&cache->state,
+                    MA_CACHE_STATE(0, false), MA_CACHE_STATE(self, true)))
+            {
+                // New thread: also reclaim neighbouring exited threads.
+                malloc_cache_reclaim(self);
+                return cache;
+            }
+        }
+        if (j == 0)
+            malloc_cache_reclaim(self);
+    }
+    return NULL;
+#endif
+}
+
+/*
+ * Release the calling thread's cache.  Only the owner modifies a busy cache's
+ * state, so this is a plain store.
+ */
+static void malloc_cache_put(struct malloc_cache_s *cache)
+{
+    uint64_t state = cache->state;
+    asm volatile ("" ::: "memory");
+    *(volatile uint64_t *)&cache->state =
+        MA_CACHE_STATE(MA_CACHE_TID(state), false);
+}
+
+static void *malloc_small_alloc(size_t size, bool lock)
+{
+    if (!malloc_small_init(lock))
+        return NULL;
+    unsigned cls = malloc_class(size);
+    struct malloc_cache_s *cache = (lock? malloc_cache_get(): NULL);
+    void *ptr;
+    if (cache == NULL)
+    {
+        if (lock && mutex_lock(&malloc_small.mutex) < 0)
+            return NULL;
+        ptr = malloc_central_pop(cls);
+        if (lock) mutex_unlock(&malloc_small.mutex);
+        return ptr;
+    }
+    ptr = cache->head[cls];
+    if (ptr == NULL && mutex_lock(&malloc_small.mutex) == 0)
+    {
+        for (unsigned i = 0; i < MA_CACHE_BATCH; i++)
+        {
+            void *obj = malloc_central_pop(cls);
+            if (obj == NULL)
+                break;
+            *(void **)obj = cache->head[cls];
+            cache->head[cls] = obj;
+            cache->count[cls]++;
+        }
+        mutex_unlock(&malloc_small.mutex);
+        ptr = cache->head[cls];
+    }
+    if (ptr != NULL)
+    {
+        cache->head[cls] = *(void **)ptr;
+        cache->count[cls]--;
+    }
+    malloc_cache_put(cache);
+    return ptr;
+}
+
+static unsigned malloc_small_class(const void *ptr)
+{
+    const uint8_t *span = (const uint8_t *)((uintptr_t)ptr &
+        ~(MA_SPAN_SIZE-1));
+    if (((const uint32_t *)span)[0] != MA_SPAN_MAGIC)
+        panic("bad free() detected");
+    unsigned cls = ((const uint32_t *)span)[1];
+    if (cls >= MA_CLASSES ||
+            (size_t)((const uint8_t *)ptr - span - MA_SPAN_HDR) %
+                malloc_class_size[cls] != 0)
+        panic("bad free() detected");
+    return cls;
+}
+
+static void free_small(void *ptr, bool lock)
+{
+    unsigned cls = malloc_small_class(ptr);
+    struct malloc_cache_s *cache = (lock? malloc_cache_get(): NULL);
+    if (cache == NULL)
+    {
+        if (lock && mutex_lock(&malloc_small.mutex) < 0)
+            panic("failed to acquire malloc() lock");
+        *(void **)ptr = malloc_small.head[cls];
+        malloc_small.head[cls] = ptr;
+        if (lock) mutex_unlock(&malloc_small.mutex);
+        return;
+    }
+    *(void **)ptr = cache->head[cls];
+    cache->head[cls] = ptr;
+    cache->count[cls]++;
+    if (cache->count[cls] > MA_CACHE_MAX &&
+            mutex_lock(&malloc_small.mutex) == 0)
+    {
+        for (unsigned i = 0; i < MA_CACHE_BATCH; i++)
+        {
+            void *obj = cache->head[cls];
+            cache->head[cls] = *(void **)obj;
+            cache->count[cls]--;
+            *(void **)obj = malloc_small.head[cls];
+            malloc_small.head[cls] = obj;
+        }
+        mutex_unlock(&malloc_small.mutex);
+    }
+    malloc_cache_put(cache);
+}
+
 static void *malloc_impl(struct malloc_pool_s *pool, size_t size, bool lock)
 {
     if (size == 0)
         return MA_ZERO;
+    if (pool == NULL && size <= MA_SMALL_MAX)
+    {
+        void *ptr = malloc_small_alloc(size, lock);
+        if (ptr != NULL)
+            return ptr;
+    }
     size += sizeof(struct malloc_node_s);
     size_t size128 = size / MA_UNIT + (size % MA_UNIT? 1: 0);
     if (size128 > UINT32_MAX)
@@ -2266,6 +2615,11 @@ static void free_impl(struct malloc_pool_s *pool, void *ptr, bool lock)
 {
     if (ptr == NULL || ptr == MA_ZERO)
         return;
+    if (pool == NULL && malloc_small_owns(ptr))
+    {
+        free_small(ptr, lock);
+        return;
+    }
 
     pool = pool_init(pool);
     if ((uint8_t *)ptr < pool->base ||
@@ -2311,6 +2665,23 @@ static void *realloc_impl(struct malloc_pool_s *pool, void *ptr, size_t size,
 {
     if (ptr == NULL || ptr == MA_ZERO)
         return malloc_impl(pool, size, lock);
+    if (pool == NULL && malloc_small_owns(ptr))
+    {
+        if (size == 0)
+        {
+            free_small(ptr, lock);
+            return MA_ZERO;
+        }
+        size_t old_size = malloc_class_size[malloc_small_class(ptr)];
+        if (size <= old_size)
+            return ptr;
+        void *new_ptr = malloc_impl(pool, size, lock);
+        if (new_ptr == NULL)
+            return new_ptr;
+        memcpy(new_ptr, ptr, old_size);
+        free_small(ptr, lock);
+        return new_ptr;
+    }
 
     pool = pool_init(pool);
     if ((uint8_t *)ptr < pool->base ||
@@ -2573,76 +2944,455 @@ static int tolower(int c)
 /* STRING                                                                   */
 /****************************************************************************/
 
-static void *memset(void *dst, int c, size_t n)
+/*
+ * The mem*() and strlen() family are implemented word-at-a-time using the
+ * general purpose registers only, which is safe under the default `gpr'
+ * state save mode.
+ *
+ * If STRING_SIMD is defined, SSE2 and AVX2 versions are also compiled in, and
+ * the best version for the CPU is selected on first use via CPUID.  Since
+ * these clobber the %xmm/%ymm registers, the instrumentation must be called
+ * with the `xsave' state save mode, which E9Tool will automatically select
+ * for such binaries.  If STRING_NO_AVX2 is also defined, only the SSE2
+ * versions are compiled in, and the cheaper `sse' mode suffices.
+ */
+#define STRING_WORD         1
+#define STRING_SSE2         2
+#define STRING_AVX2         3
+
+#define STRING_ONES         0x0101010101010101ull
+#define STRING_HIGHS        0x8080808080808080ull
+#define STRING_ZERO(x)      (((x) - STRING_ONES) & ~(x) & STRING_HIGHS)
+
+typedef uint64_t string_u64_t __attribute__((__aligned__(1), __may_alias__));
+typedef uint32_t string_u32_t __attribute__((__aligned__(1), __may_alias__));
+typedef uint16_t string_u16_t __attribute__((__aligned__(1), __may_alias__));
+
+#ifdef STRING_SIMD
+typedef char string_v16_t
+    __attribute__((__vector_size__(16), __aligned__(1), __may_alias__));
+typedef char string_v32_t
+    __attribute__((__vector_size__(32), __aligned__(1), __may_alias__));
+
+static int string_level = 0;
+
+/*
+ * Select the string implementation using CPUID.
+ */
+static __attribute__((__noinline__)) int string_cpuid(void)
+{
+    int level = STRING_SSE2;            // Always available on x86_64
+#ifndef STRING_NO_AVX2
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+        : "a"(0), "c"(0));
+    uint32_t max = eax;
+    asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+        : "a"(1), "c"(0));
+    const uint32_t osxsave_avx = (1u << 27) | (1u << 28);
+    if (max >= 7 && (ecx & osxsave_avx) == osxsave_avx)
+    {
+        asm volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        if ((eax & 0x6) == 0x6)         // OS saves %xmm and %ymm state?
+        {
+            asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx),
+                "=d"(edx) : "a"(7), "c"(0));
+            if ((ebx & (1u << 5)) != 0)
+                level = STRING_AVX2;
+        }
+    }
+#endif
+    string_level = level;
+    return level;
+}
+
+static inline int string_simd(void)
 {
-    uint8_t *dst8 = (uint8_t *)dst;
-    for (size_t i = 0; i < n; i++)
-        dst8[i] = (uint8_t)c;
-    return dst;
+    int level = string_level;
+    return (level != 0? level: string_cpuid());
 }
+#endif
 
-static void *memcpy(void *dst, const void *src, size_t n)
+/*
+ * Word-at-a-time implementations.
+ */
+static void string_set_word(uint8_t *d, int c, size_t n)
 {
-    uint8_t *dst8 = (uint8_t *)dst;
-    const uint8_t *src8 = (const uint8_t *)src;
-    for (size_t i = 0; i < n; i++)
-        dst8[i] = src8[i];
-    return dst;
+    if (n < 8)
+    {
+        for (size_t i = 0; i < n; i++)
+            d[i] = (uint8_t)c;
+        return;
+    }
+    uint64_t v = STRING_ONES * (uint8_t)c;
+    for (size_t i = 0; i + 8 <= n; i += 8)
+        *(string_u64_t *)(d + i) = v;
+    *(string_u64_t *)(d + n - 8) = v;
 }
 
-static void *memmove(void *dst, const void *src, size_t n)
+static void string_move_word(uint8_t *d, const uint8_t *s, size_t n)
 {
-    uint8_t *dst8 = (uint8_t *)dst;
-    const uint8_t *src8 = (const uint8_t *)src;
-    if (dst8 < src8)
-        memcpy(dst, src, n);
+    // Note: the first/last word is loaded before any store, so this is
+    //       also safe for overlapping buffers.
+    if (n < 8)
+    {
+        if (n >= 4)
+        {
+            uint32_t x = *(const string_u32_t *)s;
+            uint32_t y = *(const string_u32_t *)(s + n - 4);
+            *(string_u32_t *)d = x;
+            *(string_u32_t *)(d + n - 4) = y;
+        }
+        else if (n >= 2)
+        {
+            uint16_t x = *(const string_u16_t *)s;
+            uint16_t y = *(const string_u16_t *)(s + n - 2);
+            *(string_u16_t *)d = x;
+            *(string_u16_t *)(d + n - 2) = y;
+        }
+        else if (n == 1)
+            d[0] = s[0];
+        return;
+    }
+    if ((uintptr_t)d - (uintptr_t)s >= n)
+    {
+        uint64_t last = *(const string_u64_t *)(s + n - 8);
+        for (size_t i = 0; i + 8 <= n; i += 8)
+            *(string_u64_t *)(d + i) = *(const string_u64_t *)(s + i);
+        *(string_u64_t *)(d + n - 8) = last;
+    }
     else
     {
-        for (ssize_t i = (ssize_t)n-1; i >= 0; i--)
-            dst8[i] = src8[i];
+        uint64_t first = *(const string_u64_t *)s;
+        for (size_t i = n; i >= 8; i -= 8)
+            *(string_u64_t *)(d + i - 8) = *(const string_u64_t *)(s + i - 8);
+        *(string_u64_t *)d = first;
     }
-    return dst;
 }
 
-static int memcmp(const void *a, const void *b, size_t n)
+static int string_cmp_word(const uint8_t *a, const uint8_t *b, size_t n)
 {
-    const uint8_t *a8 = (const uint8_t *)a;
-    const uint8_t *b8 = (const uint8_t *)b;
-    for (size_t i = 0; i < n; i++)
+    size_t i = 0;
+    if (n >= 8)
     {
-        int cmp = (int)a8[i] - (int)b8[i];
+        while (true)
+        {
+            uint64_t x = *(const string_u64_t *)(a + i);
+            uint64_t y = *(const string_u64_t *)(b + i);
+            if (x != y)
+            {
+                i += __builtin_ctzll(x ^ y) / 8;
+                return (int)a[i] - (int)b[i];
+            }
+            if (i + 8 == n)
+                return 0;
+            i += 8;
+            i = (i + 8 > n? n - 8: i);
+        }
+    }
+    for (; i < n; i++)
+    {
+        int cmp = (int)a[i] - (int)b[i];
         if (cmp != 0)
             return cmp;
     }
     return 0;
 }
 
-
-static void *memchr(const void *a, int c, size_t n)
+static const uint8_t *string_chr_word(const uint8_t *a, int c, size_t n)
 {
-    const uint8_t *a8 = (const uint8_t *)a;
-    for (size_t i = 0; i < n; i++)
+    size_t i = 0;
+    if (n >= 8)
     {
-        if ((int)a8[i] == c)
-            return (void *)(a8 + i);
+        uint64_t v = STRING_ONES * (uint8_t)c;
+        while (true)
+        {
+            uint64_t x = *(const string_u64_t *)(a + i) ^ v;
+            uint64_t z = STRING_ZERO(x);
+            if (z != 0)
+                return a + i + __builtin_ctzll(z) / 8;
+            if (i + 8 == n)
+                return NULL;
+            i += 8;
+            i = (i + 8 > n? n - 8: i);
+        }
+    }
+    for (; i < n; i++)
+    {
+        if (a[i] == (uint8_t)c)
+            return a + i;
     }
     return NULL;
 }
 
-static size_t strlen(const char *s)
+static size_t string_nlen_word(const char *s, size_t n)
+{
+    // Note: aligned words never cross a page boundary, so reading past the
+    //       terminator is safe.
+    size_t i = 0;
+    for (; i < n && ((uintptr_t)(s + i) & 0x7) != 0; i++)
+    {
+        if (s[i] == '\0')
+            return i;
+    }
+    for (; i < n; i += 8)
+    {
+        uint64_t x = *(const string_u64_t *)(s + i);
+        uint64_t z = STRING_ZERO(x);
+        if (z != 0)
+        {
+            i += __builtin_ctzll(z) / 8;
+            return (i < n? i: n);
+        }
+    }
+    return n;
+}
+
+#ifdef STRING_SIMD
+/*
+ * SSE2 implementations (n >= 16).
+ */
+static __attribute__((__target__("sse2"))) void string_set_sse2(uint8_t *d,
+    int c, size_t n)
+{
+    string_v16_t v = (string_v16_t){0} + (char)c;
+    for (size_t i = 0; i + 16 <= n; i += 16)
+        *(string_v16_t *)(d + i) = v;
+    *(string_v16_t *)(d + n - 16) = v;
+}
+
+static __attribute__((__target__("sse2"))) void string_move_sse2(uint8_t *d,
+    const uint8_t *s, size_t n)
+{
+    if ((uintptr_t)d - (uintptr_t)s >= n)
+    {
+        string_v16_t last = *(const string_v16_t *)(s + n - 16);
+        for (size_t i = 0; i + 16 <= n; i += 16)
+            *(string_v16_t *)(d + i) = *(const string_v16_t *)(s + i);
+        *(string_v16_t *)(d + n - 16) = last;
+    }
+    else
+    {
+        string_v16_t first = *(const string_v16_t *)s;
+        for (size_t i = n; i >= 16; i -= 16)
+            *(string_v16_t *)(d + i - 16) =
+                *(const string_v16_t *)(s + i - 16);
+        *(string_v16_t *)d = first;
+    }
+}
+
+static __attribute__((__target__("sse2"))) int string_cmp_sse2(
+    const uint8_t *a, const uint8_t *b, size_t n)
+{
+    for (size_t i = 0; ; )
+    {
+        string_v16_t x = *(const string_v16_t *)(a + i);
+        string_v16_t y = *(const string_v16_t *)(b + i);
+        unsigned m = __builtin_ia32_pmovmskb128(x == y) ^ 0xFFFFu;
+        if (m != 0)
+        {
+            i += __builtin_ctz(m);
+            return (int)a[i] - (int)b[i];
+        }
+        if (i + 16 == n)
+            return 0;
+        i += 16;
+        i = (i + 16 > n? n - 16: i);
+    }
+}
+
+static __attribute__((__target__("sse2"))) const uint8_t *string_chr_sse2(
+    const uint8_t *a, int c, size_t n)
+{
+    string_v16_t v = (string_v16_t){0} + (char)c;
+    for (size_t i = 0; ; )
+    {
+        unsigned m = __builtin_ia32_pmovmskb128(
+            *(const string_v16_t *)(a + i) == v);
+        if (m != 0)
+            return a + i + __builtin_ctz(m);
+        if (i + 16 == n)
+            return NULL;
+        i += 16;
+        i = (i + 16 > n? n - 16: i);
+    }
+}
+
+static __attribute__((__target__("sse2"))) size_t string_nlen_sse2(
+    const char *s, size_t n)
 {
-    size_t n = 0;
-    for (size_t i = 0; s[i] != '\0'; i++)
-        n++;
+    // Note: aligned blocks never cross a page boundary.
+    string_v16_t z = {0};
+    uintptr_t offset = (uintptr_t)s & 0xF;
+    const char *p = s - offset;
+    unsigned m = __builtin_ia32_pmovmskb128(*(const string_v16_t *)p == z);
+    m >>= offset;
+    if (m != 0)
+        return __builtin_ctz(m) < n? __builtin_ctz(m): n;
+    for (p += 16; (size_t)(p - s) < n; p += 16)
+    {
+        m = __builtin_ia32_pmovmskb128(*(const string_v16_t *)p == z);
+        if (m != 0)
+        {
+            size_t i = (size_t)(p - s) + __builtin_ctz(m);
+            return (i < n? i: n);
+        }
+    }
     return n;
 }
 
+#ifndef STRING_NO_AVX2
+/*
+ * AVX2 implementations (n >= 32).
+ */
+static __attribute__((__target__("avx2"))) void string_set_avx2(uint8_t *d,
+    int c, size_t n)
+{
+    string_v32_t v = (string_v32_t){0} + (char)c;
+    for (size_t i = 0; i + 32 <= n; i += 32)
+        *(string_v32_t *)(d + i) = v;
+    *(string_v32_t *)(d + n - 32) = v;
+}
+
+static __attribute__((__target__("avx2"))) void string_move_avx2(uint8_t *d,
+    const uint8_t *s, size_t n)
+{
+    if ((uintptr_t)d - (uintptr_t)s >= n)
+    {
+        string_v32_t last = *(const string_v32_t *)(s + n - 32);
+        for (size_t i = 0; i + 32 <= n; i += 32)
+            *(string_v32_t *)(d + i) = *(const string_v32_t *)(s + i);
+        *(string_v32_t *)(d + n - 32) = last;
+    }
+    else
+    {
+        string_v32_t first = *(const string_v32_t *)s;
+        for (size_t i = n; i >= 32; i -= 32)
+            *(string_v32_t *)(d + i - 32) =
+                *(const string_v32_t *)(s + i - 32);
+        *(string_v32_t *)d = first;
+    }
+}
+
+static __attribute__((__target__("avx2"))) int string_cmp_avx2(
+    const uint8_t *a, const uint8_t *b, size_t n)
+{
+    for (size_t i = 0; ; )
+    {
+        string_v32_t x = *(const string_v32_t *)(a + i);
+        string_v32_t y = *(const string_v32_t *)(b + i);
+        unsigned m = ~(unsigned)__builtin_ia32_pmovmskb256(x == y);
+        if (m != 0)
+        {
+            i += __builtin_ctz(m);
+            return (int)a[i] - (int)b[i];
+        }
+        if (i + 32 == n)
+            return 0;
+        i += 32;
+        i = (i + 32 > n? n - 32: i);
+    }
+}
+
+static __attribute__((__target__("avx2"))) const uint8_t *string_chr_avx2(
+    const uint8_t *a, int c, size_t n)
+{
+    string_v32_t v = (string_v32_t){0} + (char)c;
+    for (size_t i = 0; ; )
+    {
+        unsigned m = (unsigned)__builtin_ia32_pmovmskb256(
+            *(const string_v32_t *)(a + i) == v);
+        if (m != 0)
+            return a + i + __builtin_ctz(m);
+        if (i + 32 == n)
+            return NULL;
+        i += 32;
+        i = (i + 32 > n? n - 32: i);
+    }
+}
+
+static __attribute__((__target__("avx2"))) size_t string_nlen_avx2(
+    const char *s, size_t n)
+{
+    string_v32_t z = {0};
+    uintptr_t offset = (uintptr_t)s & 0x1F;
+    const char *p = s - offset;
+    unsigned m = (unsigned)__builtin_ia32_pmovmskb256(
+        *(const string_v32_t *)p == z);
+    m >>= offset;
+    if (m != 0)
+        return __builtin_ctz(m) < n? __builtin_ctz(m): n;
+    for (p += 32; (size_t)(p - s) < n; p += 32)
+    {
+        m = (unsigned)__builtin_ia32_pmovmskb256(
+            *(const string_v32_t *)p == z);
+        if (m != 0)
+        {
+            size_t i = (size_t)(p - s) + __builtin_ctz(m);
+            return (i < n? i: n);
+        }
+    }
+    return n;
+}
+#endif  /* STRING_NO_AVX2 */
+#endif  /* STRING_SIMD */
+
+/*
+ * Dispatch to the best implementation for size `n'.
+ */
+#ifndef STRING_SIMD
+#define STRING_DISPATCH(f, n, ...)                                          \
+    string_##f##_word(__VA_ARGS__)
+#elif defined(STRING_NO_AVX2)
+#define STRING_DISPATCH(f, n, ...)                                          \
+    ((n) >= 16 && string_simd() >= STRING_SSE2?                             \
+        string_##f##_sse2(__VA_ARGS__):                                     \
+        string_##f##_word(__VA_ARGS__))
+#else
+#define STRING_DISPATCH(f, n, ...)                                          \
+    ((n) < 16? string_##f##_word(__VA_ARGS__):                              \
+     (n) >= 32 && string_simd() == STRING_AVX2?                             \
+        string_##f##_avx2(__VA_ARGS__):                                     \
+        string_##f##_sse2(__VA_ARGS__))
+#endif
+
+static void *memset(void *dst, int c, size_t n)
+{
+    STRING_DISPATCH(set, n, (uint8_t *)dst, c, n);
+    return dst;
+}
+
+static void *memcpy(void *dst, const void *src, size_t n)
+{
+    STRING_DISPATCH(move, n, (uint8_t *)dst, (const uint8_t *)src, n);
+    return dst;
+}
+
+static void *memmove(void *dst, const void *src, size_t n)
+{
+    STRING_DISPATCH(move, n, (uint8_t *)dst, (const uint8_t *)src, n);
+    return dst;
+}
+
+static int memcmp(const void *a, const void *b, size_t n)
+{
+    return STRING_DISPATCH(cmp, n, (const uint8_t *)a, (const uint8_t *)b,
+        n);
+}
+
+static void *memchr(const void *a, int c, size_t n)
+{
+    return (void *)STRING_DISPATCH(chr, n, (const uint8_t *)a, c, n);
+}
+
 static size_t strnlen(const char *s, size_t n)
 {
-    size_t m = 0;
-    for (size_t i = 0; m < n && s[i] != '\0'; i++)
-        m++;
-    return m;
+    return STRING_DISPATCH(nlen, n, s, n);
+}
+
+static size_t strlen(const char *s)
+{
+    return strnlen(s, SIZE_MAX);
 }
 
 static int strncmp(const char *s1, const char *s2, size_t n)
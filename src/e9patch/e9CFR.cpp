@@ -16,8 +16,16 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 #include <sys/mman.h>
 
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
 #include "e9CFR.h"
 #include "e9elf.h"
 #include "e9x86_64.h"
@@ -90,6 +98,621 @@ static intptr_t addrToOffset(const Elf64_Phdr *phdrs, size_t phnum,
     return INTPTR_MIN;
 }
 
+/*
+ * Possible jump tables.  Maps the table address to the number of entries,
+ * or SIZE_MAX if the bounds are unknown.
+ */
+typedef std::map<intptr_t, size_t> JumpTables;
+
+/*
+ * Insert a jump table.  If the table is already known, the larger bound wins.
+ */
+static void addJumpTable(intptr_t table, size_t n, JumpTables &tables)
+{
+    auto r = tables.insert({table, n});
+    if (!r.second)
+        r.first->second = std::max(r.first->second, n);
+}
+
+/*
+ * Jump table idiom match state.  Registers are numbered 0..15, except for
+ * the legacy high-byte registers %ah..%bh which are numbered 16..19.
+ */
+struct JumpTableMatch
+{
+    int base;                           // Table base register, or -1.
+    int reg;                            // Bounded register, or -1.
+    intptr_t mem;                       // Bounded %rip-relative offset.
+    unsigned width;                     // Bounded value width (bytes).
+    size_t n;                           // Number of table entries, or 0.
+};
+
+/*
+ * Update the match state for a `mov' from `src'/`mem' to `dst'.
+ */
+static bool matchMove(JumpTableMatch &M, int dst, int src, intptr_t mem,
+    unsigned width)
+{
+    if (dst == M.base)
+        return false;
+    if (M.n > 0 && width <= M.width &&
+            ((src >= 0 && src == M.reg) ||
+             (src < 0 && mem != INTPTR_MIN && mem == M.mem)))
+    {
+        M.reg   = dst;
+        M.mem   = INTPTR_MIN;
+        M.width = sizeof(int32_t);
+    }
+    else if (M.reg >= 0 && (M.reg >= 16? M.reg - 16: M.reg) == dst)
+        M.reg = -1;
+    return true;
+}
+
+/*
+ * Match one instruction of the jump table idiom (prior to the movslq) at
+ * offset `k'.  The `lea' is only matched at offset `lea'.  Returns the
+ * instruction length, or 0 if there is no match.
+ */
+static size_t matchJumpTableInstr(const uint8_t *data, off_t k, off_t end,
+    off_t lea, JumpTableMatch &M)
+{
+    const intptr_t MAX_TABLE = 0x10000;
+    off_t k0 = k;
+    uint8_t rex = 0x0;
+    if (k < end && (data[k] & 0xf0) == 0x40)
+        rex = data[k++];
+    if (k+2 > end)
+        return 0;
+    uint8_t op = data[k++];
+    if (op == 0x0f)
+        op = (data[k] == 0xb6 || data[k] == 0xb7? data[k++]: 0x00);
+    if (k >= end)
+        return 0;
+    uint8_t modRM = data[k];
+    int r  = (int)((modRM >> 3) & 0x7) | ((rex & 0x4) << 1);
+    int rm = (int)(modRM & 0x7) | ((rex & 0x1) << 3);
+    int rm8 = (rex == 0x0 && rm >= 4 && rm < 8? 16 + (rm - 4): rm);
+    bool reg = ((modRM & 0xc0) == 0xc0);
+    bool rip = ((modRM & 0xc7) == 0x05);
+    bool w   = ((rex & 0x8) != 0);
+    intptr_t mem = INTPTR_MIN, imm;
+    switch (op)
+    {
+        case 0x8d:                      // lea table(%rip),%base
+            if (k0 != lea || !w || !rip || k+5 > end)
+                return 0;
+            M.base = r;
+            M.reg  = (M.reg == r? -1: M.reg);
+            return (size_t)(k + 5 - k0);
+        case 0x89: case 0x8b:           // mov %r32,%r32; mov var(%rip),%r32
+            if (w || (!reg && !(rip && op == 0x8b)))
+                return 0;
+            if (reg && !matchMove(M, (op == 0x89? rm: r),
+                    (op == 0x89? r: rm), INTPTR_MIN, sizeof(int32_t)))
+                return 0;
+            if (reg)
+                return (size_t)(k + 1 - k0);
+            if (k+5 > end)
+                return 0;
+            mem = k + 5 + *(int32_t *)(data + k + 1);
+            if (!matchMove(M, r, -1, mem, sizeof(int32_t)))
+                return 0;
+            return (size_t)(k + 5 - k0);
+        case 0xb6: case 0xb7:           // movzbl/movzwl
+        {
+            unsigned width = (op == 0xb6? sizeof(int8_t): sizeof(int16_t));
+            if (w || (!reg && !rip))
+                return 0;
+            if (!reg)
+            {
+                if (k+5 > end)
+                    return 0;
+                mem = k + 5 + *(int32_t *)(data + k + 1);
+            }
+            if (!matchMove(M, r, (reg? (op == 0xb6? rm8: rm): -1), mem,
+                    width))
+                return 0;
+            return (size_t)(reg? k + 1 - k0: k + 5 - k0);
+        }
+        case 0x3c: case 0x3d:           // cmp $imm,%al/%eax
+            k--;
+            M.reg   = (op == 0x3c? rex == 0x0? 0: -1: 0);
+            M.width = (op == 0x3c? sizeof(int8_t): w? sizeof(int64_t):
+                                                    sizeof(int32_t));
+            if ((rex & 0x1) != 0 || M.reg < 0)
+                return 0;
+            k += (op == 0x3c? 2: 5);
+            if (k > end)
+                return 0;
+            imm = (op == 0x3c? (intptr_t)data[k-1]:
+                               (intptr_t)*(int32_t *)(data + k - 4));
+            break;
+        case 0x80: case 0x81: case 0x83:    // cmp $imm,%reg; cmp $imm,var
+        {
+            if ((modRM & 0x38) != 0x38 || (!reg && !rip))
+                return 0;
+            size_t isize = (op == 0x81? sizeof(int32_t): sizeof(int8_t));
+            k += (reg? 1: 5);
+            if (k + (off_t)isize > end)
+                return 0;
+            imm = (op == 0x80? (intptr_t)data[k]:
+                   op == 0x83? (intptr_t)(int8_t)data[k]:
+                               (intptr_t)*(int32_t *)(data + k));
+            if (!reg)
+                mem = k + (off_t)isize + *(int32_t *)(data + k - 4);
+            k += isize;
+            M.reg   = (reg? (op == 0x80? rm8: rm): -1);
+            M.mem   = mem;
+            M.width = (op == 0x80? sizeof(int8_t): w? sizeof(int64_t):
+                                                    sizeof(int32_t));
+            break;
+        }
+        default:
+            return 0;
+    }
+
+    // The cmp must be immediately followed by a ja/jae:
+    if (M.n > 0 || imm < 0 || imm >= MAX_TABLE)
+        return 0;
+    bool ja;
+    if (k+2 <= end && (data[k] == 0x77 || data[k] == 0x73))
+    {
+        ja = (data[k] == 0x77);         // ja/jae rel8
+        k += 2;
+    }
+    else if (k+6 <= end && data[k] == 0x0f &&
+            (data[k+1] == 0x87 || data[k+1] == 0x83))
+    {
+        ja = (data[k+1] == 0x87);       // ja/jae rel32
+        k += 6;
+    }
+    else
+        return 0;
+    M.n = (size_t)imm + (ja? 1: 0);
+    return (M.n == 0? 0: (size_t)(k - k0));
+}
+
+/*
+ * Match the jump table dispatch at offset `k':
+ *
+ *      movslq (%base,%idx,4),%tmp
+ *      add %base,%tmp
+ *      jmp *%tmp
+ *
+ * Returns true if there is a match.
+ */
+static bool matchJumpTableDispatch(const uint8_t *data, off_t k, off_t end,
+    const JumpTableMatch &M)
+{
+    // movslq (%base,%idx,4),%tmp
+    if (k+4 > end || (data[k] & 0xf8) != 0x48 || data[k+1] != 0x63)
+        return false;
+    uint8_t rex = data[k], modRM = data[k+2], sib = data[k+3];
+    int tmp  = (int)((modRM >> 3) & 0x7) | ((rex & 0x4) << 1);
+    int idx  = (int)((sib >> 3) & 0x7) | ((rex & 0x2) << 2);
+    int base = (int)(sib & 0x7) | ((rex & 0x1) << 3);
+    if ((modRM & 0xc7) != 0x04 || (sib & 0xc0) != 0x80 ||
+            (sib & 0x7) == 0x5 || idx == 0x4 || base != M.base ||
+            idx != M.reg || M.width < sizeof(int32_t))
+        return false;
+    k += 4;
+
+    // add %base,%tmp
+    if (k+3 > end || (data[k] & 0xfa) != 0x48 || (data[k+2] & 0xc0) != 0xc0)
+        return false;
+    rex   = data[k];
+    modRM = data[k+2];
+    int r  = (int)((modRM >> 3) & 0x7) | ((rex & 0x4) << 1);
+    int rm = (int)(modRM & 0x7) | ((rex & 0x1) << 3);
+    if (!(data[k+1] == 0x01 && r == base && rm == tmp) &&
+            !(data[k+1] == 0x03 && r == tmp && rm == base))
+        return false;
+    k += 3;
+
+    // [notrack] jmp *%tmp
+    if (k < end && data[k] == 0x3e)
+        k++;
+    if (tmp >= 8)
+    {
+        if (k >= end || data[k] != 0x41)
+            return false;
+        k++;
+    }
+    return (k+2 <= end && data[k] == 0xff &&
+        data[k+1] == (0xe0 | (tmp & 0x7)));
+}
+
+/*
+ * Attempt to recover a bounded PIC-style jump table for the
+ * `lea table(%rip),%base' instruction at offset `j'.  The recognized idiom
+ * (as emitted by gcc/clang for `switch') is:
+ *
+ *      cmp $N,%idx
+ *      ja default                  (or jae)
+ *      lea table(%rip),%base
+ *      movslq (%base,%idx,4),%tmp
+ *      add %base,%tmp
+ *      jmp *%tmp
+ *
+ * The cmp/ja may also follow the lea, and the bounded value may reach %idx
+ * via zero-extending moves or a load from the same %rip-relative location.
+ * Since no disassembly is available, the idiom is parsed forward from each
+ * possible cmp offset in a small window before the lea, and every byte up
+ * to the jmp must be accounted for.  Returns the number of table entries,
+ * or 0 if the idiom was not recognized.
+ */
+static size_t matchJumpTable(const uint8_t *data, off_t lo, off_t j,
+    off_t end)
+{
+    const off_t WINDOW = 32;
+    for (off_t p = std::max(lo, j - WINDOW); p <= j; p++)
+    {
+        JumpTableMatch M = {-1, -1, INTPTR_MIN, 0, 0};
+        off_t k = p;
+        while (k <= j || M.base >= 0)
+        {
+            if (M.base >= 0 && M.n > 0 &&
+                    matchJumpTableDispatch(data, k, end, M))
+                return M.n;
+            size_t len = matchJumpTableInstr(data, k, end, j, M);
+            if (len == 0)
+                break;
+            k += len;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Direct jump target scan state.
+ */
+struct TargetScan
+{
+    const uint8_t *data;                // Binary data.
+    const Elf64_Phdr *phdrs;            // Binary PHDRs.
+    size_t phnum;                       // Binary # PHDRs.
+    size_t size;                        // Binary size.
+    bool pic;                           // Binary is PIC?
+    bool cet;                           // Scan for endbr64?
+    off_t offset;                       // Segment offset.
+    intptr_t addr;                      // Segment address.
+    off_t end;                          // Segment end offset.
+    uint8_t *targets;                   // Target map.
+    size_t lo;                          // Target map lowest set byte.
+    size_t hi;                          // Target map highest set byte.
+    JumpTables tables;                  // Possible jump tables.
+};
+
+/*
+ * Set a target and track the target map bounds.
+ */
+static void scanSetTarget(TargetScan &S, intptr_t offset)
+{
+    if (!setTarget(S.targets, S.size, offset))
+        return;
+    size_t i = (size_t)offset / 8;
+    S.lo = std::min(S.lo, i);
+    S.hi = std::max(S.hi, i);
+}
+
+/*
+ * Scan for a direct jump/call (or other code pointer) at offset `j'.
+ */
+static void scanTarget(TargetScan &S, off_t j)
+{
+    const uint8_t *data = S.data;
+    off_t end = S.end;
+    int8_t rel8;
+    int32_t rel32;
+    intptr_t target = INTPTR_MIN, next = INTPTR_MIN;
+    switch (data[j])
+    {
+        case 0x0F:                  // jcc rel32
+            if (j+1 >= end)
+                return;
+            switch (data[j+1])
+            {
+                case 0x80: case 0x81: case 0x82: case 0x83:
+                case 0x84: case 0x85: case 0x86: case 0x87:
+                case 0x88: case 0x89: case 0x8A: case 0x8B:
+                case 0x8C: case 0x8D: case 0x8E: case 0x8F:
+                    j++;
+                    next = j + 5;
+                    break;
+                default:
+                    return;
+            }
+            // Fallthrough:
+        case 0xE8: case 0xE9:       // callq/jumpq rel32
+            if (j + /*sizeof(callq/jmpq)=*/5 > end)
+                return;
+            memcpy(&rel32, data + j + 1, sizeof(rel32));
+            target = j + 5 + (intptr_t)rel32;
+            if (data[j] == 0xE8)
+                next = j + 5;       // return target
+            break;
+        case 0xE3:                  // jrcxz rel8
+        case 0xEB:                  // jmp rel8
+        case 0x70: case 0x71: case 0x72: case 0x73: case 0x74:
+        case 0x75: case 0x76: case 0x77: case 0x78: case 0x79:
+        case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7E:
+        case 0x7F:                  // jcc rel8
+            if (j + /*sizeof(jmp rel8)=*/2 > end)
+                return;
+            rel8 = data[j + 1];
+            target = j + 2 + (intptr_t)rel8;
+            next = j + 2;
+            break;
+        case 0xFF:                  // call *mem64
+        {
+            if (j+2 > end)
+                return;
+            ssize_t sz = getModRMSize(data+j+1, end-(j+1));
+            if (sz < 0)
+                return;
+            next = j + 1 + sz;
+            break;
+        }
+        case 0xB8: case 0xB9: case 0xBA: case 0xBB:
+        case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+        case 0x68:                  // mov $ptr,%reg; push $ptr
+            if (S.pic || j+5 > end)
+                return;
+            target = addrToOffset(S.phdrs, S.phnum,
+                *(int32_t *)(data + j + 1));
+            break;
+        case 0xC7:                  // mov $ptr,mem64
+        {
+            if (S.pic || j+2 > end)
+                return;
+            ssize_t sz = getModRMSize(data+j+1, end-(j+1));
+            if (sz < 0 || j+1+sz+(ssize_t)sizeof(int32_t) > end)
+                return;
+            int32_t imm32 = *(int32_t *)(data + j + 1 + sz);
+            target = addrToOffset(S.phdrs, S.phnum, imm32);
+            break;
+        }
+        case 0x48: case 0x4C:       // lea ptr(%rip),%reg
+        {
+            if (j+7 > end)
+                return;
+            if (data[j+1] != 0x8d)
+                return;
+            uint8_t modRM = data[j+2];
+            uint8_t mod = (modRM & 0xc0) >> 6;
+            uint8_t rm  = modRM & 0x7;
+            if (mod != 0x00 && rm != 0x05)
+                return;
+            target = j + 7 + *(int32_t *)(data + j + 3);
+            if (target >= 0 && target % sizeof(int32_t) == 0)
+            {
+                intptr_t table = S.addr + (target - S.offset);
+                size_t n = (option_OCFR_hacks? 0:
+                    matchJumpTable(data, S.offset, j, end));
+                addJumpTable(table, (n > 0? n: SIZE_MAX), S.tables);
+            }
+            break;
+        }
+        case 0xF3:                  // endbr64
+            if (j+4 > end || !S.cet)
+                return;
+            if (data[j+1] != 0x0F || data[j+2] != 0x1E ||
+                    data[j+3] != 0xFA)
+                return;
+            target = j;     // endbr64
+            break;
+        default:
+            return;
+    }
+    scanSetTarget(S, target);
+    scanSetTarget(S, next);
+}
+
+/*
+ * Scan the range [lo..hi) (scalar version).
+ */
+static void scanTargetsScalar(TargetScan &S, off_t lo, off_t hi)
+{
+    for (off_t j = lo; j < hi; j++)
+        scanTarget(S, j);
+}
+
+#ifdef __x86_64__
+/*
+ * Scan the range [lo..hi) (SSE2 version).  The vector kernel finds all
+ * candidate bytes (a superset of the bytes handled by scanTarget()) 16 bytes
+ * at a time, and only the candidates are passed to scanTarget().
+ */
+static void scanTargetsSSE2(TargetScan &S, off_t lo, off_t hi)
+{
+    const uint8_t *data = S.data;
+    const __m128i x0F = _mm_set1_epi8(0x0F), x48 = _mm_set1_epi8(0x48),
+        x4C = _mm_set1_epi8(0x4C), x68 = _mm_set1_epi8(0x68),
+        x70 = _mm_set1_epi8(0x70), x80 = _mm_set1_epi8((char)0x80),
+        x8D = _mm_set1_epi8((char)0x8D), xB8 = _mm_set1_epi8((char)0xB8),
+        xC7 = _mm_set1_epi8((char)0xC7), xE3 = _mm_set1_epi8((char)0xE3),
+        xE8 = _mm_set1_epi8((char)0xE8), xEB = _mm_set1_epi8((char)0xEB),
+        xF0 = _mm_set1_epi8((char)0xF0), xF3 = _mm_set1_epi8((char)0xF3),
+        xF8 = _mm_set1_epi8((char)0xF8), xFE = _mm_set1_epi8((char)0xFE),
+        xFF = _mm_set1_epi8((char)0xFF), zero = _mm_setzero_si128();
+    const __m128i pic = (S.pic? zero: xFF), cet = (S.cet? xFF: zero);
+    off_t j = lo;
+    for (; j + 16 <= hi && j + 17 <= S.end; j += 16)
+    {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(data + j));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(data + j + 1));
+        __m128i m  = _mm_cmpeq_epi8(_mm_and_si128(b0, xF0), x70);
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_and_si128(b0, xFE), xE8));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(b0, xE3));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(b0, xEB));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(b0, xFF));
+        m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(b0, x0F),
+            _mm_cmpeq_epi8(_mm_and_si128(b1, xF0), x80)));
+        m = _mm_or_si128(m, _mm_and_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(b0, x48), _mm_cmpeq_epi8(b0, x4C)),
+            _mm_cmpeq_epi8(b1, x8D)));
+        m = _mm_or_si128(m, _mm_and_si128(pic,
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_and_si128(b0, xF8), xB8),
+            _mm_or_si128(_mm_cmpeq_epi8(b0, x68), _mm_cmpeq_epi8(b0, xC7)))));
+        m = _mm_or_si128(m, _mm_and_si128(cet,
+            _mm_and_si128(_mm_cmpeq_epi8(b0, xF3), _mm_cmpeq_epi8(b1, x0F))));
+        for (unsigned mask = (unsigned)_mm_movemask_epi8(m); mask != 0;
+                mask &= mask - 1)
+            scanTarget(S, j + __builtin_ctz(mask));
+    }
+    scanTargetsScalar(S, j, hi);
+}
+
+/*
+ * Scan the range [lo..hi) (AVX2 version).
+ */
+__attribute__((__target__("avx2")))
+static void scanTargetsAVX2(TargetScan &S, off_t lo, off_t hi)
+{
+    const uint8_t *data = S.data;
+    const __m256i x0F = _mm256_set1_epi8(0x0F), x48 = _mm256_set1_epi8(0x48),
+        x4C = _mm256_set1_epi8(0x4C), x68 = _mm256_set1_epi8(0x68),
+        x70 = _mm256_set1_epi8(0x70), x80 = _mm256_set1_epi8((char)0x80),
+        x8D = _mm256_set1_epi8((char)0x8D),
+        xB8 = _mm256_set1_epi8((char)0xB8),
+        xC7 = _mm256_set1_epi8((char)0xC7),
+        xE3 = _mm256_set1_epi8((char)0xE3),
+        xE8 = _mm256_set1_epi8((char)0xE8),
+        xEB = _mm256_set1_epi8((char)0xEB),
+        xF0 = _mm256_set1_epi8((char)0xF0),
+        xF3 = _mm256_set1_epi8((char)0xF3),
+        xF8 = _mm256_set1_epi8((char)0xF8),
+        xFE = _mm256_set1_epi8((char)0xFE),
+        xFF = _mm256_set1_epi8((char)0xFF), zero = _mm256_setzero_si256();
+    const __m256i pic = (S.pic? zero: xFF), cet = (S.cet? xFF: zero);
+    off_t j = lo;
+    for (; j + 32 <= hi && j + 33 <= S.end; j += 32)
+    {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(data + j));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(data + j + 1));
+        __m256i m  = _mm256_cmpeq_epi8(_mm256_and_si256(b0, xF0), x70);
+        m = _mm256_or_si256(m,
+            _mm256_cmpeq_epi8(_mm256_and_si256(b0, xFE), xE8));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(b0, xE3));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(b0, xEB));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(b0, xFF));
+        m = _mm256_or_si256(m, _mm256_and_si256(_mm256_cmpeq_epi8(b0, x0F),
+            _mm256_cmpeq_epi8(_mm256_and_si256(b1, xF0), x80)));
+        m = _mm256_or_si256(m, _mm256_and_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(b0, x48),
+                _mm256_cmpeq_epi8(b0, x4C)),
+            _mm256_cmpeq_epi8(b1, x8D)));
+        m = _mm256_or_si256(m, _mm256_and_si256(pic,
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(_mm256_and_si256(b0, xF8), xB8),
+            _mm256_or_si256(_mm256_cmpeq_epi8(b0, x68),
+                _mm256_cmpeq_epi8(b0, xC7)))));
+        m = _mm256_or_si256(m, _mm256_and_si256(cet,
+            _mm256_and_si256(_mm256_cmpeq_epi8(b0, xF3),
+                _mm256_cmpeq_epi8(b1, x0F))));
+        for (uint32_t mask = (uint32_t)_mm256_movemask_epi8(m); mask != 0;
+                mask &= mask - 1)
+            scanTarget(S, j + __builtin_ctz(mask));
+    }
+    scanTargetsScalar(S, j, hi);
+}
+#endif
+
+/*
+ * Scan the executable segments for direct jump targets.  The segments are
+ * split into one chunk per thread, and each thread uses its own target map.
+ * The per-thread maps are OR-merged at the end.
+ */
+static void scanTargets(const Binary *B, uint8_t *targets,
+    const Elf64_Phdr *phdrs, size_t phnum, bool pic, bool cet,
+    JumpTables &tables)
+{
+    typedef void (*ScanFunc)(TargetScan &, off_t, off_t);
+    ScanFunc scan = scanTargetsScalar;
+#ifdef __x86_64__
+    scan = (__builtin_cpu_supports("avx2")? scanTargetsAVX2:
+            scanTargetsSSE2);
+#endif
+
+    size_t total = 0;
+    for (unsigned i = 0; i < phnum; i++)
+    {
+        const Elf64_Phdr *phdr = phdrs + i;
+        if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_X) != 0)
+            total += (size_t)phdr->p_memsz;
+    }
+    unsigned nthreads = option_OCFR_threads;
+    if (nthreads == 0)
+        nthreads = std::min(std::thread::hardware_concurrency(), 8u);
+    nthreads = std::max(nthreads, 1u);
+    const size_t MIN_CHUNK = 0x100000;
+    nthreads = (unsigned)std::min((size_t)nthreads, total / MIN_CHUNK + 1);
+
+    const size_t map_size = (B->size + PAGE_SIZE) / 8;
+    std::vector<TargetScan> scans(nthreads);
+    for (unsigned t = 0; t < nthreads; t++)
+    {
+        TargetScan &S = scans[t];
+        S.data    = B->original.bytes;
+        S.phdrs   = phdrs;
+        S.phnum   = phnum;
+        S.size    = B->size;
+        S.pic     = pic;
+        S.cet     = cet;
+        S.lo      = SIZE_MAX;
+        S.hi      = 0;
+        S.targets = targets;
+        if (t == 0)
+            continue;
+        void *ptr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (ptr == MAP_FAILED)
+            error("failed to allocate target map: %s", strerror(errno));
+        S.targets = (uint8_t *)ptr;
+    }
+
+    auto worker = [&](unsigned t)
+    {
+        TargetScan &S = scans[t];
+        for (unsigned i = 0; i < phnum; i++)
+        {
+            const Elf64_Phdr *phdr = phdrs + i;
+            if (phdr->p_type != PT_LOAD || (phdr->p_flags & PF_X) == 0)
+                continue;
+            S.offset    = (off_t)phdr->p_offset;
+            S.addr      = (intptr_t)phdr->p_vaddr;
+            size_t size = (size_t)phdr->p_memsz;
+            S.end       = (S.offset + size > B->size? B->size:
+                                                      S.offset + size);
+            if (S.end <= S.offset)
+                continue;
+            size_t len   = (size_t)(S.end - S.offset);
+            size_t chunk = (len + nthreads - 1) / nthreads;
+            off_t lo = S.offset + (off_t)std::min(len, t * chunk);
+            off_t hi = S.offset + (off_t)std::min(len, (t + 1) * chunk);
+            scan(S, lo, hi);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < nthreads; t++)
+        threads.emplace_back(worker, t);
+    worker(0);
+    for (auto &thread: threads)
+        thread.join();
+
+    for (unsigned t = 0; t < nthreads; t++)
+    {
+        TargetScan &S = scans[t];
+        for (const auto &entry: S.tables)
+            addJumpTable(entry.first, entry.second, tables);
+        if (t == 0)
+            continue;
+        for (size_t i = S.lo; i <= S.hi && i < map_size; i++)
+            targets[i] |= S.targets[i];
+        munmap(S.targets, map_size);
+    }
+}
+
 /*
  * Target analysis.  Find instructions that can be reached by a
  * control-flow-transfer, including returns.  This can be a "safe"
@@ -150,129 +773,40 @@ void targetAnalysis(Binary *B)
     //       calls/jumps.  This analysis does not assume the binary can be
     //       disassembled, and safely handles data-in-code, etc.
     //
-    std::set<intptr_t> tables;
+    JumpTables tables;
+    scanTargets(B, targets, phdrs, phnum, pic, cet, tables);
+
+    // Step (4): Find other indirect jump targets.
+    {
+        // Entry point
+        intptr_t target = addrToOffset(phdrs, phnum, B->elf.ehdr->e_entry);
+        setTarget(targets, B->size, target);
+    }
     for (unsigned i = 0; i < phnum; i++)
     {
+        // FDE initial locations (.eh_frame_hdr binary search table).
+        // Note: only the (universal) GNU ld/lld encodings are supported.
         const Elf64_Phdr *phdr = phdrs + i;
-        if (phdr->p_type != PT_LOAD || (phdr->p_flags & PF_X) == 0)
+        if (phdr->p_type != PT_GNU_EH_FRAME || phdr->p_filesz < 12 ||
+                phdr->p_offset + phdr->p_filesz > B->size)
             continue;
-        off_t offset  = (off_t)phdr->p_offset;
-        intptr_t addr = (intptr_t)phdr->p_vaddr;
-        size_t size   = (size_t)phdr->p_memsz;
-        off_t end     = (offset + size > B->size? B->size: offset + size);
-        for (off_t j = offset; j < end; j++)
+        const uint8_t *hdr = data + phdr->p_offset;
+        if (hdr[0] != /*version=*/1 ||
+                hdr[1] != /*DW_EH_PE_pcrel|DW_EH_PE_sdata4=*/0x1b ||
+                hdr[2] != /*DW_EH_PE_udata4=*/0x03 ||
+                hdr[3] != /*DW_EH_PE_datarel|DW_EH_PE_sdata4=*/0x3b)
+            continue;
+        const uint32_t count = *(const uint32_t *)(hdr + 8);
+        const int32_t *table = (const int32_t *)(hdr + 12);
+        if (count > (phdr->p_filesz - 12) / (2 * sizeof(int32_t)))
+            continue;
+        for (uint32_t j = 0; j < count; j++)
         {
-            int8_t rel8;
-            int32_t rel32;
-            intptr_t target = INTPTR_MIN, next = INTPTR_MIN;
-            switch (data[j])
-            {
-                case 0x0F:                  // jcc rel32
-                    if (j+1 >= end)
-                        continue;
-                    switch (data[j+1])
-                    {
-                        case 0x80: case 0x81: case 0x82: case 0x83:
-                        case 0x84: case 0x85: case 0x86: case 0x87:
-                        case 0x88: case 0x89: case 0x8A: case 0x8B:
-                        case 0x8C: case 0x8D: case 0x8E: case 0x8F:
-                            j++;
-                            next = j + 5;
-                            break;
-                        default:
-                            continue;
-                    }
-                    // Fallthrough:
-                case 0xE8: case 0xE9:       // callq/jumpq rel32
-                    if (j + /*sizeof(callq/jmpq)=*/5 > end)
-                        continue;
-                    memcpy(&rel32, data + j + 1, sizeof(rel32));
-                    target = j + 5 + (intptr_t)rel32;
-                    if (data[j] == 0xE8)
-                        next = j + 5;       // return target
-                    break;
-                case 0xE3:                  // jrcxz rel8
-                case 0xEB:                  // jmp rel8
-                case 0x70: case 0x71: case 0x72: case 0x73: case 0x74:
-                case 0x75: case 0x76: case 0x77: case 0x78: case 0x79:
-                case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7E:
-                case 0x7F:                  // jcc rel8
-                    if (j + /*sizeof(jmp rel8)=*/2 > end)
-                        continue;
-                    rel8 = data[j + 1];
-                    target = j + 2 + (intptr_t)rel8;
-                    next = j + 2;
-                    break;
-                case 0xFF:                  // call *mem64
-                {
-                    if (j+2 > end)
-                        continue;
-                    ssize_t sz = getModRMSize(data+j+1, end-(j+1));
-                    if (sz < 0)
-                        continue;
-                    next = j + 1 + sz;
-                    break;
-                }
-                case 0xB8: case 0xB9: case 0xBA: case 0xBB:
-                case 0xBC: case 0xBD: case 0xBE: case 0xBF:
-                case 0x68:                  // mov $ptr,%reg; push $ptr
-                    if (pic || j+5 > end)
-                        continue;
-                    target = addrToOffset(phdrs, phnum,
-                        *(int32_t *)(data + j + 1));
-                    break;
-                case 0xC7:                  // mov $ptr,mem64
-                {
-                    if (pic || j+2 > end)
-                        continue;
-                    ssize_t sz = getModRMSize(data+j+1, end-(j+1));
-                    if (sz < 0 || j+1+sz+(ssize_t)sizeof(int32_t) > end)
-                        continue;
-                    int32_t imm32 = *(int32_t *)(data + j + 1 + sz);
-                    target = addrToOffset(phdrs, phnum, imm32);
-                    break;
-                }
-                case 0x48: case 0x4C:       // lea ptr(%rip),%reg
-                {
-                    if (j+7 > end)
-                        continue;
-                    if (data[j+1] != 0x8d)
-                        continue;
-                    uint8_t modRM = data[j+2];
-                    uint8_t mod = (modRM & 0xc0) >> 6;
-                    uint8_t rm  = modRM & 0x7;
-                    if (mod != 0x00 && rm != 0x05)
-                        continue;
-                    target = j + 7 + *(int32_t *)(data + j + 3);
-                    if (target >= 0 && target % sizeof(int32_t) == 0)
-                    {
-                        intptr_t table = addr + (target - offset);
-                        tables.insert(table);
-                    }
-                    break;
-                }
-                case 0xF3:                  // endbr64
-                    if (j+4 > end || !cet)
-                        continue;
-                    if (data[j+1] != 0x0F || data[j+2] != 0x1E ||
-                            data[j+3] != 0xFA)
-                        continue;
-                    target = j;     // endbr64
-                    break;
-                default:
-                    continue;
-            }
+            intptr_t addr = (intptr_t)phdr->p_vaddr + table[2 * j];
+            intptr_t target = addrToOffset(phdrs, phnum, addr);
             setTarget(targets, B->size, target);
-            setTarget(targets, B->size, next);
         }
     }
-
-    // Step (4): Find other indirect jump targets.
-    {
-        // Entry point
-        intptr_t target = addrToOffset(phdrs, phnum, B->elf.ehdr->e_entry);
-        setTarget(targets, B->size, target);
-    }
     struct hshtab_s
     {
         uint32_t nbuckets;
@@ -445,8 +979,11 @@ void targetAnalysis(Binary *B)
             auto i = tables.find(table);
             if (i == tables.end())
                 continue;
-            
-            for (const int32_t *q = p; q < bounds.second; q++)
+
+            // If the bounds were recovered, only the table entries are
+            // considered:
+            size_t n = i->second;
+            for (const int32_t *q = p; q < bounds.second && n > 0; q++, n--)
             {
                 intptr_t offset = (intptr_t)*q;
                 intptr_t label = table + offset;
@@ -26,12 +26,14 @@
 #include <unistd.h>
 
 #include "e9CFR.h"
+#include "e9cache.h"
 #include "e9elf.h"
 #include "e9emit.h"
 #include "e9optimize.h"
 #include "e9patch.h"
 #include "e9pe.h"
 #include "e9json.h"
+#include "e9stats.h"
 #include "e9tactics.h"
 #include "e9x86_64.h"
 
@@ -454,6 +456,7 @@ static void parseEmit(Binary *B, const Message &msg)
     free(output);
 
     // Build trampoline entry set (b4 flush)
+    phaseSwitch(PHASE_TACTICS);
     buildEntrySet(B);
 
     // Flush the queue:
@@ -467,6 +470,7 @@ static void parseEmit(Binary *B, const Message &msg)
                    B->mode == MODE_PE_DLL? WINDOWS_VIRTUAL_ALLOC_SIZE:
                     granularity);
     size_t mapping_size = std::max(granularity, option_mem_mapping_size);
+    phaseSwitch(PHASE_MAPPINGS);
     buildMappings(B->allocator, mapping_size, mappings);
     switch (option_mem_granularity)
     {
@@ -484,10 +488,13 @@ static void parseEmit(Binary *B, const Message &msg)
     }
 
     // Post-processing & optimizations:
+    phaseSwitch(PHASE_FLATTEN);
     flattenAllTrampolines(B);
+    phaseSwitch(PHASE_OPTIMIZE);
     optimizeAllJumps(B);
 
     // Create the patched binary:
+    phaseSwitch(PHASE_EMIT);
     switch (B->mode)
     {
         case MODE_ELF_EXE: case MODE_ELF_DSO:
@@ -524,6 +531,9 @@ static void parseEmit(Binary *B, const Message &msg)
             error("failed to parse \"emit\" message (id=%u); invalid "
                 "\"format\" code %u", msg.id, (unsigned)format);
     }
+
+    // Save the patching decisions for the next run:
+    cacheSave(B);
 }
 
 /*
@@ -798,9 +808,11 @@ Binary *parseMessage(Binary *B, Message &msg)
                     "\"binary\" message (id=%u)", msg.id);
             return parseBinary(msg);
         case METHOD_INSTRUCTION:
+            phaseSwitch(PHASE_INSTRUCTION);
             parseInstruction(B, msg);
             return B;
         case METHOD_PATCH:
+            phaseSwitch(PHASE_TACTICS);
             parsePatch(B, msg);
             return B;
         case METHOD_EMIT:
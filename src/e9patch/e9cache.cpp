@@ -0,0 +1,416 @@
+/*
+ * e9cache.cpp
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The patching cache records the decision (tactic, jump location and
+ * trampoline entry addresses) made for each patched instruction.  When the
+ * same input binary is rewritten again, the cached decision is replayed
+ * first, and the full tactic search is only used for sites where the replay
+ * fails (e.g., the trampoline or neighbourhood has changed).  Replays are
+ * always re-validated by the tactics themselves, so a stale cache can only
+ * ever affect the choice of patch, never its correctness.
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+
+#include <unistd.h>
+
+#include "e9cache.h"
+#include "e9patch.h"
+
+#define CACHE_MAGIC         "E9CACHE"
+#define CACHE_FORMAT        1
+
+/*
+ * Cache file header.
+ */
+struct CacheHeader
+{
+    char magic[8];                      // CACHE_MAGIC
+    uint32_t format;                    // CACHE_FORMAT
+    uint32_t mode;                      // Binary mode.
+    char version[16];                   // E9Patch version.
+    uint64_t hash;                      // Input binary hash.
+    uint64_t num_entries;               // Number of entries.
+};
+
+/*
+ * Cache file record.  The file layout is the header, followed by all
+ * records, followed by all allocations.
+ */
+struct CacheRecord
+{
+    int64_t addr;                       // Patched instruction address.
+    uint64_t hash;                      // Trampoline+metadata hash.
+    uint32_t tactic;                    // Tactic used.
+    uint32_t num_allocs;                // Number of allocations.
+    uint64_t num_allocs_total;          // Number of allocations (incl.)
+};
+
+/*
+ * Cache state.
+ */
+static bool cache_loaded = false;
+static uint64_t cache_hash = 0;
+static std::string cache_filename;
+static std::vector<CacheEntry> cache_old;           // Sorted by address
+static std::vector<CacheAlloc> cache_old_allocs;
+static std::vector<CacheRecord> cache_new;
+static std::vector<CacheAlloc> cache_new_allocs;
+static const Instr *cache_last_I = nullptr;
+static uint64_t cache_last_hash = 0;
+
+/*
+ * Cache statistics.
+ */
+static size_t stat_cache_hits       = 0;
+static size_t stat_cache_misses     = 0;
+static size_t stat_cache_mismatches = 0;
+
+/*
+ * FNV-1a hashing.
+ */
+#define FNV_OFFSET          0xcbf29ce484222325ull
+#define FNV_PRIME           0x100000001b3ull
+static uint64_t hash(uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (uint64_t)bytes[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+static uint64_t hash(uint64_t h, uint64_t x)
+{
+    return hash(h, &x, sizeof(x));
+}
+static uint64_t hash(uint64_t h, const char *str)
+{
+    return hash(h, str, strlen(str) + 1);
+}
+
+/*
+ * Hash a trampoline template.
+ */
+static uint64_t hash(uint64_t h, const Trampoline *T)
+{
+    if (T == nullptr)
+        return hash(h, (uint64_t)0);
+    h = hash(h, (uint64_t)T->num_entries);
+    for (unsigned i = 0; i < T->num_entries; i++)
+    {
+        const Entry *entry = T->entries + i;
+        h = hash(h, (uint64_t)entry->kind);
+        switch (entry->kind)
+        {
+            case ENTRY_BYTES:
+                h = hash(h, (uint64_t)entry->length);
+                h = hash(h, entry->bytes, entry->length);
+                break;
+            case ENTRY_ZEROES:
+                h = hash(h, (uint64_t)entry->length);
+                break;
+            case ENTRY_LABEL:
+                h = hash(h, entry->label);
+                break;
+            case ENTRY_MACRO:
+                h = hash(h, entry->macro);
+                break;
+            case ENTRY_REL8: case ENTRY_REL32:
+            case ENTRY_INT8: case ENTRY_INT16: case ENTRY_INT32:
+            case ENTRY_INT64:
+                h = hash(h, (uint64_t)entry->use);
+                if (entry->use)
+                    h = hash(h, entry->label);
+                else
+                    h = hash(h, entry->uint64);
+                break;
+            case ENTRY_BREAK:
+                h = hash(h, (uint64_t)entry->optimize);
+                break;
+            case ENTRY_DEBUG: case ENTRY_INSTR:
+            case ENTRY_INSTR_BYTES: case ENTRY_TAKE:
+                break;
+            case ENTRY_BATCH:
+                h = hash(h, entry->uint64);
+                break;
+        }
+    }
+    return h;
+}
+
+/*
+ * Hash the trampoline and metadata of a patch site.
+ */
+static uint64_t hash(const Instr *I, const Trampoline *T)
+{
+    if (I == cache_last_I)
+        return cache_last_hash;
+    uint64_t h = hash(FNV_OFFSET, T);
+    const Metadata *meta = I->metadata;
+    if (meta != nullptr)
+    {
+        h = hash(h, (uint64_t)meta->num_entries);
+        for (size_t i = 0; i < meta->num_entries; i++)
+        {
+            h = hash(h, meta->entries[i].name);
+            h = hash(h, meta->entries[i].T);
+        }
+    }
+    cache_last_I    = I;
+    cache_last_hash = h;
+    return h;
+}
+
+/*
+ * Load the cache (if it exists).
+ */
+static void cacheLoad(const Binary *B)
+{
+    cache_loaded = true;
+
+    uint64_t h = hash(FNV_OFFSET, B->original.bytes, B->size);
+    h = hash(h, STRING(VERSION));
+    h = hash(h, (uint64_t)B->mode);
+    cache_hash = h;
+
+    char name[32];
+    snprintf(name, sizeof(name), "%.16lx.e9cache", h);
+    cache_filename = option_cache;
+    cache_filename += '/';
+    cache_filename += name;
+
+    FILE *stream = fopen(cache_filename.c_str(), "r");
+    if (stream == nullptr)
+    {
+        if (errno != ENOENT)
+            warning("failed to open cache file \"%s\" for reading: %s",
+                cache_filename.c_str(), strerror(errno));
+        return;
+    }
+
+    CacheHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, stream) != 1 ||
+            memcmp(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+            hdr.format != CACHE_FORMAT ||
+            strncmp(hdr.version, STRING(VERSION), sizeof(hdr.version)) != 0 ||
+            hdr.mode != (uint32_t)B->mode || hdr.hash != cache_hash)
+    {
+        warning("ignoring invalid or stale cache file \"%s\"",
+            cache_filename.c_str());
+        fclose(stream);
+        return;
+    }
+    std::vector<CacheRecord> records(hdr.num_entries);
+    if (hdr.num_entries > 0 &&
+            fread(records.data(), sizeof(CacheRecord), records.size(),
+                stream) != records.size())
+    {
+corrupt:
+        warning("ignoring corrupt cache file \"%s\"",
+            cache_filename.c_str());
+        fclose(stream);
+        return;
+    }
+    size_t num_allocs =
+        (records.size() == 0? 0: records.back().num_allocs_total);
+    cache_old_allocs.resize(num_allocs);
+    if (num_allocs > 0 &&
+            fread(cache_old_allocs.data(), sizeof(CacheAlloc), num_allocs,
+                stream) != num_allocs)
+        goto corrupt;
+    cache_old.reserve(records.size());
+    for (const auto &record: records)
+    {
+        if (record.num_allocs > record.num_allocs_total ||
+                record.num_allocs_total > num_allocs)
+        {
+            cache_old.clear();
+            goto corrupt;
+        }
+        const CacheAlloc *allocs = cache_old_allocs.data() +
+            (record.num_allocs_total - record.num_allocs);
+        cache_old.push_back({(intptr_t)record.addr, record.hash,
+            record.tactic, record.num_allocs, allocs});
+    }
+    std::sort(cache_old.begin(), cache_old.end(),
+        [](const CacheEntry &a, const CacheEntry &b)
+        {
+            return (a.addr < b.addr);
+        });
+    fclose(stream);
+    debug("loaded %zu cached patch decisions from \"%s\"", cache_old.size(),
+        cache_filename.c_str());
+}
+
+/*
+ * Lookup the cached decision for the given patch site, or nullptr if there
+ * is no (valid) cached decision.
+ */
+const CacheEntry *cacheLookup(const Binary *B, const Instr *I,
+    const Trampoline *T)
+{
+    if (option_cache.empty())
+        return nullptr;
+    if (!cache_loaded)
+        cacheLoad(B);
+    auto i = std::lower_bound(cache_old.begin(), cache_old.end(), I->addr,
+        [](const CacheEntry &a, intptr_t addr)
+        {
+            return (a.addr < addr);
+        });
+    if (i == cache_old.end() || i->addr != I->addr)
+        return nullptr;
+    const CacheEntry *entry = &(*i);
+    if (entry->hash != hash(I, T))
+        return nullptr;             // Trampoline has changed
+    return entry;
+}
+
+/*
+ * Record the decision for the given patch site.
+ */
+void cacheRecord(const Binary *B, const Instr *I, const Trampoline *T,
+    unsigned tactic, const CacheAllocSet &allocs, const CacheEntry *hint,
+    bool replayed)
+{
+    if (option_cache.empty())
+        return;
+    if (!cache_loaded)
+        cacheLoad(B);
+    if (replayed)
+        stat_cache_hits++;
+    else
+        stat_cache_misses++;
+    if (option_cache_validate && hint != nullptr)
+    {
+        bool match = (hint->tactic == tactic &&
+            hint->num_allocs == allocs.size());
+        for (size_t i = 0; match && i < allocs.size(); i++)
+            match = (hint->allocs[i].owner == allocs[i].owner &&
+                     hint->allocs[i].jump  == allocs[i].jump &&
+                     hint->allocs[i].entry == allocs[i].entry);
+        if (!match)
+        {
+            stat_cache_mismatches++;
+            debug("cached decision for instruction 0x%lx differs from "
+                "full search", I->addr);
+        }
+    }
+
+    cache_new_allocs.insert(cache_new_allocs.end(), allocs.begin(),
+        allocs.end());
+    CacheRecord record;
+    memset(&record, 0x0, sizeof(record));
+    record.addr             = (int64_t)I->addr;
+    record.hash             = hash(I, T);
+    record.tactic           = tactic;
+    record.num_allocs       = (uint32_t)allocs.size();
+    record.num_allocs_total = cache_new_allocs.size();
+    cache_new.push_back(record);
+}
+
+/*
+ * Save the cache.
+ */
+void cacheSave(const Binary *B)
+{
+    if (option_cache.empty())
+        return;
+    if (!cache_loaded)
+        cacheLoad(B);
+
+    // Write to a temporary file first, so that concurrent or interrupted
+    // runs never see a partial cache:
+    std::string tmp(cache_filename);
+    tmp += ".tmp.";
+    tmp += std::to_string((int)getpid());
+    FILE *stream = fopen(tmp.c_str(), "w");
+    if (stream == nullptr)
+    {
+        warning("failed to open cache file \"%s\" for writing: %s",
+            tmp.c_str(), strerror(errno));
+        return;
+    }
+
+    CacheHeader hdr;
+    memset(&hdr, 0x0, sizeof(hdr));
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    hdr.format = CACHE_FORMAT;
+    hdr.mode   = (uint32_t)B->mode;
+    strncpy(hdr.version, STRING(VERSION), sizeof(hdr.version)-1);
+    hdr.hash        = cache_hash;
+    hdr.num_entries = cache_new.size();
+    bool ok = (fwrite(&hdr, sizeof(hdr), 1, stream) == 1);
+    ok = ok && (cache_new.size() == 0 ||
+        fwrite(cache_new.data(), sizeof(CacheRecord), cache_new.size(),
+            stream) == cache_new.size());
+    ok = ok && (cache_new_allocs.size() == 0 ||
+        fwrite(cache_new_allocs.data(), sizeof(CacheAlloc),
+            cache_new_allocs.size(), stream) == cache_new_allocs.size());
+    ok = (fclose(stream) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), cache_filename.c_str()) < 0)
+    {
+        warning("failed to write cache file \"%s\": %s",
+            cache_filename.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return;
+    }
+    debug("saved %zu patch decisions to \"%s\"", cache_new.size(),
+        cache_filename.c_str());
+}
+
+/*
+ * Print the cache statistics.
+ */
+void printCacheStats(void)
+{
+    if (option_cache.empty())
+        return;
+    size_t total = stat_cache_hits + stat_cache_misses;
+    printf("num_cache_hits        = %zu / %zu (%.2f%%)\n",
+        stat_cache_hits, total,
+        (total == 0? 0.0: (double)stat_cache_hits / (double)total * 100.0));
+    if (option_cache_validate)
+        printf("num_cache_mismatches  = %zu\n", stat_cache_mismatches);
+}
+
+/*
+ * Print the cache statistics (as a JSON object member).
+ */
+void printCacheStatsJSON(FILE *stream)
+{
+    if (option_cache.empty())
+    {
+        fputs("\"cache\":null", stream);
+        return;
+    }
+    fprintf(stream, "\"cache\":{\"hits\":%zu,\"misses\":%zu",
+        stat_cache_hits, stat_cache_misses);
+    if (option_cache_validate)
+        fprintf(stream, ",\"mismatches\":%zu", stat_cache_mismatches);
+    fputc('}', stream);
+}
@@ -0,0 +1,61 @@
+/*
+ * e9cache.h
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __E9CACHE_H
+#define __E9CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+
+#include <vector>
+
+#include "e9patch.h"
+
+/*
+ * A cached trampoline allocation.
+ */
+struct CacheAlloc
+{
+    intptr_t owner;                     // Trampoline instruction address.
+    intptr_t jump;                      // Jump (or trap) address.
+    intptr_t entry;                     // Trampoline entry address.
+};
+typedef std::vector<CacheAlloc> CacheAllocSet;
+
+/*
+ * A cached patching decision.
+ */
+struct CacheEntry
+{
+    intptr_t addr;                      // Patched instruction address.
+    uint64_t hash;                      // Trampoline+metadata hash.
+    unsigned tactic;                    // Tactic used.
+    unsigned num_allocs;                // Number of allocations.
+    const CacheAlloc *allocs;           // Trampoline allocations.
+};
+
+const CacheEntry *cacheLookup(const Binary *B, const Instr *I,
+    const Trampoline *T);
+void cacheRecord(const Binary *B, const Instr *I, const Trampoline *T,
+    unsigned tactic, const CacheAllocSet &allocs, const CacheEntry *hint,
+    bool replayed);
+void cacheSave(const Binary *B);
+void printCacheStats(void);
+void printCacheStatsJSON(FILE *stream);
+
+#endif
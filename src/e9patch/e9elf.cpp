@@ -552,13 +552,30 @@ size_t emitElf(Binary *B, const MappingSet &mappings, size_t mapping_size)
         config->num_finis++;
     }
     config->traps = (B->Traps.size() > 0? (uint32_t)(size - config_offset): 0);
-    for (auto i = B->Traps.rbegin(); i != B->Traps.rend(); ++i)
+    if (B->Traps.size() > 0)
     {
-        const Alloc *A = *i;
-        struct e9_trap_s trap = {A->I->addr, A->lb + A->entry};
-        memcpy(data + size, &trap, sizeof(trap));
-        size += sizeof(trap);
-        config->num_traps++;
+        // Build the trap hash table (load factor <= 2/3):
+        size_t num_buckets = 1;
+        while (2 * num_buckets < 3 * B->Traps.size())
+            num_buckets *= 2;
+        if (num_buckets > UINT32_MAX)
+            error("failed to emit trap table; too many traps (%zu)",
+                B->Traps.size());
+        struct e9_trap_s *traps = (struct e9_trap_s *)(data + size);
+        memset(traps, 0, num_buckets * sizeof(struct e9_trap_s));
+        config->trap_mask = (uint32_t)(num_buckets - 1);
+        for (const Alloc *A: B->Traps)
+        {
+            intptr_t rip = A->I->addr;
+            assert(rip != 0x0);
+            uint32_t i = e9_trap_hash(rip);
+            while (traps[i & config->trap_mask].rip != 0x0)
+                i++;
+            traps[i & config->trap_mask].rip        = rip;
+            traps[i & config->trap_mask].trampoline = A->lb + A->entry;
+            config->num_traps++;
+        }
+        size += num_buckets * sizeof(struct e9_trap_s);
     }
 
     std::vector<Bounds> bounds;
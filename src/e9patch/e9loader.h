@@ -50,10 +50,20 @@ struct e9_map_s
 
 struct e9_trap_s
 {
-    intptr_t rip;                               // Trap location
+    intptr_t rip;                               // Trap location (0=empty)
     intptr_t trampoline;                        // Trampoline location
 };
 
+/*
+ * The traps are stored in an open-addressed (linear probing) hash table of
+ * (trap_mask+1) entries, so the SIGILL handler can find the trampoline in
+ * O(1) rather than by binary search.
+ */
+static inline uint32_t e9_trap_hash(intptr_t rip)
+{
+    return (uint32_t)(((uint64_t)rip * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
 struct e9_config_s
 {
     char     magic[8];                          // "E9PATCH\0"
@@ -76,6 +86,7 @@ struct e9_config_s
     uint32_t finis;                             // Fini functions offset
     uint32_t num_traps;                         // # Trap functions
     uint32_t traps;                             // Trap functions offset
+    uint32_t trap_mask;                         // Trap table size - 1
     uint32_t handler;                           // Trap handler function
 };
 
@@ -221,27 +221,23 @@ void e9handler(int sig, siginfo_t *info, ucontext_t *ctx,
     const struct e9_trap_s *traps =
         (const struct e9_trap_s *)(loader_base + config->traps);
     const uint8_t *rip = (const uint8_t *)mctx->gregs[REG_RIP];
-    int64_t idx = -1;
+    const uint8_t *trampoline = NULL;
     if (rip >= elf_base && rip <= loader_base)
     {
-        int64_t lo = 0, hi = config->num_traps;
         intptr_t key = rip - elf_base;
-        while (lo <= hi)
+        for (uint32_t i = e9_trap_hash(key); ; i++)
         {
-            int64_t mid = (lo + hi) / 2;
-            if (key < traps[mid].rip)
-                hi = mid - 1;
-            else if (key > traps[mid].rip)
-                lo = mid + 1;
-            else
+            const struct e9_trap_s *trap = traps + (i & config->trap_mask);
+            if (trap->rip == key)
             {
-                idx = mid;
+                trampoline = elf_base + trap->trampoline;
                 break;
             }
+            if (trap->rip == 0x0)
+                break;
         }
     }
-    const uint8_t *trampoline = elf_base + traps[idx].trampoline;
-    if (idx < 0)
+    if (trampoline == NULL)
     {
         // No trampoline found:
         struct e9scratch_s *scratch = e9scratch(config, /*alloc=*/false);
@@ -31,8 +31,11 @@
 #include <sys/mman.h>
 
 #include "e9api.h"
+#include "e9cache.h"
 #include "e9json.h"
 #include "e9patch.h"
+#include "e9stats.h"
+#include "e9tactics.h"
 
 /*
  * Global options.
@@ -40,6 +43,8 @@
 bool option_is_tty             = false;
 bool option_debug              = false;
 bool option_batch              = false;
+std::string option_cache;
+bool option_cache_validate     = false;
 bool option_tactic_B0          = false;
 bool option_tactic_B1          = true;
 bool option_tactic_B2          = true;
@@ -48,8 +53,10 @@ bool option_tactic_T1          = true;
 bool option_tactic_T2          = true;
 bool option_tactic_T3          = true;
 bool option_tactic_backward_T3 = true;
+bool option_tactic_adaptive    = false;
 bool option_OCFR               = false;
 bool option_OCFR_hacks         = false;
+unsigned option_OCFR_threads   = 0;
 unsigned option_Oepilogue      = 0;
 unsigned option_Oepilogue_size = 64;
 bool option_Oorder             = false;
@@ -76,6 +83,8 @@ bool option_loader_phdr_set    = false;
 bool option_loader_static_set  = false;
 bool option_mem_rebase_set     = false;
 bool option_log                = true;
+bool option_stats              = false;
+bool option_stats_json         = false;
 int option_log_color           = COLOR_NONE;
 
 /*
@@ -243,9 +252,15 @@ static void usage(FILE *stream, const char *progname)
         "\n"
         "\t-OCFR-hacks[=false]\n"
         "\t\tMakes -OCFR even more conservative.  This may help some\n"
-        "\t\tbinaries that use non-standard relocations.\n"
+        "\t\tbinaries that use non-standard relocations.  This also\n"
+        "\t\tdisables jump table bounds recovery.\n"
         "\t\tDefault: false (disabled)\n"
         "\n"
+        "\t-OCFR-threads=N\n"
+        "\t\tUse N threads for the -OCFR target analysis, where 0 means\n"
+        "\t\tuse the number of CPUs (up to 8).\n"
+        "\t\tDefault: 0\n"
+        "\n"
         "\t-Oepilogue=N\n"
         "\t\tAppend a epilogue of up to N instructions to the end of each\n"
         "\t\ttrampoline.  This may enhance -Opeephole.\n"
@@ -283,6 +298,19 @@ static void usage(FILE *stream, const char *progname)
         "\t\tRewrite the binary in one batch rather than incrementally.\n"
         "\t\tDefault: false (disabled)\n"
         "\n"
+        "\t--cache=DIR\n"
+        "\t\tCache patching decisions in the directory DIR.  The cache is\n"
+        "\t\tkeyed by the input binary, and cached decisions are replayed\n"
+        "\t\twhen the same binary is rewritten again.  Only patch sites\n"
+        "\t\twhose trampolines or neighbourhoods have changed will be\n"
+        "\t\tre-searched.\n"
+        "\t\tDefault: (disabled)\n"
+        "\n"
+        "\t--cache-validate[=false]\n"
+        "\t\tEnable [disable] cache validation.  Cached decisions are not\n"
+        "\t\treplayed, but are instead compared against a full search.\n"
+        "\t\tDefault: false (disabled)\n"
+        "\n"
         "\t--debug[=false]\n"
         "\t\tEnable [disable] debug log messages.\n"
         "\t\tDefault: false (disabled)\n"
@@ -296,6 +324,14 @@ static void usage(FILE *stream, const char *progname)
         "\t--output FILE, -o FILE\n"
         "\t\tWrite output to FILE instead of stdout.\n"
         "\n"
+        "\t--stats=FORMAT\n"
+        "\t\tPrint the final statistics in FORMAT, which is one of\n"
+        "\t\t{text,json}.  The json format is a single line that also\n"
+        "\t\tincludes per-phase wall-clock/CPU time, allocation counts\n"
+        "\t\tand peak RSS.  Passing this option also enables per-tactic\n"
+        "\t\ttiming, which is otherwise not measured.\n"
+        "\t\tDefault: text\n"
+        "\n"
         "\t--loader-base=ADDR\n"
         "\t\tSet ADDR to be the base address of the program loader.\n"
         "\t\tOnly relevant for ELF binaries.\n"
@@ -367,6 +403,13 @@ static void usage(FILE *stream, const char *progname)
         "\t\tDefault: true  (enabled) for B1/B2/T1/T2/T3\n"
         "\t\t         false (disabled) for B0\n"
         "\n"
+        "\t--tactic-adaptive[=false]\n"
+        "\t\tEnable [disable] adaptive tactic scheduling.  This skips\n"
+        "\t\ttactics T1/T2/T3 for instruction classes (size and successor)\n"
+        "\t\twhere the tactic has recently been (almost) always failing.\n"
+        "\t\tThis makes rewriting faster, but may reduce coverage.\n"
+        "\t\tDefault: false (disabled)\n"
+        "\n"
         "\t--tactic-backward-T3[=false]\n"
         "\t\tEnable [disables] backward jumps for tactic T3.\n"
         "\t\tDefault: true (enabled)\n"
@@ -397,6 +440,8 @@ static void usage(FILE *stream, const char *progname)
 enum Option
 {
     OPTION_BATCH,
+    OPTION_CACHE,
+    OPTION_CACHE_VALIDATE,
     OPTION_DEBUG,
     OPTION_HELP,
     OPTION_INPUT,
@@ -412,6 +457,7 @@ enum Option
     OPTION_MEM_UB,
     OPTION_OCFR,
     OPTION_OCFR_HACKS,
+    OPTION_OCFR_THREADS,
     OPTION_OEPILOGUE,
     OPTION_OEPILOGUE_SIZE,
     OPTION_OORDER,
@@ -420,6 +466,7 @@ enum Option
     OPTION_OPROLOGUE_SIZE,
     OPTION_OSCRATCH_STACK,
     OPTION_OUTPUT,
+    OPTION_STATS,
     OPTION_TACTIC_B0,
     OPTION_TACTIC_B1,
     OPTION_TACTIC_B2,
@@ -427,6 +474,7 @@ enum Option
     OPTION_TACTIC_T1,
     OPTION_TACTIC_T2,
     OPTION_TACTIC_T3,
+    OPTION_TACTIC_ADAPTIVE,
     OPTION_TACTIC_BACKWARD_T3,
     OPTION_TRAP,
     OPTION_TRAP_ALL,
@@ -448,6 +496,7 @@ void parseOptions(char * const argv[], bool api)
     {
         {"OCFR",               opt_arg, nullptr, OPTION_OCFR},
         {"OCFR-hacks",         opt_arg, nullptr, OPTION_OCFR_HACKS},
+        {"OCFR-threads",       req_arg, nullptr, OPTION_OCFR_THREADS},
         {"Oepilogue",          req_arg, nullptr, OPTION_OEPILOGUE},
         {"Oepilogue-size",     req_arg, nullptr, OPTION_OEPILOGUE_SIZE},
         {"Oorder",             opt_arg, nullptr, OPTION_OORDER},
@@ -456,6 +505,8 @@ void parseOptions(char * const argv[], bool api)
         {"Oprologue-size",     req_arg, nullptr, OPTION_OPROLOGUE_SIZE},
         {"Oscratch-stack",     opt_arg, nullptr, OPTION_OSCRATCH_STACK},
         {"batch",              opt_arg, nullptr, OPTION_BATCH},
+        {"cache",              req_arg, nullptr, OPTION_CACHE},
+        {"cache-validate",     opt_arg, nullptr, OPTION_CACHE_VALIDATE},
         {"debug",              opt_arg, nullptr, OPTION_DEBUG},
         {"help",               no_arg,  nullptr, OPTION_HELP},
         {"input",              req_arg, nullptr, OPTION_INPUT},
@@ -470,6 +521,7 @@ void parseOptions(char * const argv[], bool api)
         {"mem-rebase",         req_arg, nullptr, OPTION_MEM_REBASE},
         {"mem-ub",             req_arg, nullptr, OPTION_MEM_UB},
         {"output",             req_arg, nullptr, OPTION_OUTPUT},
+        {"stats",              req_arg, nullptr, OPTION_STATS},
         {"tactic-B0",          opt_arg, nullptr, OPTION_TACTIC_B0},
         {"tactic-B1",          opt_arg, nullptr, OPTION_TACTIC_B1},
         {"tactic-B2",          opt_arg, nullptr, OPTION_TACTIC_B2},
@@ -477,6 +529,7 @@ void parseOptions(char * const argv[], bool api)
         {"tactic-T1",          opt_arg, nullptr, OPTION_TACTIC_T1},
         {"tactic-T2",          opt_arg, nullptr, OPTION_TACTIC_T2},
         {"tactic-T3",          opt_arg, nullptr, OPTION_TACTIC_T3},
+        {"tactic-adaptive",    opt_arg, nullptr, OPTION_TACTIC_ADAPTIVE},
         {"tactic-backward-T3", opt_arg, nullptr, OPTION_TACTIC_BACKWARD_T3},
         {"trap",               req_arg, nullptr, OPTION_TRAP},
         {"trap-all",           opt_arg, nullptr, OPTION_TRAP_ALL},
@@ -508,6 +561,13 @@ void parseOptions(char * const argv[], bool api)
             case OPTION_BATCH:
                 option_batch = parseBoolOptArg("--batch", optarg);
                 break;
+            case OPTION_CACHE:
+                option_cache = optarg;
+                break;
+            case OPTION_CACHE_VALIDATE:
+                option_cache_validate = parseBoolOptArg("--cache-validate",
+                    optarg);
+                break;
             case OPTION_DEBUG:
                 option_debug = parseBoolOptArg("--debug", optarg);
                 break;
@@ -525,6 +585,10 @@ void parseOptions(char * const argv[], bool api)
             case OPTION_OCFR_HACKS:
                 option_OCFR_hacks = parseBoolOptArg("-OCFR-hacks", optarg);
                 break;
+            case OPTION_OCFR_THREADS:
+                option_OCFR_threads =
+                    (unsigned)parseIntOptArg("-OCFR-threads", optarg, 0, 64);
+                break;
             case OPTION_OEPILOGUE:
                 option_Oepilogue =
                     (unsigned)parseIntOptArg("-Oepilogue", optarg, 0, 64);
@@ -557,6 +621,17 @@ void parseOptions(char * const argv[], bool api)
             case OPTION_OUTPUT:
                 option_output = optarg;
                 break;
+            case OPTION_STATS:
+                option_stats = true;
+                if (strcmp(optarg, "json") == 0)
+                    option_stats_json = true;
+                else if (strcmp(optarg, "text") == 0)
+                    option_stats_json = false;
+                else
+                    error("failed to parse argument \"%s\" for the "
+                        "`--stats' option; expected one of {text,json}",
+                        optarg);
+                break;
             case OPTION_TACTIC_B0:
                 option_tactic_B0 =
                     parseBoolOptArg("--tactic-B0", optarg);
@@ -585,6 +660,10 @@ void parseOptions(char * const argv[], bool api)
                 option_tactic_T3 =
                     parseBoolOptArg("--tactic-T3", optarg);
                 break;
+            case OPTION_TACTIC_ADAPTIVE:
+                option_tactic_adaptive =
+                    parseBoolOptArg("--tactic-adaptive", optarg);
+                break;
             case OPTION_TACTIC_BACKWARD_T3:
                 option_tactic_backward_T3 =
                     parseBoolOptArg("--tactic-backward-T3", optarg);
@@ -697,6 +776,47 @@ void parseOptions(char * const argv[], bool api)
             argv[optind]);
 }
 
+/*
+ * Print the final statistics as a single-line JSON object.
+ */
+static void printStatsJSON(const Binary *B, size_t stat_num_total,
+    size_t stat_time, size_t stat_memory)
+{
+    const char *mode_str = "???";
+    switch (B->mode)
+    {
+        case MODE_ELF_EXE: mode_str = "elf.exe"; break;
+        case MODE_ELF_DSO: mode_str = "elf.dso"; break;
+        case MODE_PE_EXE:  mode_str = "pe.exe";  break;
+        case MODE_PE_DLL:  mode_str = "pe.dll";  break;
+    }
+    log(COLOR_NONE, '\n');
+    printf("{\"tool\":\"e9patch\",\"version\":\"%s\",\"mode\":\"%s\","
+        "\"input_binary\":", STRING(VERSION), mode_str);
+    printJSONString(stdout, B->filename);
+    printf(",\"output_binary\":");
+    printJSONString(stdout, B->output);
+    printf(",\"num_total\":%zu,\"num_patched\":%zu,\"num_patched_B0\":%zu,"
+        "\"num_patched_B1\":%zu,\"num_patched_B2\":%zu,"
+        "\"num_patched_T0\":%zu,\"num_patched_T1\":%zu,"
+        "\"num_patched_T2\":%zu,\"num_patched_T3\":%zu,",
+        stat_num_total, stat_num_patched, stat_num_B0, stat_num_B1,
+        stat_num_B2, stat_num_T0, stat_num_T1, stat_num_T2, stat_num_T3);
+    printf("\"num_virtual_mappings\":%zu,\"num_physical_mappings\":%zu,"
+        "\"num_virtual_bytes\":%zu,\"num_physical_bytes\":%zu,"
+        "\"input_file_size\":%zu,\"output_file_size\":%zu,"
+        "\"time_elapsed_ms\":%zu,\"memory_used_kb\":%zu,",
+        stat_num_virtual_mappings, stat_num_physical_mappings,
+        stat_num_virtual_bytes, stat_num_physical_bytes,
+        stat_input_file_size, stat_output_file_size, stat_time, stat_memory);
+    printTacticStatsJSON(stdout);
+    putchar(',');
+    printCacheStatsJSON(stdout);
+    putchar(',');
+    printPhaseStats(stdout);
+    printf("}\n");
+}
+
 /*
  * The real entry point.
  */
@@ -730,11 +850,15 @@ int realMain(int argc, char **argv)
     Binary *B = nullptr;
     Message msg;
     size_t lineno = 1;
-    while (getMessage(stdin, lineno, msg))
+    while (true)
     {
+        phaseSwitch(PHASE_PARSE);
+        if (!getMessage(stdin, lineno, msg))
+            break;
         B = parseMessage(B, msg);
         lineno = msg.lineno;
     }
+    phaseSwitch(PHASE_NONE);
     if (B == nullptr)
         exit(EXIT_SUCCESS);
 
@@ -779,64 +903,73 @@ int realMain(int argc, char **argv)
             mode_str = "Windows PE dynamic link library"; break;
     }
 
-    log(COLOR_NONE, '\n');
-    printf("-----------------------------------------------\n");
-    printf("mode                  = %s\n", mode_str);
-    printf("input_binary          = %s\n", B->filename);
-    printf("output_binary         = %s\n", B->output);
-    printf("num_patched           = %zu / %zu (%s%s%%)\n",
-        stat_num_patched, stat_num_total, (approx? "~": ""),
-        percent);
-    if (option_tactic_B0)
-        printf("num_patched_B0        = %s%zu / %zu (%.2f%%)%s\n",
-            (option_is_tty && stat_num_B0 > 0? "\33[31m": ""),
-            stat_num_B0, stat_num_total,
-            (double)stat_num_B0 / (double)stat_num_total * 100.0,
-            (option_is_tty && stat_num_B0 > 0? "\33[0m": "")),
-    printf("num_patched_B1        = %zu / %zu (%.2f%%)\n",
-        stat_num_B1, stat_num_total,
-        (double)stat_num_B1 / (double)stat_num_total * 100.0);
-    printf("num_patched_B2        = %zu / %zu (%.2f%%)\n",
-        stat_num_B2, stat_num_total,
-        (double)stat_num_B2 / (double)stat_num_total * 100.0);
-    if (option_OCFR)
-        printf("num_patched_T0        = %zu / %zu (%.2f%%)\n",
-            stat_num_T0, stat_num_total,
-            (double)stat_num_T0 / (double)stat_num_total * 100.0);
-    printf("num_patched_T1        = %zu / %zu (%.2f%%)\n",
-        stat_num_T1, stat_num_total,
-        (double)stat_num_T1 / (double)stat_num_total * 100.0);
-    printf("num_patched_T2        = %zu / %zu (%.2f%%)\n",
-        stat_num_T2, stat_num_total,
-        (double)stat_num_T2 / (double)stat_num_total * 100.0);
-    printf("num_patched_T3        = %zu / %zu (%.2f%%)\n",
-        stat_num_T3, stat_num_total,
-        (double)stat_num_T3 / (double)stat_num_total * 100.0);
-    printf("num_virtual_mappings  = %s%zu%s\n",
-        (option_is_tty &&
-            (ssize_t)stat_num_virtual_mappings >=
-                MAX_MAPPINGS - MAX_MAPPINGS_DELTA?
-            "\33[33m": ""),
-        stat_num_virtual_mappings,
-        (option_is_tty &&
-            (ssize_t)stat_num_virtual_mappings >=
-                MAX_MAPPINGS - MAX_MAPPINGS_DELTA?
-            "\33[0m": ""));
-    printf("num_physical_mappings = %zu (%.2f%%)\n",
-        stat_num_physical_mappings,
-        (double)stat_num_physical_mappings /
-            (double)stat_num_virtual_mappings * 100.0);
-    printf("num_virtual_bytes     = %zu\n", stat_num_virtual_bytes);
-    printf("num_physical_bytes    = %zu (%.2f%%)\n", stat_num_physical_bytes,
-        (double)stat_num_physical_bytes /
-            (double)stat_num_virtual_bytes * 100.0);
-    printf("input_file_size       = %zu\n", stat_input_file_size);
-    printf("output_file_size      = %zu (%.2f%%)\n",
-        stat_output_file_size,
-        (double)stat_output_file_size / (double)stat_input_file_size * 100.0);
-    printf("time_elapsed          = %zums\n", stat_time);
-    printf("memory_used           = %zuKB\n", stat_memory);
-    printf("-----------------------------------------------\n");
+    if (option_stats_json)
+        printStatsJSON(B, stat_num_total, stat_time, stat_memory);
+    else
+    {
+        log(COLOR_NONE, '\n');
+        printf("-----------------------------------------------\n");
+        printf("mode                  = %s\n", mode_str);
+        printf("input_binary          = %s\n", B->filename);
+        printf("output_binary         = %s\n", B->output);
+        printf("num_patched           = %zu / %zu (%s%s%%)\n",
+            stat_num_patched, stat_num_total, (approx? "~": ""),
+            percent);
+        if (option_tactic_B0)
+            printf("num_patched_B0        = %s%zu / %zu (%.2f%%)%s\n",
+                (option_is_tty && stat_num_B0 > 0? "\33[31m": ""),
+                stat_num_B0, stat_num_total,
+                (double)stat_num_B0 / (double)stat_num_total * 100.0,
+                (option_is_tty && stat_num_B0 > 0? "\33[0m": "")),
+        printf("num_patched_B1        = %zu / %zu (%.2f%%)\n",
+            stat_num_B1, stat_num_total,
+            (double)stat_num_B1 / (double)stat_num_total * 100.0);
+        printf("num_patched_B2        = %zu / %zu (%.2f%%)\n",
+            stat_num_B2, stat_num_total,
+            (double)stat_num_B2 / (double)stat_num_total * 100.0);
+        if (option_OCFR)
+            printf("num_patched_T0        = %zu / %zu (%.2f%%)\n",
+                stat_num_T0, stat_num_total,
+                (double)stat_num_T0 / (double)stat_num_total * 100.0);
+        printf("num_patched_T1        = %zu / %zu (%.2f%%)\n",
+            stat_num_T1, stat_num_total,
+            (double)stat_num_T1 / (double)stat_num_total * 100.0);
+        printf("num_patched_T2        = %zu / %zu (%.2f%%)\n",
+            stat_num_T2, stat_num_total,
+            (double)stat_num_T2 / (double)stat_num_total * 100.0);
+        printf("num_patched_T3        = %zu / %zu (%.2f%%)\n",
+            stat_num_T3, stat_num_total,
+            (double)stat_num_T3 / (double)stat_num_total * 100.0);
+        printTacticStats();
+        printCacheStats();
+        printf("num_virtual_mappings  = %s%zu%s\n",
+            (option_is_tty &&
+                (ssize_t)stat_num_virtual_mappings >=
+                    MAX_MAPPINGS - MAX_MAPPINGS_DELTA?
+                "\33[33m": ""),
+            stat_num_virtual_mappings,
+            (option_is_tty &&
+                (ssize_t)stat_num_virtual_mappings >=
+                    MAX_MAPPINGS - MAX_MAPPINGS_DELTA?
+                "\33[0m": ""));
+        printf("num_physical_mappings = %zu (%.2f%%)\n",
+            stat_num_physical_mappings,
+            (double)stat_num_physical_mappings /
+                (double)stat_num_virtual_mappings * 100.0);
+        printf("num_virtual_bytes     = %zu\n", stat_num_virtual_bytes);
+        printf("num_physical_bytes    = %zu (%.2f%%)\n",
+            stat_num_physical_bytes,
+            (double)stat_num_physical_bytes /
+                (double)stat_num_virtual_bytes * 100.0);
+        printf("input_file_size       = %zu\n", stat_input_file_size);
+        printf("output_file_size      = %zu (%.2f%%)\n",
+            stat_output_file_size,
+            (double)stat_output_file_size / (double)stat_input_file_size *
+                100.0);
+        printf("time_elapsed          = %zums\n", stat_time);
+        printf("memory_used           = %zuKB\n", stat_memory);
+        printf("-----------------------------------------------\n");
+    }
 
     if ((ssize_t)stat_num_virtual_mappings >= MAX_MAPPINGS - MAX_MAPPINGS_DELTA)
         warning("the number of virtual mappings (%zu) %s the default "
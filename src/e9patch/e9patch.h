@@ -31,6 +31,7 @@
 #include <deque>
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 
 #define NO_RETURN               __attribute__((__noreturn__))
@@ -597,8 +598,11 @@ inline uint8_t *Instr::getState() const
 extern bool option_is_tty;
 extern bool option_debug;
 extern bool option_batch;
+extern std::string option_cache;
+extern bool option_cache_validate;
 extern bool option_OCFR;
 extern bool option_OCFR_hacks;
+extern unsigned option_OCFR_threads;
 extern unsigned option_Oepilogue;
 extern unsigned option_Oepilogue_size;
 extern bool option_Oorder;
@@ -614,6 +618,7 @@ extern bool option_tactic_T1;
 extern bool option_tactic_T2;
 extern bool option_tactic_T3;
 extern bool option_tactic_backward_T3;
+extern bool option_tactic_adaptive;
 extern intptr_t option_loader_base;
 extern int option_loader_phdr;
 extern bool option_loader_static;
@@ -631,6 +636,8 @@ extern bool option_loader_phdr_set;
 extern bool option_loader_static_set;
 extern bool option_mem_rebase_set;
 extern bool option_log;
+extern bool option_stats;
+extern bool option_stats_json;
 extern int option_log_color;
 
 /*
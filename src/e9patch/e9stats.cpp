@@ -0,0 +1,163 @@
+/*
+ * e9stats.cpp
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-phase statistics for --stats=json.  Each phase accumulates the
+ * wall-clock time, CPU time (all threads), the number (and size) of
+ * operator new allocations, and the peak RSS.  Since the peak RSS is
+ * monotonic, each phase also records by how much it grew the peak, which
+ * attributes the final memory_used to the phase(s) responsible.
+ *
+ * Phases may be entered many times (e.g., parse/instruction alternate for
+ * each message), so phaseSwitch() only reads the (cheap) wall-clock on a
+ * change of phase, and the CPU time and RSS are sampled periodically (see
+ * phaseSample()).  Nothing is recorded unless --stats=json is enabled.
+ */
+
+#include <cstdint>
+
+#include "e9patch.h"
+#include "e9stats.h"
+#include "e9stats_common.h"
+
+/*
+ * Phase statistics.
+ */
+struct PhaseStats
+{
+    size_t calls;                       // Number of times entered
+    uint64_t wall;                      // Wall-clock time (ns)
+    uint64_t cpu;                       // CPU time (us)
+    size_t allocs;                      // Number of allocations
+    size_t alloc_bytes;                 // Number of allocated bytes
+    size_t rss;                         // Peak RSS at phase exit (KB)
+    size_t rss_growth;                  // Peak RSS growth (KB)
+};
+
+static PhaseStats phase_stats[PHASE_MAX];
+static Phase phase_curr = PHASE_NONE;
+static uint64_t phase_wall        = 0;
+static size_t phase_allocs        = 0;
+static size_t phase_alloc_bytes   = 0;
+
+/*
+ * Phase names.
+ */
+static const char *getPhaseName(Phase phase)
+{
+    switch (phase)
+    {
+        case PHASE_PARSE:       return "parse";
+        case PHASE_INSTRUCTION: return "instruction";
+        case PHASE_TACTICS:     return "tactics";
+        case PHASE_MAPPINGS:    return "mappings";
+        case PHASE_FLATTEN:     return "flatten";
+        case PHASE_OPTIMIZE:    return "optimize";
+        case PHASE_EMIT:        return "emit";
+        default:                return "???";
+    }
+}
+
+/*
+ * Sample the CPU time and peak RSS.  getrusage() is a real system call, so
+ * this is done at most once per PHASE_SAMPLE_WALL, and the CPU time is
+ * distributed over the phases in proportion to their wall-clock time
+ * during the sample window.
+ */
+#define PHASE_SAMPLE_WALL       1000000ull      // 1ms
+static uint64_t sample_wall = 0;
+static uint64_t sample_cpu  = 0;
+static size_t   sample_rss  = 0;
+static uint64_t window[PHASE_MAX];
+static void phaseSample(uint64_t wall, bool force)
+{
+    if (!force && wall - sample_wall < PHASE_SAMPLE_WALL)
+        return;
+    uint64_t cpu;
+    size_t rss;
+    if (!getUsage(cpu, rss))
+        return;
+    uint64_t total = 0;
+    for (unsigned i = 0; i < PHASE_MAX; i++)
+        total += window[i];
+    for (unsigned i = 0; total > 0 && i < PHASE_MAX; i++)
+    {
+        if (window[i] == 0)
+            continue;
+        phase_stats[i].cpu +=
+            (uint64_t)((double)(cpu - sample_cpu) *
+                ((double)window[i] / (double)total));
+        phase_stats[i].rss = rss;
+        window[i] = 0;
+    }
+    if (phase_curr != PHASE_NONE)
+        phase_stats[phase_curr].rss_growth += rss - sample_rss;
+    sample_wall = wall;
+    sample_cpu  = cpu;
+    sample_rss  = rss;
+}
+
+/*
+ * Switch to the given phase.
+ */
+void phaseSwitch(Phase phase)
+{
+    if (!option_stats_json || phase == phase_curr)
+        return;
+    uint64_t wall      = getWallTime();
+    size_t allocs      = stat_allocs.load(std::memory_order_relaxed);
+    size_t alloc_bytes = stat_alloc_bytes.load(std::memory_order_relaxed);
+    if (phase_curr != PHASE_NONE)
+    {
+        PhaseStats &stats = phase_stats[phase_curr];
+        stats.wall        += wall - phase_wall;
+        stats.allocs      += allocs - phase_allocs;
+        stats.alloc_bytes += alloc_bytes - phase_alloc_bytes;
+        window[phase_curr] += wall - phase_wall;
+    }
+    phaseSample(wall, (phase_curr == PHASE_NONE || phase == PHASE_NONE));
+    phase_curr        = phase;
+    phase_wall        = wall;
+    phase_allocs      = allocs;
+    phase_alloc_bytes = alloc_bytes;
+    if (phase != PHASE_NONE)
+        phase_stats[phase].calls++;
+}
+
+/*
+ * Print the phase statistics (as a JSON object member).
+ */
+void printPhaseStats(FILE *stream)
+{
+    phaseSwitch(PHASE_NONE);
+    fputs("\"phases\":{", stream);
+    bool prev = false;
+    for (unsigned i = PHASE_NONE+1; i < PHASE_MAX; i++)
+    {
+        const PhaseStats &stats = phase_stats[i];
+        fprintf(stream, "%s\"%s\":{\"calls\":%zu,\"wall_ms\":%.3f,"
+            "\"cpu_ms\":%.3f,\"allocs\":%zu,\"alloc_bytes\":%zu,"
+            "\"peak_rss_kb\":%zu,\"rss_growth_kb\":%zu}",
+            (prev? ",": ""), getPhaseName((Phase)i), stats.calls,
+            (double)stats.wall / 1000000.0, (double)stats.cpu / 1000.0,
+            stats.allocs, stats.alloc_bytes, stats.rss, stats.rss_growth);
+        prev = true;
+    }
+    fprintf(stream, "},\"allocs\":%zu,\"alloc_bytes\":%zu",
+        stat_allocs.load(), stat_alloc_bytes.load());
+}
@@ -0,0 +1,44 @@
+/*
+ * e9stats.h
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __E9STATS_H
+#define __E9STATS_H
+
+#include <cstdio>
+
+/*
+ * Rewriting phases (for --stats=json).
+ */
+enum Phase
+{
+    PHASE_NONE,
+    PHASE_PARSE,                        // JSON parsing + other messages
+    PHASE_INSTRUCTION,                  // "instruction" messages
+    PHASE_TACTICS,                      // "patch" messages + queue flush
+    PHASE_MAPPINGS,                     // buildMappings/optimizeMappings
+    PHASE_FLATTEN,                      // flattenAllTrampolines
+    PHASE_OPTIMIZE,                     // optimizeAllJumps
+    PHASE_EMIT,                         // emitElf/emitPE + output
+    PHASE_MAX
+};
+
+void phaseSwitch(Phase phase);
+void printPhaseStats(FILE *stream);
+void printJSONString(FILE *stream, const char *str);
+
+#endif
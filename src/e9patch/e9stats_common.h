@@ -0,0 +1,135 @@
+/*
+ * e9stats_common.h
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * --stats=json support shared by E9Patch and E9Tool.  This header defines
+ * the replacement operator new/delete, so it must be included by exactly
+ * one translation unit of each tool (e9stats.cpp), after the declaration of
+ * `option_stats_json'.
+ */
+
+#ifndef __E9STATS_COMMON_H
+#define __E9STATS_COMMON_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+#include <sys/resource.h>
+
+static std::atomic<size_t> stat_allocs(0);
+static std::atomic<size_t> stat_alloc_bytes(0);
+
+/*
+ * Allocation counting.
+ */
+static void *countAlloc(size_t size)
+{
+    if (option_stats_json)
+    {
+        stat_allocs.fetch_add(1, std::memory_order_relaxed);
+        stat_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    return malloc(size == 0? 1: size);
+}
+void *operator new(size_t size)
+{
+    void *ptr = countAlloc(size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+void *operator new[](size_t size)
+{
+    void *ptr = countAlloc(size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return countAlloc(size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return countAlloc(size);
+}
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+/*
+ * Get the wall-clock time (ns).
+ */
+static uint64_t getWallTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Get the CPU time (us, all threads) and peak RSS (KB).
+ */
+static bool getUsage(uint64_t &cpu, size_t &rss)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return false;
+    cpu = (uint64_t)usage.ru_utime.tv_sec * 1000000ull +
+          (uint64_t)usage.ru_utime.tv_usec +
+          (uint64_t)usage.ru_stime.tv_sec * 1000000ull +
+          (uint64_t)usage.ru_stime.tv_usec;
+    rss = (size_t)usage.ru_maxrss;
+    return true;
+}
+
+/*
+ * Print a JSON string.
+ */
+void printJSONString(FILE *stream, const char *str)
+{
+    putc('\"', stream);
+    for (; *str != '\0'; str++)
+    {
+        char c = *str;
+        switch (c)
+        {
+            case '\"': fputs("\\\"", stream); break;
+            case '\\': fputs("\\\\", stream); break;
+            case '\n': fputs("\\n", stream); break;
+            case '\t': fputs("\\t", stream); break;
+            default:
+                if ((uint8_t)c < ' ')
+                    fprintf(stream, "\\u%.4x", (unsigned)c);
+                else
+                    putc(c, stream);
+        }
+    }
+    putc('\"', stream);
+}
+
+#endif
@@ -21,10 +21,12 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <ctime>
 
 #include <sys/mman.h>
 
 #include "e9alloc.h"
+#include "e9cache.h"
 #include "e9optimize.h"
 #include "e9patch.h"
 #include "e9tactics.h"
@@ -57,9 +59,38 @@ enum Tactic
     TACTIC_T0,                          // Grouping.
     TACTIC_T1,                          // Prefixed punned jump.
     TACTIC_T2,                          // Successor eviction.
-    TACTIC_T3                           // Neighbour eviction.
+    TACTIC_T3,                          // Neighbour eviction.
+    TACTIC_MAX
 };
 
+/*
+ * Per-tactic statistics for each instruction class.  The class is the
+ * instruction size (1..4, or 5+) combined with whether the successor
+ * instruction is still free to be evicted.
+ */
+#define CLASS_MAX           (5 * 2)
+#define ADAPTIVE_MIN_TRIES  64          // Min. tries before skipping
+#define ADAPTIVE_MAX_TRIES  256         // Decay stats after this many tries
+#define ADAPTIVE_RATIO      64          // Hopeless if < 1/RATIO success
+#define ADAPTIVE_PROBE      8           // Still try every Nth hopeless
+struct TacticStat
+{
+    size_t tries;                       // Recent attempts (decayed)
+    size_t succs;                       // Recent successes (decayed)
+    size_t evals;                       // Total hopeless evaluations
+    size_t skips;                       // Total skipped attempts
+    size_t total_tries;                 // Total attempts
+    uint64_t time;                      // Total time (ns)
+};
+static TacticStat tactic_stats[CLASS_MAX][TACTIC_MAX];
+
+/*
+ * The cached decision currently being replayed (or nullptr).  During a
+ * replay, each trampoline allocation is pinned to the cached jump location
+ * and entry address.
+ */
+static const CacheEntry *replay = nullptr;
+
 /*
  * Representation of a patch.
  */
@@ -81,6 +112,7 @@ struct Patch
         }
     } original;
     Patch *next = nullptr;              // Next dependent patch.
+    intptr_t jump = INTPTR_MIN;         // Jump (or trap) address.
 
     Patch(Instr *I, Tactic t, const Alloc *A = nullptr) :
         A(A), I(I), tactic(t), original(I)
@@ -138,6 +170,8 @@ static void commit(Binary &B, Patch *P)
         case TACTIC_T3:
             stat_num_T3++;
             break;
+        default:
+            break;
     }
 
     if (P->tactic == TACTIC_B0)
@@ -182,6 +216,24 @@ static void undo(Binary &B, Patch *P)
 static Bounds makeBounds(Binary &B, const Trampoline *T, const Instr *I,
     const Instr *J, unsigned prefix, bool trap)
 {
+    // Step (0): If replaying a cached decision, only the cached jump
+    // location & entry address are allowed:
+    intptr_t pin = INTPTR_MIN;
+    if (replay != nullptr)
+    {
+        for (unsigned i = 0; i < replay->num_allocs; i++)
+        {
+            const CacheAlloc &A = replay->allocs[i];
+            if (A.owner == J->addr && A.jump == I->addr + (intptr_t)prefix)
+            {
+                pin = A.entry;
+                break;
+            }
+        }
+        if (pin == INTPTR_MIN)
+            return {INTPTR_MAX, INTPTR_MIN};
+    }
+
     // Step (1): Calculate the mask to protect overlapping instructions:
     assert(prefix < I->size || trap);
     size_t size = prefix + 1;
@@ -265,7 +317,14 @@ static Bounds makeBounds(Binary &B, const Trampoline *T, const Instr *I,
         default:
             break;
     }
- 
+
+    // Step (8): Apply the cached entry address (if any).
+    if (pin != INTPTR_MIN)
+    {
+        lo = std::max(lo, pin);
+        hi = std::min(hi, pin);
+    }
+
     return {lo, hi};
 }
 
@@ -339,6 +398,7 @@ static void patchJump(Patch *P, unsigned offset)
     assert(*state == STATE_INSTRUCTION || *state == STATE_FREE);
     *bytes++ = /*jmpq opcode=*/0xE9;
     *state++ = STATE_PATCHED;
+    P->jump = P->I->addr + offset;
     offset++;
 
     const uint8_t *rel32p8 = (uint8_t *)&rel32;
@@ -394,6 +454,7 @@ static void patchTrap(Patch *P)
     assert(*state == STATE_INSTRUCTION || *state == STATE_FREE);
     bytes[0] = 0x27;    // Invalid x86_64 opcode
     state[0] = STATE_PATCHED;
+    P->jump = P->I->addr;
 }
 
 /*
@@ -644,6 +705,7 @@ static Patch *tactic_T3b(Binary &B, Instr *I, const Trampoline *T)
     I->STATE[0] = STATE_PATCHED;
     I->PATCH[0] = /*short jmp opcode=*/0xEB;
     I->next()->STATE[0] |= STATE_LOCKED;
+    Q->jump = target;
     Q->next = P;
     return Q;
 }
@@ -791,6 +853,7 @@ static Patch *tactic_T3(Binary &B, Instr *I, const Trampoline *T)
     Patch *Q = new Patch(I, TACTIC_T3, A);
     patchShortJump(Q, addr);
     patchUnused(Q, /*sizeof(short jmp)=*/2);
+    Q->jump = addr;
     Q->next = P;
     return Q;
 }
@@ -876,6 +939,161 @@ static Patch *tactic_T0(Binary &B, Instr *I, const Trampoline *T,
     return Q;
 }
 
+/*
+ * Get the class of an instruction for the purpose of tactic statistics.
+ */
+static unsigned getTacticClass(const Instr *I)
+{
+    unsigned size = (I->size < JMP_SIZE? I->size: JMP_SIZE);
+    const Instr *J = I->succ();
+    bool free = (J != nullptr && canPatch(J) && !J->is_patched);
+    return (size - 1) * 2 + (free? 1: 0);
+}
+
+/*
+ * Returns true if the tactic is statistically hopeless for the class.
+ */
+static bool isHopeless(TacticStat &stat, Tactic tactic)
+{
+    switch (tactic)
+    {
+        case TACTIC_T1: case TACTIC_T2: case TACTIC_T3:
+            break;
+        default:
+            return false;           // Cheap or last resort
+    }
+    if (stat.tries < ADAPTIVE_MIN_TRIES ||
+            stat.succs * ADAPTIVE_RATIO >= stat.tries)
+        return false;
+    // Occasionally probe anyway, since the virtual address space changes
+    // as more instructions are patched:
+    stat.evals++;
+    return (stat.evals % ADAPTIVE_PROBE != 0);
+}
+
+/*
+ * Apply the given tactic.
+ */
+static Patch *dispatchTactic(Binary &B, Instr *I, const Trampoline *T,
+    Tactic tactic)
+{
+    switch (tactic)
+    {
+        case TACTIC_B0:
+            return tactic_B0(B, I, T);
+        case TACTIC_B1:
+            return tactic_B1(B, I, T);
+        case TACTIC_B2:
+            return tactic_B2(B, I, T);
+        case TACTIC_T0:
+            return tactic_T0(B, I, T);
+        case TACTIC_T1:
+            return tactic_T1(B, I, T);
+        case TACTIC_T2:
+            return tactic_T2(B, I, T);
+        case TACTIC_T3:
+            return tactic_T3(B, I, T);
+        default:
+            return nullptr;
+    }
+}
+
+/*
+ * Try to apply the given tactic, and record statistics.
+ */
+static Patch *applyTactic(Binary &B, Instr *I, const Trampoline *T,
+    Tactic tactic, unsigned cls)
+{
+    TacticStat &stat = tactic_stats[cls][tactic];
+    if (option_tactic_adaptive && isHopeless(stat, tactic))
+    {
+        stat.skips++;
+        return nullptr;
+    }
+
+    Patch *P = nullptr;
+    if (option_stats)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        P = dispatchTactic(B, I, T, tactic);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        stat.time += (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ull +
+            (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+    }
+    else
+        P = dispatchTactic(B, I, T, tactic);
+    stat.total_tries++;
+    stat.tries++;
+    stat.succs += (P != nullptr? 1: 0);
+    if (stat.tries >= ADAPTIVE_MAX_TRIES)
+    {
+        // Decay so that the statistics track recent behaviour:
+        stat.tries /= 2;
+        stat.succs /= 2;
+    }
+    return P;
+}
+
+/*
+ * Print the tactic statistics.
+ */
+void printTacticStats(void)
+{
+    if (!option_stats && !option_tactic_adaptive)
+        return;
+    for (unsigned t = 0; t < TACTIC_MAX; t++)
+    {
+        Tactic tactic = (Tactic)t;
+        if ((tactic == TACTIC_B0 && !option_tactic_B0) ||
+                (tactic == TACTIC_T0 && !option_OCFR))
+            continue;
+        uint64_t time = 0;
+        size_t tries = 0, skips = 0;
+        for (unsigned cls = 0; cls < CLASS_MAX; cls++)
+        {
+            time  += tactic_stats[cls][t].time;
+            tries += tactic_stats[cls][t].total_tries;
+            skips += tactic_stats[cls][t].skips;
+        }
+        if (option_stats)
+            printf("time_tactic_%s        = %.2fms (%zu tries",
+                getTacticName(tactic), (double)time / 1000000.0, tries);
+        else
+            printf("tries_tactic_%s       = %zu (untimed",
+                getTacticName(tactic), tries);
+        if (option_tactic_adaptive)
+            printf(", %zu skipped", skips);
+        printf(")\n");
+    }
+}
+
+/*
+ * Print the tactic statistics (as a JSON object member).
+ */
+void printTacticStatsJSON(FILE *stream)
+{
+    fputs("\"tactics\":{", stream);
+    bool prev = false;
+    for (unsigned t = 0; t < TACTIC_MAX; t++)
+    {
+        Tactic tactic = (Tactic)t;
+        uint64_t time = 0;
+        size_t tries = 0, skips = 0;
+        for (unsigned cls = 0; cls < CLASS_MAX; cls++)
+        {
+            time  += tactic_stats[cls][t].time;
+            tries += tactic_stats[cls][t].total_tries;
+            skips += tactic_stats[cls][t].skips;
+        }
+        fprintf(stream, "%s\"%s\":{\"time_ms\":%.3f,\"tries\":%zu,"
+            "\"skips\":%zu}", (prev? ",": ""), getTacticName(tactic),
+            (double)time / 1000000.0, tries, skips);
+        prev = true;
+    }
+    fputc('}', stream);
+}
+
 /*
  * Patch the instruction at the given offset.
  */
@@ -891,22 +1109,32 @@ bool patch(Binary &B, Instr *I, const Trampoline *T)
                 "in reverse order?)", I->addr, I->size, I->STATE[0]);
     }
 
-    // Try all patching tactics in order T0/B1/B2/T1/T2/T3:
+    // Try all patching tactics in order T0/B1/B2/T1/T2/T3/B0.  With
+    // --tactic-adaptive, hopeless tactics (for this class of instruction)
+    // are skipped.  The order itself is never changed, since earlier
+    // tactics always give cheaper patches.
+    static const Tactic order[] =
+    {
+        TACTIC_T0, TACTIC_B1, TACTIC_B2, TACTIC_T1, TACTIC_T2, TACTIC_T3,
+        TACTIC_B0
+    };
+    unsigned cls = getTacticClass(I);
     Patch *P = nullptr;
-    if (P == nullptr)
-        P = tactic_T0(B, I, T);
-    if (P == nullptr)
-        P = tactic_B1(B, I, T);
-    if (P == nullptr)
-        P = tactic_B2(B, I, T);
-    if (P == nullptr)
-        P = tactic_T1(B, I, T);
-    if (P == nullptr)
-        P = tactic_T2(B, I, T);
-    if (P == nullptr)
-        P = tactic_T3(B, I, T);
-    if (P == nullptr)
-        P = tactic_B0(B, I, T);
+
+    // With --cache, first try to replay the cached decision (if any):
+    const CacheEntry *hint = cacheLookup(&B, I, T);
+    bool replayed = false;
+    if (hint != nullptr && !option_cache_validate && hint->tactic < TACTIC_MAX)
+    {
+        replay   = hint;
+        P        = dispatchTactic(B, I, T, (Tactic)hint->tactic);
+        replay   = nullptr;
+        replayed = (P != nullptr);
+    }
+
+    for (unsigned i = 0; P == nullptr && i < sizeof(order) / sizeof(order[0]);
+            i++)
+        P = applyTactic(B, I, T, order[i], cls);
 
     if (P == nullptr)
     {
@@ -916,6 +1144,20 @@ bool patch(Binary &B, Instr *I, const Trampoline *T)
         return false;       // Failed :(
     }
 
+    if (!option_cache.empty())
+    {
+        static CacheAllocSet allocs;
+        allocs.clear();
+        for (const Patch *Q = P; Q != nullptr; Q = Q->next)
+        {
+            if (Q->A == nullptr)
+                continue;
+            intptr_t entry = Q->A->lb + (intptr_t)Q->A->entry;
+            allocs.push_back({Q->A->I->addr, Q->jump, entry});
+        }
+        cacheRecord(&B, I, T, P->tactic, allocs, hint, replayed);
+    }
+
     bool uses_B0 = (P->tactic == TACTIC_B0);
     const char *name = getTacticName(P->tactic);
     commit(B, P);
@@ -22,5 +22,7 @@
 #include "e9patch.h"
 
 bool patch(Binary &B, Instr *I, const Trampoline *T);
+void printTacticStats(void);
+void printTacticStatsJSON(FILE *stream);
 
 #endif
@@ -34,6 +34,7 @@
 #include "e9parser.h"
 #include "e9plugin.h"
 #include "e9tool.h"
+#include "e9trace.h"
 #include "e9x86_64.h"
 
 using namespace e9tool;
@@ -1250,6 +1251,14 @@ const Patch *parsePatch(const ELF &elf, const char *str)
             kind = PATCH_PLUGIN; break;
         case TOKEN_TRAP:
             kind = PATCH_TRAP; break;
+        case TOKEN_TRACE:
+            // `trace(...)@file' is a call to a function named `trace':
+            if (strchr(parser.buf + parser.pos, '@') != nullptr)
+            {
+                symbol = parseFunctionName(parser);
+                kind = PATCH_CALL; break;
+            }
+            kind = PATCH_TRACE; break;
         case TOKEN_IF:
             conditional = true;
             parser.getToken();
@@ -1264,8 +1273,10 @@ const Patch *parsePatch(const ELF &elf, const char *str)
     Plugin *plugin = nullptr;
     CallABI abi = ABI_CLEAN;
     CallJump jmp = JUMP_NONE;
+    CallSave save = SAVE_AUTO;
     std::vector<Argument> args;
-    int status = 0, signal = 0;
+    int status = 0, signal = 0, trace = 0;
+    uint32_t sample = 0, period = 0;
     int t = 0;
     switch (kind)
     {
@@ -1289,6 +1300,32 @@ const Patch *parsePatch(const ELF &elf, const char *str)
             parser.expectToken(')');
             break;
 
+        case PATCH_TRACE:
+            if (parser.peekToken() != '(')
+                break;
+            parser.getToken();
+            while (true)
+            {
+                switch (parser.getToken())
+                {
+                    case TOKEN_MEM:
+                        trace |= TRACE_FLAG_MEM;
+                        break;
+                    case TOKEN_NAME:
+                        if (strcmp(parser.s, "time") == 0)
+                        {
+                            trace |= TRACE_FLAG_TIME;
+                            break;
+                        }
+                        // Fallthrough:
+                    default:
+                        parser.unexpectedToken();
+                }
+                if (parser.expectToken2(',', ')') == ')')
+                    break;
+            }
+            break;
+
         case PATCH_PLUGIN:
             parser.expectToken('(');
             parser.expectToken2(TOKEN_STRING, TOKEN_NAME);
@@ -1306,9 +1343,44 @@ const Patch *parsePatch(const ELF &elf, const char *str)
             t = parser.expectToken2('(', '<');
             if (t == '<')
             {
-                t = parser.expectToken2(TOKEN_CLEAN, TOKEN_NAKED);
-                abi = (t == TOKEN_CLEAN? ABI_CLEAN: ABI_NAKED);
-                parser.expectToken('>');
+                while (true)
+                {
+                    switch (parser.getToken())
+                    {
+                        case TOKEN_CLEAN:
+                            abi = ABI_CLEAN; break;
+                        case TOKEN_NAKED:
+                            abi = ABI_NAKED; break;
+                        case TOKEN_GPR:
+                            save = SAVE_GPR; break;
+                        case TOKEN_SSE:
+                            save = SAVE_SSE; break;
+                        case TOKEN_XSAVE:
+                            save = SAVE_XSAVE; break;
+                        case TOKEN_NAME:
+                        {
+                            bool is_sample = (strcmp(parser.s, "sample") == 0);
+                            if (!is_sample && strcmp(parser.s, "period") != 0)
+                                parser.unexpectedToken();
+                            parser.expectToken('=');
+                            parser.expectToken(TOKEN_INTEGER);
+                            if (parser.i <= 0 || parser.i > INT32_MAX)
+                                error("failed to parse call trampoline; the "
+                                    "%s must be an integer within the range "
+                                    "1..%d", (is_sample? "sample": "period"),
+                                    INT32_MAX);
+                            if (is_sample)
+                                sample = (uint32_t)parser.i;
+                            else
+                                period = (uint32_t)parser.i;
+                            break;
+                        }
+                        default:
+                            parser.unexpectedToken();
+                    }
+                    if (parser.expectToken2(',', '>') == '>')
+                        break;
+                }
                 parser.expectToken('(');
             }
             while (true)
@@ -1336,6 +1408,9 @@ const Patch *parsePatch(const ELF &elf, const char *str)
                 if (t != ',')
                     parser.unexpectedToken();
             }
+            if (sample != 0 && period != 0)
+                error("failed to parse call trampoline; only one of the "
+                    "`sample' or `period' options can be specified");
             parser.expectToken('@');
             parser.getBlob();
             filename = strDup(parser.s);
@@ -1373,7 +1448,7 @@ const Patch *parsePatch(const ELF &elf, const char *str)
             name += "$call_";
             name += std::to_string(id++);
             return new Patch(strDup(name.c_str()), PATCH_CALL, pos, filename,
-                symbol, abi, jmp, std::move(args));
+                symbol, abi, jmp, save, std::move(args), sample, period);
         case PATCH_EXIT:
             name += "$exit_";
             name += std::to_string(status);
@@ -1382,6 +1457,13 @@ const Patch *parsePatch(const ELF &elf, const char *str)
             name += "$signal_";
             name += std::to_string(signal);
             return new Patch(strDup(name.c_str()), PATCH_SIGNAL, pos, signal);
+        case PATCH_TRACE:
+            name += "$trace";
+            if ((trace & TRACE_FLAG_TIME) != 0)
+                name += "_time";
+            if ((trace & TRACE_FLAG_MEM) != 0)
+                name += "_mem";
+            return new Patch(strDup(name.c_str()), PATCH_TRACE, pos, trace);
         case PATCH_PLUGIN:
             name += "$plugin_";
             name += std::to_string(id++);
@@ -2047,7 +2129,7 @@ static MatchVal makeMatchValue(const MatchVar *var, const ELF *elf,
             break;
         case MATCH_FILENAME: case MATCH_ABSNAME: case MATCH_BASENAME:
         case MATCH_DIRNAME: case MATCH_LINE: case MATCH_LINE_ENTRY:
-            line = findLine(elf->lines, I->address);
+            line = findInstrLine(elf->lines, idx);
             if (line == nullptr)
                 goto undefined;
             break;
@@ -2387,6 +2469,80 @@ static MatchVal matchCastToBool(MatchVal val)
     }
 }
 
+/*
+ * Compare two (defined) values.
+ */
+static bool matchCompare(MatchOp op, const MatchVal &lhs, const MatchVal &rhs)
+{
+    switch (op)
+    {
+        case MATCH_OP_EQ:
+            return (lhs == rhs);
+        case MATCH_OP_NEQ:
+            return (lhs != rhs);
+        case MATCH_OP_LT:
+            return (lhs < rhs);
+        case MATCH_OP_LEQ:
+            return (lhs <= rhs);
+        case MATCH_OP_GT:
+            return (lhs > rhs);
+        case MATCH_OP_GEQ:
+            return (lhs >= rhs);
+        case MATCH_OP_IN:
+            if (rhs.type != MATCH_TYPE_SET)
+                return false;
+            else if (lhs.type != MATCH_TYPE_SET)
+                return isMember(&lhs, &rhs);
+            else
+                return isSubset(&lhs, &rhs);
+        default:
+            return false;
+    }
+}
+
+/*
+ * Test if a comparison is a function name predicate, i.e., of the form
+ * (f.name OP VALUE) for a constant VALUE (string, regex or set).
+ */
+static bool isFNamePredicate(const MatchExpr *expr)
+{
+    const MatchExpr *lhs = expr->lhs, *rhs = expr->rhs;
+    if (lhs->op != MATCH_OP_ARG || lhs->arg.inst != MATCH_INST_VAR ||
+            rhs->op != MATCH_OP_ARG || rhs->arg.inst != MATCH_INST_VAL)
+        return false;
+    const MatchVar *var = lhs->arg.var;
+    return (var->match == MATCH_F_NAME && var->set == MATCH_Is &&
+        var->i == 0 && var->field == MATCH_FIELD_NONE &&
+        rhs->arg.val->type != MATCH_TYPE_UNDEFINED);
+}
+
+/*
+ * Evaluate a function name predicate.  The predicate is evaluated once for
+ * every function and cached as one bit per function, so the (string or
+ * regex) comparison is not repeated for every instruction.
+ */
+static bool matchFNamePredicate(const MatchExpr *expr, const ELF &elf,
+    size_t idx)
+{
+    const F *f = findF(elf.fs, idx);
+    if (f == nullptr || f->name == nullptr)
+        return false;
+    auto i = expr->fbits.find(&elf);
+    if (i == expr->fbits.end())
+    {
+        const MatchVal &rhs = *expr->rhs->arg.val;
+        std::vector<bool> fbits(elf.fs.size());
+        for (size_t j = 0; j < elf.fs.size(); j++)
+        {
+            const char *name = elf.fs[j].name;
+            fbits[j] = (name != nullptr &&
+                matchCompare(expr->op, MatchVal(name), rhs));
+        }
+        i = expr->fbits.emplace(&elf, std::move(fbits)).first;
+    }
+    return i->second[f - elf.fs.data()];
+}
+
 /*
  * Evaluate a matching.
  */
@@ -2459,6 +2615,11 @@ static MatchVal matchDoEval(const MatchExpr *expr, const ELF &elf,
         {
             res.type = MATCH_TYPE_INTEGER;
             res.i    = false;
+            if (!option_debug && isFNamePredicate(expr))
+            {
+                res.i = matchFNamePredicate(expr, elf, idx);
+                break;
+            }
             lhs = matchDoEval(expr->lhs, elf, Is, idx, I, scratch);
             if (lhs.type == MATCH_TYPE_UNDEFINED)
                 break;
@@ -2466,33 +2627,7 @@ static MatchVal matchDoEval(const MatchExpr *expr, const ELF &elf,
             rhs = matchDoEval(expr->rhs, elf, Is, idx, I, rscratch);
             if (rhs.type == MATCH_TYPE_UNDEFINED)
                 break;
-            switch (expr->op)
-            {
-                case MATCH_OP_EQ:
-                    res.i = (lhs == rhs); break;
-                case MATCH_OP_NEQ:
-                    res.i = (lhs != rhs); break;
-                case MATCH_OP_LT:
-                    res.i = (lhs < rhs); break;
-                case MATCH_OP_LEQ:
-                    res.i = (lhs <= rhs); break;
-                case MATCH_OP_GT:
-                    res.i = (lhs > rhs); break;
-                case MATCH_OP_GEQ:
-                    res.i = (lhs >= rhs); break;
-                case MATCH_OP_IN:
-                {
-                    if (rhs.type != MATCH_TYPE_SET)
-                        res.i = false;
-                    else if (lhs.type != MATCH_TYPE_SET)
-                        res.i = isMember(&lhs, &rhs);
-                    else
-                        res.i = isSubset(&lhs, &rhs);
-                    break;
-                }
-                default:
-                    break;
-            }
+            res.i = matchCompare(expr->op, lhs, rhs);
             break;
         }
         case MATCH_OP_ADD: case MATCH_OP_SUB:
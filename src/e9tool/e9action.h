@@ -367,6 +367,8 @@ struct MatchExpr
         const MatchArg arg;
     };
     const MatchExpr *rhs;
+    mutable std::map<const e9tool::ELF *, std::vector<bool>> fbits;
+                                        // Per-function predicate cache.
 
     MatchExpr(MatchOp op, const MatchExpr *expr) :
         op(op), lhs(expr), rhs(nullptr)
@@ -399,6 +401,7 @@ enum PatchKind
     PATCH_SIGNAL,
     PATCH_CALL,
     PATCH_PLUGIN,
+    PATCH_TRACE,
 };
 
 /*
@@ -414,12 +417,19 @@ struct Patch
     {
         int status = 0;
         int signal;
+        int trace;
     };
     const char * const filename = nullptr;
     const char * const entry = nullptr;
     const e9tool::CallABI abi = e9tool::ABI_CLEAN;
     const e9tool::CallJump jmp = e9tool::JUMP_NONE;
+    const e9tool::CallSave save = e9tool::SAVE_AUTO;
     const std::vector<e9tool::Argument> args;
+    const uint32_t sample = 0;          // Sample every Nth hit (0=all)
+    const uint32_t period = 0;          // Sample every N cycles (0=all)
+    mutable intptr_t counters = 0;      // Per-site sample counters
+    mutable size_t num_sites = 0;       // # sampled sites
+    mutable size_t site = 0;            // Next site's counter index
     mutable const e9tool::Call *call = nullptr;
     Plugin * const plugin = nullptr;
 
@@ -433,15 +443,18 @@ struct Patch
     Patch(const char *name, PatchKind kind, e9tool::PatchPos pos, int status) :
         name(name), kind(kind), pos(pos), status(status)
     {
-        assert(kind == PATCH_EXIT || kind == PATCH_SIGNAL);
+        assert(kind == PATCH_EXIT || kind == PATCH_SIGNAL ||
+            kind == PATCH_TRACE);
     }
 
     Patch(const char *name, PatchKind kind, e9tool::PatchPos pos,
             const char *filename, const char *entry,
-            e9tool::CallABI abi, e9tool::CallJump jmp,
-            const std::vector<e9tool::Argument> &args) :
+            e9tool::CallABI abi, e9tool::CallJump jmp, e9tool::CallSave save,
+            const std::vector<e9tool::Argument> &args, uint32_t sample = 0,
+            uint32_t period = 0) :
         name(name), kind(kind), pos(pos),
-        filename(filename), entry(entry), abi(abi), jmp(jmp), args(args)
+        filename(filename), entry(entry), abi(abi), jmp(jmp), save(save),
+        args(args), sample(sample), period(period)
     {
         assert(kind == PATCH_CALL);
     }
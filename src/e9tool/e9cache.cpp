@@ -0,0 +1,468 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * ANALYSIS CACHE.
+ *
+ * The analysis cache stores the disassembly (Instr array), jump targets,
+ * basic blocks, functions and line information for an input binary.  The
+ * cache file is keyed by a hash of the binary contents and the options that
+ * affect disassembly, and is mmap'ed read-only by later runs.  The file
+ * consists of a header followed by fixed-size records for each component,
+ * and finally a string table.  Strings that point into the input binary
+ * (e.g., symbol names) are stored as file offsets rather than copied.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "e9cache.h"
+#include "e9elf.h"
+#include "e9misc.h"
+#include "e9tool.h"
+
+using namespace e9tool;
+
+static_assert(sizeof(BB) == 3 * sizeof(uint32_t), "unexpected BB layout");
+
+#define CACHE_MAGIC         "E9TCACHE"
+#define CACHE_FORMAT        3
+
+#define FNV_PRIME           0x100000001b3ull
+
+#define STR_NONE            UINT32_MAX  // nullptr
+#define STR_ELF             0x80000000  // Offset into the ELF file
+
+/*
+ * Cache file header.
+ */
+struct CacheHeader
+{
+    char magic[8];                      // CACHE_MAGIC
+    uint32_t format;                    // CACHE_FORMAT
+    uint32_t mask;                      // Cached components
+    char version[16];                   // E9Tool version
+    uint64_t key;                       // Cache key
+    uint64_t num_instrs;                // # Instrs
+    uint64_t num_desyncs;               // # Desyncs
+    uint64_t num_targets;               // # Target kinds
+    uint64_t num_bbs;                   // # BBs
+    uint64_t num_fs;                    // # Fs
+    uint64_t num_lines;                 // # Lines
+    uint64_t num_line_index;            // # Line index entries
+    uint64_t strs_size;                 // String table size
+};
+
+/*
+ * Cache file records.
+ */
+/*
+ * Note: Instr, TargetKind, BB and line index records are stored using their
+ *       in-memory layout.
+ */
+struct CacheDesync
+{
+    int64_t lo;
+    int64_t hi;
+    int64_t addr;
+    uint32_t section;                   // String
+    uint32_t byte;
+};
+struct CacheF
+{
+    uint32_t name;                      // String
+    uint32_t lb;
+    uint32_t ub;
+    uint32_t best;
+};
+struct CacheLine
+{
+    int64_t lb;
+    int64_t ub;
+    uint32_t dir;                       // String
+    uint32_t file;                      // String
+    uint32_t line;
+    uint32_t pad;
+};
+
+/*
+ * Round up to a multiple of 8 bytes.
+ */
+static size_t align8(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+/*
+ * FNV-1a hash.
+ */
+uint64_t cacheHash(uint64_t h, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        h ^= (uint64_t)bytes[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+/*
+ * Hash the contents of a file.
+ */
+uint64_t cacheHashFile(uint64_t h, const char *filename)
+{
+    FILE *stream = fopen(filename, "r");
+    if (stream == nullptr)
+        error("failed to open file \"%s\" for reading: %s", filename,
+            strerror(errno));
+    char buf[BUFSIZ];
+    size_t size;
+    while ((size = fread(buf, sizeof(char), sizeof(buf), stream)) > 0)
+        h = cacheHash(h, buf, size);
+    fclose(stream);
+    return h;
+}
+
+/*
+ * Get the cache filename.
+ */
+static std::string getCacheFilename(const char *dir, uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%.16lx.e9tcache", key);
+    std::string filename(dir);
+    filename += '/';
+    filename += name;
+    return filename;
+}
+
+/*
+ * String table builder.
+ */
+struct StrTab
+{
+    const ELF &elf;
+    std::string strs;
+    std::map<const char *, uint32_t, CStrCmp> index;
+
+    StrTab(const ELF &elf) : elf(elf)
+    {
+        ;
+    }
+
+    uint32_t add(const char *str)
+    {
+        if (str == nullptr)
+            return STR_NONE;
+        const uint8_t *ptr = (const uint8_t *)str;
+        if (ptr >= elf.data && ptr < elf.data + elf.size &&
+                (size_t)(ptr - elf.data) < STR_ELF)
+            return STR_ELF | (uint32_t)(ptr - elf.data);
+        auto i = index.find(str);
+        if (i != index.end())
+            return i->second;
+        uint32_t offset = (uint32_t)strs.size();
+        strs += str;
+        strs += '\0';
+        index.insert({str, offset});
+        return offset;
+    }
+};
+
+/*
+ * Convert an offset back into a string.
+ */
+static const char *getStr(const ELF &elf, const char *strs, size_t strs_size,
+    uint32_t offset)
+{
+    if (offset == STR_NONE)
+        return nullptr;
+    if ((offset & STR_ELF) != 0)
+    {
+        offset &= ~STR_ELF;
+        return (offset < elf.size? (const char *)elf.data + offset: nullptr);
+    }
+    return (offset < strs_size? strs + offset: nullptr);
+}
+
+/*
+ * Load the analysis cache.  Returns the mask of loaded components.
+ */
+unsigned loadCache(const char *dir, uint64_t key, ELF &elf,
+    std::vector<Instr> &Is, std::vector<Desync> &desyncs)
+{
+    std::string filename = getCacheFilename(dir, key);
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+            warning("failed to open cache file \"%s\" for reading: %s",
+                filename.c_str(), strerror(errno));
+        return 0x0;
+    }
+    struct stat buf;
+    if (fstat(fd, &buf) != 0)
+    {
+        close(fd);
+        return 0x0;
+    }
+    size_t size = (size_t)buf.st_size;
+    if (size < sizeof(CacheHeader))
+    {
+        close(fd);
+        goto invalid;
+    }
+
+    {
+        // Note: the mapping is never unmapped, since function names and line
+        //       information point directly into it.
+        const uint8_t *data = (const uint8_t *)mmap(nullptr, size, PROT_READ,
+            MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+        {
+            warning("failed to map cache file \"%s\": %s", filename.c_str(),
+                strerror(errno));
+            return 0x0;
+        }
+
+        const CacheHeader *hdr = (const CacheHeader *)data;
+        if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+                hdr->format != CACHE_FORMAT ||
+                strncmp(hdr->version, STRING(VERSION),
+                    sizeof(hdr->version)) != 0 ||
+                hdr->key != key ||
+                (hdr->mask & CACHE_DISASM) == 0 ||
+                hdr->num_instrs > size || hdr->num_desyncs > size ||
+                hdr->num_targets > size || hdr->num_bbs > size ||
+                hdr->num_fs > size || hdr->num_lines > size ||
+                hdr->num_line_index > size ||
+                hdr->strs_size > size)
+        {
+            munmap((void *)data, size);
+            goto invalid;
+        }
+        size_t offset = sizeof(CacheHeader);
+        const Instr *instrs = (const Instr *)(data + offset);
+        offset += align8(hdr->num_instrs * sizeof(Instr));
+        const CacheDesync *ds = (const CacheDesync *)(data + offset);
+        offset += align8(hdr->num_desyncs * sizeof(CacheDesync));
+        const TargetKind *ts = (const TargetKind *)(data + offset);
+        offset += align8(hdr->num_targets * sizeof(TargetKind));
+        const uint8_t *bbs = data + offset;
+        offset += align8(hdr->num_bbs * sizeof(BB));
+        const CacheF *fs = (const CacheF *)(data + offset);
+        offset += align8(hdr->num_fs * sizeof(CacheF));
+        const CacheLine *ls = (const CacheLine *)(data + offset);
+        offset += align8(hdr->num_lines * sizeof(CacheLine));
+        const uint32_t *lx = (const uint32_t *)(data + offset);
+        offset += align8(hdr->num_line_index * sizeof(uint32_t));
+        const char *strs = (const char *)(data + offset);
+        offset += hdr->strs_size;
+        if (offset != size ||
+                (hdr->strs_size > 0 && strs[hdr->strs_size-1] != '\0'))
+        {
+            munmap((void *)data, size);
+            goto invalid;
+        }
+        size_t strs_size = hdr->strs_size;
+
+        // Validate the records in place before loading anything, so that a
+        // corrupt cache is rebuilt rather than partially loaded:
+        const BB *bs = (const BB *)bbs;
+        size_t num_instrs = hdr->num_instrs;
+        bool ok = (hdr->num_targets <= num_instrs &&
+            hdr->num_lines <= UINT32_MAX &&
+            hdr->num_line_index <= num_instrs);
+        for (size_t i = 0; ok && i < num_instrs; i++)
+            ok = (instrs[i].size > 0 &&
+                instrs[i].offset + instrs[i].size <= elf.size);
+        for (size_t i = 0; ok && i < hdr->num_bbs; i++)
+            ok = (bs[i].lb < num_instrs && bs[i].ub < num_instrs &&
+                bs[i].best < num_instrs);
+        for (size_t i = 0; ok && i < hdr->num_fs; i++)
+            ok = (fs[i].lb < num_instrs && fs[i].ub < num_instrs &&
+                fs[i].best < num_instrs &&
+                (fs[i].name == STR_NONE ||
+                    getStr(elf, strs, strs_size, fs[i].name) != nullptr));
+        for (size_t i = 0; ok && i < hdr->num_lines; i++)
+            ok = (getStr(elf, strs, strs_size, ls[i].file) != nullptr &&
+                (ls[i].dir == STR_NONE ||
+                    getStr(elf, strs, strs_size, ls[i].dir) != nullptr));
+        for (size_t i = 0; ok && i < hdr->num_line_index; i++)
+            ok = (lx[i] <= hdr->num_lines);
+        if (!ok)
+        {
+            munmap((void *)data, size);
+            goto invalid;
+        }
+
+        // Disassembly:
+        Is.assign(instrs, instrs + num_instrs);
+        for (auto &I: Is)
+        {
+            I.matching = 0;
+            I.patch    = 0;
+            I.emit     = 0;
+        }
+        for (size_t i = 0; i < hdr->num_desyncs; i++)
+        {
+            const char *section = getStr(elf, strs, strs_size, ds[i].section);
+            desyncs.push_back({(intptr_t)ds[i].lo, (intptr_t)ds[i].hi,
+                (intptr_t)ds[i].addr, (section == nullptr? "???": section),
+                (uint8_t)ds[i].byte});
+        }
+
+        // Analysis (entries are already sorted).  Targets, BBs and the line
+        // index share their in-memory layout, so are copied in bulk:
+        elf.targets.kinds.assign(ts, ts + hdr->num_targets);
+        elf.targets.count = (size_t)(hdr->num_targets -
+            std::count(ts, ts + hdr->num_targets, (TargetKind)0));
+        elf.bbs = BBs(bs, bs + hdr->num_bbs);
+        elf.fs.reserve(hdr->num_fs);
+        for (size_t i = 0; i < hdr->num_fs; i++)
+            elf.fs.emplace_back(getStr(elf, strs, strs_size, fs[i].name),
+                fs[i].lb, fs[i].ub, fs[i].best);
+        elf.lines.lines.reserve(hdr->num_lines);
+        for (size_t i = 0; i < hdr->num_lines; i++)
+            elf.lines.lines.emplace_back((intptr_t)ls[i].lb,
+                (intptr_t)ls[i].ub, getStr(elf, strs, strs_size, ls[i].dir),
+                getStr(elf, strs, strs_size, ls[i].file),
+                (unsigned)ls[i].line);
+        elf.lines.index.assign(lx, lx + hdr->num_line_index);
+        debug("loaded analysis cache \"%s\" (instrs=%zu, targets=%zu, "
+            "bbs=%zu, funcs=%zu, lines=%zu)", filename.c_str(), Is.size(),
+            elf.targets.size(), elf.bbs.size(), elf.fs.size(),
+            elf.lines.size());
+        return hdr->mask;
+    }
+
+invalid:
+    warning("ignoring invalid or stale cache file \"%s\"", filename.c_str());
+    return 0x0;
+}
+
+/*
+ * Save the analysis cache.
+ */
+void saveCache(const char *dir, uint64_t key, unsigned mask, const ELF &elf,
+    const std::vector<Instr> &Is, const std::vector<Desync> &desyncs)
+{
+    StrTab strtab(elf);
+    std::vector<CacheDesync> ds;
+    for (const auto &entry: desyncs)
+        ds.push_back({(int64_t)entry.lo, (int64_t)entry.hi,
+            (int64_t)entry.addr, strtab.add(entry.section),
+            (uint32_t)entry.byte});
+    static const std::vector<TargetKind> no_targets;
+    const std::vector<TargetKind> &ts =
+        ((mask & CACHE_TARGETS) != 0? elf.targets.kinds: no_targets);
+    static const BBs no_bbs;
+    const BBs &bs = ((mask & CACHE_BBS) != 0? elf.bbs: no_bbs);
+    std::vector<CacheF> fs;
+    if ((mask & CACHE_FS) != 0)
+    {
+        for (const auto &f: elf.fs)
+            fs.push_back({strtab.add(f.name), f.lb, f.ub, f.best});
+    }
+    std::vector<CacheLine> ls;
+    static const std::vector<uint32_t> no_index;
+    const std::vector<uint32_t> &lx =
+        ((mask & CACHE_LINES) != 0? elf.lines.index: no_index);
+    if ((mask & CACHE_LINES) != 0)
+    {
+        for (const auto &line: elf.lines.lines)
+            ls.push_back({(int64_t)line.lb, (int64_t)line.ub,
+                strtab.add(line.dir), strtab.add(line.file), line.line, 0});
+    }
+
+    CacheHeader hdr;
+    memset(&hdr, 0x0, sizeof(hdr));
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.format = CACHE_FORMAT;
+    hdr.mask   = mask | CACHE_DISASM;
+    strncpy(hdr.version, STRING(VERSION), sizeof(hdr.version)-1);
+    hdr.key         = key;
+    hdr.num_instrs  = Is.size();
+    hdr.num_desyncs = ds.size();
+    hdr.num_targets = ts.size();
+    hdr.num_bbs     = bs.size();
+    hdr.num_fs      = fs.size();
+    hdr.num_lines   = ls.size();
+    hdr.num_line_index = lx.size();
+    hdr.strs_size   = strtab.strs.size();
+
+    // Write to a temporary file first, so that concurrent or interrupted
+    // runs never see a partial cache:
+    std::string filename = getCacheFilename(dir, key);
+    std::string tmp(filename);
+    tmp += ".tmp.";
+    tmp += std::to_string((int)getpid());
+    FILE *stream = fopen(tmp.c_str(), "w");
+    if (stream == nullptr)
+    {
+        warning("failed to open cache file \"%s\" for writing: %s",
+            tmp.c_str(), strerror(errno));
+        return;
+    }
+    const uint64_t zero = 0;
+    auto write = [stream, &zero](const void *data, size_t size) -> bool
+    {
+        if (size > 0 && fwrite(data, sizeof(uint8_t), size, stream) != size)
+            return false;
+        size_t pad = align8(size) - size;
+        return (pad == 0 || fwrite(&zero, sizeof(uint8_t), pad, stream) == pad);
+    };
+    bool ok = write(&hdr, sizeof(hdr));
+    ok = ok && write(Is.data(), Is.size() * sizeof(Instr));
+    ok = ok && write(ds.data(), ds.size() * sizeof(CacheDesync));
+    ok = ok && write(ts.data(), ts.size() * sizeof(TargetKind));
+    ok = ok && write(bs.data(), bs.size() * sizeof(BB));
+    ok = ok && write(fs.data(), fs.size() * sizeof(CacheF));
+    ok = ok && write(ls.data(), ls.size() * sizeof(CacheLine));
+    ok = ok && write(lx.data(), lx.size() * sizeof(uint32_t));
+    ok = ok && (strtab.strs.size() == 0 ||
+        fwrite(strtab.strs.data(), sizeof(char), strtab.strs.size(), stream) ==
+            strtab.strs.size());
+    ok = (fclose(stream) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), filename.c_str()) < 0)
+    {
+        warning("failed to write cache file \"%s\": %s", filename.c_str(),
+            strerror(errno));
+        unlink(tmp.c_str());
+        return;
+    }
+    debug("saved analysis cache \"%s\"", filename.c_str());
+}
@@ -0,0 +1,65 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __E9CACHE_H
+#define __E9CACHE_H
+
+#include <cstdint>
+
+#include <vector>
+
+#include "e9elf.h"
+#include "e9tool.h"
+
+/*
+ * Cached analysis components.
+ */
+#define CACHE_DISASM        0x01
+#define CACHE_TARGETS       0x02
+#define CACHE_BBS           0x04
+#define CACHE_FS            0x08
+#define CACHE_LINES         0x10
+
+#define CACHE_HASH_INIT     0xcbf29ce484222325ull
+
+/*
+ * Disassembly desync information.
+ */
+struct Desync
+{
+    intptr_t lo;
+    intptr_t hi;
+    intptr_t addr;
+    const char *section;
+    uint8_t byte;
+};
+
+extern uint64_t cacheHash(uint64_t h, const void *data, size_t size);
+extern uint64_t cacheHashFile(uint64_t h, const char *filename);
+extern unsigned loadCache(const char *dir, uint64_t key, e9tool::ELF &elf,
+    std::vector<e9tool::Instr> &Is, std::vector<Desync> &desyncs);
+extern void saveCache(const char *dir, uint64_t key, unsigned mask,
+    const e9tool::ELF &elf, const std::vector<e9tool::Instr> &Is,
+    const std::vector<Desync> &desyncs);
+
+#endif
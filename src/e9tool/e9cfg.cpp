@@ -30,11 +30,19 @@
  */
 
 #include <cstdint>
+#include <cstring>
 
+#include <algorithm>
+#include <map>
 #include <set>
+#include <vector>
 
+#include "e9cfg.h"
+#include "e9codegen.h"
+#include "e9dwarf.h"
 #include "e9elf.h"
 #include "e9tool.h"
+#include "e9x86_64.h"
 
 #define TARGET_ENTRY 0x08
 #define TARGET_ENDBR 0x10
@@ -45,22 +53,35 @@ extern bool option_debug;
 #define DEBUG(targets, target, msg, ...)                                \
     do                                                                  \
     {                                                                   \
-        if (option_debug && (targets).find(target) == (targets).end())  \
+        if (option_debug &&                                             \
+                (targets).seen.find(target) == (targets).seen.end())    \
             debug("CFG: " msg, ##__VA_ARGS__);                          \
     }                                                                   \
     while (false)
 
+/*
+ * Raw (address-keyed) targets.  These are collected by the analysis passes,
+ * and later merged and mapped to instruction indexes.
+ */
+struct RawTargets : public std::vector<std::pair<intptr_t, TargetKind>>
+{
+    std::set<intptr_t> seen;            // --debug only (for DEBUG())
+};
+
+/*
+ * Possible jump tables.  Maps the table address to the number of entries,
+ * or SIZE_MAX if the bounds are unknown.
+ */
+typedef std::map<intptr_t, size_t> JumpTables;
+
 /*
  * Insert target information.
  */
-static void addTarget(intptr_t target, TargetKind kind, Targets &targets)
+static void addTarget(intptr_t target, TargetKind kind, RawTargets &targets)
 {
-    auto r = targets.insert({target, kind});
-    if (!r.second)
-    {
-        // Existing entry found:
-        r.first->second |= kind;
-    }  
+    targets.push_back({target, kind});
+    if (option_debug)
+        targets.seen.insert(target);
 }
 
 /*
@@ -81,6 +102,193 @@ static std::pair<const T *, const T *> getBounds(const uint8_t *lb0,
     return {(const T *)lb, (const T *)ub}; 
 }
 
+/*
+ * Insert a jump table.  If the table is already known, the larger bound wins.
+ */
+static void addJumpTable(intptr_t table, size_t n, JumpTables &tables)
+{
+    auto r = tables.insert({table, n});
+    if (!r.second)
+        r.first->second = std::max(r.first->second, n);
+}
+
+/*
+ * Test if an instruction (possibly) writes to a register.
+ */
+static bool isRegWritten(const InstrInfo *I, Register reg)
+{
+    for (unsigned i = 0; I->regs.write[i] != REGISTER_INVALID; i++)
+        if (getCanonicalReg(I->regs.write[i]) == reg)
+            return true;
+    for (unsigned i = 0; I->regs.condwrite[i] != REGISTER_INVALID; i++)
+        if (getCanonicalReg(I->regs.condwrite[i]) == reg)
+            return true;
+    return false;
+}
+
+/*
+ * Get the address of a %rip-relative memory operand, or INTPTR_MIN.
+ */
+static intptr_t getRIPAddress(const InstrInfo *I, const OpInfo *op)
+{
+    if (op == nullptr || op->type != OPTYPE_MEM ||
+            op->mem.base != REGISTER_RIP || op->mem.index != REGISTER_NONE)
+        return INTPTR_MIN;
+    return (intptr_t)I->address + (intptr_t)I->size + (intptr_t)op->mem.disp;
+}
+
+/*
+ * Attempt to recover a bounded PIC-style jump table for the `jmp *%reg'
+ * instruction Is[i].  The recognized idiom (as emitted by gcc/clang for
+ * `switch') is:
+ *
+ *      cmp $N,%idx
+ *      ja default                  (or jae)
+ *      lea table(%rip),%base
+ *      movslq (%base,%idx,4),%tmp
+ *      add %base,%tmp
+ *      jmp *%tmp
+ *
+ * The cmp/ja and lea may appear in either order, and may be interleaved
+ * with other instructions that do not clobber %idx/%base.  The bounded
+ * value may also reach %idx via a zero-extending move, or via a load from
+ * the same %rip-relative location, e.g.:
+ *
+ *      cmpl $N,var(%rip)           cmp $N,%sil
+ *      ja default                  ja default
+ *      mov var(%rip),%idx          movzbl %sil,%idx
+ *
+ * Returns the number of table entries, or 0 if the idiom was not recognized
+ * (including if the lea was hoisted out of the window).
+ */
+static size_t CFGJumpTableAnalysis(const ELF *elf, const Instr *Is,
+    ssize_t i, intptr_t &table, intptr_t &lea)
+{
+    const unsigned WINDOW  = 16;
+    const size_t MAX_TABLE = 0x10000;
+
+    InstrInfo I0, *I = &I0;
+    getInstrInfo(elf, Is + i, I);
+    const OpInfo *op = getOperand(I, 0, OPTYPE_REG, 0x0);
+    if (op == nullptr || op->size != sizeof(void *))
+        return 0;
+    Register tmp = getCanonicalReg(op->reg), base = REGISTER_NONE,
+        idx = REGISTER_NONE;
+    bool load = false;          // Seen the movslq?
+    intptr_t mem = INTPTR_MIN;  // Bounded value is in memory?
+    unsigned width = sizeof(int32_t);
+    int jcc = -1;               // 1=ja, 0=jae, -1=none
+    size_t n = 0;
+    lea = INTPTR_MIN;
+    for (unsigned k = 0; k < WINDOW && --i >= 0; k++)
+    {
+        if ((intptr_t)(Is[i].address + Is[i].size) != I->address)
+            return 0;           // Gap
+        getInstrInfo(elf, Is + i, I);
+        if (base == REGISTER_NONE)
+        {
+            // add %base,%tmp
+            const OpInfo *src = getOperand(I, 0, OPTYPE_REG, 0x0),
+                         *dst = getOperand(I, 1, OPTYPE_REG, 0x0);
+            if (I->mnemonic != MNEMONIC_ADD || I->count.op != 2 ||
+                    src == nullptr || dst == nullptr)
+                return 0;
+            if ((src->access & ACCESS_WRITE) != 0)
+                std::swap(src, dst);
+            if (getCanonicalReg(dst->reg) != tmp ||
+                    getCanonicalReg(src->reg) != src->reg)
+                return 0;
+            base = src->reg;
+            continue;
+        }
+        if (!load)
+        {
+            // movslq (%base,%idx,4),%tmp
+            const OpInfo *src = getOperand(I, 0, OPTYPE_MEM, 0x0),
+                         *dst = getOperand(I, 0, OPTYPE_REG, 0x0);
+            if (I->mnemonic != MNEMONIC_MOVSXD || I->count.op != 2 ||
+                    src == nullptr || dst == nullptr ||
+                    getCanonicalReg(dst->reg) != tmp ||
+                    src->mem.seg != REGISTER_NONE ||
+                    src->mem.base != base ||
+                    src->mem.index == REGISTER_NONE ||
+                    src->mem.scale != sizeof(int32_t) ||
+                    src->mem.disp != 0)
+                return 0;
+            idx  = getCanonicalReg(src->mem.index);
+            load = true;
+            continue;
+        }
+        if (jcc >= 0)
+        {
+            // cmp $N,%idx (must immediately precede the ja/jae)
+            const OpInfo *imm = getOperand(I, 0, OPTYPE_IMM, 0x0),
+                         *val = (mem == INTPTR_MIN?
+                                 getOperand(I, 0, OPTYPE_REG, 0x0):
+                                 getOperand(I, 0, OPTYPE_MEM, 0x0));
+            if (I->mnemonic != MNEMONIC_CMP || I->count.op != 2 ||
+                    imm == nullptr || val == nullptr ||
+                    val->size < width ||
+                    imm->imm < 0 || imm->imm >= (intptr_t)MAX_TABLE)
+                return 0;
+            if (mem == INTPTR_MIN? getCanonicalReg(val->reg) != idx:
+                                   getRIPAddress(I, val) != mem)
+                return 0;
+            n = (size_t)imm->imm + (size_t)jcc;
+            if (n == 0)
+                return 0;
+            jcc = -1;
+        }
+        else if (lea < 0 && I->mnemonic == MNEMONIC_LEA &&
+                I->op[0].type == OPTYPE_MEM &&
+                I->op[0].mem.base == REGISTER_RIP &&
+                I->op[1].type == OPTYPE_REG && I->op[1].reg == base)
+        {
+            // lea table(%rip),%base
+            table = getRIPAddress(I, I->op + 0);
+            lea   = I->address;
+        }
+        else if (n == 0 &&
+                (I->mnemonic == MNEMONIC_JA || I->mnemonic == MNEMONIC_JAE))
+            jcc = (I->mnemonic == MNEMONIC_JA? 1: 0);
+        else if (n == 0 && idx != REGISTER_NONE &&
+                (I->mnemonic == MNEMONIC_MOV ||
+                 I->mnemonic == MNEMONIC_MOVZX) &&
+                I->count.op == 2 && I->op[1].type == OPTYPE_REG &&
+                getCanonicalReg(I->op[1].reg) == idx &&
+                I->op[1].size == sizeof(int32_t))
+        {
+            // mov %src32,%idx32 / movzx %src,%idx32 / mov var(%rip),%idx32
+            const OpInfo *src = I->op + 0;
+            if (I->mnemonic == MNEMONIC_MOV &&
+                    src->size != sizeof(int32_t))
+                return 0;
+            width = src->size;
+            if (src->type == OPTYPE_REG)
+                idx = getCanonicalReg(src->reg);
+            else if ((mem = getRIPAddress(I, src)) != INTPTR_MIN)
+                idx = REGISTER_NONE;
+            else
+                return 0;
+        }
+        else if (isRegWritten(I, REGISTER_RIP) ||
+                (lea < 0 && isRegWritten(I, base)) ||
+                (n == 0 && idx != REGISTER_NONE && isRegWritten(I, idx)))
+            return 0;
+        else if (n == 0 && mem != INTPTR_MIN)
+        {
+            // Any memory write may clobber the bounded value:
+            for (unsigned j = 0; j < I->count.op; j++)
+                if (I->op[j].type == OPTYPE_MEM &&
+                        (I->op[j].access & ACCESS_WRITE) != 0)
+                    return 0;
+        }
+        if (n != 0 && lea >= 0)
+            return n;
+    }
+    return 0;
+}
+
 /*
  * Find the instruction corresponding to the address.  Returns a negative index
  * corresponding instruction is not found.
@@ -101,13 +309,28 @@ ssize_t e9tool::findInstr(const Instr *Is, size_t size, intptr_t address)
     return -1;
 }
 
+/*
+ * Get the end of the FDE containing `addr' (or INTPTR_MAX if none).
+ */
+static intptr_t getFDEBound(const FDEs &fdes, intptr_t addr)
+{
+    auto i = std::upper_bound(fdes.begin(), fdes.end(),
+        std::make_pair(addr, INTPTR_MAX));
+    if (i == fdes.begin())
+        return INTPTR_MAX;
+    --i;
+    return (addr < i->second? i->second: INTPTR_MAX);
+}
+
 /*
  * Code analysis pass: find all probable code targets.
  */
 static void CFGCodeAnalysis(const ELF *elf, bool pic, const Instr *Is,
-    size_t size, std::set<intptr_t> &tables, Targets &targets)
+    size_t size, const FDEs &fdes, JumpTables &tables, RawTargets &targets)
 {
     // STEP (1): Calculate a rough-cut of the targets:
+    std::vector<std::pair<intptr_t, intptr_t>> leas;
+    std::set<intptr_t> bounded;
     intptr_t next = INTPTR_MIN;
     for (size_t i = 0; i < size; i++)
     {
@@ -165,7 +388,7 @@ static void CFGCodeAnalysis(const ELF *elf, bool pic, const Instr *Is,
                     // This does not point to an instruction, but may be
                     // pointing to the base of a PIC-style jump-table.  We
                     // save the address for later analysis.
-                    tables.insert(target);
+                    leas.push_back({I->address, target});
                 }
                 continue;
 
@@ -181,7 +404,21 @@ static void CFGCodeAnalysis(const ELF *elf, bool pic, const Instr *Is,
                         I->op[0].mem.scale == sizeof(void *))
                 {
                     target = (intptr_t)I->op[0].mem.disp;
-                    tables.insert(target);
+                    addJumpTable(target, SIZE_MAX, tables);
+                }
+                else if (I->op[0].type == OPTYPE_REG)
+                {
+                    // [HEURISTIC] Attempt to recover the jump table bounds
+                    // from the dispatch code.
+                    intptr_t table = 0, lea = 0;
+                    size_t n = CFGJumpTableAnalysis(elf, Is, i, table, lea);
+                    if (n > 0)
+                    {
+                        DEBUG(targets, table, "JmpTbl: %p[%zu] (%p)",
+                            (void *)table, n, (void *)I->address);
+                        addJumpTable(table, n, tables);
+                        bounded.insert(lea);
+                    }
                 }
                 DEBUG(targets, next, "Next  : %p", (void *)next);
                 addTarget(next, TARGET_ENTRY, targets);
@@ -227,6 +464,14 @@ static void CFGCodeAnalysis(const ELF *elf, bool pic, const Instr *Is,
         addTarget(target, TARGET_DIRECT | (call? TARGET_FUNCTION: 0), targets);
     }
 
+    // Any `lea' not attributed to a bounded jump table is treated as a
+    // potential jump table with unknown bounds:
+    for (const auto &entry: leas)
+    {
+        if (bounded.find(entry.first) == bounded.end())
+            addJumpTable(entry.second, SIZE_MAX, tables);
+    }
+
     // Symbols are assumed to be functions:
     for (unsigned i = 0; i < 2; i++)
     {
@@ -243,6 +488,13 @@ static void CFGCodeAnalysis(const ELF *elf, bool pic, const Instr *Is,
             addTarget(target, TARGET_INDIRECT | TARGET_FUNCTION, targets);
         }
     }
+
+    // FDEs are also assumed to be functions (works for stripped binaries):
+    for (const auto &fde: fdes)
+    {
+        DEBUG(targets, fde.first, "FDE   : %p (F)", (void *)fde.first);
+        addTarget(fde.first, TARGET_INDIRECT | TARGET_FUNCTION, targets);
+    }
 }
 
 /*
@@ -250,7 +502,7 @@ static void CFGCodeAnalysis(const ELF *elf, bool pic, const Instr *Is,
  */
 static void CFGSectionAnalysis(const ELF *elf, bool pic, const char *name,
     const Elf64_Shdr *shdr, const Instr *Is, size_t size,
-    const std::set<intptr_t> &tables, Targets &targets)
+    const JumpTables &tables, RawTargets &targets)
 {
     if ((shdr->sh_flags & SHF_EXECINSTR) != 0 || shdr->sh_addr == 0x0)
         return;
@@ -306,8 +558,10 @@ static void CFGSectionAnalysis(const ELF *elf, bool pic, const char *name,
             if (i == tables.end())
                 continue;
 
-            // This is "probably" a PIC-style jump table.
-            for (const int32_t *q = p; q < bounds.second; q++)
+            // This is "probably" a PIC-style jump table.  If the bounds are
+            // known, only the recovered entries are considered.
+            size_t n = i->second;
+            for (const int32_t *q = p; q < bounds.second && n > 0; q++, n--)
             {
                 intptr_t offset = (intptr_t)*q;
                 intptr_t target = table + offset;
@@ -326,7 +580,7 @@ static void CFGSectionAnalysis(const ELF *elf, bool pic, const char *name,
  * Data analysis pass: find potential code pointers in data.
  */
 static void CFGDataAnalysis(const ELF *elf, bool pic, const Instr *Is,
-    size_t size, const std::set<intptr_t> &tables, Targets &targets)
+    size_t size, const JumpTables &tables, RawTargets &targets)
 {
     // Gather relocation information:
     const SectionInfo &sections = getELFSectionInfo(elf);
@@ -356,6 +610,232 @@ static void CFGDataAnalysis(const ELF *elf, bool pic, const Instr *Is,
             tables, targets);
 }
 
+/*
+ * Initialize a code map covering all executable sections.
+ */
+void initCodeMap(const ELF *elf, CodeMap &map)
+{
+    intptr_t lb = INTPTR_MAX, ub = INTPTR_MIN;
+    for (const auto *shdr: elf->exes)
+    {
+        lb = std::min(lb, (intptr_t)shdr->sh_addr);
+        ub = std::max(ub, (intptr_t)(shdr->sh_addr + shdr->sh_size));
+    }
+    map.data.clear();
+    map.flags.clear();
+    map.lb = 0;
+    if (lb >= ub)
+        return;
+    map.lb = lb;
+    map.flags.assign((size_t)(ub - lb), 0x0);
+}
+
+/*
+ * Mark the range [lo..hi) in the code map.
+ */
+void markCodeMap(CodeMap &map, intptr_t lo, intptr_t hi, uint8_t flag)
+{
+    intptr_t ub = map.lb + (intptr_t)map.flags.size();
+    lo = std::max(lo, map.lb);
+    hi = std::min(hi, ub);
+    for (intptr_t addr = lo; addr < hi; addr++)
+        map.flags[addr - map.lb] |= flag;
+}
+
+/*
+ * Find the next known instruction start in the range [addr..hi), or return
+ * INTPTR_MAX if there is none.
+ */
+intptr_t nextCodeMap(const CodeMap &map, intptr_t addr, intptr_t hi)
+{
+    intptr_t ub = map.lb + (intptr_t)map.flags.size();
+    addr = std::max(addr, map.lb);
+    hi = std::min(hi, ub);
+    for (; addr < hi; addr++)
+    {
+        if ((map.flags[addr - map.lb] & CODE_START) != 0)
+            return addr;
+    }
+    return INTPTR_MAX;
+}
+
+/*
+ * Find the executable section containing an address.
+ */
+static const Elf64_Shdr *findExe(const ELF *elf, intptr_t addr)
+{
+    for (const auto *shdr: elf->exes)
+    {
+        if (addr >= (intptr_t)shdr->sh_addr &&
+                addr < (intptr_t)(shdr->sh_addr + shdr->sh_size))
+            return shdr;
+    }
+    return nullptr;
+}
+
+/*
+ * Traverse and mark all code reachable from the `work' list.  For weak
+ * seeds, each linear path is only marked if the whole path is plausible,
+ * i.e., it ends with an instruction without a fall-through (or joins known
+ * code), with no undecodable, suspicious or overlapping instructions.
+ * Otherwise the path is abandoned.
+ */
+static size_t traverseCodeMap(const ELF *elf, int threshold, bool weak,
+    std::vector<intptr_t> &work, CodeMap &map)
+{
+    size_t count = 0;
+    std::vector<std::pair<intptr_t, size_t>> path;
+    std::vector<intptr_t> targets;
+    while (!work.empty())
+    {
+        intptr_t addr = work.back();
+        work.pop_back();
+        const Elf64_Shdr *shdr = findExe(elf, addr);
+        bool fall = false, ok = !weak;
+        path.clear();
+        targets.clear();
+        while (shdr != nullptr)
+        {
+            intptr_t ub = (intptr_t)(shdr->sh_addr + shdr->sh_size);
+            if (addr >= ub)
+                break;              // Out-of-range
+            uint8_t flags = getCodeMap(map, addr);
+            if (flags != 0x0)
+            {
+                // Visited, overlap, or data:
+                ok = ok || (fall && flags == CODE_START);
+                break;
+            }
+            const uint8_t *code = getELFData(elf) + shdr->sh_offset +
+                (addr - (intptr_t)shdr->sh_addr);
+            uint16_t category;
+            intptr_t target;
+            size_t len = decodeFlow(code, (size_t)(ub - addr), addr, category,
+                target);
+            if (len == 0 ||
+                    ((fall || weak) && suspiciousness(code, len) >= threshold))
+                break;
+            bool overlap = false;
+            for (size_t i = 1; !overlap && i < len; i++)
+                overlap = (getCodeMap(map, addr + i) != 0x0);
+            if (overlap)
+                break;
+            path.push_back({addr, len});
+            if (target != INTPTR_MIN)
+                targets.push_back(target);
+            if ((category & CATEGORY_RETURN) != 0 ||
+                    category == CATEGORY_JUMP)
+            {
+                ok = true;
+                break;              // No fall-through
+            }
+            addr += len;
+            fall = true;
+        }
+        if (!ok)
+            continue;
+        for (const auto &entry: path)
+        {
+            markCodeMap(map, entry.first, entry.first + 1, CODE_START);
+            markCodeMap(map, entry.first + 1, entry.first + entry.second,
+                CODE_BODY);
+        }
+        count += path.size();
+        work.insert(work.end(), targets.begin(), targets.end());
+    }
+    return count;
+}
+
+/*
+ * Recursive traversal pass: mark all code reachable from a set of seeds
+ * (the entry point, function symbols, FDEs, and init/fini arrays) as known
+ * code.  Indirect jumps/calls are not followed.
+ *
+ * Relocated pointers into executable sections (R_X86_64_RELATIVE addends)
+ * are only weak seeds, since they may also point to data-in-code (e.g.,
+ * jump tables or constants).  Weak seeds are traversed last, and a path
+ * from a weak seed is only marked if it is plausible code.
+ *
+ * [HEURISTIC] Calls are assumed to return.  To limit the damage of a
+ *             non-returning call followed by data, a fall-through
+ *             instruction that is suspicious (see --Dthreshold) terminates
+ *             the path.
+ */
+void buildCodeMap(const ELF *elf, int threshold, CodeMap &map)
+{
+    if (map.flags.size() == 0)
+        return;
+
+    // Step (1): Collect the seeds:
+    std::vector<intptr_t> work, hints;
+    switch (getELFType(elf))
+    {
+        case BINARY_TYPE_ELF_DSO: case BINARY_TYPE_ELF_PIE:
+        case BINARY_TYPE_ELF_EXE:
+        {
+            const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)getELFData(elf);
+            work.push_back((intptr_t)ehdr->e_entry);
+            break;
+        }
+        default:
+            break;
+    }
+    for (unsigned i = 0; i < 2; i++)
+    {
+        const SymbolInfo &syms = (i == 0? getELFDynSymInfo(elf):
+                                          getELFSymInfo(elf));
+        for (const auto &entry: syms)
+        {
+            const Elf64_Sym *sym = entry.second;
+            if (sym->st_shndx != SHN_UNDEF &&
+                    ELF64_ST_TYPE(sym->st_info) == STT_FUNC)
+                work.push_back((intptr_t)sym->st_value);
+        }
+    }
+    const FDEs &fdes = getFDEs(elf);
+    for (const auto &fde: fdes)
+        work.push_back(fde.first);
+    const SectionInfo &sections = getELFSectionInfo(elf);
+    for (const auto &entry: sections)
+    {
+        const Elf64_Shdr *shdr = entry.second;
+        const uint8_t *sh_data = getELFData(elf) + shdr->sh_offset;
+        size_t sh_size = shdr->sh_size;
+        switch (shdr->sh_type)
+        {
+            case SHT_INIT_ARRAY: case SHT_FINI_ARRAY:
+            case SHT_PREINIT_ARRAY:
+            {
+                const intptr_t *array = (const intptr_t *)sh_data;
+                for (size_t i = 0; i < sh_size / sizeof(intptr_t); i++)
+                    work.push_back(array[i]);
+                break;
+            }
+            case SHT_RELA:
+            {
+                const Elf64_Rela *rela = (const Elf64_Rela *)sh_data;
+                const Elf64_Rela *rela_end =
+                    rela + sh_size / sizeof(Elf64_Rela);
+                for (; rela < rela_end; rela++)
+                {
+                    if (ELF64_R_TYPE(rela->r_info) == R_X86_64_RELATIVE)
+                        hints.push_back((intptr_t)rela->r_addend);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Step (2): Recursive traversal:
+    size_t count = traverseCodeMap(elf, threshold, /*weak=*/false, work, map);
+    size_t weak  = traverseCodeMap(elf, threshold, /*weak=*/true, hints, map);
+    if (option_debug)
+        debug("recursive traversal found %zu instructions (%zu from "
+            "relocations)", count + weak, weak);
+}
+
 /*
  * Build the set of potential jump targets.
  */
@@ -373,15 +853,36 @@ void e9tool::buildTargets(const ELF *elf, const Instr *Is, size_t size,
     }
 
     // Pass #1: Find all code targets. 
-    std::set<intptr_t> tables;
-    CFGCodeAnalysis(elf, pic, Is, size, tables, targets);
+    const FDEs &fdes = getFDEs(elf);
+    JumpTables tables;
+    RawTargets raw;
+    CFGCodeAnalysis(elf, pic, Is, size, fdes, tables, raw);
     
     // Pass #2: Find all data targets.
-    CFGDataAnalysis(elf, pic, Is, size, tables, targets);
+    CFGDataAnalysis(elf, pic, Is, size, tables, raw);
+
+    // Merge duplicate targets:
+    std::sort(raw.begin(), raw.end(),
+        [](const std::pair<intptr_t, TargetKind> &a,
+           const std::pair<intptr_t, TargetKind> &b) -> bool
+        {
+            return (a.first < b.first);
+        });
+    size_t n = 0;
+    for (size_t i = 0; i < raw.size(); i++)
+    {
+        if (n > 0 && raw[n-1].first == raw[i].first)
+            raw[n-1].second |= raw[i].second;
+        else
+            raw[n++] = raw[i];
+    }
+    raw.resize(n);
+    raw.shrink_to_fit();
 
     // Pass #3: "Clean up" the targets.
     Targets new_targets;
-    for (const auto &entry: targets)
+    new_targets.kinds.assign(size, 0);
+    for (const auto &entry: raw)
     {
         intptr_t target = entry.first;
         TargetKind kind = entry.second;
@@ -415,11 +916,11 @@ void e9tool::buildTargets(const ELF *elf, const Instr *Is, size_t size,
             continue;   // No target found.
         
         // Add target:
-        addTarget((intptr_t)Is[i].address, kind, new_targets);
+        new_targets.set((size_t)i, kind);
     }
 
     // Pass #4: Normalize the target kinds.
-    for (auto &entry: targets)
+    for (auto &entry: raw)
     {
         TargetKind &kind = entry.second;
         if ((kind & TARGET_ENTRY) != 0)
@@ -438,15 +939,16 @@ void e9tool::buildTargets(const ELF *elf, const Instr *Is, size_t size,
 void e9tool::buildBBs(const ELF *elf, const Instr *Is, size_t size,
     const Targets &targets, BBs &bbs)
 {
-    std::map<uint32_t, BB> tmp;
-    for (const auto &entry: targets)
+    const FDEs &fdes = getFDEs(elf);
+    bbs.reserve(targets.size());
+    for (size_t idx = 0; idx < size; idx++)
     {
-        intptr_t target = entry.first;
-        size_t i = findInstr(Is, size, target);
-        if (i >= size)
+        if (targets.get(idx) == 0)
             continue;
+        size_t i = idx;
         uint32_t lb = i, ub = i, best = i;
         const Instr *I = Is + i;
+        intptr_t bound = getFDEBound(fdes, I->address);
 
         for (++i; i < size; i++)
         {
@@ -479,7 +981,7 @@ void e9tool::buildBBs(const ELF *elf, const Instr *Is, size_t size,
             const Instr *J = I+1;
             if (I->address + I->size != J->address)
                 break;
-            if (targets.find(J->address) != targets.end())
+            if (targets.get(i) != 0 || (intptr_t)J->address >= bound)
                 break;
             ub++;
             if (Is[best].size < /*sizeof(jmpq)=*/5 &&
@@ -490,13 +992,9 @@ void e9tool::buildBBs(const ELF *elf, const Instr *Is, size_t size,
         debug("basic block 0x%lx..0x%lx [%zui,%zuB]", Is[lb].address,
             Is[ub].address, ub - lb + 1, 
             Is[ub].address - Is[lb].address + Is[ub].size);
-        BB bb(lb, ub, best);
-        tmp.insert({lb, bb});
+        bbs.emplace_back(lb, ub, best);
     }
-
-    bbs.reserve(tmp.size());
-    for (const auto &entry: tmp)
-        bbs.push_back(entry.second);
+    bbs.shrink_to_fit();
 }
 
 /*
@@ -524,6 +1022,7 @@ const BB *e9tool::findBB(const BBs &bbs, size_t idx)
 void e9tool::buildFs(const ELF *elf, const Instr *Is, size_t size,
     const Targets &targets, Fs &fs)
 {
+    const FDEs &fdes = getFDEs(elf);
     std::map<intptr_t, const char *> names;
     for (unsigned i = 0; i < 2; i++)
     {
@@ -540,18 +1039,15 @@ void e9tool::buildFs(const ELF *elf, const Instr *Is, size_t size,
             names.insert({target, name});
         }
     }
-    std::map<uint32_t, F> tmp;
-    for (const auto &entry: targets)
+    for (size_t idx = 0; idx < size; idx++)
     {
-        if ((entry.second & TARGET_FUNCTION) == 0)
-            continue;
-        intptr_t target = entry.first;
-        size_t i = findInstr(Is, size, target);
-        if (i >= size)
+        if ((targets.get(idx) & TARGET_FUNCTION) == 0)
             continue;
+        size_t i = idx;
         uint32_t lb = i, ub = i, best = i;
         bool found = false;
         const Instr *I = Is + i;
+        intptr_t bound = getFDEBound(fdes, I->address);
 
         for (++i; i < size; i++)
         {
@@ -584,8 +1080,8 @@ void e9tool::buildFs(const ELF *elf, const Instr *Is, size_t size,
             const Instr *J = I+1;
             if (I->address + I->size != J->address)
                 break;
-            auto j = targets.find(J->address);
-            if (j != targets.end() && (j->second & TARGET_FUNCTION) != 0)
+            if ((targets.get(i) & TARGET_FUNCTION) != 0 ||
+                    (intptr_t)J->address >= bound)
                 break;
             ub++;
             if (!found && Is[best].size < /*sizeof(jmpq)=*/5 &&
@@ -599,13 +1095,9 @@ void e9tool::buildFs(const ELF *elf, const Instr *Is, size_t size,
             Is[ub].address, ub - lb + 1, 
             Is[ub].address - Is[lb].address + Is[ub].size,
             (name == nullptr? "": ",name="), (name == nullptr? "": name));
-        F f(name, lb, ub, best);
-        tmp.insert({lb, f});
+        fs.emplace_back(name, lb, ub, best);
     }
-
-    fs.reserve(tmp.size());
-    for (const auto &entry: tmp)
-        fs.push_back(entry.second);
+    fs.shrink_to_fit();
 }
 
 /*
@@ -657,11 +1149,56 @@ void dumpInfo(const std::string basename, const Instr *Is, size_t size,
             error("failed to open CSV file \"%s\" for writing: %s",
                 filename.c_str(), strerror(errno));
         fputs("target,direct?,indirect?,function?\n", stream);
-        for (const auto &entry: targets)
-            fprintf(stream, "%p,%d,%d,%d\n", (void *)entry.first,
-                (entry.second & TARGET_DIRECT?   1: 0),
-                (entry.second & TARGET_INDIRECT? 1: 0),
-                (entry.second & TARGET_FUNCTION? 1: 0));
+        for (size_t i = 0; i < size; i++)
+        {
+            TargetKind kind = targets.get(i);
+            if (kind == 0)
+                continue;
+            fprintf(stream, "%p,%d,%d,%d\n",
+                (void *)(uintptr_t)Is[i].address,
+                (kind & TARGET_DIRECT?   1: 0),
+                (kind & TARGET_INDIRECT? 1: 0),
+                (kind & TARGET_FUNCTION? 1: 0));
+        }
+        fclose(stream);
+    }
+
+    // Indirect target bitmap.  The format is a 32 byte header:
+    //      char     magic[8];      // "E9BITMAP"
+    //      uint64_t lb;            // Lowest instruction address
+    //      uint64_t ub;            // Highest instruction address (+size)
+    //      uint64_t reserved;      // Zero
+    // followed by one bit per byte in the range [lb..ub), where bit (i%8) of
+    // byte (i/8) is set if (lb+i) is an indirect jump/call target.  The file
+    // is intended to be mmap()'ed directly by the instrumentation.
+    {
+        std::string filename(basename);
+        filename += ".TARGETs.bitmap";
+        FILE *stream = fopen(filename.c_str(), "w");
+        if (stream == nullptr)
+            error("failed to open bitmap file \"%s\" for writing: %s",
+                filename.c_str(), strerror(errno));
+        uint64_t hdr[4] = {0, UINT64_MAX, 0, 0};
+        memcpy(hdr, "E9BITMAP", sizeof(hdr[0]));
+        for (size_t i = 0; i < size; i++)
+        {
+            hdr[1] = std::min(hdr[1], (uint64_t)Is[i].address);
+            hdr[2] = std::max(hdr[2], (uint64_t)Is[i].address + Is[i].size);
+        }
+        hdr[1] = (size == 0? 0: hdr[1]);
+        std::vector<uint8_t> bitmap((hdr[2] - hdr[1] + 7) / 8, 0);
+        for (size_t i = 0; i < size; i++)
+        {
+            if ((targets.get(i) & TARGET_INDIRECT) == 0)
+                continue;
+            uint64_t offset = (uint64_t)Is[i].address - hdr[1];
+            bitmap[offset / 8] |= (uint8_t)(1 << (offset % 8));
+        }
+        if (fwrite(hdr, sizeof(hdr), 1, stream) != 1 ||
+                (bitmap.size() > 0 &&
+                    fwrite(bitmap.data(), bitmap.size(), 1, stream) != 1))
+            error("failed to write bitmap file \"%s\": %s",
+                filename.c_str(), strerror(errno));
         fclose(stream);
     }
 
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __E9CFG_H
+#define __E9CFG_H
+
+#include <cstdint>
+
+#include <utility>
+#include <vector>
+
+#include "e9elf.h"
+#include "e9tool.h"
+
+/*
+ * Code map flags.
+ */
+#define CODE_START          0x01    // Known instruction start
+#define CODE_BODY           0x02    // Known instruction byte (not start)
+#define CODE_DATA           0x04    // Known data (excluded or data-in-code)
+
+/*
+ * Code map.  Records (per byte) which parts of the executable sections are
+ * known to be code, i.e., reachable from a seed via recursive traversal, and
+ * which parts are known to be data.
+ */
+struct CodeMap
+{
+    intptr_t lb = 0;                    // Lowest address.
+    std::vector<uint8_t> flags;         // Per-byte flags.
+    std::vector<std::pair<intptr_t, intptr_t>> data;
+                                        // Data-in-code ranges [lo..hi).
+};
+
+/*
+ * Get the code map flags for an address.
+ */
+static inline uint8_t getCodeMap(const CodeMap &map, intptr_t addr)
+{
+    if (addr < map.lb || addr - map.lb >= (intptr_t)map.flags.size())
+        return 0x0;
+    return map.flags[addr - map.lb];
+}
+
+extern void initCodeMap(const e9tool::ELF *elf, CodeMap &map);
+extern void markCodeMap(CodeMap &map, intptr_t lo, intptr_t hi,
+    uint8_t flag);
+extern intptr_t nextCodeMap(const CodeMap &map, intptr_t addr, intptr_t hi);
+extern void buildCodeMap(const e9tool::ELF *elf, int threshold, CodeMap &map);
+
+#endif
@@ -786,6 +786,215 @@ const int *getCallerSaveRegs(bool sysv, bool clean, bool state,
     }
 }
 
+/*
+ * Get the registers saved by an inline fast path.  This is %rax (which holds
+ * the result), %rflags, and the registers used by the (register) args.
+ */
+const int *getFastPathSaveRegs(bool sysv, size_t num_args)
+{
+    if (sysv)
+    {
+        static const int fast_save[][9] =
+        {
+            {RAX_IDX, RFLAGS_IDX, -1},
+            {RAX_IDX, RFLAGS_IDX, RDI_IDX, -1},
+            {RAX_IDX, RFLAGS_IDX, RSI_IDX, RDI_IDX, -1},
+            {RAX_IDX, RFLAGS_IDX, RDX_IDX, RSI_IDX, RDI_IDX, -1},
+            {RAX_IDX, RFLAGS_IDX, RCX_IDX, RDX_IDX, RSI_IDX, RDI_IDX, -1},
+            {RAX_IDX, RFLAGS_IDX, R8_IDX, RCX_IDX, RDX_IDX, RSI_IDX, RDI_IDX,
+                -1},
+            {RAX_IDX, RFLAGS_IDX, R9_IDX, R8_IDX, RCX_IDX, RDX_IDX, RSI_IDX,
+                RDI_IDX, -1},
+        };
+        assert(num_args < sizeof(fast_save) / sizeof(fast_save[0]));
+        return fast_save[num_args];
+    }
+    else
+    {
+        static const int fast_save[][7] =
+        {
+            {RAX_IDX, RFLAGS_IDX, -1},
+            {RAX_IDX, RFLAGS_IDX, RCX_IDX, -1},
+            {RAX_IDX, RFLAGS_IDX, RDX_IDX, RCX_IDX, -1},
+            {RAX_IDX, RFLAGS_IDX, R8_IDX, RDX_IDX, RCX_IDX, -1},
+            {RAX_IDX, RFLAGS_IDX, R9_IDX, R8_IDX, RDX_IDX, RCX_IDX, -1},
+        };
+        assert(num_args < sizeof(fast_save) / sizeof(fast_save[0]));
+        return fast_save[num_args];
+    }
+}
+
+/*
+ * Send a `movups %xmm,offset(%rsp)' or `movups offset(%rsp),%xmm'
+ * instruction.
+ */
+static void sendMovXMM(FILE *out, bool store, int xmmno, int32_t offset)
+{
+    if (xmmno >= 8)
+        fprintf(out, "%u,", 0x44);
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x0f, (store? 0x11: 0x10), 0x84 | ((xmmno & 0x7) << 3), 0x24,
+        offset);
+}
+
+/*
+ * Send an xsave/xrstor of the extended state.  This clobbers %rax, %rcx,
+ * %rdx and %rflags, so these are temporarily stashed in the save area.
+ *
+ * If `detect' is set, the trampoline falls back to fxsave/fxrstor (x87 and
+ * SSE state only) if the OS has not enabled xsave (CPUID.1:ECX.OSXSAVE).
+ * The CPUID result is cached in the XSTATE_MODE_ADDR byte, so CPUID is
+ * only executed once.
+ */
+static void sendXSave(FILE *out, int32_t offset, bool restore, bool flags,
+    bool detect)
+{
+    if (flags)
+    {
+        fprintf(out, "%u,", 0x9c);                  // pushfq
+        offset += sizeof(int64_t);
+    }
+    sendMovFromR64ToStack(out, RAX_IDX, offset + XSTATE_STASH);
+    sendMovFromR64ToStack(out, RCX_IDX, offset + XSTATE_STASH + 8);
+    sendMovFromR64ToStack(out, RDX_IDX, offset + XSTATE_STASH + 16);
+
+    if (detect)
+    {
+        // movzbl XSTATE_MODE(%rip),%eax
+        // test %eax,%eax
+        // jnz .Lknown
+        fprintf(out, "%u,%u,%u,{\"rel32\":%d},", 0x0f, 0xb6, 0x05,
+            XSTATE_MODE_ADDR);
+        fprintf(out, "%u,%u,", 0x85, 0xc0);
+        fprintf(out, "%u,{\"int8\":%d},", 0x75, 41);
+
+        // mov %rbx,offset+XSTATE_STASH+24(%rsp)
+        // mov $1,%eax
+        // cpuid
+        // mov offset+XSTATE_STASH+24(%rsp),%rbx
+        // bt $27,%ecx                  # OSXSAVE
+        // mov $XSTATE_MODE_FXSAVE,%eax
+        // sbb $0,%eax                  # XSTATE_MODE_XSAVE if OSXSAVE
+        // mov %al,XSTATE_MODE(%rip)
+        // .Lknown:
+        static_assert(XSTATE_MODE_FXSAVE == XSTATE_MODE_XSAVE + 1,
+            "invalid xstate modes");
+        fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},", 0x48, 0x89, 0x9c, 0x24,
+            offset + XSTATE_STASH + 24);
+        fprintf(out, "%u,{\"int32\":%d},", 0xb8, 1);
+        fprintf(out, "%u,%u,", 0x0f, 0xa2);
+        fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},", 0x48, 0x8b, 0x9c, 0x24,
+            offset + XSTATE_STASH + 24);
+        fprintf(out, "%u,%u,%u,%u,", 0x0f, 0xba, 0xe1, 27);
+        fprintf(out, "%u,{\"int32\":%d},", 0xb8, XSTATE_MODE_FXSAVE);
+        fprintf(out, "%u,%u,%u,", 0x83, 0xd8, 0x00);
+        fprintf(out, "%u,%u,{\"rel32\":%d},", 0x88, 0x05, XSTATE_MODE_ADDR);
+    }
+
+    // The xsave area must be 64-byte aligned:
+    // lea offset+XSTATE_SLOT+63(%rsp),%rcx
+    // and $-64,%rcx
+    sendLeaFromStackToR64(out, offset + XSTATE_SLOT + 63, RCX_IDX);
+    fprintf(out, "%u,%u,%u,{\"int8\":%d},", 0x48, 0x83, 0xe1, -64);
+
+    // xor %edx,%edx
+    // cmp $XSTATE_MODE_XSAVE,%eax
+    // mov $XSTATE_MASK,%eax
+    // jne .Lfxsave
+    //
+    // Note: the requested-feature mask is implicitly intersected with
+    //       XCR0, so the same mask is correct for any CPU.
+    fprintf(out, "%u,%u,", 0x31, 0xd2);
+    if (detect)
+        fprintf(out, "%u,%u,%u,", 0x83, 0xf8, XSTATE_MODE_XSAVE);
+    fprintf(out, "%u,{\"int32\":%d},", 0xb8, XSTATE_MASK);
+    if (detect)
+        fprintf(out, "%u,{\"int8\":%d},", 0x75, (restore? 6: 62));
+    if (!restore)
+    {
+        // The save area is recycled stack memory, so the XSAVE header
+        // must be zeroed for the later xrstor to succeed:
+        // mov %rdx,512+8*i(%rcx)
+        for (int i = 0; i < 8; i++)
+            fprintf(out, "%u,%u,%u,{\"int32\":%d},", 0x48, 0x89, 0x91,
+                512 + 8 * i);
+
+        // xsave64 (%rcx)
+        fprintf(out, "%u,%u,%u,%u,", 0x48, 0x0f, 0xae, 0x21);
+    }
+    else
+    {
+        // xrstor64 (%rcx)
+        fprintf(out, "%u,%u,%u,%u,", 0x48, 0x0f, 0xae, 0x29);
+    }
+    if (detect)
+    {
+        // jmp .Ldone
+        // .Lfxsave:
+        // fxsave64 (%rcx) / fxrstor64 (%rcx)
+        // .Ldone:
+        fprintf(out, "%u,{\"int8\":%d},", 0xeb, 4);
+        fprintf(out, "%u,%u,%u,%u,", 0x48, 0x0f, 0xae, (restore? 0x09: 0x01));
+    }
+
+    sendMovFromStackToR64(out, offset + XSTATE_STASH, RAX_IDX);
+    sendMovFromStackToR64(out, offset + XSTATE_STASH + 8, RCX_IDX);
+    sendMovFromStackToR64(out, offset + XSTATE_STASH + 16, RDX_IDX);
+    if (flags)
+        fprintf(out, "%u,", 0x9d);                  // popfq
+}
+
+/*
+ * Save the extended state.  Here `offset' is the distance between the
+ * current %rsp and the %rsp after the initial `lea -0x4000(%rsp),%rsp', and
+ * `flags' is true if %rflags has not already been saved.
+ */
+void sendSaveXState(FILE *out, int32_t offset, bool sysv, CallSave save,
+    bool flags)
+{
+    switch (save)
+    {
+        case SAVE_SSE:
+        {
+            // Only the caller-save %xmm registers need to be saved:
+            int num_xmm = (sysv? 16: 6);
+            for (int i = 0; i < num_xmm; i++)
+                sendMovXMM(out, /*store=*/true, i,
+                    offset + XSTATE_SLOT + 16 * i);
+            break;
+        }
+        case SAVE_XSAVE:
+            sendXSave(out, offset, /*restore=*/false, flags, /*detect=*/sysv);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Restore the extended state saved by sendSaveXState().
+ */
+void sendRestoreXState(FILE *out, int32_t offset, bool sysv, CallSave save,
+    bool flags)
+{
+    switch (save)
+    {
+        case SAVE_SSE:
+        {
+            int num_xmm = (sysv? 16: 6);
+            for (int i = 0; i < num_xmm; i++)
+                sendMovXMM(out, /*store=*/false, i,
+                    offset + XSTATE_SLOT + 16 * i);
+            break;
+        }
+        case SAVE_XSAVE:
+            sendXSave(out, offset, /*restore=*/true, flags, /*detect=*/sysv);
+            break;
+        default:
+            break;
+    }
+}
+
 /*
  * Move a register to stack.
  */
@@ -53,6 +53,25 @@
 #define RSP_SLOT    0x4000
 #define RIP_SLOT    (0x4000 - sizeof(int64_t))
 
+/*
+ * Extended state save area.  Offsets are relative to the stack pointer
+ * immediately after the initial `lea -0x4000(%rsp),%rsp', i.e., above the
+ * RSP_SLOT/RIP_SLOT slots and below the (original) red zone.
+ */
+#define XSTATE_STASH    0x20                // %rax/%rcx/%rdx scratch
+#define XSTATE_SLOT     0x40                // %xmm or xsave area
+#define XSTATE_SIZE     0x1000              // Max xsave area size
+#define XSTATE_MASK     0xe7                // x87,SSE,AVX,AVX512
+
+/*
+ * The xsave mode byte (Linux only).  This is zero until the first xsave
+ * call trampoline checks CPUID for OSXSAVE, and is placed immediately below
+ * the toggle runtime (see e9toggle.h).
+ */
+#define XSTATE_MODE_ADDR    0x6ffdf000      // Mode byte (rw-)
+#define XSTATE_MODE_XSAVE   1               // Use xsave/xrstor
+#define XSTATE_MODE_FXSAVE  2               // Use fxsave/fxrstor
+
 /*
  * Prototypes.
  */
@@ -65,6 +84,11 @@ extern e9tool::Register getCanonicalReg(e9tool::Register reg);
 extern bool isHighReg(e9tool::Register reg);
 extern const int *getCallerSaveRegs(bool sysv, bool clean, bool state,
     bool conditional, size_t num_args);
+extern const int *getFastPathSaveRegs(bool sysv, size_t num_args);
+extern void sendSaveXState(FILE *out, int32_t offset, bool sysv,
+    e9tool::CallSave save, bool flags);
+extern void sendRestoreXState(FILE *out, int32_t offset, bool sysv,
+    e9tool::CallSave save, bool flags);
 extern std::pair<bool, bool> sendPush(FILE *out, int32_t offset, bool before,
     e9tool::Register reg,
     e9tool::Register rscratch = e9tool::REGISTER_INVALID);
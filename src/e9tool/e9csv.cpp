@@ -24,7 +24,15 @@
 #include <cstdint>
 #include <cstdio>
 
+#include <algorithm>
 #include <map>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "e9action.h"
 #include "e9csv.h"
@@ -38,17 +46,46 @@ using namespace e9tool;
  */
 struct CSV
 {
-    FILE *stream;                   // Input stream
+    const char *ptr;                // Current position
+    const char *end;                // End of input
     const char *filename;           // Filename
     int length;                     // Record length
     unsigned lineno;                // Lineno
 };
 
 /*
- * CSV data representation.
+ * CSV record representation.
  */
 typedef std::vector<MatchVal> Record;
-typedef std::map<intptr_t, Record> Data;
+
+/*
+ * CSV column representation.
+ */
+struct Column
+{
+    std::vector<uint8_t> types;     // Value types (MATCH_TYPE_*)
+    std::vector<intptr_t> vals;     // Values (integer or string pointer)
+
+    void push_back(const MatchVal &val)
+    {
+        types.push_back((uint8_t)val.type);
+        vals.push_back(val.type == MATCH_TYPE_STRING? (intptr_t)val.str:
+            val.i);
+    }
+};
+
+/*
+ * CSV data representation (columnar).  Column 0 is the (sorted) address
+ * column.
+ */
+struct Data
+{
+    int length = -1;                // Record length
+    std::vector<intptr_t> addrs;    // Address column
+    std::vector<Column> cols;       // Value columns (1..length-1)
+    std::vector<unsigned> linenos;  // Record linenos (parsing only)
+    size_t cursor = 0;              // Last lookup position
+};
 
 /*
  * CSV data cache.
@@ -84,17 +121,50 @@ static bool entryToInt(const char *entry, intptr_t *val)
     return true;
 }
 
+/*
+ * Map a CSV file into memory.
+ */
+static const char *mapCSV(const char *filename, size_t &size)
+{
+    int fd = open(filename, O_RDONLY, 0);
+    if (fd < 0)
+        error("failed to open CSV file \"%s\" for reading: %s", filename,
+            strerror(errno));
+    struct stat buf;
+    if (fstat(fd, &buf) != 0)
+        error("failed to get status of CSV file \"%s\": %s", filename,
+            strerror(errno));
+    size = (size_t)buf.st_size;
+    if (size == 0)
+    {
+        close(fd);
+        return "";
+    }
+    void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED)
+        error("failed to map CSV file \"%s\" into memory: %s", filename,
+            strerror(errno));
+    close(fd);
+    return (const char *)ptr;
+}
+
+/*
+ * Unmap a CSV file.
+ */
+static void unmapCSV(const char *data, size_t size)
+{
+    if (size > 0)
+        munmap((void *)data, size);
+}
+
 /*
  * Checked getc.
  */
 static char getChar(CSV &csv)
 {
-    char c = getc(csv.stream);
-    if (ferror(csv.stream))
-        error("failed to parse CSV file \"%s\" at line %u: %s", csv.filename,
-            csv.lineno, strerror(errno));
-    if (feof(csv.stream))
+    if (csv.ptr >= csv.end)
         return EOF;
+    char c = *csv.ptr++;
     if (!isascii(c))
         error("failed to parse CSV file \"%s\" at line %u; file contains a "
             "non-ASCII character `\\x%.2X'", csv.filename, csv.lineno,
@@ -119,7 +189,7 @@ static void unGetChar(char c, CSV &csv)
         default:
             break;
     }
-    ungetc(c, csv.stream);
+    csv.ptr--;
 }
 
 /*
@@ -160,27 +230,20 @@ static bool parseEntry(CSV &csv, MatchVal &val)
                 entry += c;
             }
         default:
-            entry += c;
-            while (true)
-            {
-                c = getChar(csv);
-                switch (c)
-                {
-                    case ',': case '\n': case '\r': case EOF:
-                    {
-                        unGetChar(c, csv);
-                        intptr_t x;
-                        if (entryToInt(entry.c_str(), &x))
-                            val = MatchVal(x);
-                        else
-                            val = MatchVal(strDup(entry.c_str()));
-                        return true;
-                    }
-                    default:
-                        entry += c;
-                        break;
-                }
-            }
+        {
+            // Unquoted entries are scanned in-place:
+            const char *start = csv.ptr - 1;
+            while (csv.ptr < csv.end && *csv.ptr != ',' &&
+                    *csv.ptr != '\n' && *csv.ptr != '\r')
+                (void)getChar(csv);
+            entry.assign(start, csv.ptr - start);
+            intptr_t x;
+            if (entryToInt(entry.c_str(), &x))
+                val = MatchVal(x);
+            else
+                val = MatchVal(strDup(entry.c_str()));
+            return true;
+        }
     }
 }
 
@@ -221,19 +284,14 @@ static bool parseRecord(CSV &csv, Record &record)
 }
 
 /*
- * Parse a CSV file.
+ * Parse a chunk of a CSV file into columnar data.
  */
-static void parseCSV(const char *filename, Data &data)
+static void parseChunk(CSV &csv, Data &data)
 {
-    FILE *stream = fopen(filename, "r");
-    if (stream == nullptr)
-        error("failed to open CSV file \"%s\" for reading: %s", filename,
-            strerror(errno));
-
-    CSV csv = {stream, filename, -1, 0};
+    Record record;
     while (true)
     {
-        Record record;
+        record.clear();
         if (!parseRecord(csv, record))
             break;
         if (csv.length < 0)
@@ -246,17 +304,174 @@ static void parseCSV(const char *filename, Data &data)
         if (addr.type != MATCH_TYPE_INTEGER)
             error("failed to parse CSV file \"%s\" at line %u; first record "
                 "entry must be an address", csv.filename, csv.lineno);
-        auto r = data.emplace(std::piecewise_construct,
-            std::make_tuple(addr.i), std::make_tuple());
-        if (!r.second)
+        if (data.cols.size() + 1 < record.size())
+            data.cols.resize(record.size() - 1);
+        data.addrs.push_back(addr.i);
+        for (size_t i = 1; i < record.size(); i++)
+            data.cols[i-1].push_back(record[i]);
+        data.linenos.push_back(csv.lineno);
+    }
+    data.length = csv.length;
+}
+
+/*
+ * Append columnar data.
+ */
+static void appendData(const char *filename, Data &data, Data &tail)
+{
+    if (tail.length < 0)
+        return;
+    if (data.length < 0)
+        data.length = tail.length;
+    else if (tail.length != data.length)
+        error("failed to parse CSV file \"%s\" at line %u; record with "
+            "invalid length %d (expected %d)", filename, tail.linenos[0],
+            tail.length, data.length);
+    data.addrs.insert(data.addrs.end(), tail.addrs.begin(),
+        tail.addrs.end());
+    data.cols.resize(tail.cols.size());
+    for (size_t i = 0; i < tail.cols.size(); i++)
+    {
+        Column &col = data.cols[i], &tcol = tail.cols[i];
+        col.types.insert(col.types.end(), tcol.types.begin(),
+            tcol.types.end());
+        col.vals.insert(col.vals.end(), tcol.vals.begin(), tcol.vals.end());
+    }
+    data.linenos.insert(data.linenos.end(), tail.linenos.begin(),
+        tail.linenos.end());
+    tail = Data();
+}
+
+/*
+ * Permute a column.
+ */
+template <typename T>
+static void permute(const std::vector<size_t> &perm, std::vector<T> &vec)
+{
+    std::vector<T> tmp(perm.size());
+    for (size_t i = 0; i < perm.size(); i++)
+        tmp[i] = vec[perm[i]];
+    vec.swap(tmp);
+}
+
+/*
+ * Sort columnar data by address.
+ */
+static void sortData(const char *filename, Data &data)
+{
+    size_t size = data.addrs.size();
+    if (!std::is_sorted(data.addrs.begin(), data.addrs.end()))
+    {
+        std::vector<size_t> perm(size);
+        for (size_t i = 0; i < size; i++)
+            perm[i] = i;
+        std::stable_sort(perm.begin(), perm.end(),
+            [&data](size_t i, size_t j) -> bool
+            {
+                return (data.addrs[i] < data.addrs[j]);
+            });
+        permute(perm, data.addrs);
+        permute(perm, data.linenos);
+        for (auto &col: data.cols)
+        {
+            permute(perm, col.types);
+            permute(perm, col.vals);
+        }
+    }
+    for (size_t i = 1; i < size; i++)
+    {
+        if (data.addrs[i-1] == data.addrs[i])
             error("failed to parse CSV file \"%s\" at line %u; duplicate "
-                "record with address 0x%lx", csv.filename, csv.lineno,
-                addr);
-        record.shrink_to_fit();
-        record.swap(r.first->second);
+                "record with address 0x%lx", filename,
+                std::max(data.linenos[i-1], data.linenos[i]),
+                data.addrs[i]);
     }
+    std::vector<unsigned>().swap(data.linenos);
+    data.addrs.shrink_to_fit();
+    for (auto &col: data.cols)
+    {
+        col.types.shrink_to_fit();
+        col.vals.shrink_to_fit();
+    }
+}
 
-    fclose(stream);
+/*
+ * Parse a CSV file.  Files without quoted entries are split into chunks
+ * (at newline boundaries) which are parsed in parallel.
+ */
+static void parseCSV(const char *filename, Data &data)
+{
+    const size_t MIN_CHUNK = 1 << 20;       // Min bytes per thread
+    size_t size;
+    const char *buf = mapCSV(filename, size);
+    const char *end = buf + size;
+
+    unsigned nthreads = std::min(std::thread::hardware_concurrency(), 8u);
+    nthreads = std::max(nthreads, 1u);
+    nthreads = (unsigned)std::min((size_t)nthreads, size / MIN_CHUNK + 1);
+    if (nthreads > 1 && memchr(buf, '\"', size) != nullptr)
+        nthreads = 1;                       // Quoted newlines
+
+    std::vector<CSV> chunks;
+    const char *ptr = buf;
+    unsigned lineno = 0;
+    for (unsigned t = 0; t < nthreads && ptr < end; t++)
+    {
+        const char *next = (t == nthreads-1? end:
+            std::max(ptr, buf + (t+1) * (size / nthreads)));
+        if (next < end)
+        {
+            next = (const char *)memchr(next, '\n', end - next);
+            next = (next == nullptr? end: next + 1);
+        }
+        chunks.push_back({ptr, next, filename, -1, lineno});
+        lineno += (unsigned)std::count(ptr, next, '\n');
+        ptr = next;
+    }
+
+    std::vector<Data> parts(chunks.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < chunks.size(); t++)
+        threads.emplace_back(parseChunk, std::ref(chunks[t]),
+            std::ref(parts[t]));
+    if (chunks.size() > 0)
+        parseChunk(chunks[0], parts[0]);
+    for (auto &thread: threads)
+        thread.join();
+
+    for (auto &part: parts)
+        appendData(filename, data, part);
+    sortData(filename, data);
+    unmapCSV(buf, size);
+}
+
+/*
+ * Find the row for the given address.  Lookups are usually made in
+ * increasing address order (i.e., aligned with the instruction array), so
+ * the search gallops forward from the previous position.
+ */
+static ssize_t findRow(Data &data, intptr_t addr)
+{
+    const std::vector<intptr_t> &addrs = data.addrs;
+    size_t size = addrs.size(), i = data.cursor, lo = 0, hi = size;
+    if (size == 0)
+        return -1;
+    if (i < size && addrs[i] == addr)
+        return (ssize_t)i;
+    if (i < size && addrs[i] < addr)
+    {
+        lo = hi = i + 1;
+        for (size_t step = 1; hi < size && addrs[hi] < addr; step *= 2)
+        {
+            lo = hi + 1;
+            hi += step;
+        }
+        hi = std::min(hi + 1, size);
+    }
+    auto j = std::lower_bound(addrs.begin() + lo, addrs.begin() + hi, addr);
+    i = j - addrs.begin();
+    data.cursor = std::min(i, size - 1);
+    return (i < size && addrs[i] == addr? (ssize_t)i: -1);
 }
 
 /*
@@ -274,13 +489,23 @@ MatchVal getCSVValue(intptr_t addr, const char *basename, uint16_t idx)
         filename += ".csv";
         parseCSV(filename.c_str(), data);
     }
-    auto i = data.find(addr);
-    if (i == data.end())
+    ssize_t i = findRow(data, addr);
+    if (i < 0)
         return MatchVal();
-    const Record &record = i->second;
-    if (idx >= record.size())
+    if (idx == 0)
+        return MatchVal(data.addrs[i]);
+    if (idx > data.cols.size())
         return MatchVal();
-    return record[idx];
+    const Column &col = data.cols[idx-1];
+    switch (col.types[i])
+    {
+        case MATCH_TYPE_INTEGER:
+            return MatchVal(col.vals[i]);
+        case MATCH_TYPE_STRING:
+            return MatchVal((const char *)col.vals[i]);
+        default:
+            return MatchVal();
+    }
 }
 
 /*
@@ -288,13 +513,11 @@ MatchVal getCSVValue(intptr_t addr, const char *basename, uint16_t idx)
  */
 void parseAddrs(const char *filename, std::vector<intptr_t> &As)
 {
-    FILE *stream = fopen(filename, "r");
-    if (stream == nullptr)
-        error("failed to open CSV file \"%s\" for reading: %s",
-            filename, strerror(errno));
+    size_t size;
+    const char *data = mapCSV(filename, size);
 
     Record record;
-    CSV csv = {stream, filename, -1, 0};
+    CSV csv = {data, data + size, filename, -1, 0};
     for (size_t i = 0; ; i++)
     {
         if (!parseRecord(csv, record))
@@ -315,7 +538,7 @@ void parseAddrs(const char *filename, std::vector<intptr_t> &As)
         record.clear();
     }
 
-    fclose(stream);
+    unmapCSV(data, size);
     std::sort(As.begin(), As.end());
     std::unique(As.begin(), As.end());
     As.shrink_to_fit();
@@ -327,13 +550,12 @@ void parseAddrs(const char *filename, std::vector<intptr_t> &As)
 void parseTargets(const char *filename, const Instr *Is, size_t size,
     Targets &targets)
 {
-    FILE *stream = fopen(filename, "r");
-    if (stream == nullptr)
-        error("failed to open CSV file \"%s\" for reading: %s",
-            filename, strerror(errno));
+    size_t data_size;
+    const char *data = mapCSV(filename, data_size);
 
+    targets.kinds.assign(size, 0);
     Record record;
-    CSV csv = {stream, filename, -1, 0};
+    CSV csv = {data, data + data_size, filename, -1, 0};
     for (size_t i = 0; ; i++)
     {
         if (!parseRecord(csv, record))
@@ -367,14 +589,17 @@ void parseTargets(const char *filename, const Instr *Is, size_t size,
             kind |= (func.i != 0? kinds[i]: 0);
         }
         record.clear();
-        if (kind == 0 || findInstr(Is, size, addr.i) < 0)
+        if (kind == 0)
+            continue;
+        ssize_t idx = findInstr(Is, size, addr.i);
+        if (idx < 0)
             continue;
-        auto r = targets.insert({addr.i, kind});
-        if (!r.second)
+        if (targets.get((size_t)idx) != 0)
             error("failed to parse CSV file \"%s\" at line %u; duplicate "
                 "record with address 0x%lx", csv.filename, csv.lineno,
                 addr);
+        targets.set((size_t)idx, kind);
     }
-    fclose(stream);
+    unmapCSV(data, data_size);
 }
 
@@ -18,29 +18,51 @@
 
 #include <cstddef>
 
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <vector>
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <dlfcn.h>
 #include <elf.h>
 
+#include "e9dwarf.h"
 #include "e9elf.h"
 #include "e9misc.h"
 #include "e9tool.h"
 
 #ifdef SYSTEM_LIBDW
+#include <dwarf.h>
 #include <elfutils/libdw.h>
 #else
+#include "dwarf.h"
 #include "libdw.h"
 #endif
 
 using namespace e9tool;
 
+/*
+ * Raw line information.
+ */
+struct LineInfo
+{
+    intptr_t addr;                  // Line address
+    const char *dir;                // Line directory
+    const char *file;               // Line filename (nullptr=end)
+    unsigned line;                  // Line number
+};
+
 /*
  * Check if lines are the same.
  */
-static bool sameLine(const Line &line_1, const Line &line_2)
+static bool sameLine(const LineInfo &line_1, const LineInfo &line_2)
 {
+    if (line_1.file == nullptr || line_2.file == nullptr)
+        return false;
     if (line_1.line != line_2.line)
         return false;
     if (line_1.dir == nullptr && line_2.dir != nullptr)
@@ -56,80 +78,152 @@ static bool sameLine(const Line &line_1, const Line &line_2)
 }
 
 /*
- * Build source line information.
+ * Build the instruction index -> line map.  This is equivalent to calling
+ * findLine() for each instruction, but in linear time.
  */
-extern void e9tool::buildLines(const ELF *elf, const Instr *Is, size_t size,
-    Lines &Ls)
+static void indexLines(const Instr *Is, size_t size, Lines &Ls)
 {
-    int fd = open(elf->filename, O_RDONLY, 0);
-    if (fd < 0)
-        error("failed to open file \"%s\" for reading: %s", elf->filename,
-            strerror(errno));
-
-    Dwarf *dbg = dwarf_begin(fd, DWARF_C_READ);
-    if (dbg == nullptr)
+    const std::vector<Line> &lines = Ls.lines;
+    Ls.index.assign(size, 0);
+    for (size_t i = 0, j = 0; i < size; i++)
     {
-        const char *err = dwarf_errmsg(0);
-        if (strcmp(err, "no DWARF information") != 0)
-            error("failed to read debug information (DWARF) from file "
-                "\"%s\": %s", elf->filename, err);
-        warning("no debug information (DWARF) found in \"%s\"; line/file "
-            "information is undefined", elf->filename);
-        return;
+        intptr_t addr = (intptr_t)Is[i].address;
+        while (j < lines.size() && lines[j].lb < addr)
+            j++;
+        if (j < lines.size() && lines[j].lb == addr)
+            Ls.index[i] = (uint32_t)(j + 1);
+        else if (j > 0 && lines[j-1].lb <= addr && addr < lines[j-1].ub)
+            Ls.index[i] = (uint32_t)j;
     }
+}
 
-    Dwarf_Off offset = 0, last = 0;
-    size_t hdr_size;
-    Lines Tmp;
-    while (dwarf_nextcu(dbg, offset, &offset, &hdr_size, 0, 0, 0) == 0)
+/*
+ * Decode the line program of the CU with the given DIE offset.  The
+ * strings are owned by `dbg' and must be interned with internLines().
+ */
+static void decodeCU(Dwarf *dbg, Dwarf_Off off, std::vector<LineInfo> &Tmp)
+{
+    Dwarf_Die cudie_obj, *cudie;
+    cudie = dwarf_offdie(dbg, off, &cudie_obj);
+    if (cudie == nullptr)
+        return;
+    Dwarf_Lines *lines = nullptr;
+    Dwarf_Files *files = nullptr;
+    size_t nlines = 0, nfiles = 0, ndirs = 0;
+    if (dwarf_getsrclines(cudie, &lines, &nlines) != 0)
+        return;
+    if (dwarf_getsrcfiles(cudie, &files, &nfiles) != 0)
+        return;
+    const char *const *dirs = nullptr;
+    if (dwarf_getsrcdirs(files, &dirs, &ndirs) != 0)
+        return;
+    const char *dir = dirs[0];
+    for (size_t i = 0; i < nlines; i++)
     {
-        Dwarf_Die cudie_obj, *cudie;
-        cudie = dwarf_offdie(dbg, last + hdr_size, &cudie_obj);
-        last = offset;
-        if (cudie == nullptr)
+        Dwarf_Line *line = dwarf_onesrcline(lines, i);
+        if (line == nullptr)
             continue;
-        Dwarf_Lines *lines = nullptr;
-        Dwarf_Files *files = nullptr;
-        size_t nlines = 0, nfiles = 0, ndirs = 0;
-        if (dwarf_getsrclines(cudie, &lines, &nlines) != 0)
+        Dwarf_Addr addr;
+        if (dwarf_lineaddr(line, &addr) != 0)
             continue;
-        if (dwarf_getsrcfiles(cudie, &files, &nfiles) != 0)
+        bool end = false;
+        if (dwarf_lineendsequence(line, &end) == 0 && end)
+        {
+            Tmp.push_back({(intptr_t)addr, nullptr, nullptr, 0});
             continue;
-        const char *const *dirs = nullptr;
-        if (dwarf_getsrcdirs(files, &dirs, &ndirs) != 0)
+        }
+        const char *file = dwarf_linesrc(line, nullptr, nullptr);
+        if (file == nullptr)
             continue;
-        const char *dir = (dirs[0] != nullptr? strCache(dirs[0]): nullptr);
-        for (size_t i = 0; i < nlines; i++)
+        int lineno;
+        if (dwarf_lineno(line, &lineno) != 0)
+            continue;
+        if (lineno <= 0)
+            continue;
+        const char *tmp = (dir != nullptr && file[0] != '/'? dir: nullptr);
+        Tmp.push_back({(intptr_t)addr, tmp, file, (unsigned)lineno});
+    }
+}
+
+/*
+ * Replace the (Dwarf-owned) strings with persistent copies.
+ */
+static void internLines(std::vector<LineInfo> &Tmp)
+{
+    std::map<const char *, const char *> cache;
+    auto intern = [&cache](const char *str) -> const char *
+    {
+        if (str == nullptr)
+            return nullptr;
+        auto i = cache.find(str);
+        if (i != cache.end())
+            return i->second;
+        const char *new_str = strCache(str);
+        cache.insert({str, new_str});
+        return new_str;
+    };
+    for (auto &line: Tmp)
+    {
+        line.dir  = intern(line.dir);
+        line.file = intern(line.file);
+    }
+}
+
+/*
+ * A compilation unit (CU).
+ */
+struct CUInfo
+{
+    Dwarf_Off hdr;                  // CU header offset
+    Dwarf_Off off;                  // CU DIE offset
+    Dwarf_Off next;                 // Next CU header offset
+};
+
+/*
+ * A CU address range.
+ */
+struct CURange
+{
+    intptr_t lb;                    // Range base address
+    intptr_t ub;                    // Range end address
+    size_t cu;                      // CU index
+};
+
+/*
+ * Convert raw line information into sorted line ranges.
+ */
+static void makeLines(const Instr *Is, size_t size, std::vector<LineInfo> &Tmp,
+    std::vector<Line> &lines)
+{
+    // Sort by address, keeping the first entry for duplicate addresses
+    // (but preferring lines over end-of-sequence markers):
+    std::stable_sort(Tmp.begin(), Tmp.end(),
+        [](const LineInfo &a, const LineInfo &b) -> bool
         {
-            Dwarf_Line *line = dwarf_onesrcline(lines, i);
-            if (line == nullptr)
-                continue;
-            Dwarf_Addr addr;
-            if (dwarf_lineaddr(line, &addr) != 0)
-                continue;
-            const char *file = dwarf_linesrc(line, nullptr, nullptr);
-            if (file == nullptr)
-                continue;
-            int lineno;
-            if (dwarf_lineno(line, &lineno) != 0)
-                continue;
-            if (lineno <= 0)
-                continue;
-            file = strCache(file);
-            const char *tmp = (dir != nullptr && file[0] != '/'? dir: nullptr);
-            Tmp.emplace(std::piecewise_construct,
-                std::forward_as_tuple((intptr_t)addr),
-                std::forward_as_tuple((intptr_t)addr, INTPTR_MAX, tmp, file,
-                    (unsigned)lineno));
-        }
+            return (a.addr < b.addr);
+        });
+    size_t n = 0;
+    for (size_t i = 0; i < Tmp.size(); i++)
+    {
+        if (n == 0 || Tmp[n-1].addr != Tmp[i].addr)
+            Tmp[n++] = Tmp[i];
+        else if (Tmp[n-1].file == nullptr && Tmp[i].file != nullptr)
+            Tmp[n-1] = Tmp[i];
     }
+    Tmp.resize(n);
+
     for (auto i = Tmp.begin(), iend = Tmp.end(); i != iend; )
     {
-        const Line &line = i->second;
-        for (++i; i != iend && sameLine(i->second, line); ++i)
+        const LineInfo &line = *i;
+        if (line.file == nullptr)
+        {
+            ++i;                        // End-of-sequence
+            continue;
+        }
+        for (++i; i != iend && sameLine(*i, line); ++i)
             ;
-        intptr_t lb = line.lb;
-        intptr_t ub = (i != iend? i->second.lb: INTPTR_MAX);
+        intptr_t lb = line.addr;
+        intptr_t ub = (i != iend? i->addr: INTPTR_MAX);
         if (ub == INTPTR_MAX)
         {
             // Alternative method for end-case
@@ -139,21 +233,689 @@ extern void e9tool::buildLines(const ELF *elf, const Instr *Is, size_t size,
                     i++)
                 ub = Is[i].address + Is[i].size;
         }
-        Ls.emplace(std::piecewise_construct,
-            std::forward_as_tuple(lb),
-            std::forward_as_tuple(lb, ub, line.dir, line.file, line.line));
+        lines.emplace_back(lb, ub, line.dir, line.file, line.line);
+    }
+    lines.shrink_to_fit();
+}
+
+/*
+ * Find the line associated with the given address in sorted lines.
+ */
+static const Line *findSortedLine(const std::vector<Line> &lines,
+    intptr_t addr)
+{
+    auto i = std::lower_bound(lines.begin(), lines.end(), addr,
+        [](const Line &line, intptr_t addr) -> bool
+        {
+            return (line.lb < addr);
+        });
+    if (i != lines.end() && i->lb == addr)
+        return &*i;
+    if (i == lines.begin())
+        return nullptr;
+    i--;
+    if (i->lb <= addr && addr < i->ub)
+        return &*i;
+    else
+        return nullptr;
+}
+
+/*
+ * Lazy line loader.  Line programs are only decoded for CUs that contain
+ * a queried address.
+ */
+struct e9tool::LineLoader
+{
+    Dwarf *dbg;                     // DWARF handle
+    const Instr *Is;                // Instructions
+    size_t size;                    // Number of instructions
+    std::vector<CUInfo> cus;        // All CUs
+    std::vector<std::vector<Line> *> lines;
+                                    // Decoded CU lines (or nullptr)
+    std::vector<CURange> ranges;    // CU ranges (sorted by lb)
+    std::vector<intptr_t> max_ub;   // Prefix maximum of ranges[].ub
+    std::vector<size_t> unranged;   // CUs with unknown ranges
+    size_t decoded = 0;             // Number of decoded CUs
+    intptr_t last_addr = INTPTR_MIN;
+                                    // Last queried address
+    const Line *last = nullptr;     // Last query result (memoized)
+};
+
+/*
+ * Get all CUs.
+ */
+static void getCUs(Dwarf *dbg, std::vector<CUInfo> &cus)
+{
+    Dwarf_Off offset = 0, last = 0;
+    size_t hdr_size;
+    while (dwarf_nextcu(dbg, offset, &offset, &hdr_size, 0, 0, 0) == 0)
+    {
+        cus.push_back({last, last + hdr_size, offset});
+        last = offset;
+    }
+}
+
+/*
+ * Read an unsigned integer from a section.
+ */
+static bool readUInt(const uint8_t *&ptr, const uint8_t *end, unsigned size,
+    uint64_t &val)
+{
+    if (ptr + size > end)
+        return false;
+    val = 0;
+    memcpy(&val, ptr, size);
+    ptr += size;
+    return true;
+}
+
+/*
+ * .eh_frame section (or .eh_frame_hdr section) view.
+ */
+struct EHSection
+{
+    const uint8_t *start;           // Section data
+    const uint8_t *end;             // Section data end
+    intptr_t addr;                  // Section address
+};
+
+/*
+ * Get an .eh_frame/.eh_frame_hdr section view.
+ */
+static bool getEHSection(const ELF *elf, const char *name, EHSection &S)
+{
+    const Elf64_Shdr *shdr = getELFSection(elf, name);
+    if (shdr == nullptr || shdr->sh_type == SHT_NOBITS ||
+            shdr->sh_offset + shdr->sh_size > elf->size)
+        return false;
+    S.start = elf->data + shdr->sh_offset;
+    S.end   = S.start + shdr->sh_size;
+    S.addr  = (intptr_t)shdr->sh_addr;
+    return true;
+}
+
+/*
+ * Read an (U|S)LEB128 value.
+ */
+static bool readLEB128(const uint8_t *&ptr, const uint8_t *end, bool sign,
+    uint64_t &val)
+{
+    val = 0;
+    for (unsigned shift = 0; ptr < end && shift < 64; shift += 7)
+    {
+        uint8_t b = *ptr++;
+        val |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) != 0)
+            continue;
+        if (sign && shift + 7 < 64 && (b & 0x40) != 0)
+            val |= ~(uint64_t)0 << (shift + 7);
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Read a DW_EH_PE_* encoded pointer.  Only the encodings used by GCC/clang
+ * are supported (no textrel/funcrel/aligned/indirect).
+ */
+static bool readEHPointer(const EHSection &S, const uint8_t *&ptr,
+    uint8_t enc, intptr_t datarel, intptr_t &val)
+{
+    intptr_t pc = S.addr + (ptr - S.start);
+    uint64_t x;
+    bool ok;
+    switch (enc & 0x0f)
+    {
+        case DW_EH_PE_absptr: case DW_EH_PE_udata8: case DW_EH_PE_sdata8:
+            ok = readUInt(ptr, S.end, 8, x);
+            break;
+        case DW_EH_PE_uleb128:
+            ok = readLEB128(ptr, S.end, false, x);
+            break;
+        case DW_EH_PE_sleb128:
+            ok = readLEB128(ptr, S.end, true, x);
+            break;
+        case DW_EH_PE_udata2:
+            ok = readUInt(ptr, S.end, 2, x);
+            break;
+        case DW_EH_PE_sdata2:
+            ok = readUInt(ptr, S.end, 2, x);
+            x = (uint64_t)(int64_t)(int16_t)x;
+            break;
+        case DW_EH_PE_udata4:
+            ok = readUInt(ptr, S.end, 4, x);
+            break;
+        case DW_EH_PE_sdata4:
+            ok = readUInt(ptr, S.end, 4, x);
+            x = (uint64_t)(int64_t)(int32_t)x;
+            break;
+        default:
+            return false;
+    }
+    if (!ok)
+        return false;
+    switch (enc & 0xf0)
+    {
+        case DW_EH_PE_absptr:
+            break;
+        case DW_EH_PE_pcrel:
+            x += (uint64_t)pc;
+            break;
+        case DW_EH_PE_datarel:
+            x += (uint64_t)datarel;
+            break;
+        default:
+            return false;
+    }
+    val = (intptr_t)x;
+    return true;
+}
+
+/*
+ * Parse a CIE and return the FDE pointer encoding (cached).
+ */
+static bool parseCIE(const EHSection &S, size_t offset,
+    std::map<size_t, uint8_t> &cies, uint8_t &enc)
+{
+    auto i = cies.find(offset);
+    if (i != cies.end())
+    {
+        enc = i->second;
+        return true;
+    }
+    const uint8_t *ptr = S.start + offset;
+    uint64_t len, id, version, x;
+    if (!readUInt(ptr, S.end, 4, len) || len == 0 || len == 0xFFFFFFFF ||
+            len > (uint64_t)(S.end - ptr))
+        return false;
+    const uint8_t *end = ptr + len;
+    if (!readUInt(ptr, end, 4, id) || id != 0 ||
+            !readUInt(ptr, end, 1, version))
+        return false;
+    const char *aug = (const char *)ptr;
+    size_t aug_len = strnlen(aug, end - ptr);
+    if (aug_len >= (size_t)(end - ptr))
+        return false;
+    ptr += aug_len + 1;
+    if (strstr(aug, "eh") != nullptr)
+        ptr += sizeof(void *);
+    if (!readLEB128(ptr, end, false, x) ||          // Code alignment
+            !readLEB128(ptr, end, true, x))         // Data alignment
+        return false;
+    if (version == 1)
+        ptr++;                                      // Return register
+    else if (!readLEB128(ptr, end, false, x))
+        return false;
+    enc = DW_EH_PE_absptr;
+    if (aug[0] == 'z')
+    {
+        if (!readLEB128(ptr, end, false, x))        // Augmentation length
+            return false;
+        for (const char *a = aug + 1; *a != '\0'; a++)
+        {
+            intptr_t y;
+            uint8_t penc;
+            switch (*a)
+            {
+                case 'R':
+                    if (ptr >= end)
+                        return false;
+                    enc = *ptr++;
+                    break;
+                case 'P':
+                    if (ptr >= end)
+                        return false;
+                    penc = *ptr++ & ~DW_EH_PE_indirect; // Skipped anyway
+                    if (!readEHPointer(S, ptr, penc, 0, y))
+                        return false;
+                    break;
+                case 'L':
+                    ptr++;
+                    break;
+                case 'S': case 'B':
+                    break;
+                default:
+                    return false;
+            }
+        }
     }
+    cies.insert({offset, enc});
+    return true;
+}
+
+/*
+ * Parse the FDE at the given offset.  Returns the offset of the next entry,
+ * or 0 on error/end.  The range [lb..ub) is set for FDEs, else lb=ub=0.
+ */
+static size_t parseFDE(const EHSection &S, size_t offset,
+    std::map<size_t, uint8_t> &cies, intptr_t &lb, intptr_t &ub)
+{
+    lb = ub = 0;
+    const uint8_t *ptr = S.start + offset;
+    uint64_t len, id;
+    if (!readUInt(ptr, S.end, 4, len) || len == 0 || len == 0xFFFFFFFF ||
+            len > (uint64_t)(S.end - ptr))
+        return 0;
+    const uint8_t *end = ptr + len;
+    size_t next = end - S.start;
+    const uint8_t *cie = ptr;
+    if (!readUInt(ptr, end, 4, id))
+        return 0;
+    if (id == 0)
+        return next;                                // CIE
+    if (id > (uint64_t)(cie - S.start))
+        return 0;
+    uint8_t enc;
+    intptr_t range;
+    if (!parseCIE(S, (cie - S.start) - id, cies, enc) ||
+            !readEHPointer(S, ptr, enc, 0, lb) ||
+            !readEHPointer(S, ptr, enc & 0x0f, 0, range))
+        return 0;
+    ub = lb + range;
+    return next;
+}
+
+/*
+ * Get the function ranges described by the .eh_frame section (sorted by
+ * address).  If available, the .eh_frame_hdr binary search table is used to
+ * locate the FDEs directly, otherwise the .eh_frame section is scanned.  The
+ * result is parsed once and cached with the ELF.
+ */
+const FDEs &getFDEs(const ELF *elf)
+{
+    FDEs &fdes = elf->fdes;
+    if (elf->fdes_built)
+        return fdes;
+    elf->fdes_built = true;
+
+    EHSection S;
+    if (!getEHSection(elf, ".eh_frame", S))
+        return fdes;
+    std::map<size_t, uint8_t> cies;
+    intptr_t lb, ub;
+
+    EHSection H;
+    bool ok = false;
+    if (getEHSection(elf, ".eh_frame_hdr", H) && H.end - H.start >= 4 &&
+            H.start[0] == 1 && H.start[3] == (DW_EH_PE_datarel |
+                DW_EH_PE_sdata4))
+    {
+        const uint8_t *ptr = H.start + 4;
+        intptr_t frame, count;
+        ok = (readEHPointer(H, ptr, H.start[1], H.addr, frame) &&
+              readEHPointer(H, ptr, H.start[2], H.addr, count) &&
+              count >= 0 && (size_t)count <= (size_t)(H.end - ptr) / 8);
+        for (intptr_t i = 0; ok && i < count; i++)
+        {
+            intptr_t loc, fde;
+            ok = (readEHPointer(H, ptr, H.start[3], H.addr, loc) &&
+                  readEHPointer(H, ptr, H.start[3], H.addr, fde) &&
+                  fde >= S.addr && fde < S.addr + (S.end - S.start) &&
+                  parseFDE(S, fde - S.addr, cies, lb, ub) != 0 &&
+                  lb == loc);
+            if (ok && ub > lb)
+                fdes.push_back({lb, ub});
+        }
+        if (!ok)
+            fdes.clear();
+    }
+    for (size_t offset = 0; !ok && offset < (size_t)(S.end - S.start); )
+    {
+        offset = parseFDE(S, offset, cies, lb, ub);
+        if (offset == 0)
+            break;
+        if (ub > lb)
+            fdes.push_back({lb, ub});
+    }
+    std::sort(fdes.begin(), fdes.end());
+    if (option_debug)
+        debug("found %zu function(s) in .eh_frame%s", fdes.size(),
+            (ok? " (via .eh_frame_hdr)": ""));
+    return fdes;
+}
+
+/*
+ * Build CU ranges from the .debug_aranges section.  Returns false if
+ * the section is missing or malformed.
+ */
+static bool getArangeCURanges(const ELF *elf, const std::vector<CUInfo> &cus,
+    std::vector<CURange> &ranges, std::vector<bool> &ranged)
+{
+    const Elf64_Shdr *shdr = getELFSection(elf, ".debug_aranges");
+    if (shdr == nullptr || shdr->sh_type == SHT_NOBITS ||
+            (shdr->sh_flags & SHF_COMPRESSED) != 0 ||
+            shdr->sh_offset + shdr->sh_size > elf->size)
+        return false;
+    std::map<Dwarf_Off, size_t> hdrs;
+    for (size_t i = 0; i < cus.size(); i++)
+        hdrs.insert({cus[i].hdr, i});
+
+    std::vector<CURange> tmp;
+    std::vector<bool> seen(cus.size(), false);
+    const uint8_t *start = elf->data + shdr->sh_offset;
+    const uint8_t *end = start + shdr->sh_size;
+    const uint8_t *ptr = start;
+    while (ptr < end)
+    {
+        const uint8_t *set = ptr;
+        uint64_t len, version, cu_off, addr_size, seg_size;
+        unsigned off_size = 4;
+        if (!readUInt(ptr, end, 4, len))
+            return false;
+        if (len == 0xFFFFFFFF)
+        {
+            off_size = 8;
+            if (!readUInt(ptr, end, 8, len))
+                return false;
+        }
+        if (len > (uint64_t)(end - ptr))
+            return false;
+        const uint8_t *set_end = ptr + len;
+        if (!readUInt(ptr, set_end, 2, version) ||
+                !readUInt(ptr, set_end, off_size, cu_off) ||
+                !readUInt(ptr, set_end, 1, addr_size) ||
+                !readUInt(ptr, set_end, 1, seg_size))
+            return false;
+        if (version != 2 || addr_size != sizeof(uint64_t) || seg_size != 0)
+            return false;
+        auto i = hdrs.find(cu_off);
+        if (i == hdrs.end())
+            return false;
+        size_t tuple = 2 * addr_size;
+        ptr = set + (((ptr - set) + tuple - 1) / tuple) * tuple;
+        while (true)
+        {
+            uint64_t addr, size;
+            if (!readUInt(ptr, set_end, 8, addr) ||
+                    !readUInt(ptr, set_end, 8, size))
+                return false;
+            if (addr == 0 && size == 0)
+                break;
+            tmp.push_back({(intptr_t)addr, (intptr_t)(addr + size),
+                i->second});
+        }
+        seen[i->second] = true;
+        ptr = set_end;
+    }
+    ranges.insert(ranges.end(), tmp.begin(), tmp.end());
+    for (size_t i = 0; i < seen.size(); i++)
+        ranged[i] = ranged[i] || seen[i];
+    return true;
+}
+
+/*
+ * Build the CU range from the CU's DW_AT_low_pc/DW_AT_high_pc.  Returns
+ * false if the range cannot be determined (e.g., uses DW_AT_ranges).
+ */
+static bool getDieCURange(Dwarf *dbg, const CUInfo &cu, size_t idx,
+    std::vector<CURange> &ranges)
+{
+    Dwarf_Die cudie_obj, *cudie;
+    cudie = dwarf_offdie(dbg, cu.off, &cudie_obj);
+    if (cudie == nullptr)
+        return false;
+    if (dwarf_hasattr(cudie, DW_AT_ranges))
+        return false;
+    Dwarf_Attribute attr_obj, *attr;
+    attr = dwarf_attr(cudie, DW_AT_low_pc, &attr_obj);
+    if (attr == nullptr || attr->form != DW_FORM_addr)
+        return false;
+    uint64_t lb, ub;
+    memcpy(&lb, attr->valp, sizeof(lb));
+    attr = dwarf_attr(cudie, DW_AT_high_pc, &attr_obj);
+    if (attr == nullptr)
+        return false;
+    if (attr->form == DW_FORM_addr)
+        memcpy(&ub, attr->valp, sizeof(ub));
+    else
+    {
+        Dwarf_Word size;
+        if (dwarf_formudata(attr, &size) != 0)
+            return false;
+        ub = lb + size;
+    }
+    if (ub < lb)
+        return false;
+    ranges.push_back({(intptr_t)lb, (intptr_t)ub, idx});
+    return true;
+}
+
+/*
+ * Get the decoded lines for the given CU.
+ */
+static const std::vector<Line> &getCULines(LineLoader *L, size_t cu)
+{
+    if (L->lines[cu] != nullptr)
+        return *L->lines[cu];
+    std::vector<LineInfo> Tmp;
+    decodeCU(L->dbg, L->cus[cu].off, Tmp);
+    internLines(Tmp);
+    std::vector<Line> *lines = new std::vector<Line>;
+    makeLines(L->Is, L->size, Tmp, *lines);
+    L->lines[cu] = lines;
+    L->decoded++;
+    return *lines;
+}
+
+/*
+ * Lazily find the line associated with the given address.  If several
+ * CUs cover the address, the first CU wins.
+ */
+static const Line *findLazyLine(LineLoader *L, intptr_t addr)
+{
+    // The same instruction is typically queried several times in a row
+    // (e.g., for both `line' and `file'):
+    if (addr == L->last_addr)
+        return L->last;
+    const Line *result = nullptr;
+    size_t best = SIZE_MAX;
+    auto check = [L, addr, &result, &best](size_t cu)
+    {
+        if (cu >= best)
+            return;
+        const Line *line = findSortedLine(getCULines(L, cu), addr);
+        if (line != nullptr)
+        {
+            result = line;
+            best   = cu;
+        }
+    };
+    for (size_t cu: L->unranged)
+        check(cu);
+    auto i = std::upper_bound(L->ranges.begin(), L->ranges.end(), addr,
+        [](intptr_t addr, const CURange &range) -> bool
+        {
+            return (addr < range.lb);
+        });
+    for (size_t j = i - L->ranges.begin(); j > 0 && L->max_ub[j-1] > addr;
+            j--)
+    {
+        const CURange &range = L->ranges[j-1];
+        if (range.lb <= addr && addr < range.ub)
+            check(range.cu);
+    }
+    size_t j = i - L->ranges.begin();
+    if (result == nullptr && j > 0)
+        check(L->ranges[j-1].cu);       // Padding after a range?
+    L->last_addr = addr;
+    L->last      = result;
+    return result;
+}
+
+/*
+ * Build the lazy line loader.
+ */
+static void buildLazyLines(const ELF *elf, const Instr *Is, size_t size,
+    Dwarf *dbg, Lines &Ls)
+{
+    LineLoader *L = new LineLoader;
+    L->dbg  = dbg;
+    L->Is   = Is;
+    L->size = size;
+    getCUs(dbg, L->cus);
+    L->lines.assign(L->cus.size(), nullptr);
+
+    std::vector<bool> ranged(L->cus.size(), false);
+    if (!getArangeCURanges(elf, L->cus, L->ranges, ranged))
+        L->ranges.clear();
+    for (size_t i = 0; i < L->cus.size(); i++)
+    {
+        if (ranged[i] || getDieCURange(dbg, L->cus[i], i, L->ranges))
+            continue;
+        L->unranged.push_back(i);
+    }
+    std::sort(L->ranges.begin(), L->ranges.end(),
+        [](const CURange &a, const CURange &b) -> bool
+        {
+            return (a.lb < b.lb);
+        });
+    intptr_t max_ub = INTPTR_MIN;
+    for (const auto &range: L->ranges)
+    {
+        max_ub = std::max(max_ub, range.ub);
+        L->max_ub.push_back(max_ub);
+    }
+    debug("lines: lazy, cus=%zu, ranges=%zu, unranged=%zu", L->cus.size(),
+        L->ranges.size(), L->unranged.size());
+    Ls.loader = L;
+}
+
+/*
+ * An eager line decoding job for a (contiguous) subset of CUs.
+ */
+struct LineJob
+{
+    const char *filename;           // DWARF filename
+    const CUInfo *cus;              // CUs to decode
+    size_t num_cus;                 // Number of CUs
+    int fd = -1;                    // Private file descriptor
+    Dwarf *dbg = nullptr;           // Private DWARF handle
+    std::vector<LineInfo> Tmp;      // Decoded lines
+};
+
+/*
+ * Decode all CUs for the given job.
+ */
+static void decodeCUs(Dwarf *dbg, LineJob *job)
+{
+    for (size_t i = 0; i < job->num_cus; i++)
+        decodeCU(dbg, job->cus[i].off, job->Tmp);
+}
+
+/*
+ * Eagerly build all lines, decoding CUs in parallel.
+ */
+static void buildEagerLines(const ELF *elf, const Instr *Is, size_t size,
+    Dwarf *dbg, unsigned nthreads, Lines &Ls)
+{
+    const size_t MIN_CHUNK = 64 * 1024;     // Min .debug_info per thread
+    std::vector<CUInfo> cus;
+    getCUs(dbg, cus);
+    size_t total = (cus.size() > 0? cus.back().next: 0);
+    if (nthreads == 0)
+        nthreads = std::min(std::thread::hardware_concurrency(), 8u);
+    nthreads = std::max(nthreads, 1u);
+    nthreads = (unsigned)std::min((size_t)nthreads, total / MIN_CHUNK + 1);
+    nthreads = (unsigned)std::min((size_t)nthreads,
+        std::max(cus.size(), (size_t)1));
+
+    // Split the CUs into (roughly) equal sized contiguous chunks:
+    std::vector<LineJob> jobs(nthreads);
+    size_t chunk = total / nthreads + 1, j = 0;
+    for (unsigned t = 0; t < nthreads; t++)
+    {
+        size_t k = j;
+        while (k < cus.size() &&
+                (t == nthreads-1 || cus[k].hdr < (t+1) * chunk))
+            k++;
+        jobs[t].filename = elf->filename;
+        jobs[t].cus      = cus.data() + j;
+        jobs[t].num_cus  = k - j;
+        j = k;
+    }
+
+    auto worker = [&jobs](unsigned t)
+    {
+        LineJob *job = &jobs[t];
+        job->fd = open(job->filename, O_RDONLY, 0);
+        if (job->fd < 0)
+            return;
+        job->dbg = dwarf_begin(job->fd, DWARF_C_READ);
+        if (job->dbg == nullptr)
+            return;
+        decodeCUs(job->dbg, job);
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < nthreads; t++)
+        threads.emplace_back(worker, t);
+    decodeCUs(dbg, &jobs[0]);
+    for (auto &thread: threads)
+        thread.join();
+
+    // Merge in CU order (same result as a serial decode):
+    std::vector<LineInfo> Tmp;
+    for (unsigned t = 0; t < nthreads; t++)
+    {
+        LineJob *job = &jobs[t];
+        if (t > 0 && job->dbg == nullptr)
+            decodeCUs(dbg, job);        // Fallback
+        internLines(job->Tmp);
+        Tmp.insert(Tmp.end(), job->Tmp.begin(), job->Tmp.end());
+        std::vector<LineInfo>().swap(job->Tmp);
+        if (job->dbg != nullptr)
+            dwarf_end(job->dbg);
+        if (job->fd >= 0)
+            close(job->fd);
+    }
+    makeLines(Is, size, Tmp, Ls.lines);
+    indexLines(Is, size, Ls);
+    debug("lines: eager, cus=%zu, threads=%u, lines=%zu", cus.size(),
+        nthreads, Ls.lines.size());
 
 #if 0
-    for (const auto &E: Ls)
+    for (const auto &L: Ls.lines)
     {
-        const Line &L = E.second;
         fprintf(stderr, "0x%lx..0x%lx [%zu]: %s:%u\n", L.lb, L.ub,
             L.ub - L.lb, L.file, L.line);
     }
 #endif
+}
+
+/*
+ * Build source line information.  In lazy mode, only a CU address range
+ * index is built, and line programs are decoded on demand.  Otherwise,
+ * all CUs are decoded eagerly using `nthreads' threads (0=auto).
+ */
+extern void e9tool::buildLines(const ELF *elf, const Instr *Is, size_t size,
+    Lines &Ls, bool lazy, unsigned nthreads)
+{
+    int fd = open(elf->filename, O_RDONLY, 0);
+    if (fd < 0)
+        error("failed to open file \"%s\" for reading: %s", elf->filename,
+            strerror(errno));
+
+    Dwarf *dbg = dwarf_begin(fd, DWARF_C_READ);
+    if (dbg == nullptr)
+    {
+        const char *err = dwarf_errmsg(0);
+        if (strcmp(err, "no DWARF information") != 0)
+            error("failed to read debug information (DWARF) from file "
+                "\"%s\": %s", elf->filename, err);
+        warning("no debug information (DWARF) found in \"%s\"; line/file "
+            "information is undefined", elf->filename);
+        close(fd);
+        return;
+    }
 
+    if (lazy)
+    {
+        // Note: `dbg' must remain valid for later lookups.
+        buildLazyLines(elf, Is, size, dbg, Ls);
+        return;
+    }
+    buildEagerLines(elf, Is, size, dbg, nthreads, Ls);
     dwarf_end(dbg);
+    close(fd);
 }
 
 /*
@@ -161,18 +923,22 @@ extern void e9tool::buildLines(const ELF *elf, const Instr *Is, size_t size,
  */
 extern const Line *e9tool::findLine(const Lines &Ls, intptr_t addr)
 {
-    auto i = Ls.lower_bound(addr);
-    if (i == Ls.end())
-        return nullptr;
-    if (i->second.lb == addr)
-        return &i->second;
-    auto j = Ls.begin();
-    if (i == j)
-        return nullptr;
-    i--;
-    if (i->second.lb <= addr && addr < i->second.ub)
-        return &i->second;
-    else
+    if (Ls.loader != nullptr)
+        return findLazyLine(Ls.loader, addr);
+    return findSortedLine(Ls.lines, addr);
+}
+
+/*
+ * Find the line associated with the given instruction index.
+ */
+extern const Line *e9tool::findInstrLine(const Lines &Ls, size_t idx)
+{
+    if (Ls.loader != nullptr)
+        return (idx < Ls.loader->size?
+            findLazyLine(Ls.loader, (intptr_t)Ls.loader->Is[idx].address):
+            nullptr);
+    if (idx >= Ls.index.size() || Ls.index[idx] == 0)
         return nullptr;
+    return &Ls.lines[Ls.index[idx]-1];
 }
 
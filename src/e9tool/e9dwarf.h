@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2024 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __E9DWARF_H
+#define __E9DWARF_H
+
+#include <cstdint>
+
+#include <utility>
+#include <vector>
+
+#include "e9elf.h"
+
+/*
+ * Function ranges [lb..ub) recovered from .eh_frame FDEs (sorted).
+ */
+typedef std::vector<std::pair<intptr_t, intptr_t>> FDEs;
+
+extern const FDEs &getFDEs(const e9tool::ELF *elf);
+
+#endif
@@ -20,9 +20,11 @@
 #include <list>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <cstdint>
+#include <cstring>
 
 #include <elf.h>
 
@@ -70,9 +72,63 @@ struct Symbol
 };
 
 /*
- * Symbol cache.  INTPTR_MIN=missing, (>0)=original, (<0)=derived.
+ * GNU symbol hash (as used by DT_GNU_HASH).
  */
-typedef std::map<Symbol, intptr_t> Symbols;
+static inline uint32_t gnuHash(const char *name)
+{
+    uint32_t h = 5381;
+    for (const uint8_t *s = (const uint8_t *)name; *s != '\0'; s++)
+        h = (h << 5) + h + *s;
+    return h;
+}
+
+/*
+ * C-string hashing.
+ */
+struct CStrHash
+{
+    size_t operator()(const char *s) const
+    {
+        return gnuHash(s);
+    }
+};
+struct CStrEq
+{
+    bool operator()(const char *a, const char *b) const
+    {
+        return (strcmp(a, b) == 0);
+    }
+};
+
+/*
+ * Symbol cache.  Maps a symbol name to its typesigs (sorted).  Addresses
+ * are INTPTR_MIN=missing, (>0)=original, (<0)=derived.
+ */
+typedef std::vector<std::pair<TypeSig, intptr_t>> SymbolSigs;
+typedef std::unordered_map<const char *, SymbolSigs, CStrHash, CStrEq>
+    Symbols;
+
+/*
+ * Symbol index entry.
+ */
+struct SymbolEntry
+{
+    const char *name;                   // Symbol name
+    uint32_t hash;                      // Symbol hash (gnuHash() & ~1)
+    const Elf64_Sym *dynsym;            // .dynsym symbol (or nullptr)
+    const Elf64_Sym *sym;               // .symtab symbol (or nullptr)
+    intptr_t plt;                       // PLT entry (or INTPTR_MIN)
+    intptr_t got;                       // GOT entry (or INTPTR_MIN)
+};
+
+/*
+ * Hashed symbol index over .dynsym/.symtab/PLT/GOT names.
+ */
+struct SymbolIndex
+{
+    std::vector<SymbolEntry> entries;   // Entries
+    std::vector<uint32_t> table;        // Hash table (entry index + 1)
+};
 
 /*
  * ELF file.
@@ -111,6 +167,9 @@ namespace e9tool
         // PLT
         PLTInfo plt;
 
+        // Symbol index (dynsyms+syms+GOT+PLT)
+        SymbolIndex index;
+
         BinaryType type;                // Binary type.
         bool reloc;                     // Needs relocation?
         bool dynlink;                   // Dynamically linked?
@@ -126,6 +185,9 @@ namespace e9tool
         Lines lines;                    // Lines [optional, only with (-g)]
 
         mutable Symbols symbols;        // Symbol cache.
+        mutable std::vector<std::pair<intptr_t, intptr_t>> fdes;
+                                        // FDE cache (see getFDEs()).
+        mutable bool fdes_built = false;// FDE cache built?
         std::list<Elf64_Shdr> sec_cache;// Extra allocated sections (PE).
         std::list<Elf64_Sym> sym_cache; // Extra allocated symbols (PE).
         std::string str_cache;          // Extra allocated strings (PE).
@@ -144,17 +206,21 @@ namespace e9tool
         const CallABI abi;
         const CallJump jmp;
         const PatchPos pos;
+        const CallSave save;
         const bool state;
         const ELF * const target;
         const char *const entry;
         const std::vector<ArgumentKind> args;
-
-        Call(CallABI abi, CallJump jmp, PatchPos pos, bool state,
-                const ELF *target, const char *entry,
-                const std::vector<ArgumentKind> &args) :
-            abi(abi), jmp(jmp), pos(pos), state(state), target(target),
-            entry(entry),
-            args(args)      // copy
+        const std::vector<uint8_t> fastpath;    // Inline fast path (if any)
+
+        Call(CallABI abi, CallJump jmp, PatchPos pos, CallSave save,
+                bool state, const ELF *target, const char *entry,
+                const std::vector<ArgumentKind> &args,
+                const std::vector<uint8_t> &fastpath) :
+            abi(abi), jmp(jmp), pos(pos), save(save), state(state),
+            target(target), entry(entry),
+            args(args),     // copy
+            fastpath(fastpath)
         {
             ;
         }
@@ -30,6 +30,7 @@
 
 #include <list>
 #include <regex>
+#include <set>
 #include <string>
 
 #include <fcntl.h>
@@ -48,6 +49,7 @@
 #include "e9tool.h"
 #include "e9misc.h"
 #include "e9types.h"
+#include "e9x86_64.h"
 #include "../e9patch/e9loader.h"
 
 using namespace e9tool;
@@ -879,6 +881,123 @@ static void parseSymbols(const uint8_t *data, const Elf64_Shdr *shdr_syms,
     }
 }
 
+/*
+ * Find the symbol index entry for the given name, or insert a new entry.
+ */
+static SymbolEntry *insertSymbolEntry(SymbolIndex &index, const char *name,
+    uint32_t hash)
+{
+    size_t mask = index.table.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        uint32_t j = index.table[i];
+        if (j == 0)
+        {
+            index.entries.push_back({name, hash, nullptr, nullptr,
+                INTPTR_MIN, INTPTR_MIN});
+            index.table[i] = (uint32_t)index.entries.size();
+            return &index.entries.back();
+        }
+        SymbolEntry *entry = &index.entries[j-1];
+        if (entry->hash == hash && strcmp(entry->name, name) == 0)
+            return entry;
+    }
+}
+
+/*
+ * Find the symbol index entry for the given name, or nullptr.
+ */
+static const SymbolEntry *findSymbolEntry(const ELF *elf, const char *name)
+{
+    const SymbolIndex &index = elf->index;
+    if (index.table.size() == 0)
+        return nullptr;
+    uint32_t hash = gnuHash(name) & ~1u;
+    size_t mask = index.table.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        uint32_t j = index.table[i];
+        if (j == 0)
+            return nullptr;
+        const SymbolEntry *entry = &index.entries[j-1];
+        if (entry->hash == hash && strcmp(entry->name, name) == 0)
+            return entry;
+    }
+}
+
+/*
+ * Get the (precomputed) .dynsym hash chain from the .gnu.hash section, if
+ * present.  Each chain value is the symbol's gnuHash() with the low bit
+ * reused as an end-of-chain marker.
+ */
+static const uint32_t *getGNUHashChain(const ELF *elf,
+    const Elf64_Shdr *shdr_dynsym, size_t &lo, size_t &hi)
+{
+    const Elf64_Shdr *shdr = getELFSection(elf, ".gnu.hash");
+    if (shdr == nullptr || shdr_dynsym == nullptr ||
+            shdr->sh_type != SHT_GNU_HASH ||
+            shdr->sh_offset + shdr->sh_size > elf->size ||
+            shdr->sh_size < 4 * sizeof(uint32_t))
+        return nullptr;
+    const uint32_t *hdr = (const uint32_t *)(elf->data + shdr->sh_offset);
+    size_t nbuckets = hdr[0], symoffset = hdr[1], bloom_size = hdr[2];
+    size_t nsyms = shdr_dynsym->sh_size / sizeof(Elf64_Sym);
+    size_t offset = 4 * sizeof(uint32_t) + bloom_size * sizeof(uint64_t) +
+        nbuckets * sizeof(uint32_t);
+    if (symoffset > nsyms ||
+            offset + (nsyms - symoffset) * sizeof(uint32_t) > shdr->sh_size)
+        return nullptr;
+    lo = symoffset;
+    hi = nsyms;
+    return (const uint32_t *)(elf->data + shdr->sh_offset + offset);
+}
+
+/*
+ * Build the hashed symbol index.
+ */
+static void buildSymbolIndex(ELF *elf)
+{
+    SymbolIndex &index = elf->index;
+    size_t n = elf->dynsyms.size() + elf->syms.size() + elf->plt.size() +
+        elf->got.size();
+    if (n == 0)
+        return;
+    size_t size = 16;
+    while (size < 2 * n)
+        size *= 2;
+    index.table.assign(size, 0);
+    index.entries.reserve(n);
+
+    const Elf64_Shdr *shdr_dynsym = getELFSection(elf, ".dynsym");
+    const Elf64_Sym *dynsym_tab = (shdr_dynsym == nullptr? nullptr:
+        (const Elf64_Sym *)(elf->data + shdr_dynsym->sh_offset));
+    size_t lo = 0, hi = 0;
+    const uint32_t *chain = getGNUHashChain(elf, shdr_dynsym, lo, hi);
+    for (const auto &entry: elf->dynsyms)
+    {
+        size_t idx = entry.second - dynsym_tab;
+        uint32_t hash = (chain != nullptr && idx >= lo && idx < hi?
+            chain[idx - lo]: gnuHash(entry.first)) & ~1u;
+        SymbolEntry *sym = insertSymbolEntry(index, entry.first, hash);
+        sym->dynsym = entry.second;
+    }
+    for (const auto &entry: elf->syms)
+    {
+        uint32_t hash = gnuHash(entry.first) & ~1u;
+        insertSymbolEntry(index, entry.first, hash)->sym = entry.second;
+    }
+    for (const auto &entry: elf->plt)
+    {
+        uint32_t hash = gnuHash(entry.first) & ~1u;
+        insertSymbolEntry(index, entry.first, hash)->plt = entry.second;
+    }
+    for (const auto &entry: elf->got)
+    {
+        uint32_t hash = gnuHash(entry.first) & ~1u;
+        insertSymbolEntry(index, entry.first, hash)->got = entry.second;
+    }
+}
+
 /*
  * Parse an ELF file.
  */
@@ -1221,6 +1340,7 @@ ELF *e9tool::parseELF(const char *filename, intptr_t base)
     elf->exes.reserve(exes.size());
     for (const auto &entry: exes)
         elf->exes.push_back(entry.second);
+    buildSymbolIndex(elf);
     return elf;
 }
 
@@ -1543,6 +1663,7 @@ ELF *e9tool::parsePE(const char *filename)
     elf->sym_cache.swap(sym_cache);
     elf->str_cache.swap(strs);
 
+    buildSymbolIndex(elf);
     return elf;
 }
 
@@ -1616,31 +1737,23 @@ const Elf64_Shdr *e9tool::getELFSection(const ELF *elf, const char *name)
 }
 const Elf64_Sym *e9tool::getELFDynSym(const ELF *elf, const char *name)
 {
-    auto i = elf->dynsyms.find(name);
-    if (i == elf->dynsyms.end())
-        return nullptr;
-    return i->second;
+    const SymbolEntry *entry = findSymbolEntry(elf, name);
+    return (entry == nullptr? nullptr: entry->dynsym);
 }
 const Elf64_Sym *e9tool::getELFSym(const ELF *elf, const char *name)
 {
-    auto i = elf->syms.find(name);
-    if (i == elf->syms.end())
-        return nullptr;
-    return i->second;
+    const SymbolEntry *entry = findSymbolEntry(elf, name);
+    return (entry == nullptr? nullptr: entry->sym);
 }
 intptr_t e9tool::getELFPLTEntry(const ELF *elf, const char *name)
 {
-    auto i = elf->plt.find(name);
-    if (i == elf->plt.end())
-        return INTPTR_MIN;
-    return i->second;
+    const SymbolEntry *entry = findSymbolEntry(elf, name);
+    return (entry == nullptr? INTPTR_MIN: entry->plt);
 }
 intptr_t e9tool::getELFGOTEntry(const ELF *elf, const char *name)
 {
-    auto i = elf->got.find(name);
-    if (i == elf->got.end())
-        return INTPTR_MIN;
-    return i->second;
+    const SymbolEntry *entry = findSymbolEntry(elf, name);
+    return (entry == nullptr? INTPTR_MIN: entry->got);
 }
 const char *e9tool::getELFStrTab(const ELF *elf)
 {
@@ -1853,6 +1966,56 @@ void e9tool::sendELFFileMessage(FILE *out, const ELF *ptr, bool absolute)
     }
 }
 
+/*
+ * Send the inline fast path of a call trampoline.  The fast path runs with
+ * the arguments loaded into registers, and may clobber %rax, %rflags and the
+ * argument registers only.  If it returns zero (failure), the full (slow
+ * path) call is made, otherwise the call is skipped.
+ */
+static void sendFastPath(FILE *out, const char *patch, const Call &call,
+    bool sysv)
+{
+    // lea -0x4000(%rsp),%rsp
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x48, 0x8d, 0xa4, 0x24, -0x4000);
+    const int *rsave = getFastPathSaveRegs(sysv, call.args.size());
+    int num_rsave = 0;
+    int32_t offset = 0x4000;
+    for (int i = 0; rsave[i] >= 0; i++, num_rsave++)
+    {
+        sendPush(out, offset, (call.pos != POS_AFTER), getReg(rsave[i]),
+            REGISTER_RAX);
+        offset += sizeof(int64_t);
+    }
+    fprintf(out, "\"$FAST_ARGS@%s\",", patch);
+    for (auto b: call.fastpath)
+        fprintf(out, "%u,", b);
+    fprintf(out, "\"$FAST_RSTOR@%s\",", patch);
+
+    // test %rax,%rax
+    // jz .Lslow
+    //
+    fprintf(out, "%u,%u,%u,", 0x48, 0x85, 0xc0);
+    fprintf(out, "%u,{\"rel8\":\".Lslow@%s\"},", 0x74, patch);
+    for (int j = 0; j < 2; j++)
+    {
+        // Both paths restore the state, but the fast path then skips the
+        // call:
+        for (int i = num_rsave-1; i >= 0; i--)
+            sendPop(out, /*preserve_rax=*/false, getReg(rsave[i]));
+        // lea 0x4000(%rsp),%rsp
+        fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+            0x48, 0x8d, 0xa4, 0x24, 0x4000);
+        if (j == 0)
+        {
+            // jmpq .Lfast
+            // .Lslow:
+            fprintf(out, "%u,{\"rel32\":\".Lfast@%s\"},", 0xe9, patch);
+            fprintf(out, "\".Lslow@%s\",", patch);
+        }
+    }
+}
+
 /*
  * Send a call ELF trampoline.
  */
@@ -1871,6 +2034,16 @@ unsigned e9tool::sendCallTrampolineMessage(FILE *out, const char *name,
             break;
     }
 
+    // The xsave mode byte (see sendSaveXState()):
+    static bool have_xstate_mode = false;
+    if (call.save == SAVE_XSAVE && sysv && !have_xstate_mode)
+    {
+        uint8_t mode[PAGE_SIZE] = {0};
+        sendReserveMessage(out, XSTATE_MODE_ADDR, mode, sizeof(mode),
+            PROT_READ | PROT_WRITE);
+        have_xstate_mode = true;
+    }
+
     const char *patch = name+1;
     sendMessageHeader(out, "trampoline");
     sendParamHeader(out, "name");
@@ -1879,6 +2052,10 @@ unsigned e9tool::sendCallTrampolineMessage(FILE *out, const char *name,
     sendParamHeader(out, "template");
     putc('[', out);
 
+    // Inline fast path (if any):
+    if (call.fastpath.size() > 0)
+        sendFastPath(out, patch, call, sysv);
+
     // Adjust the stack:
     fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",     // lea -0x4000(%rsp),%rsp
         0x48, 0x8d, 0xa4, 0x24, -0x4000);
@@ -1900,6 +2077,9 @@ unsigned e9tool::sendCallTrampolineMessage(FILE *out, const char *name,
             offset += sizeof(int64_t);
     }
 
+    // Save the extended state (if necessary):
+    sendSaveXState(out, offset - 0x4000, sysv, call.save, !(clean || state));
+
     // Load the arguments:
     fprintf(out, "\"$ARGS@%s\",", patch);
     if (!sysv)
@@ -1920,6 +2100,8 @@ unsigned e9tool::sendCallTrampolineMessage(FILE *out, const char *name,
             0x48, 0x8d, 0x64, 0x24, 0x20);
     }
     fprintf(out, "\"$RSTOR@%s\",", patch);
+    sendRestoreXState(out, offset - 0x4000, sysv, call.save,
+        !(clean || state));
     
     // If clean & conditional & !state, store result in %rcx, else in %rax
     bool preserve_rax = (conditional || !clean);
@@ -1994,8 +2176,11 @@ unsigned e9tool::sendCallTrampolineMessage(FILE *out, const char *name,
     }
 
     // Restore the stack pointer.
-    fprintf(out, "\"$RSTOR_RSP@%s\"]", patch);
-    
+    fprintf(out, "\"$RSTOR_RSP@%s\"", patch);
+    if (call.fastpath.size() > 0)
+        fprintf(out, ",\".Lfast@%s\"", patch);
+    putc(']', out);
+
     sendSeparator(out, /*last=*/true);
     return sendMessageFooter(out, /*sync=*/true);
 }
@@ -2052,9 +2237,11 @@ static void checkCompatible(const ELF &elf, const ELF &target)
  */
 const Call &e9tool::makeCall(const ELF *elf, const char *filename,
     const char *entry, CallABI abi, CallJump jmp, PatchPos pos,
-    const std::vector<ArgumentKind> &args)
+    const std::vector<ArgumentKind> &args, CallSave save)
 {
     static std::map<const char *, ELF *, CStrCmp> files;
+    static std::map<const ELF *, CallSave> saves;
+    static std::set<std::pair<const ELF *, const ELF *>> checked;
     static intptr_t file_addr = 0x70000000;
 
     char *pathname = realpath(filename, nullptr);
@@ -2067,7 +2254,6 @@ const Call &e9tool::makeCall(const ELF *elf, const char *filename,
     if (i == files.end())
     {
         target = parseELF(filename, file_addr);
-        checkCompatible(*elf, *target);
         files.insert({pathname, target});
         file_addr  = target->end + 2 * PAGE_SIZE;
         file_addr -= file_addr % PAGE_SIZE;
@@ -2077,6 +2263,8 @@ const Call &e9tool::makeCall(const ELF *elf, const char *filename,
         free((void *)pathname);
         target = i->second;
     }
+    if (checked.insert({elf, target}).second)
+        checkCompatible(*elf, *target);
 
     bool state = false;
     for (auto arg: args)
@@ -2086,7 +2274,30 @@ const Call &e9tool::makeCall(const ELF *elf, const char *filename,
         if (state)
             break;
     }
-    Call *call = new Call(abi, jmp, pos, state, target, strDup(entry), args);
+    if (save == SAVE_AUTO)
+    {
+        // Use the cheapest mode that preserves everything the target
+        // binary may clobber:
+        auto j = saves.find(target);
+        if (j == saves.end())
+            j = saves.insert({target, getCallSave(target)}).first;
+        save = j->second;
+    }
+    std::vector<uint8_t> fastpath;
+    if (getFastPath(target, entry, fastpath))
+    {
+        // The fast path is limited to unconditional calls with register
+        // arguments only:
+        size_t max_args = (target->type == BINARY_TYPE_PE_EXE ||
+            target->type == BINARY_TYPE_PE_DLL? 4: 6);
+        if (jmp != JUMP_NONE || state || args.size() > max_args)
+            error("failed to inline \"%s.inline\" from binary \"%s\"; "
+                "inline fast paths are not supported for conditional calls, "
+                "calls with a `state' argument, or calls with more than %zu "
+                "arguments", entry, target->filename, max_args);
+    }
+    Call *call = new Call(abi, jmp, pos, save, state, target, strDup(entry),
+        args, fastpath);
     return *call;
 }
 
@@ -29,7 +29,9 @@
 #include "e9elf.h"
 #include "e9metadata.h"
 #include "e9misc.h"
+#include "e9toggle.h"
 #include "e9tool.h"
+#include "e9trace.h"
 #include "e9x86_64.h"
 
 using namespace e9tool;
@@ -352,6 +354,20 @@ struct CallInfo
         }
     }
 
+    /*
+     * Constructor (explicit caller save registers).
+     */
+    CallInfo(const int *rsave, bool before, bool pic) :
+        rsave(rsave), before(before), pic(pic)
+    {
+        for (unsigned i = 0; rsave[i] >= 0; i++)
+        {
+            push(getReg(rsave[i]), /*caller_save=*/true);
+            if (rsave[i] == RFLAGS_IDX)
+                clobber(REGISTER_RAX);
+        }
+    }
+
     CallInfo() = delete;
     CallInfo(const CallInfo &) = delete;
 };
@@ -1957,7 +1973,7 @@ static Type sendLoadArgumentMetadata(FILE *out, CallInfo &info,
         case ARGUMENT_FILENAME: case ARGUMENT_ABSNAME:
         case ARGUMENT_BASENAME: case ARGUMENT_DIRNAME:
         {
-            const Line *line = findLine(elf->lines, I->address);
+            const Line *line = findInstrLine(elf->lines, i);
             if (line != nullptr)
             {
                 if (arg.kind == ARGUMENT_DIRNAME &&
@@ -1991,7 +2007,7 @@ static Type sendLoadArgumentMetadata(FILE *out, CallInfo &info,
         }
         case ARGUMENT_LINE:
         {
-            const Line *line = findLine(elf->lines, I->address);
+            const Line *line = findInstrLine(elf->lines, i);
             if (line == nullptr)
             {
                 sendSExtFromI32ToR64(out, 0, regno);
@@ -2081,7 +2097,7 @@ static void sendArgumentDataMetadata(FILE *out, const char *name,
         case ARGUMENT_FILENAME: case ARGUMENT_ABSNAME:
         case ARGUMENT_BASENAME: case ARGUMENT_DIRNAME:
         {
-            const Line *line = findLine(elf->lines, I->address);
+            const Line *line = findInstrLine(elf->lines, i);
             if (line == nullptr)
             {
             bad_line:
@@ -2131,6 +2147,82 @@ void e9tool::sendPrintMetadata(FILE *out, const InstrInfo *I)
     sendDefinitionFooter(out);
 }
 
+/*
+ * Send a "trace" trampoline metadata.  The memory address is that of the
+ * first memory operand accessed by the instruction (if any).
+ */
+static void sendTraceSiteMetadata(FILE *out, const char *name, intptr_t id,
+    const InstrInfo *I, unsigned flags)
+{
+    if ((flags & TRACE_FLAG_MEM) == 0)
+    {
+        sendTraceMetadata(out, name, id, I, flags);
+        return;
+    }
+
+    const OpInfo *memop = nullptr;
+    for (uint8_t j = 0; memop == nullptr && j < I->count.op; j++)
+    {
+        const OpInfo *op = I->op + j;
+        if (op->type == OPTYPE_MEM &&
+                (op->access & (ACCESS_READ | ACCESS_WRITE)) != 0 &&
+                I->mnemonic != MNEMONIC_LEA && I->mnemonic != MNEMONIC_NOP)
+            memop = op;
+    }
+    if (memop == nullptr)
+        flags &= ~TRACE_FLAG_MEM;
+    sendTraceMetadata(out, name, id, I, flags);
+
+    sendDefinitionHeader(out, name+1, "MEM");
+    if (memop != nullptr)
+    {
+        // %rax and %rdx have been pushed by the trampoline.
+        CallInfo info(/*sysv=*/true, /*clean=*/false, /*state=*/false,
+            /*conditional=*/false, /*num_args=*/0, /*before=*/true,
+            /*pic=*/false);
+        info.rsp_offset = 0x4000 + 2 * sizeof(int64_t);
+        sendLoadFromMemOpToR64(out, I, info, memop->size, memop->mem.seg,
+            memop->mem.disp, memop->mem.base, memop->mem.index,
+            memop->mem.scale, /*lea=*/true, RAX_IDX, /*asis=*/true);
+        fprintf(out, "%u", /*push %rax=*/0x50);
+    }
+    sendDefinitionFooter(out);
+}
+
+/*
+ * Build metadata for the inline fast path of a call.  The frame only saves
+ * %rax (the result), %rflags, and the argument registers.
+ */
+static void sendFastPathMetadata(FILE *out, const char *name, const ELF *elf,
+    const Call &call, const std::vector<Argument> &args, intptr_t id,
+    const std::vector<Instr> &Is, size_t i, const InstrInfo *I, bool sysv,
+    bool pic)
+{
+    sendDefinitionHeader(out, name, "FAST_ARGS");
+    bool before = (call.pos == POS_BEFORE);
+    CallInfo info(getFastPathSaveRegs(sysv, args.size()), before, pic);
+    int argno = 0;
+    for (const auto &arg: args)
+    {
+        int regno = getArgRegIdx(sysv, argno);
+        (void)sendLoadArgumentMetadata(out, info, elf, name, call.pos, Is, i,
+            I, id, arg, argno, regno);
+        argno++;
+    }
+    sendDefinitionFooter(out);
+    info.call(/*conditional=*/true);
+
+    sendDefinitionHeader(out, name, "FAST_RSTOR");
+    Register reg;
+    while ((reg = info.pop()) != REGISTER_INVALID)
+    {
+        Register rscratch = info.getScratch();
+        if (sendPop(out, /*preserve_rax=*/true, reg, rscratch))
+            info.clobber(rscratch);
+    }
+    sendDefinitionFooter(out);
+}
+
 /*
  * Send a "call" trampoline metadata.
  */
@@ -2264,6 +2356,11 @@ void e9tool::sendCallMetadata(FILE *out, const char *name, const ELF *elf,
     }
     sendDefinitionFooter(out);
 
+    // Inline fast path (if necessary).
+    if (call.fastpath.size() > 0)
+        sendFastPathMetadata(out, name, elf, call, args, id, Is, i, I, sysv,
+            pic);
+
     // Place data (if necessary).
     sendDefinitionHeader(out, name, "DATA");
     argno = 0;
@@ -2304,11 +2401,20 @@ void sendMetadata(FILE *out, const ELF *elf, const Action *action, size_t idx,
         case PATCH_EXIT: case PATCH_EMPTY: case PATCH_TRAP: case PATCH_BREAK:
             return;
         case PATCH_PRINT:
-            sendPrintMetadata(out, I);
+            if (option_print_buffer != nullptr)
+                sendTraceMetadata(out, "$print", id, I, /*flags=*/0x0);
+            else
+                sendPrintMetadata(out, I);
             return;
         case PATCH_CALL:
             sendCallMetadata(out, patch->name, elf, *patch->call, patch->args,
                 id, Is, i, I);
+            if (patch->sample != 0 || patch->period != 0)
+                sendSampleMetadata(out, patch->name,
+                    patch->counters + patch->site++ * SAMPLE_COUNTER_SIZE);
+            return;
+        case PATCH_TRACE:
+            sendTraceSiteMetadata(out, patch->name, id, I, patch->trace);
             return;
         default:
             return;
@@ -44,6 +44,9 @@ bool option_bbs          = false;
 bool option_fs           = false;
 bool option_trap_all     = false;
 bool option_lines        = false;
+bool option_stats_json   = false;
+
+const char *option_print_buffer = nullptr;
 
 /*
  * Duplicate a string.
@@ -299,6 +302,22 @@ void usage(FILE *stream, const char *progname)
         "\t--backend PROG\n"
         "\t\tUse PROG as the backend.  The default is \"e9patch\".\n"
         "\n"
+        "\t--batch FILE\n"
+        "\t\tRewrite all binaries listed in FILE, where each line is of\n"
+        "\t\tthe form \"INPUT OUTPUT\".  The match/patch actions are\n"
+        "\t\tapplied to each binary, and plugins and instrumentation are\n"
+        "\t\tloaded once.  Binaries are rewritten by a pool of concurrent\n"
+        "\t\tworkers (see --jobs), largest first, and a timing summary\n"
+        "\t\tis printed.  Cannot be combined with an INPUT-BINARY or\n"
+        "\t\t--output.\n"
+        "\n"
+        "\t--cache DIR\n"
+        "\t\tCache the disassembly and analysis results (jump targets,\n"
+        "\t\tbasic blocks, functions, and lines) for the input binary in\n"
+        "\t\tthe directory DIR.  Subsequent runs over the same binary\n"
+        "\t\t(with the same disassembly options) will reuse the cached\n"
+        "\t\tresults rather than recomputing them.\n"
+        "\n"
         "\t-CFR, -X\n"
         "\t\tEnables binary rewriting \"with\" control-flow recovery.  This\n"
         "\t\tusually makes the rewritten binary much faster, but may\n"
@@ -311,6 +330,13 @@ void usage(FILE *stream, const char *progname)
         "\t\tHigher compression makes the output binary smaller, but also\n"
         "\t\tincreases the number of mappings (mmap() calls) required.\n"
         "\n"
+        "\t--Drecursive\n"
+        "\t\tRun a recursive traversal pass (seeded from the entry point,\n"
+        "\t\tfunction symbols, init/fini arrays, and relocated code\n"
+        "\t\tpointers) before the linear sweep.  Reachable code is never\n"
+        "\t\ttreated as data, and data that is followed by reachable code\n"
+        "\t\tis skipped directly rather than rolled back (see --Dsync).\n"
+        "\n"
         "\t--Dsync N\n"
         "\t\tIf the disassembler desyncs (e.g., data in the code section),\n"
         "\t\tthen automatically exclude N surrounding instructions.\n"
@@ -323,6 +349,27 @@ void usage(FILE *stream, const char *progname)
         "\t--debug\n"
         "\t\tEnable debug output.\n"
         "\n"
+        "\t--dwarf MODE\n"
+        "\t\tSet the DWARF line information loading mode, where MODE is\n"
+        "\t\tone of:\n"
+        "\n"
+        "\t\t\t- \"lazy\": only decode the line tables of compilation\n"
+        "\t\t\t  units that contain queried instructions; or\n"
+        "\t\t\t- \"eager\": decode all line tables in parallel.\n"
+        "\n"
+        "\t\tThe default is \"lazy\" (or \"eager\" with --cache).\n"
+        "\n"
+        "\t--dwarf-threads N\n"
+        "\t\tUse N threads for eager DWARF line loading.  The default is\n"
+        "\t\t0 (automatic).\n"
+        "\n"
+        "\t--dry-run\n"
+        "\t\tDo not rewrite the binary.  Instead, predict the outcome of\n"
+        "\t\tpatching (tactic mix, trampoline bytes, and the number of\n"
+        "\t\tvirtual/physical mappings) without running the backend.  The\n"
+        "\t\tprediction is approximate, but is useful for quickly tuning\n"
+        "\t\tthe match (-M) and --compression options.\n"
+        "\n"
         "\t--dump-all\n"
         "\t\tDump all analysis information (disasm, targets, BBs, funcs)\n"
         "\t\tinto CSV files of the form \"OUTPUT.TYPE.csv\", where:\n"
@@ -331,7 +378,9 @@ void usage(FILE *stream, const char *progname)
         "\t\t\t- TYPE is one of {DISASM,TARGETs,BBs,FUNCs}.\n"
         "\n"
         "\t\tThe generated files are compatible with --use-disasm and\n"
-        "\t\t--use-targets.\n"
+        "\t\t--use-targets.  In addition, the indirect jump/call targets\n"
+        "\t\tare dumped as a bitmap into \"OUTPUT.TARGETs.bitmap\" (see\n"
+        "\t\texamples/cfi.c).\n"
         "\n"
         "\t--exclude RANGE, -E RANGE\n"
         "\t\tExclude the address RANGE from disassembly and rewriting.\n"
@@ -360,6 +409,10 @@ void usage(FILE *stream, const char *progname)
         "\t--help, -h\n"
         "\t\tPrint this message and exit.\n"
         "\n"
+        "\t--jobs N\n"
+        "\t\tUse N concurrent workers (and backends) for --batch mode.\n"
+        "\t\tThe default is the number of online CPUs.\n"
+        "\n"
         "\t--no-warnings\n"
         "\t\tDo not print warning messages.\n"
         "\n"
@@ -382,6 +435,18 @@ void usage(FILE *stream, const char *progname)
         "\n"
         "\t\tThe default is -O2.\n"
         "\n"
+        "\t--print-buffer FILE\n"
+        "\t\tBuffer the output of `print' patches in per-thread rings\n"
+        "\t\tand write it to FILE (at runtime) in a compact binary form,\n"
+        "\t\trather than performing a write() per instruction.  The\n"
+        "\t\ttrace can be decoded using the command:\n"
+        "\n"
+        "\t\t\te9tracedump OUTPUT.sites FILE\n"
+        "\n"
+        "\t\twhere OUTPUT.sites is written by E9Tool.  If `trace'\n"
+        "\t\tpatches are also used, their records are also written to\n"
+        "\t\tFILE (overriding --trace-file).\n"
+        "\n"
         "\t--option OPTION\n"
         "\t\tPass OPTION to the e9patch backend.\n"
         "\n"
@@ -408,6 +473,13 @@ void usage(FILE *stream, const char *progname)
         "\t\treliable for large/complex binaries.  However, this may bloat\n"
         "\t\tthe size of the output patched binary.\n"
         "\n"
+        "\t--stats=FORMAT\n"
+        "\t\tPrint the final statistics in FORMAT, which is one of\n"
+        "\t\t\"text\" or \"json\".  The \"json\" format prints one line\n"
+        "\t\tfor E9Tool and one line for E9Patch, including per-phase\n"
+        "\t\twall-clock/CPU time, allocation counts and peak RSS.\n"
+        "\t\tThe default format is \"text\".\n"
+        "\n"
         "\t--syntax SYNTAX\n"
         "\t\tSelects the assembly syntax to be SYNTAX.  Possible values are:\n"
         "\n"
@@ -416,6 +488,21 @@ void usage(FILE *stream, const char *progname)
         "\n"
         "\t\tThe default syntax is \"ATT\".\n"
         "\n"
+        "\t--toggle FILE\n"
+        "\t\tMake all actions toggleable at runtime using the control\n"
+        "\t\tFILE.  Byte N of FILE enables (non-zero) or disables (zero)\n"
+        "\t\tthe Nth action (counting from 0 in command-line order).  The\n"
+        "\t\tFILE is created at startup if it does not exist, with all\n"
+        "\t\tactions enabled, and is shared by all patched processes.\n"
+        "\n"
+        "\t--trace-file FILE\n"
+        "\t\tWrite the records of `trace' patches to FILE (at runtime).\n"
+        "\t\tThe trace can be decoded using the command:\n"
+        "\n"
+        "\t\t\te9tracedump OUTPUT.sites FILE\n"
+        "\n"
+        "\t\tThe default is \"e9trace.out\".\n"
+        "\n"
         "\t--trap=ADDR, --trap-all\n"
         "\t\tInsert a trap (int3) instruction at the corresponding\n"
         "\t\ttrampoline entry.  This can be used for debugging with gdb.\n"
@@ -66,5 +66,8 @@ extern bool option_bbs;
 extern bool option_fs;
 extern bool option_trap_all;
 extern bool option_lines;
+extern bool option_stats_json;
+
+extern const char *option_print_buffer;
 
 #endif
@@ -147,6 +147,7 @@ static const TokenInfo tokens[] =
     {"filename",        TOKEN_FILENAME,         0},
     {"fs",              TOKEN_REGISTER,         REGISTER_FS},
     {"goto",            TOKEN_GOTO,             0},
+    {"gpr",             TOKEN_GPR,              0},
     {"gs",              TOKEN_REGISTER,         REGISTER_GS},
     {"id",              TOKEN_ID,               0},
     {"if",              TOKEN_IF,               0},
@@ -259,6 +260,7 @@ static const TokenInfo tokens[] =
     {"state",           TOKEN_STATE,            0},
     {"static",          TOKEN_STATIC,           0},
     {"target",          TOKEN_TARGET,           0},
+    {"trace",           TOKEN_TRACE,            0},
     {"trampoline",      TOKEN_TRAMPOLINE,       0},
     {"trap",            TOKEN_TRAP,             0},
     {"true",            TOKEN_TRUE,             true},
@@ -300,6 +302,7 @@ static const TokenInfo tokens[] =
     {"xmm7",            TOKEN_REGISTER,         REGISTER_XMM7},
     {"xmm8",            TOKEN_REGISTER,         REGISTER_XMM8},
     {"xmm9",            TOKEN_REGISTER,         REGISTER_XMM9},
+    {"xsave",           TOKEN_XSAVE,            0},
     {"ymm0",            TOKEN_REGISTER,         REGISTER_YMM0},
     {"ymm1",            TOKEN_REGISTER,         REGISTER_YMM1},
     {"ymm10",           TOKEN_REGISTER,         REGISTER_YMM10},
@@ -73,6 +73,7 @@ enum Token
     TOKEN_FILENAME,
     TOKEN_GEQ,
     TOKEN_GOTO,
+    TOKEN_GPR,
     TOKEN_I,
     TOKEN_ID,
     TOKEN_IF,
@@ -140,6 +141,7 @@ enum Token
     TOKEN_STATE,
     TOKEN_STATIC,
     TOKEN_TARGET,
+    TOKEN_TRACE,
     TOKEN_TRAMPOLINE,
     TOKEN_TRAP,
     TOKEN_TRUE,
@@ -148,6 +150,7 @@ enum Token
     TOKEN_WRITE,
     TOKEN_WRITES,
     TOKEN_X87,
+    TOKEN_XSAVE,
 };
 
 /*
@@ -0,0 +1,827 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Dry-run mode: predict the outcome of patching without running the
+ * backend.  The prediction replays a simplified version of E9Patch's
+ * tactics (T0/B1/B2/T1/T2/T3/B0, see e9patch/e9tactics.cpp) over a byte
+ * state model of the code, including the punned jump bounds and a simple
+ * model of the virtual address space allocator.  The main approximations
+ * are:
+ *
+ *  - Jump targets (for T0) are E9Tool's targets rather than E9Patch's own
+ *    (byte-level) target analysis.
+ *  - Trampoline sizes are estimated (see the caller).
+ *  - Allocation is first-fit (or last-fit below the -Oorder target), and
+ *    ignores trampoline prologues and the physical page grouping details.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "e9elf.h"
+#include "e9misc.h"
+#include "e9predict.h"
+#include "e9tool.h"
+
+using namespace e9tool;
+
+#define JMP_SIZE            5
+#define SHORT_JMP_MAX       INT8_MAX
+#define SHORT_JMP_MIN       INT8_MIN
+#define T0_LIMIT            32
+#define TRAMPOLINE_MAX      4096
+#define PAGE_SIZE           4096
+#define ORDER_TARGET        0x70C00000
+#define LOADER_BASE         0x20e9e9000
+#define RELATIVE_MIN        (-0x1FFFFFFFFFFFF000ll)
+
+/*
+ * Byte states (as per E9Patch).
+ */
+#define STATE_INSTRUCTION   0x00
+#define STATE_PATCHED       0x01
+#define STATE_FREE          0x02
+#define STATE_OTHER         0x03
+#define STATE_LOCKED        0x10
+
+/*
+ * Instruction flags.
+ */
+#define INSTR_PATCHED       0x01
+#define INSTR_EVICTED       0x02
+
+/*
+ * Tactics (as per E9Patch).
+ */
+enum Tactic
+{
+    TACTIC_B0,
+    TACTIC_B1,
+    TACTIC_B2,
+    TACTIC_T0,
+    TACTIC_T1,
+    TACTIC_T2,
+    TACTIC_T3,
+    TACTIC_FAIL,
+    TACTIC_MAX
+};
+
+/*
+ * Undo log entry.
+ */
+struct Undo
+{
+    enum {UNDO_BYTE, UNDO_FLAGS, UNDO_ALLOC} kind;
+    intptr_t addr;                      // Address/index/alloc start
+    size_t size;                        // Alloc size
+    uint8_t byte;                       // Old byte/flags
+    uint8_t state;                      // Old state
+};
+
+/*
+ * Predictor state.
+ */
+struct Predictor
+{
+    const ELF *elf;
+    const std::vector<Instr> &Is;
+    const PredictParams &params;
+    intptr_t lb = 0;                    // Code lower bound
+    std::vector<uint8_t> bytes;         // Code bytes
+    std::vector<uint8_t> state;         // Code byte states
+    std::vector<uint8_t> flags;         // Instruction flags
+    std::map<intptr_t, intptr_t> used;  // Used address space (coalesced)
+    std::map<intptr_t, size_t> allocs;  // Trampoline allocations
+    std::vector<Undo> log;              // Undo log
+
+    Predictor(const ELF *elf, const std::vector<Instr> &Is,
+            const PredictParams &params) : elf(elf), Is(Is), params(params)
+    {
+        ;
+    }
+};
+
+/*
+ * Byte accessors.
+ */
+static uint8_t getState(const Predictor &P, intptr_t addr)
+{
+    if (addr < P.lb || addr - P.lb >= (intptr_t)P.state.size())
+        return STATE_OTHER;
+    return P.state[addr - P.lb];
+}
+static uint8_t getByte(const Predictor &P, intptr_t addr)
+{
+    if (addr < P.lb || addr - P.lb >= (intptr_t)P.bytes.size())
+        return 0x0;
+    return P.bytes[addr - P.lb];
+}
+static void setByte(Predictor &P, intptr_t addr, uint8_t byte, uint8_t state)
+{
+    if (addr < P.lb || addr - P.lb >= (intptr_t)P.state.size())
+        return;
+    size_t i = addr - P.lb;
+    P.log.push_back({Undo::UNDO_BYTE, addr, 0, P.bytes[i], P.state[i]});
+    P.bytes[i] = byte;
+    P.state[i] = state;
+}
+static void setFlags(Predictor &P, size_t idx, uint8_t flags)
+{
+    P.log.push_back({Undo::UNDO_FLAGS, (intptr_t)idx, 0, P.flags[idx], 0});
+    P.flags[idx] |= flags;
+}
+
+/*
+ * Instruction accessors.
+ */
+static intptr_t addr(const Predictor &P, size_t i)
+{
+    return (intptr_t)P.Is[i].address;
+}
+static size_t size(const Predictor &P, size_t i)
+{
+    return (size_t)P.Is[i].size;
+}
+static ssize_t succ(const Predictor &P, size_t i)
+{
+    if (i + 1 >= P.Is.size() || addr(P, i) + (intptr_t)size(P, i) != addr(P, i+1))
+        return -1;
+    return (ssize_t)(i + 1);
+}
+static ssize_t pred(const Predictor &P, size_t i)
+{
+    if (i == 0 || addr(P, i-1) + (intptr_t)size(P, i-1) != addr(P, i))
+        return -1;
+    return (ssize_t)(i - 1);
+}
+static bool isTarget(const Predictor &P, size_t i)
+{
+    return (P.elf->targets.get(i) != 0);
+}
+static bool canPatch(const Predictor &P, size_t i)
+{
+    switch (getState(P, addr(P, i)))
+    {
+        case STATE_INSTRUCTION: case STATE_FREE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Insert [lo..hi) into the (coalesced) used address space.
+ */
+static void use(Predictor &P, intptr_t lo, intptr_t hi)
+{
+    auto i = P.used.upper_bound(lo);
+    if (i != P.used.begin() && std::prev(i)->second >= lo)
+    {
+        --i;
+        lo = i->first;
+        hi = std::max(hi, i->second);
+        i = P.used.erase(i);
+    }
+    while (i != P.used.end() && i->first <= hi)
+    {
+        hi = std::max(hi, i->second);
+        i = P.used.erase(i);
+    }
+    P.used.insert({lo, hi});
+}
+
+/*
+ * Remove [lo..hi) from the used address space.
+ */
+static void unuse(Predictor &P, intptr_t lo, intptr_t hi)
+{
+    auto i = P.used.upper_bound(lo);
+    if (i == P.used.begin())
+        return;
+    --i;
+    intptr_t LO = i->first, HI = i->second;
+    if (HI < hi)
+        return;
+    P.used.erase(i);
+    if (LO < lo)
+        P.used.insert({LO, lo});
+    if (hi < HI)
+        P.used.insert({hi, HI});
+}
+
+/*
+ * Test if [lo..lo+size) spans a page boundary.
+ */
+static bool spansPages(intptr_t lo, size_t size)
+{
+    const intptr_t MASK = ~((intptr_t)PAGE_SIZE - 1);
+    return ((lo & MASK) != ((lo + (intptr_t)size - 1) & MASK));
+}
+
+/*
+ * Allocate `size' bytes starting within [lo..hi].  As with E9Patch's default
+ * (no --mem-multi-page), the allocation may not span a page boundary.
+ * Returns the start address, or INTPTR_MIN on failure.
+ */
+static intptr_t allocate(Predictor &P, intptr_t lo, intptr_t hi, size_t size)
+{
+    intptr_t s = INTPTR_MIN;
+    if (lo > hi || size > PAGE_SIZE)
+        return s;
+    if (P.params.order && hi > ORDER_TARGET && lo <= ORDER_TARGET)
+    {
+        // Last-fit below the target:
+        intptr_t t = std::min(hi, (intptr_t)ORDER_TARGET - (intptr_t)size);
+        while (t >= lo)
+        {
+            if (spansPages(t, size))
+            {
+                t = ((t + (intptr_t)size) & ~((intptr_t)PAGE_SIZE - 1)) -
+                    (intptr_t)size;
+                continue;
+            }
+            auto i = P.used.lower_bound(t + (intptr_t)size);
+            if (i == P.used.begin() || std::prev(i)->second <= t)
+            {
+                s = t;
+                break;
+            }
+            t = std::prev(i)->first - (intptr_t)size;
+        }
+    }
+    if (s == INTPTR_MIN)
+    {
+        // First-fit:
+        intptr_t t = lo;
+        auto i = P.used.upper_bound(t);
+        if (i != P.used.begin() && std::prev(i)->second > t)
+            t = std::prev(i)->second;
+        while (t <= hi)
+        {
+            if (spansPages(t, size))
+            {
+                t = (t + (intptr_t)PAGE_SIZE) & ~((intptr_t)PAGE_SIZE - 1);
+                continue;
+            }
+            if (i == P.used.end() || i->first >= t + (intptr_t)size)
+            {
+                s = t;
+                break;
+            }
+            t = std::max(t, i->second);
+            ++i;
+        }
+    }
+    if (s == INTPTR_MIN)
+        return s;
+    use(P, s, s + (intptr_t)size);
+    P.allocs.insert({s, size});
+    P.log.push_back({Undo::UNDO_ALLOC, s, size, 0, 0});
+    return s;
+}
+
+/*
+ * Undo all changes since `mark'.
+ */
+static void rollback(Predictor &P, size_t mark)
+{
+    while (P.log.size() > mark)
+    {
+        const Undo &U = P.log.back();
+        switch (U.kind)
+        {
+            case Undo::UNDO_BYTE:
+                P.bytes[U.addr - P.lb] = U.byte;
+                P.state[U.addr - P.lb] = U.state;
+                break;
+            case Undo::UNDO_FLAGS:
+                P.flags[U.addr] = U.byte;
+                break;
+            case Undo::UNDO_ALLOC:
+                unuse(P, U.addr, U.addr + (intptr_t)U.size);
+                P.allocs.erase(U.addr);
+                break;
+        }
+        P.log.pop_back();
+    }
+}
+
+/*
+ * Calculate the trampoline bounds (see makeBounds() in E9Patch).
+ */
+static bool makeBounds(const Predictor &P, size_t i, unsigned prefix,
+    bool trap, intptr_t &lo, intptr_t &hi)
+{
+    intptr_t a = addr(P, i);
+    size_t size = prefix + 1;
+    for (; size < P.Is[i].size &&
+            (getState(P, a + size) == STATE_INSTRUCTION ||
+             getState(P, a + size) == STATE_FREE); size++)
+        ;
+    for (; size < JMP_SIZE && getState(P, a + size) == STATE_FREE; size++)
+        ;
+    size_t diff = size - prefix - /*sizeof(jmpq opcode)=*/1;
+
+    int32_t rel32_lo, rel32_hi;
+    if (diff >= sizeof(int32_t) || trap)
+    {
+        rel32_lo = INT32_MIN;
+        rel32_hi = INT32_MAX;
+    }
+    else
+    {
+        uint32_t mask = 0xFFFFFFFFu << (8 * diff);
+        uint32_t urel32 = 0;
+        for (unsigned k = 0; k < sizeof(uint32_t); k++)
+            urel32 |= (uint32_t)getByte(P, a + prefix + 1 + k) << (8 * k);
+        uint32_t urel32_lo = urel32 & mask;
+        uint32_t urel32_hi = urel32_lo | (0xFFFFFFFFu & ~mask);
+        rel32_lo = (int32_t)urel32_lo;
+        rel32_hi = (int32_t)urel32_hi;
+    }
+    intptr_t jmp_from = a + prefix + JMP_SIZE;
+    lo = jmp_from + rel32_lo;
+    hi = jmp_from + rel32_hi;
+    if (lo > hi)
+        std::swap(lo, hi);
+    lo = std::max(lo, jmp_from - (intptr_t)INT32_MAX);
+    hi = std::min(hi, jmp_from - (intptr_t)INT32_MIN - TRAMPOLINE_MAX);
+    hi = std::min(hi, (intptr_t)LOADER_BASE - (intptr_t)PAGE_SIZE);
+    return (lo <= hi);
+}
+
+/*
+ * Allocate a (punned) jump/trap trampoline.
+ */
+static intptr_t allocateJump(Predictor &P, size_t i, unsigned prefix,
+    size_t tsize, bool trap = false)
+{
+    intptr_t lo, hi;
+    if (!makeBounds(P, i, prefix, trap, lo, hi))
+        return INTPTR_MIN;
+    return allocate(P, lo, hi, tsize);
+}
+
+/*
+ * Patching primitives (see E9Patch).
+ */
+static void patchJumpPrefix(Predictor &P, size_t i, unsigned prefix)
+{
+    const uint8_t prefixes[] = {0x48, 0x26, 0x36, 0x3E};
+    for (unsigned k = 0; k < prefix; k++)
+        setByte(P, addr(P, i) + k, prefixes[k], STATE_PATCHED);
+}
+static void patchJump(Predictor &P, size_t i, unsigned offset, intptr_t entry)
+{
+    intptr_t a = addr(P, i) + offset;
+    int32_t rel32 = (int32_t)(entry - (a + JMP_SIZE));
+    setByte(P, a, /*jmpq opcode=*/0xE9, STATE_PATCHED);
+    for (unsigned k = 0; k < sizeof(rel32); k++)
+    {
+        uint8_t b = (uint8_t)(rel32 >> (8 * k));
+        intptr_t b_addr = a + 1 + k;
+        if (offset + 1 + k < size(P, i) ||
+                getState(P, b_addr) == STATE_FREE)
+            setByte(P, b_addr, b, STATE_PATCHED);
+        else if (getState(P, b_addr) != STATE_OTHER)
+            setByte(P, b_addr, getByte(P, b_addr),
+                getState(P, b_addr) | STATE_LOCKED);
+    }
+}
+static void patchUnused(Predictor &P, size_t i, unsigned offset)
+{
+    for (unsigned k = offset; k < size(P, i); k++)
+    {
+        intptr_t a = addr(P, i) + k;
+        if (getState(P, a) == STATE_INSTRUCTION)
+            setByte(P, a, /*int3=*/0xcc, STATE_FREE);
+    }
+}
+
+/*
+ * Tactics B1/B2/T1.
+ */
+static bool tactic_B1(Predictor &P, size_t i, size_t tsize)
+{
+    if (size(P, i) < JMP_SIZE || !canPatch(P, i))
+        return false;
+    intptr_t entry = allocateJump(P, i, 0, tsize);
+    if (entry == INTPTR_MIN)
+        return false;
+    patchJump(P, i, 0, entry);
+    patchUnused(P, i, JMP_SIZE);
+    return true;
+}
+static bool tactic_B2(Predictor &P, size_t i, size_t tsize)
+{
+    if (size(P, i) >= JMP_SIZE || !canPatch(P, i))
+        return false;
+    intptr_t entry = allocateJump(P, i, 0, tsize);
+    if (entry == INTPTR_MIN)
+        return false;
+    patchJump(P, i, 0, entry);
+    return true;
+}
+static bool tactic_T1(Predictor &P, size_t i, size_t tsize)
+{
+    if (size(P, i) >= JMP_SIZE || !canPatch(P, i))
+        return false;
+    for (unsigned prefix = 1; prefix < sizeof(int32_t); prefix++)
+    {
+        uint8_t state = getState(P, addr(P, i) + prefix);
+        if (state != STATE_FREE &&
+                (state != STATE_INSTRUCTION || prefix >= size(P, i)))
+            break;
+        if (prefix >= size(P, i))
+            break;
+        intptr_t entry = allocateJump(P, i, prefix, tsize);
+        if (entry != INTPTR_MIN)
+        {
+            patchJumpPrefix(P, i, prefix);
+            patchJump(P, i, prefix, entry);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Evict an instruction (B1/B2/T1 with an evictee trampoline).
+ */
+static bool evict(Predictor &P, size_t j, bool B1 = true)
+{
+    size_t esize = size(P, j) + JMP_SIZE;
+    if ((B1 && tactic_B1(P, j, esize)) || tactic_B2(P, j, esize) ||
+            tactic_T1(P, j, esize))
+    {
+        setFlags(P, j, INSTR_PATCHED | INSTR_EVICTED);
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Tactic T2: evict the successor instruction.
+ */
+static bool tactic_T2(Predictor &P, size_t i, size_t tsize)
+{
+    if (size(P, i) >= JMP_SIZE || !canPatch(P, i))
+        return false;
+    ssize_t j = succ(P, i);
+    if (j < 0 || !canPatch(P, j))
+        return false;
+    size_t mark = P.log.size();
+    if (!evict(P, j, /*B1=*/false))
+        return false;
+    if (tactic_B2(P, i, tsize) || tactic_T1(P, i, tsize))
+        return true;
+    rollback(P, mark);
+    return false;
+}
+
+/*
+ * Tactic T3: evict a neighbour instruction.
+ */
+static bool tactic_T3J(Predictor &P, size_t j, unsigned k, size_t tsize)
+{
+    size_t mark = P.log.size();
+    uint8_t state = getState(P, addr(P, j) + k);
+    intptr_t entry = allocateJump(P, j, k, tsize);
+    if (entry == INTPTR_MIN)
+        return false;
+    patchJump(P, j, k, entry);
+    if (state == STATE_FREE || evict(P, j))
+        return true;
+    rollback(P, mark);
+    return false;
+}
+static bool tactic_T3b(Predictor &P, size_t i, size_t tsize)
+{
+    ssize_t j = succ(P, i);
+    if (!canPatch(P, i) || j < 0 || !canPatch(P, j))
+        return false;
+    intptr_t target = addr(P, i) + /*sizeof(short jmp)=*/2 +
+        (intptr_t)(int8_t)getByte(P, addr(P, j));
+    if (target >= addr(P, i))
+    {
+        for (; j < (ssize_t)P.Is.size() &&
+                addr(P, j) + (intptr_t)size(P, j) <= target; j++)
+            ;
+        if (j >= (ssize_t)P.Is.size())
+            return false;
+    }
+    else
+    {
+        for (j = (ssize_t)i - 1; j >= 0 && addr(P, j) > target; j--)
+            ;
+        if (j < 0 || addr(P, j) + (intptr_t)size(P, j) > addr(P, i))
+            return false;
+    }
+    if (target <= addr(P, j))
+        return false;
+    uint8_t state = getState(P, target);
+    if (state != STATE_INSTRUCTION && state != STATE_FREE)
+        return false;
+    size_t next = i + 1;
+    if (!tactic_T3J(P, j, (unsigned)(target - addr(P, j)), tsize))
+        return false;
+    setByte(P, addr(P, i), /*short jmp opcode=*/0xEB, STATE_PATCHED);
+    setByte(P, addr(P, next), getByte(P, addr(P, next)),
+        getState(P, addr(P, next)) | STATE_LOCKED);
+    return true;
+}
+static bool tactic_T3(Predictor &P, size_t i, size_t tsize)
+{
+    if (size(P, i) == 1)
+        return tactic_T3b(P, i, tsize);
+    if (size(P, i) >= JMP_SIZE || !canPatch(P, i))
+        return false;
+    intptr_t from = addr(P, i) + /*sizeof(short jmp)=*/2;
+    size_t j = i;
+    while (j + 1 < P.Is.size() && addr(P, j+1) - from <= SHORT_JMP_MAX)
+        j++;
+    for (ssize_t J = (ssize_t)j; J >= 0; J--)
+    {
+        if ((size_t)J == i)
+            continue;
+        intptr_t a = addr(P, J);
+        if (from - (a + (intptr_t)size(P, J) - 1) > -SHORT_JMP_MIN)
+            break;
+        uint8_t state = getState(P, a);
+        if ((state & ~STATE_LOCKED) == STATE_PATCHED)
+        {
+            if (getState(P, a + size(P, J) - 1) != STATE_FREE)
+                continue;
+        }
+        else if (state != STATE_INSTRUCTION && state != STATE_FREE)
+            continue;
+        for (unsigned k = 0; k < size(P, J); k++)
+        {
+            if (k == 0 && state != STATE_FREE)
+                continue;
+            if (a > addr(P, i) && (a + k) - from > SHORT_JMP_MAX)
+                continue;
+            if (a < addr(P, i) && from - (a + k) > -SHORT_JMP_MIN)
+                break;
+            if (a < addr(P, i) && addr(P, i) - (a + k) < JMP_SIZE)
+                continue;
+            uint8_t kstate = getState(P, a + k);
+            if (kstate != STATE_INSTRUCTION && kstate != STATE_FREE)
+                continue;
+            if (!tactic_T3J(P, J, k, tsize))
+                continue;
+            int8_t rel8 = (int8_t)((a + k) - from);
+            setByte(P, addr(P, i), /*short jmp opcode=*/0xEB, STATE_PATCHED);
+            setByte(P, addr(P, i) + 1, (uint8_t)rel8, STATE_PATCHED);
+            patchUnused(P, i, /*sizeof(short jmp)=*/2);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Tactic T0: batch instructions that are not jump targets.
+ */
+static bool tactic_T0(Predictor &P, size_t i, size_t tsize)
+{
+    if (!P.params.CFR || !canPatch(P, i))
+        return false;
+
+    size_t J = i, size = 0;
+    for (unsigned limit = T0_LIMIT; !isTarget(P, J) && limit > 0; limit--)
+    {
+        size += P.Is[J].size;
+        ssize_t K = pred(P, J);
+        if (K < 0 || getState(P, addr(P, K)) != STATE_INSTRUCTION)
+            break;
+        J = (size_t)K;
+    }
+    size_t L = i;
+    bool cft = false;
+    while (!cft && size < JMP_SIZE)
+    {
+        ssize_t K = succ(P, L);
+        if (K < 0 || isTarget(P, K) || !canPatch(P, K) ||
+                (P.flags[K] & (INSTR_PATCHED | INSTR_EVICTED)) ==
+                    INSTR_PATCHED)
+            break;
+        L = (size_t)K;
+        size += P.Is[L].size;
+        InstrInfo info;
+        getInstrInfo(P.elf, &P.Is[L], &info);
+        cft = ((info.category & (CATEGORY_CALL | CATEGORY_RETURN)) != 0 ||
+               (info.category & (CATEGORY_JUMP | CATEGORY_CONDITIONAL)) ==
+                    CATEGORY_JUMP);
+    }
+    if (J == L)
+        return false;
+
+    size_t mark = P.log.size();
+    size_t bsize = tsize;
+    for (size_t K = J; K <= L; K++)
+    {
+        patchUnused(P, K, 0);
+        setFlags(P, K, INSTR_PATCHED);
+        bsize += (K != i? P.Is[K].size: 0);
+    }
+    if (tactic_B1(P, J, bsize) || tactic_B2(P, J, bsize) ||
+            tactic_T1(P, J, bsize))
+        return true;
+    rollback(P, mark);
+    return false;
+}
+
+/*
+ * Tactic B0: replace the instruction with a trap.
+ */
+static bool tactic_B0(Predictor &P, size_t i, size_t tsize)
+{
+    if (!P.params.B0)
+        return false;
+    intptr_t entry = allocateJump(P, i, 0, tsize, /*trap=*/true);
+    if (entry == INTPTR_MIN)
+        return false;
+    setByte(P, addr(P, i), /*invalid opcode=*/0x27, STATE_PATCHED);
+    patchUnused(P, i, 1);
+    return true;
+}
+
+/*
+ * Patch an instruction (in E9Patch's T0/B1/B2/T1/T2/T3/B0 order).
+ */
+static Tactic patch(Predictor &P, size_t i, size_t tsize)
+{
+    P.log.clear();
+    Tactic tactic = TACTIC_FAIL;
+    if (tactic_T0(P, i, tsize))
+        tactic = TACTIC_T0;
+    else if (tactic_B1(P, i, tsize))
+        tactic = TACTIC_B1;
+    else if (tactic_B2(P, i, tsize))
+        tactic = TACTIC_B2;
+    else if (tactic_T1(P, i, tsize))
+        tactic = TACTIC_T1;
+    else if (tactic_T2(P, i, tsize))
+        tactic = TACTIC_T2;
+    else if (tactic_T3(P, i, tsize))
+        tactic = TACTIC_T3;
+    else if (tactic_B0(P, i, tsize))
+        tactic = TACTIC_B0;
+    if (tactic != TACTIC_FAIL)
+        setFlags(P, i, INSTR_PATCHED);
+    return tactic;
+}
+
+/*
+ * Reserve the address space occupied by the binary (see E9Patch's
+ * parseElf()).
+ */
+static void reserveELF(Predictor &P)
+{
+    const ELF *elf = P.elf;
+    switch (elf->type)
+    {
+        case BINARY_TYPE_ELF_EXE:
+            use(P, 0x0, 0x10000);
+            use(P, RELATIVE_MIN, 0x0);
+            break;
+        case BINARY_TYPE_ELF_DSO:
+            use(P, RELATIVE_MIN, 0x0);
+            break;
+        default:
+            break;
+    }
+    for (size_t i = 0; i < elf->phnum; i++)
+    {
+        const Elf64_Phdr *phdr = elf->phdrs + i;
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0)
+            continue;
+        intptr_t lo = (intptr_t)phdr->p_vaddr;
+        intptr_t hi = lo + (intptr_t)phdr->p_memsz;
+        lo -= lo % PAGE_SIZE;
+        hi += (hi % PAGE_SIZE == 0? 0: PAGE_SIZE - hi % PAGE_SIZE);
+        use(P, lo, hi);
+    }
+}
+
+/*
+ * Print a tactic count.
+ */
+static void printCount(const char *name, size_t count, size_t total)
+{
+    printf("%-21s = %zu / %zu (%.2f%%)\n", name, count, total,
+        (total == 0? 0.0: (double)count / (double)total * 100.0));
+}
+
+/*
+ * Predict the outcome of patching the instructions marked `patch', where
+ * sizes[Is[i].matching] is the estimated trampoline template size (in bytes)
+ * for the instruction's matching.  The report is printed to stdout in the
+ * same format as E9Patch's statistics.
+ */
+void predictPatching(const ELF *elf, const std::vector<Instr> &Is,
+    const std::vector<size_t> &sizes, const PredictParams &params)
+{
+    Predictor P(elf, Is, params);
+    if (Is.size() > 0)
+    {
+        P.lb = (intptr_t)Is.front().address;
+        intptr_t ub = (intptr_t)(Is.back().address + Is.back().size) +
+            /*overflow=*/JMP_SIZE;
+        P.bytes.assign(ub - P.lb, 0x0);
+        P.state.assign(ub - P.lb, STATE_OTHER);
+        P.flags.assign(Is.size(), 0x0);
+        for (const auto &I: Is)
+        {
+            size_t i = I.address - P.lb;
+            memcpy(P.bytes.data() + i, elf->data + I.offset, I.size);
+            memset(P.state.data() + i, STATE_INSTRUCTION, I.size);
+        }
+    }
+    reserveELF(P);
+
+    // Note: instructions MUST be patched in reverse (as per E9Tool).
+    size_t counts[TACTIC_MAX] = {0}, total = 0;
+    for (ssize_t i = (ssize_t)Is.size() - 1; i >= 0; i--)
+    {
+        if (!Is[i].patch)
+            continue;
+        size_t tsize = sizes[Is[i].matching] + Is[i].size + JMP_SIZE;
+        counts[patch(P, (size_t)i, tsize)]++;
+        total++;
+    }
+
+    // Mapping statistics:
+    size_t tramp_bytes = 0;
+    std::map<intptr_t, std::set<intptr_t>> blocks;
+    const intptr_t MAPPING_SIZE = (intptr_t)params.mapping_size;
+    const intptr_t GRANULARITY  = (intptr_t)params.granularity;
+    for (const auto &entry: P.allocs)
+    {
+        intptr_t lo = entry.first, hi = lo + (intptr_t)entry.second;
+        tramp_bytes += entry.second;
+        intptr_t a = lo - (lo % GRANULARITY + GRANULARITY) % GRANULARITY;
+        for (; a < hi; a += GRANULARITY)
+        {
+            intptr_t base = a - (a % MAPPING_SIZE + MAPPING_SIZE) %
+                MAPPING_SIZE;
+            blocks[base].insert(a);
+        }
+    }
+    size_t chunks = 0;
+    for (const auto &entry: blocks)
+        chunks += entry.second.size();
+    size_t per_mapping = (size_t)(MAPPING_SIZE / GRANULARITY);
+    size_t num_virtual  = blocks.size();
+    size_t num_physical = (chunks + per_mapping - 1) / per_mapping;
+
+    printf("-----------------------------------------------\n");
+    printf("mode                  = dry-run (predicted)\n");
+    printf("input_binary          = %s\n", elf->filename);
+    printCount("num_patched", total - counts[TACTIC_FAIL], total);
+    if (params.B0)
+        printCount("num_patched_B0", counts[TACTIC_B0], total);
+    printCount("num_patched_B1", counts[TACTIC_B1], total);
+    printCount("num_patched_B2", counts[TACTIC_B2], total);
+    if (params.CFR)
+        printCount("num_patched_T0", counts[TACTIC_T0], total);
+    printCount("num_patched_T1", counts[TACTIC_T1], total);
+    printCount("num_patched_T2", counts[TACTIC_T2], total);
+    printCount("num_patched_T3", counts[TACTIC_T3], total);
+    printf("num_trampoline_bytes  = ~%zu\n", tramp_bytes);
+    printf("num_virtual_mappings  = ~%zu\n", num_virtual);
+    printf("num_physical_mappings = ~%zu (%.2f%%)\n", num_physical,
+        (num_virtual == 0? 0.0:
+            (double)num_physical / (double)num_virtual * 100.0));
+    printf("num_virtual_bytes     = ~%zu\n", num_virtual * MAPPING_SIZE);
+    printf("num_physical_bytes    = ~%zu\n", num_physical * MAPPING_SIZE);
+    printf("-----------------------------------------------\n");
+}
@@ -0,0 +1,51 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __E9PREDICT_H
+#define __E9PREDICT_H
+
+#include <cstdint>
+
+#include <vector>
+
+#include "e9elf.h"
+#include "e9tool.h"
+
+/*
+ * Dry-run (prediction) parameters.  These mirror the E9Patch options that
+ * would otherwise be sent to the backend.
+ */
+struct PredictParams
+{
+    bool CFR;                           // -OCFR?
+    bool B0;                            // --tactic-B0?
+    bool order;                         // -Oorder?
+    size_t mapping_size;                // --mem-mapping-size
+    size_t granularity;                 // --mem-granularity
+};
+
+extern void predictPatching(const e9tool::ELF *elf,
+    const std::vector<e9tool::Instr> &Is, const std::vector<size_t> &sizes,
+    const PredictParams &params);
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-phase statistics for --stats=json.  Each phase accumulates the
+ * wall-clock time, CPU time (all threads), the number (and size) of
+ * operator new allocations, and the peak RSS.  Since the peak RSS is
+ * monotonic, each phase also records by how much it grew the peak.
+ */
+
+#include <cstdint>
+
+#include "e9misc.h"
+#include "e9stats.h"
+#include "../e9patch/e9stats_common.h"
+
+/*
+ * Phase statistics.
+ */
+struct PhaseStats
+{
+    uint64_t wall;                      // Wall-clock time (ns)
+    uint64_t cpu;                       // CPU time (us)
+    size_t allocs;                      // Number of allocations
+    size_t alloc_bytes;                 // Number of allocated bytes
+    size_t rss;                         // Peak RSS at phase exit (KB)
+    size_t rss_growth;                  // Peak RSS growth (KB)
+};
+
+static PhaseStats phase_stats[PHASE_MAX];
+static Phase phase_curr = PHASE_NONE;
+static PhaseStats phase_start;
+static uint64_t start_wall = 0;
+
+/*
+ * Phase names.
+ */
+static const char *getPhaseName(Phase phase)
+{
+    switch (phase)
+    {
+        case PHASE_DISASM:      return "disasm";
+        case PHASE_CFG:         return "cfg";
+        case PHASE_LINES:       return "lines";
+        case PHASE_MATCHING:    return "matching";
+        case PHASE_TRAMPOLINES: return "trampolines";
+        case PHASE_METADATA:    return "metadata";
+        case PHASE_BACKEND:     return "backend";
+        default:                return "???";
+    }
+}
+
+/*
+ * Sample the current totals.
+ */
+static void phaseSample(PhaseStats &sample)
+{
+    sample.wall = getWallTime();
+    if (!getUsage(sample.cpu, sample.rss))
+    {
+        sample.cpu = 0;
+        sample.rss = 0;
+    }
+    sample.allocs      = stat_allocs.load(std::memory_order_relaxed);
+    sample.alloc_bytes = stat_alloc_bytes.load(std::memory_order_relaxed);
+}
+
+/*
+ * Switch to the given phase.
+ */
+void phaseSwitch(Phase phase)
+{
+    if (!option_stats_json || phase == phase_curr)
+        return;
+    PhaseStats sample;
+    phaseSample(sample);
+    if (start_wall == 0)
+        start_wall = sample.wall;
+    if (phase_curr != PHASE_NONE)
+    {
+        PhaseStats &stats = phase_stats[phase_curr];
+        stats.wall        += sample.wall - phase_start.wall;
+        stats.cpu         += sample.cpu - phase_start.cpu;
+        stats.allocs      += sample.allocs - phase_start.allocs;
+        stats.alloc_bytes += sample.alloc_bytes - phase_start.alloc_bytes;
+        stats.rss          = sample.rss;
+        stats.rss_growth  += sample.rss - phase_start.rss;
+    }
+    phase_curr  = phase;
+    phase_start = sample;
+}
+
+/*
+ * Print the phase statistics (as JSON object members).
+ */
+void printPhaseStats(FILE *stream)
+{
+    phaseSwitch(PHASE_NONE);
+    PhaseStats total;
+    phaseSample(total);
+    fprintf(stream, "\"time_elapsed_ms\":%.3f,\"cpu_ms\":%.3f,"
+        "\"memory_used_kb\":%zu,\"phases\":{",
+        (double)(total.wall - start_wall) / 1000000.0,
+        (double)total.cpu / 1000.0, total.rss);
+    bool prev = false;
+    for (unsigned i = PHASE_NONE+1; i < PHASE_MAX; i++)
+    {
+        const PhaseStats &stats = phase_stats[i];
+        fprintf(stream, "%s\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f,"
+            "\"allocs\":%zu,\"alloc_bytes\":%zu,\"peak_rss_kb\":%zu,"
+            "\"rss_growth_kb\":%zu}",
+            (prev? ",": ""), getPhaseName((Phase)i),
+            (double)stats.wall / 1000000.0, (double)stats.cpu / 1000.0,
+            stats.allocs, stats.alloc_bytes, stats.rss, stats.rss_growth);
+        prev = true;
+    }
+    fprintf(stream, "},\"allocs\":%zu,\"alloc_bytes\":%zu",
+        total.allocs, total.alloc_bytes);
+}
@@ -0,0 +1,49 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __E9STATS_H
+#define __E9STATS_H
+
+#include <cstdio>
+
+/*
+ * E9Tool phases (for --stats=json).
+ */
+enum Phase
+{
+    PHASE_NONE,
+    PHASE_DISASM,                       // Disassembly (+ cache load)
+    PHASE_CFG,                          // Targets, BBs, functions
+    PHASE_LINES,                        // Line information
+    PHASE_MATCHING,                     // Matching
+    PHASE_TRAMPOLINES,                  // Sending trampolines
+    PHASE_METADATA,                     // Sending patches + metadata
+    PHASE_BACKEND,                      // Waiting for E9Patch
+    PHASE_MAX
+};
+
+extern void phaseSwitch(Phase phase);
+extern void printPhaseStats(FILE *stream);
+extern void printJSONString(FILE *stream, const char *str);
+
+#endif
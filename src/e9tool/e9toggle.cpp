@@ -0,0 +1,332 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runtime-toggleable instrumentation (--toggle).  Each action is assigned an
+ * enable byte (in command-line order), and each group of patches belonging
+ * to the action is guarded by a test of that byte.  The enable bytes live in
+ * a page that is mapped (MAP_SHARED) from a control file at startup, so an
+ * entire action can be switched on or off from outside the process by a
+ * single byte write.  When an action is disabled, its patches are skipped,
+ * i.e., only the displaced instruction is executed.
+ *
+ * Sampled call trampolines (`call<sample=N>' and `call<period=N>') use a
+ * similar gate that tests a per-site counter, and only execute the call
+ * (including the register save/restore) for sampled hits.  The counters
+ * are updated without locking, so concurrent threads may occasionally
+ * lose a decrement, which is harmless for sampling.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "e9misc.h"
+#include "e9toggle.h"
+#include "e9tool.h"
+
+#include "e9toggle_elf.c"
+
+using namespace e9tool;
+
+#define PAGE_SIZE               4096
+
+/*
+ * Send the toggle runtime messages.
+ */
+void sendToggleRuntimeElfMessages(FILE *out, const char *filename,
+    BinaryType type, size_t num_actions)
+{
+    static_assert(sizeof(ToggleData) <= PAGE_SIZE, "toggle data too big");
+    static_assert(TOGGLE_RT_CODE_ADDR - TOGGLE_RT_DATA_ADDR == PAGE_SIZE &&
+            TOGGLE_RT_DATA_ADDR - TOGGLE_RT_ENABLE_ADDR == PAGE_SIZE,
+        "toggle runtime pages must be contiguous");
+
+    switch (type)
+    {
+        case BINARY_TYPE_PE_EXE: case BINARY_TYPE_PE_DLL:
+            error("toggleable instrumentation is not-yet-implemented for "
+                "Windows PE binaries");
+        default:
+            break;
+    }
+    if (num_actions > TOGGLE_MAX)
+        error("failed to create toggle runtime; too many actions (%zu, "
+            "max=%u)", num_actions, TOGGLE_MAX);
+    size_t len = strlen(filename);
+    if (len >= TOGGLE_PATH_MAX)
+        error("failed to create toggle runtime; control filename \"%s\" is "
+            "too long (max=%u)", filename, TOGGLE_PATH_MAX-1);
+
+    uint8_t enable[PAGE_SIZE] = {0};
+    memset(enable, 1, num_actions);             // Initially enabled
+    uint8_t data[PAGE_SIZE] = {0};
+    ToggleData *tdata = (ToggleData *)data;
+    memcpy(tdata->path, filename, len);
+
+    sendReserveMessage(out, TOGGLE_RT_ENABLE_ADDR, enable, sizeof(enable),
+        PROT_READ | PROT_WRITE);
+    sendReserveMessage(out, TOGGLE_RT_DATA_ADDR, data, sizeof(data),
+        PROT_READ);
+    sendReserveMessage(out, TOGGLE_RT_CODE_ADDR, e9toggle_elf_bin,
+        sizeof(e9toggle_elf_bin), PROT_READ | PROT_EXEC,
+        /*init=*/TOGGLE_RT_CODE_ADDR + TOGGLE_RT_INIT_OFFSET);
+}
+
+/*
+ * Send the start of a toggle gate for action `idx'.  Here `pos' is a
+ * character that distinguishes gates for the same action within one
+ * trampoline.  The gate preserves all registers and %rflags (using jrcxz).
+ */
+void sendToggleGate(FILE *out, size_t idx, char pos)
+{
+    // lea -0x4000(%rsp),%rsp
+    // push %rcx
+    // movzbl ENABLE(%rip),%ecx
+    // jrcxz .Loff
+    // jmp .Lon
+    // .Loff:
+    // pop %rcx
+    // lea 0x4000(%rsp),%rsp
+    // jmpq .Lskip
+    // .Lon:
+    // pop %rcx
+    // lea 0x4000(%rsp),%rsp
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x48, 0x8d, 0xa4, 0x24, -0x4000);
+    fprintf(out, "%u,", 0x51);
+    fprintf(out, "%u,%u,%u,{\"rel32\":%zu},", 0x0f, 0xb6, 0x0d,
+        TOGGLE_RT_ENABLE_ADDR + idx);
+    fprintf(out, "%u,{\"rel8\":\".Loff@%c%zu\"},", 0xe3, pos, idx);
+    fprintf(out, "%u,{\"rel8\":\".Lon@%c%zu\"},", 0xeb, pos, idx);
+    fprintf(out, "\".Loff@%c%zu\",", pos, idx);
+    fprintf(out, "%u,", 0x59);
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x48, 0x8d, 0xa4, 0x24, 0x4000);
+    fprintf(out, "%u,{\"rel32\":\".Lskip@%c%zu\"},", 0xe9, pos, idx);
+    fprintf(out, "\".Lon@%c%zu\",", pos, idx);
+    fprintf(out, "%u,", 0x59);
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x48, 0x8d, 0xa4, 0x24, 0x4000);
+}
+
+/*
+ * Send the end of a toggle gate.  If `next' is non-NULL, then enabled path
+ * jumps to the label `next' (e.g., to skip the displaced instruction).
+ */
+void sendToggleGateEnd(FILE *out, size_t idx, char pos, const char *next)
+{
+    if (next != nullptr)
+        fprintf(out, "%u,{\"rel32\":\"%s\"},", 0xe9, next);
+    fprintf(out, "\".Lskip@%c%zu\",", pos, idx);
+}
+
+/*
+ * Send the displaced instruction for a trampoline with several gated
+ * `replace' actions `idxs'.  Each enabled replace action runs (in order), and
+ * the instruction is skipped if any of them is enabled.
+ */
+void sendToggleReplaced(FILE *out, const std::vector<size_t> &idxs)
+{
+    // lea -0x4000(%rsp),%rsp
+    // push %rcx
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x48, 0x8d, 0xa4, 0x24, -0x4000);
+    fprintf(out, "%u,", 0x51);
+
+    // movzbl ENABLE(%rip),%ecx
+    // jrcxz .+5
+    // jmpq .Lreplaced_on
+    for (auto idx: idxs)
+    {
+        fprintf(out, "%u,%u,%u,{\"rel32\":%zu},", 0x0f, 0xb6, 0x0d,
+            TOGGLE_RT_ENABLE_ADDR + idx);
+        fprintf(out, "%u,%u,", 0xe3, 0x05);
+        fprintf(out, "%u,{\"rel32\":\".Lreplaced_on\"},", 0xe9);
+    }
+
+    // pop %rcx
+    // lea 0x4000(%rsp),%rsp
+    // $instr
+    // jmpq .Lreplaced
+    // .Lreplaced_on:
+    // pop %rcx
+    // lea 0x4000(%rsp),%rsp
+    // .Lreplaced:
+    fprintf(out, "%u,", 0x59);
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x48, 0x8d, 0xa4, 0x24, 0x4000);
+    fputs("\"$instr\",", out);
+    fprintf(out, "%u,{\"rel32\":\".Lreplaced\"},", 0xe9);
+    fputs("\".Lreplaced_on\",", out);
+    fprintf(out, "%u,", 0x59);
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x48, 0x8d, 0xa4, 0x24, 0x4000);
+    fputs("\".Lreplaced\",", out);
+}
+
+/*
+ * Send the sample counters "reserve" message for `num_sites' sites, and
+ * return the counters' address.
+ */
+intptr_t sendSampleCountersMessage(FILE *out, BinaryType type,
+    size_t num_sites)
+{
+    static intptr_t end = SAMPLE_COUNTERS_END;
+
+    switch (type)
+    {
+        case BINARY_TYPE_PE_EXE: case BINARY_TYPE_PE_DLL:
+            error("sampled call trampolines are not-yet-implemented for "
+                "Windows PE binaries");
+        default:
+            break;
+    }
+    size_t size = num_sites * SAMPLE_COUNTER_SIZE;
+    size = (size % PAGE_SIZE == 0? size: size + PAGE_SIZE - size % PAGE_SIZE);
+    size = (size == 0? PAGE_SIZE: size);
+    if ((intptr_t)size > end)
+        error("failed to allocate sample counters; too many sites (%zu)",
+            num_sites);
+    intptr_t addr = end - (intptr_t)size;
+    end = addr;
+
+    std::vector<uint8_t> zeroes(size, 0x0);
+    sendReserveMessage(out, addr, zeroes.data(), zeroes.size(),
+        PROT_READ | PROT_WRITE);
+    return addr;
+}
+
+/*
+ * Send the start of a sample gate for call patch `name'.  The gate
+ * preserves all registers and %rflags.  The counter is zero-initialized,
+ * so the first hit at each site is always sampled.
+ */
+void sendSampleGate(FILE *out, const char *name, uint32_t sample,
+    uint32_t period)
+{
+    const char *patch = name+1;
+
+    // lea -0x4000(%rsp),%rsp
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x48, 0x8d, 0xa4, 0x24, -0x4000);
+    if (sample != 0)
+    {
+        // push %rcx
+        // mov COUNTER(%rip),%ecx
+        // jrcxz .Lsampled
+        // lea -0x1(%rcx),%ecx
+        // mov %ecx,COUNTER(%rip)
+        // pop %rcx
+        // lea 0x4000(%rsp),%rsp
+        // jmpq .Lunsampled
+        // .Lsampled:
+        // mov $(N-1),%ecx
+        // mov %ecx,COUNTER(%rip)
+        // pop %rcx
+        fprintf(out, "%u,", 0x51);
+        fprintf(out, "%u,%u,\"$SAMPLE@%s\",", 0x8b, 0x0d, patch);
+        fprintf(out, "%u,{\"rel8\":\".Lsampled@%s\"},", 0xe3, patch);
+        fprintf(out, "%u,%u,%u,", 0x8d, 0x49, 0xff);
+        fprintf(out, "%u,%u,\"$SAMPLE@%s\",", 0x89, 0x0d, patch);
+        fprintf(out, "%u,", 0x59);
+        fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+            0x48, 0x8d, 0xa4, 0x24, 0x4000);
+        fprintf(out, "%u,{\"rel32\":\".Lunsampled@%s\"},", 0xe9, patch);
+        fprintf(out, "\".Lsampled@%s\",", patch);
+        fprintf(out, "%u,{\"int32\":%u},", 0xb9, sample - 1);
+        fprintf(out, "%u,%u,\"$SAMPLE@%s\",", 0x89, 0x0d, patch);
+        fprintf(out, "%u,", 0x59);
+    }
+    else
+    {
+        // push %rax
+        // push %rdx
+        // lahf
+        // seto %al
+        // push %rax
+        // rdtsc
+        // shl $32,%rdx
+        // or %rdx,%rax
+        // cmp COUNTER(%rip),%rax
+        // jae .Lsampled
+        // pop %rax
+        // add $0x7f,%al
+        // sahf
+        // pop %rdx
+        // pop %rax
+        // lea 0x4000(%rsp),%rsp
+        // jmpq .Lunsampled
+        // .Lsampled:
+        // add $PERIOD,%rax
+        // mov %rax,COUNTER(%rip)
+        // pop %rax
+        // add $0x7f,%al
+        // sahf
+        // pop %rdx
+        // pop %rax
+        fprintf(out, "%u,%u,", 0x50, 0x52);
+        fprintf(out, "%u,%u,%u,%u,", 0x9f, 0x0f, 0x90, 0xc0);
+        fprintf(out, "%u,", 0x50);
+        fprintf(out, "%u,%u,", 0x0f, 0x31);
+        fprintf(out, "%u,%u,%u,%u,", 0x48, 0xc1, 0xe2, 0x20);
+        fprintf(out, "%u,%u,%u,", 0x48, 0x09, 0xd0);
+        fprintf(out, "%u,%u,%u,\"$SAMPLE@%s\",", 0x48, 0x3b, 0x05, patch);
+        fprintf(out, "%u,{\"rel8\":\".Lsampled@%s\"},", 0x73, patch);
+        fprintf(out, "%u,%u,%u,%u,%u,%u,", 0x58, 0x04, 0x7f, 0x9e, 0x5a,
+            0x58);
+        fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+            0x48, 0x8d, 0xa4, 0x24, 0x4000);
+        fprintf(out, "%u,{\"rel32\":\".Lunsampled@%s\"},", 0xe9, patch);
+        fprintf(out, "\".Lsampled@%s\",", patch);
+        fprintf(out, "%u,%u,{\"int32\":%u},", 0x48, 0x05, period);
+        fprintf(out, "%u,%u,%u,\"$SAMPLE@%s\",", 0x48, 0x89, 0x05, patch);
+        fprintf(out, "%u,%u,%u,%u,%u,%u,", 0x58, 0x04, 0x7f, 0x9e, 0x5a,
+            0x58);
+    }
+    // lea 0x4000(%rsp),%rsp
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x48, 0x8d, 0xa4, 0x24, 0x4000);
+}
+
+/*
+ * Send the end of a sample gate.
+ */
+void sendSampleGateEnd(FILE *out, const char *name)
+{
+    fprintf(out, "\".Lunsampled@%s\",", name+1);
+}
+
+/*
+ * Send the sample gate metadata, where `addr' is the site's counter.
+ */
+void sendSampleMetadata(FILE *out, const char *name, intptr_t addr)
+{
+    sendDefinitionHeader(out, name+1, "SAMPLE");
+    fprintf(out, "{\"rel32\":%zd}", (ssize_t)addr);
+    sendDefinitionFooter(out);
+}
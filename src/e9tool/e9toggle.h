@@ -0,0 +1,81 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __E9TOGGLE_H
+#define __E9TOGGLE_H
+
+#include <cstdint>
+
+/*
+ * Toggle runtime layout (see e9toggle_elf.cpp).  The enable page holds one
+ * byte per action (non-zero = enabled), and is replaced by a shared mapping
+ * of the control file at startup.  The data page is placed immediately
+ * before the code.
+ */
+#define TOGGLE_RT_ENABLE_ADDR   0x6ffe0000  // Enable bytes (rw-)
+#define TOGGLE_RT_DATA_ADDR     0x6ffe1000  // Runtime data (r--)
+#define TOGGLE_RT_CODE_ADDR     0x6ffe2000  // Runtime code (r-x)
+#define TOGGLE_RT_INIT_OFFSET   0x0         // init() entry
+#define TOGGLE_MAX              4096        // Max #actions
+#define TOGGLE_PATH_MAX         4096        // Max control file path length
+
+/*
+ * Sampling counters (see `call<sample=N>' and `call<period=N>').  Each
+ * sampled call patch has one counter per site it patches, and the counter
+ * arrays are placed immediately below the toggle runtime and the xsave mode
+ * byte (see XSTATE_MODE_ADDR in e9codegen.h).
+ */
+#define SAMPLE_COUNTERS_END     (TOGGLE_RT_ENABLE_ADDR - 0x1000)
+#define SAMPLE_COUNTER_SIZE     sizeof(uint64_t)
+
+/*
+ * Toggle runtime data page.
+ */
+struct ToggleData
+{
+    char path[TOGGLE_PATH_MAX];             // Control file path
+};
+
+#ifndef E9TOGGLE_FORMAT_ONLY
+
+#include <cstdio>
+#include <vector>
+
+#include "e9tool.h"
+
+extern void sendToggleRuntimeElfMessages(FILE *out, const char *filename,
+    e9tool::BinaryType type, size_t num_actions);
+extern void sendToggleGate(FILE *out, size_t idx, char pos);
+extern void sendToggleGateEnd(FILE *out, size_t idx, char pos,
+    const char *next = nullptr);
+extern void sendToggleReplaced(FILE *out, const std::vector<size_t> &idxs);
+extern intptr_t sendSampleCountersMessage(FILE *out, e9tool::BinaryType type,
+    size_t num_sites);
+extern void sendSampleGate(FILE *out, const char *name, uint32_t sample,
+    uint32_t period);
+extern void sendSampleGateEnd(FILE *out, const char *name);
+extern void sendSampleMetadata(FILE *out, const char *name, intptr_t addr);
+
+#endif  /* E9TOGGLE_FORMAT_ONLY */
+
+#endif
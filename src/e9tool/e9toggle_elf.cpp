@@ -0,0 +1,139 @@
+/*
+ * e9toggle_elf.cpp
+ * Copyright (C) 2023 National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * NOTE: As a special exception, this file is under the MIT license.  The
+ *       rest of the E9Patch/E9Tool source code is under the GPLv3 license.
+ */
+
+/*
+ * Runtime for toggleable instrumentation (--toggle).  This is linked into
+ * the patched binary (see sendToggleRuntimeElfMessages()) at
+ * TOGGLE_RT_CODE_ADDR, with the data page and the enable page immediately
+ * before the code.
+ *
+ * At startup, init() opens (or creates) the control file, extends it to one
+ * page using the default enable bytes, and maps it over the enable page
+ * using MAP_SHARED.  Thereafter, writes to the control file (by any process)
+ * immediately enable or disable the corresponding actions.  If the control
+ * file cannot be used, the default enable bytes are kept.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#define E9TOGGLE_FORMAT_ONLY
+#include "e9toggle.h"
+
+#define PAGE_SIZE           4096
+
+extern "C"
+{
+    void toggle_init(int argc, char **argv, char **envp,
+        const void *dynamic, const void *config);
+}
+
+/*
+ * Toggle runtime entry points.
+ */
+asm (
+    ".section .text.entry,\"x\",@progbits\n"
+
+    "toggle_entry:\n"   // init() offset = +0
+    "\tjmp toggle_init\n"
+
+    ".section .text\n"
+);
+
+/*
+ * System calls.
+ */
+static intptr_t toggle_syscall(long number, intptr_t arg1 = 0,
+    intptr_t arg2 = 0, intptr_t arg3 = 0, intptr_t arg4 = 0,
+    intptr_t arg5 = 0, intptr_t arg6 = 0)
+{
+    register intptr_t r10 asm("r10") = arg4;
+    register intptr_t r8  asm("r8")  = arg5;
+    register intptr_t r9  asm("r9")  = arg6;
+    intptr_t result;
+    asm volatile (
+        "syscall"
+        : "=a"(result)
+        : "a"(number), "D"(arg1), "S"(arg2), "d"(arg3), "r"(r10), "r"(r8),
+            "r"(r9)
+        : "rcx", "r11", "memory");
+    return result;
+}
+
+/*
+ * Print a warning (the control file cannot be used).
+ */
+static void toggle_warning(const char *path)
+{
+    static const char msg[] = "e9toggle: failed to map control file \"";
+    size_t len = 0;
+    while (path[len] != '\0')
+        len++;
+    toggle_syscall(SYS_write, STDERR_FILENO, (intptr_t)msg, sizeof(msg)-1);
+    toggle_syscall(SYS_write, STDERR_FILENO, (intptr_t)path, len);
+    toggle_syscall(SYS_write, STDERR_FILENO, (intptr_t)"\"\n", 2);
+}
+
+/*
+ * Initialization: map the control file over the enable page.
+ */
+void toggle_init(int argc, char **argv, char **envp, const void *dynamic,
+    const void *config)
+{
+    uint8_t *base;
+    asm ("lea toggle_entry(%%rip),%0" : "=r"(base));
+    const ToggleData *data = (const ToggleData *)(base -
+        (TOGGLE_RT_CODE_ADDR - TOGGLE_RT_DATA_ADDR));
+    uint8_t *enable = base - (TOGGLE_RT_CODE_ADDR - TOGGLE_RT_ENABLE_ADDR);
+
+    int fd = (int)toggle_syscall(SYS_open, (intptr_t)data->path,
+        O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        toggle_warning(data->path);
+        return;
+    }
+    intptr_t size = toggle_syscall(SYS_lseek, fd, 0, SEEK_END);
+    while (size >= 0 && size < PAGE_SIZE)
+    {
+        // New (or short) control file: extend using the defaults.
+        intptr_t r = toggle_syscall(SYS_pwrite64, fd,
+            (intptr_t)(enable + size), PAGE_SIZE - size, size);
+        size = (r < 0? r: size + r);
+    }
+    intptr_t r = -1;
+    if (size >= PAGE_SIZE)
+        r = toggle_syscall(SYS_mmap, (intptr_t)enable, PAGE_SIZE,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    if (r < 0)
+        toggle_warning(data->path);
+    toggle_syscall(SYS_close, fd);
+}
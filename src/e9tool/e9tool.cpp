@@ -26,7 +26,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 
+#include <algorithm>
 #include <regex>
 #include <set>
 #include <string>
@@ -36,6 +38,7 @@
 #include <getopt.h>
 #include <libgen.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -51,16 +54,24 @@
  */
 static std::string option_format("binary");
 static std::string option_output("");
+static std::string option_toggle("");
+static std::string option_trace_file("e9trace.out");
 static std::vector<std::pair<const char *, char *>> option_plugin;
 
 #include "e9action.h"
+#include "e9cache.h"
+#include "e9cfg.h"
 #include "e9csv.h"
 #include "e9elf.h"
 #include "e9metadata.h"
 #include "e9misc.h"
 #include "e9parser.h"
 #include "e9plugin.h"
+#include "e9predict.h"
+#include "e9stats.h"
+#include "e9toggle.h"
 #include "e9tool.h"
+#include "e9trace.h"
 #include "e9x86_64.h"
 
 using namespace e9tool;
@@ -83,18 +94,6 @@ struct Exclude
     intptr_t hi;
 };
 
-/*
- * Disassembler desync information.
- */
-struct Desync
-{
-    intptr_t lo;
-    intptr_t hi;
-    intptr_t addr;
-    const char *section;
-    uint8_t byte;
-};
-
 /*
  * Spawn e9patch backend instance.
  */
@@ -452,6 +451,102 @@ struct MatchingCache
     std::vector<const Matching *> matchings;
 };
 
+/*
+ * Trampoline template sizes (in bytes) for the --dry-run estimate.  Exact
+ * sizes are the encodings emitted by the corresponding send*() functions;
+ * sizes marked `~' depend on the operands and are typical values.
+ */
+#define EST_TOGGLE_GATE     43      // sendToggleGate()
+#define EST_TOGGLE_REPLACE  5       // jmpq .Lreplaced
+#define EST_TOGGLE_REPLACED 32      // sendToggleReplaced()
+#define EST_TOGGLE_CHECK    14      // sendToggleReplaced() per action
+#define EST_TRAP            1       // int3
+#define EST_PRINT           54      // sendPrintTrampolineMessage()
+#define EST_PRINT_ASM       32      // ~ .Lasm string
+#define EST_EXIT            12      // sendExitTrampolineMessage()
+#define EST_SIGNAL          51      // sendSignalTrampolineMessage()
+#define EST_CALL_CLEAN      64      // ~ register save/restore + callq
+#define EST_CALL_NAKED      16      // ~ stack adjust + callq
+#define EST_CALL_ARG        8       // ~ argument load
+#define EST_CALL_JUMP       23      // conditional jump/goto tail
+#define EST_CALL_FASTPATH   56      // ~ fast path frame (excluding snippet)
+#define EST_SAMPLE_GATE     60      // sendSampleGate() with sample=N
+#define EST_PERIOD_GATE     79      // sendSampleGate() with period=N
+#define EST_PLUGIN          32      // ~ plugin-defined
+#define EST_TRACE           43      // sendTraceTrampolineMessage()
+#define EST_TRACE_TIME      14      // rdtsc + store
+#define EST_TRACE_MEM       8       // ~ lea MEM,%rax + push
+
+/*
+ * Estimate the trampoline template size (in bytes) for a matching (see
+ * --dry-run).  This excludes the relocated instruction and the return jump.
+ */
+static size_t estimateTrampolineSize(const Matching *M)
+{
+    size_t size = 0, replaces = 0;
+    for (const auto *action: M->actions)
+    {
+        // With --toggle, each (action, position) group has its own gate:
+        unsigned gates = 0x0;
+        for (const auto *patch: action->patch)
+        {
+            unsigned gate = (1u << patch->pos);
+            if (!option_toggle.empty() && (gates & gate) == 0)
+            {
+                gates |= gate;
+                size += EST_TOGGLE_GATE;
+                replaces += (patch->pos == POS_REPLACE? 1: 0);
+            }
+            switch (patch->kind)
+            {
+                case PATCH_EMPTY: case PATCH_BREAK:
+                    break;
+                case PATCH_TRAP:
+                    size += EST_TRAP;
+                    break;
+                case PATCH_PRINT:
+                    size += (option_print_buffer != nullptr? EST_TRACE:
+                        EST_PRINT + EST_PRINT_ASM);
+                    break;
+                case PATCH_EXIT:
+                    size += EST_EXIT;
+                    break;
+                case PATCH_SIGNAL:
+                    size += EST_SIGNAL;
+                    break;
+                case PATCH_CALL:
+                    size += (patch->abi == ABI_CLEAN? EST_CALL_CLEAN:
+                            EST_CALL_NAKED) +
+                        EST_CALL_ARG * patch->args.size() +
+                        (patch->jmp != JUMP_NONE? EST_CALL_JUMP: 0) +
+                        (patch->sample != 0? EST_SAMPLE_GATE: 0) +
+                        (patch->period != 0? EST_PERIOD_GATE: 0);
+                    if (patch->call != nullptr &&
+                            patch->call->fastpath.size() > 0)
+                        size += EST_CALL_FASTPATH +
+                            EST_CALL_ARG * patch->args.size() +
+                            patch->call->fastpath.size();
+                    break;
+                case PATCH_PLUGIN:
+                    size += EST_PLUGIN;
+                    break;
+                case PATCH_TRACE:
+                    size += EST_TRACE +
+                        ((patch->trace & TRACE_FLAG_TIME) != 0?
+                            EST_TRACE_TIME: 0) +
+                        ((patch->trace & TRACE_FLAG_MEM) != 0?
+                            EST_TRACE_MEM: 0);
+                    break;
+            }
+        }
+    }
+    if (replaces == 1)
+        size += EST_TOGGLE_REPLACE;
+    else if (replaces > 1)
+        size += EST_TOGGLE_REPLACED + EST_TOGGLE_CHECK * replaces;
+    return size;
+}
+
 /*
  * Matching.
  */
@@ -583,8 +678,13 @@ static bool sendTrampoline(FILE *out, const Action *action, size_t idx,
     }
     else
     {
+        bool sampled = (patch->sample != 0 || patch->period != 0);
+        if (sampled)
+            sendSampleGate(out, patch->name, patch->sample, patch->period);
         sendString(out, patch->name);
         sendSeparator(out);
+        if (sampled)
+            sendSampleGateEnd(out, patch->name);
         if (patch->kind == PATCH_BREAK)
             return true;
     }
@@ -597,7 +697,7 @@ static bool sendTrampoline(FILE *out, const Action *action, size_t idx,
             if (plugin->patchFunc == nullptr)
                 break;
             // Fallthrough
-        case PATCH_PRINT: case PATCH_CALL:
+        case PATCH_PRINT: case PATCH_CALL: case PATCH_TRACE:
             for (const auto &entry: metadata)
             {
                 const Patch *prev = entry.action->patch[entry.idx];
@@ -624,27 +724,38 @@ enum Option
 {
     OPTION_100,
     OPTION_BACKEND,
+    OPTION_BATCH,
+    OPTION_CACHE,
     OPTION_CFR,
     OPTION_COMPRESSION,
+    OPTION_DRECURSIVE,
     OPTION_DSYNC,
     OPTION_DTHRESHOLD,
     OPTION_DEBUG,
+    OPTION_DRY_RUN,
     OPTION_DUMP_ALL,
+    OPTION_DWARF,
+    OPTION_DWARF_THREADS,
     OPTION_EXCLUDE,
     OPTION_EXECUTABLE,
     OPTION_FORMAT,
     OPTION_HELP,
+    OPTION_JOBS,
     OPTION_MATCH,
     OPTION_NO_WARNINGS,
     OPTION_PATCH,
     OPTION_PLT,
     OPTION_PLUGIN,
+    OPTION_PRINT_BUFFER,
     OPTION_OPTION,
     OPTION_OUTPUT,
     OPTION_SEED,
     OPTION_SHARED,
     OPTION_STATIC_LOADER,
+    OPTION_STATS,
     OPTION_SYNTAX,
+    OPTION_TOGGLE,
+    OPTION_TRACE_FILE,
     OPTION_TRAP,
     OPTION_TRAP_ALL,
     OPTION_USE_DISASM,
@@ -688,6 +799,202 @@ static intptr_t parseIntOptArg(const char *option, const char *optarg,
     return r;
 }
 
+/*
+ * Parse the match/patch action pairs.
+ */
+static void parseActions(const ELF &elf,
+    const std::vector<ActionEntry> &entries, std::vector<Action *> &actions)
+{
+    for (const auto &entry: entries)
+    {
+        if (entry.match.size() == 0)
+            error("failed to parse action; the `--patch' or `-P' option "
+                "must be preceded by one or more `--match' or `-M' options");
+        
+        MatchExpr *match = nullptr;
+        for (const auto &str: entry.match)
+        {
+            MatchExpr *expr = parseMatch(elf, str.c_str());
+            match = (match == nullptr? expr:
+                new MatchExpr(MATCH_OP_AND, match, expr));
+        }
+        std::vector<const Patch *> patch;
+        for (const auto &str: entry.patch)
+        {
+            const Patch *P = parsePatch(elf, str.c_str());
+            patch.push_back(P);
+            if (P->kind == PATCH_BREAK)
+                break;
+        }
+        Action *action = new Action(match, std::move(patch));
+        actions.push_back(action);
+    }
+}
+
+/*
+ * Batch mode entry.
+ */
+struct BatchEntry
+{
+    const char *input;              // Input binary.
+    const char *output;             // Output binary.
+    size_t size;                    // Input binary size.
+    struct timespec start;          // Worker start time.
+    double time;                    // Worker wall-clock time (seconds).
+    bool ok;                        // Worker succeeded?
+};
+
+/*
+ * Get the elapsed time (in seconds) since `start'.
+ */
+static double elapsed(const struct timespec &start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start.tv_sec) +
+        (double)(now.tv_nsec - start.tv_nsec) / 1000000000.0;
+}
+
+/*
+ * Parse a batch file.  Each (non-empty) line is of the form "INPUT OUTPUT",
+ * and lines beginning with '#' are ignored.
+ */
+static void parseBatch(const char *filename, bool option_executable,
+    bool option_shared, std::vector<BatchEntry> &batch)
+{
+    FILE *stream = fopen(filename, "r");
+    if (stream == nullptr)
+        error("failed to open batch file \"%s\" for reading: %s", filename,
+            strerror(errno));
+    char *line = nullptr;
+    size_t len = 0;
+    for (unsigned lineno = 1; getline(&line, &len, stream) >= 0; lineno++)
+    {
+        char *save = nullptr;
+        const char *input  = strtok_r(line, " \t\r\n", &save);
+        if (input == nullptr || input[0] == '#')
+            continue;
+        const char *output = strtok_r(nullptr, " \t\r\n", &save);
+        if (output == nullptr ||
+                strtok_r(nullptr, " \t\r\n", &save) != nullptr)
+            error("failed to parse batch file \"%s\" at line %u; expected "
+                "\"INPUT OUTPUT\"", filename, lineno);
+        bool exe = (option_executable? true:
+                   (option_shared? false: !isLibraryFilename(input)));
+        input = findBinary(input, exe, /*dot=*/true);
+        struct stat buf;
+        if (stat(input, &buf) != 0)
+            error("failed to get status of file \"%s\": %s", input,
+                strerror(errno));
+        BatchEntry entry = {strDup(input), strDup(output),
+            (size_t)buf.st_size, {0, 0}, 0.0, false};
+        batch.push_back(entry);
+    }
+    free(line);
+    fclose(stream);
+    if (batch.size() == 0)
+        error("failed to parse batch file \"%s\"; file is empty", filename);
+}
+
+/*
+ * Run batch mode.  The parent process schedules up to `jobs' concurrent
+ * worker processes (each with its own backend), largest binaries first, and
+ * prints a timing summary.  The worker processes return the binary to be
+ * rewritten.  The parent process never returns.
+ */
+static const BatchEntry *runBatch(const char *filename, unsigned jobs,
+    bool option_executable, bool option_shared,
+    const std::vector<ActionEntry> &entries)
+{
+    std::vector<BatchEntry> batch;
+    parseBatch(filename, option_executable, option_shared, batch);
+    std::stable_sort(batch.begin(), batch.end(),
+        [](const BatchEntry &a, const BatchEntry &b) -> bool
+        {
+            return (a.size > b.size);
+        });
+    if (jobs == 0)
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = (n <= 0? 1: (unsigned)n);
+    }
+
+    // Parse the actions once against the largest binary.  This loads all
+    // plugins and instrumentation binaries, which are inherited by the
+    // workers.  Warnings are reported by the workers instead.
+    bool no_warnings = option_no_warnings;
+    option_no_warnings = true;
+    const ELF *elf = parseBinary(batch[0].input);
+    std::vector<Action *> actions;
+    parseActions(*elf, entries, actions);
+    for (const auto *action: actions)
+    {
+        for (const auto *patch: action->patch)
+        {
+            if (patch->kind != PATCH_CALL)
+                continue;
+            std::vector<ArgumentKind> sig;
+            for (const auto &arg: patch->args)
+                sig.push_back(arg.kind);
+            (void)makeCall(elf, patch->filename, patch->entry, patch->abi,
+                patch->jmp, patch->pos, sig, patch->save);
+        }
+    }
+    option_no_warnings = no_warnings;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    std::map<pid_t, BatchEntry *> workers;
+    size_t next = 0, failed = 0;
+    while (next < batch.size() || workers.size() > 0)
+    {
+        if (next < batch.size() && workers.size() < jobs)
+        {
+            BatchEntry &entry = batch[next++];
+            fflush(stdout);
+            fflush(stderr);
+            clock_gettime(CLOCK_MONOTONIC, &entry.start);
+            pid_t pid = fork();
+            if (pid == 0)
+                return new BatchEntry(entry);
+            else if (pid < 0)
+                error("failed to fork worker process: %s", strerror(errno));
+            workers.insert({pid, &entry});
+            continue;
+        }
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            error("failed to wait for worker process: %s", strerror(errno));
+        }
+        auto i = workers.find(pid);
+        if (i == workers.end() || (!WIFEXITED(status) && !WIFSIGNALED(status)))
+            continue;
+        BatchEntry *entry = i->second;
+        workers.erase(i);
+        entry->time = elapsed(entry->start);
+        entry->ok   = (WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        failed += (entry->ok? 0: 1);
+    }
+    double total = elapsed(start), sum = 0.0;
+
+    fprintf(stderr, "%10s %12s %-6s %s\n", "TIME", "SIZE", "STATUS",
+        "BINARY");
+    for (const auto &entry: batch)
+    {
+        fprintf(stderr, "%9.3fs %12zu %-6s %s -> %s\n", entry.time,
+            entry.size, (entry.ok? "ok": "FAIL"), entry.input, entry.output);
+        sum += entry.time;
+    }
+    fprintf(stderr, "rewrote %zu/%zu binaries in %.3fs (jobs=%u, "
+        "sum=%.3fs)\n", batch.size() - failed, batch.size(), total, jobs,
+        sum);
+    exit(failed == 0? EXIT_SUCCESS: EXIT_FAILURE);
+}
+
 /*
  * Entry.
  */
@@ -703,27 +1010,38 @@ int main_2(int argc, char **argv)
     {
         {"100",           no_arg,  nullptr, OPTION_100},
         {"backend",       req_arg, nullptr, OPTION_BACKEND},
+        {"batch",         req_arg, nullptr, OPTION_BATCH},
+        {"cache",         req_arg, nullptr, OPTION_CACHE},
         {"CFR",           no_arg,  nullptr, OPTION_CFR},
         {"compression",   req_arg, nullptr, OPTION_COMPRESSION},
+        {"Drecursive",    no_arg,  nullptr, OPTION_DRECURSIVE},
         {"Dsync",         req_arg, nullptr, OPTION_DSYNC},
         {"Dthreshold",    req_arg, nullptr, OPTION_DTHRESHOLD},
         {"debug",         no_arg,  nullptr, OPTION_DEBUG},
+        {"dry-run",       no_arg,  nullptr, OPTION_DRY_RUN},
         {"dump-all",      no_arg,  nullptr, OPTION_DUMP_ALL},
+        {"dwarf",         req_arg, nullptr, OPTION_DWARF},
+        {"dwarf-threads", req_arg, nullptr, OPTION_DWARF_THREADS},
         {"exclude",       req_arg, nullptr, OPTION_EXCLUDE},
         {"executable",    no_arg,  nullptr, OPTION_EXECUTABLE},
         {"format",        req_arg, nullptr, OPTION_FORMAT},
         {"help",          no_arg,  nullptr, OPTION_HELP},
+        {"jobs",          req_arg, nullptr, OPTION_JOBS},
         {"match",         req_arg, nullptr, OPTION_MATCH},
         {"no-warnings",   no_arg,  nullptr, OPTION_NO_WARNINGS},
         {"patch",         req_arg, nullptr, OPTION_PATCH},
         {"plt",           no_arg,  nullptr, OPTION_PLT},
         {"plugin",        req_arg, nullptr, OPTION_PLUGIN},
+        {"print-buffer",  req_arg, nullptr, OPTION_PRINT_BUFFER},
         {"option",        req_arg, nullptr, OPTION_OPTION},
         {"output",        req_arg, nullptr, OPTION_OUTPUT},
         {"seed",          req_arg, nullptr, OPTION_SEED},
         {"shared",        no_arg,  nullptr, OPTION_SHARED},
         {"static-loader", no_arg,  nullptr, OPTION_STATIC_LOADER},
+        {"stats",         req_arg, nullptr, OPTION_STATS},
         {"syntax",        req_arg, nullptr, OPTION_SYNTAX},
+        {"toggle",        req_arg, nullptr, OPTION_TOGGLE},
+        {"trace-file",    req_arg, nullptr, OPTION_TRACE_FILE},
         {"trap",          req_arg, nullptr, OPTION_TRAP},
         {"trap-all",      no_arg,  nullptr, OPTION_TRAP_ALL},
         {"use-disasm",    req_arg, nullptr, OPTION_USE_DISASM},
@@ -739,6 +1057,11 @@ int main_2(int argc, char **argv)
     bool option_executable = false, option_shared = false,
         option_static_loader = false;
     std::string option_backend("");
+    std::string option_batch("");
+    unsigned option_jobs = 0;
+    std::string option_cache("");
+    std::string option_dwarf("");
+    unsigned option_dwarf_threads = 0;
     std::set<intptr_t> option_trap;
     std::vector<std::string> option_match;
     std::vector<std::string> option_patch;
@@ -747,8 +1070,9 @@ int main_2(int argc, char **argv)
     std::string option_use_disasm("");
     std::string option_use_targets("");
     std::string option_use_funcs("");
-    bool option_dump_all = false;
+    bool option_dump_all = false, option_dry_run = false;
     int option_sync = 64, option_threshold = 2;
+    bool option_recursive = false;
     bool option_100 = false, option_CFR = false;
     srand(0xe9e9e9e9);
     while (true)
@@ -766,6 +1090,12 @@ int main_2(int argc, char **argv)
             case OPTION_BACKEND:
                 option_backend = optarg;
                 break;
+            case OPTION_BATCH:
+                option_batch = optarg;
+                break;
+            case OPTION_CACHE:
+                option_cache = optarg;
+                break;
             case OPTION_CFR:
             case 'X':
                 option_CFR = true;
@@ -775,6 +1105,9 @@ int main_2(int argc, char **argv)
                 option_compression_level = (unsigned)parseIntOptArg(
                     "--compression/-c", optarg, 0, 9);
                 break;
+            case OPTION_DRECURSIVE:
+                option_recursive = true;
+                break;
             case OPTION_DSYNC:
                 option_sync = (int)parseIntOptArg("--Dsync", optarg,
                     0, UINT16_MAX);
@@ -786,10 +1119,23 @@ int main_2(int argc, char **argv)
             case OPTION_DEBUG:
                 option_debug = true;
                 break;
+            case OPTION_DRY_RUN:
+                option_dry_run = true;
+                break;
             case OPTION_DUMP_ALL:
                 option_targets = option_bbs = option_fs =
                     option_dump_all = true;
                 break;
+            case OPTION_DWARF:
+                option_dwarf = optarg;
+                if (option_dwarf != "lazy" && option_dwarf != "eager")
+                    error("bad value \"%s\" for `--dwarf' option; "
+                        "expected one of \"lazy\" or \"eager\"", optarg);
+                break;
+            case OPTION_DWARF_THREADS:
+                option_dwarf_threads = (unsigned)parseIntOptArg(
+                    "--dwarf-threads", optarg, 0, 1024);
+                break;
             case OPTION_EXCLUDE:
             case 'E':
                 option_exclude.push_back(optarg);
@@ -814,10 +1160,17 @@ int main_2(int argc, char **argv)
             case 'h':
                 usage(stdout, argv[0]);
                 return EXIT_SUCCESS;
+            case OPTION_JOBS:
+                option_jobs = (unsigned)parseIntOptArg("--jobs", optarg, 1,
+                    1024);
+                break;
 
             case OPTION_OPTION:
                 option_options.push_back(optarg);
                 break;
+            case OPTION_PRINT_BUFFER:
+                option_print_buffer = optarg;
+                break;
             case OPTION_MATCH:
             case 'M':
             {
@@ -894,6 +1247,15 @@ int main_2(int argc, char **argv)
             case 's':
                 option_static_loader = true;
                 break;
+            case OPTION_STATS:
+                if (strcmp(optarg, "json") == 0)
+                    option_stats_json = true;
+                else if (strcmp(optarg, "text") == 0)
+                    option_stats_json = false;
+                else
+                    error("bad value \"%s\" for `--stats' option; "
+                        "expected \"text\" or \"json\"", optarg);
+                break;
             case OPTION_SYNTAX:
                 if (strcmp(optarg, "ATT") == 0)
                     option_intel_syntax = false;
@@ -903,6 +1265,12 @@ int main_2(int argc, char **argv)
                     error("bad value \"%s\" for `--syntax' option; "
                         "expected \"ATT\" or \"intel\"", optarg);
                 break;
+            case OPTION_TOGGLE:
+                option_toggle = optarg;
+                break;
+            case OPTION_TRACE_FILE:
+                option_trace_file = optarg;
+                break;
             case OPTION_TRAP:
             {
                 errno = 0;
@@ -933,7 +1301,18 @@ int main_2(int argc, char **argv)
                 return EXIT_FAILURE;
         }
     }
-    if (optind != argc-1)
+    if (option_dry_run && option_CFR)
+        option_targets = true;      // Needed to predict T0
+    if (option_batch != "")
+    {
+        if (optind != argc)
+            error("failed to parse command-line arguments; unexpected input "
+                "file \"%s\" in `--batch' mode", argv[optind]);
+        if (option_output != "")
+            error("failed to parse command-line arguments; the `--output' "
+                "option cannot be used in `--batch' mode");
+    }
+    else if (optind != argc-1)
     {
         error("missing input file; try `--help' for more information");
         return EXIT_FAILURE;
@@ -957,43 +1336,36 @@ int main_2(int argc, char **argv)
         error("failed to parse command-line arguments; both the `--shared' "
             "and `--executable' options cannot be used at the same time");
 
+    /*
+     * Batch mode: the parent process schedules the worker processes and
+     * never returns.  Each worker continues below with a single binary.
+     */
+    const char *filename = nullptr;
+    if (option_batch != "")
+    {
+        const BatchEntry *entry = runBatch(option_batch.c_str(),
+            option_jobs, option_executable, option_shared, option_actions);
+        filename      = entry->input;
+        option_output = entry->output;
+    }
+    else
+    {
+        filename = argv[optind];
+        bool exe = (option_executable? true:
+                   (option_shared? false: !isLibraryFilename(filename)));
+        filename = findBinary(filename, exe, /*dot=*/true);
+    }
+
     /*
      * Parse the ELF file.
      */
-    const char *filename = argv[optind];
-    bool exe = (option_executable? true:
-               (option_shared? false: !isLibraryFilename(filename)));
-    filename = findBinary(filename, exe, /*dot=*/true);
     ELF &elf = *parseBinary(filename);
 
     /*
      * Patch the match/action pairs.
      */
     std::vector<Action *> actions;
-    for (const auto &entry: option_actions)
-    {
-        if (entry.match.size() == 0)
-            error("failed to parse action; the `--patch' or `-P' option "
-                "must be preceded by one or more `--match' or `-M' options");
-        
-        MatchExpr *match = nullptr;
-        for (const auto &str: entry.match)
-        {
-            MatchExpr *expr = parseMatch(elf, str.c_str());
-            match = (match == nullptr? expr:
-                new MatchExpr(MATCH_OP_AND, match, expr));
-        }
-        std::vector<const Patch *> patch;
-        for (const auto &str: entry.patch)
-        {
-            const Patch *P = parsePatch(elf, str.c_str());
-            patch.push_back(P);
-            if (P->kind == PATCH_BREAK)
-                break;
-        }
-        Action *action = new Action(match, std::move(patch));
-        actions.push_back(action);
-    }
+    parseActions(elf, option_actions, actions);
     option_actions.clear();
     for (auto &entry: option_plugin)
     {
@@ -1059,7 +1431,15 @@ int main_2(int argc, char **argv)
     }
     Backend backend;
     std::vector<const char *> options;
-    if (option_format == "json")
+    if (option_dry_run)
+    {
+        // Pseudo-backend (discard all messages):
+        backend.pid = 0;
+        backend.out = fopen("/dev/null", "w");
+        if (backend.out == nullptr)
+            error("failed to open \"/dev/null\": %s", strerror(errno));
+    }
+    else if (option_format == "json")
     {
         // Pseudo-backend:
         backend.pid = 0;
@@ -1180,6 +1560,8 @@ int main_2(int argc, char **argv)
             options.push_back("--mem-granularity=4096");
             break;
     }
+    if (option_stats_json)
+        options.push_back("--stats=json");
     for (const char *option: option_options)
         options.push_back(option);
     if (options.size() > 0)
@@ -1204,7 +1586,7 @@ int main_2(int argc, char **argv)
      */
     bool have_print = false, have_empty = false, have_trap = false;
     std::set<const char *, CStrCmp> have_call;
-    std::set<int> have_exit, have_sig;
+    std::set<int> have_exit, have_sig, have_trace;
     for (auto *action: actions)
     {
         for (const auto *patch: action->patch)
@@ -1242,6 +1624,18 @@ int main_2(int argc, char **argv)
                     }
                     break;
                 }
+                case PATCH_TRACE:
+                {
+                    int flags = patch->trace;
+                    auto i = have_trace.find(flags);
+                    if (i == have_trace.end())
+                    {
+                        sendTraceTrampolineMessage(out, patch->name,
+                            elf.type, flags);
+                        have_trace.insert(flags);
+                    }
+                    break;
+                }
                 case PATCH_CALL:
                 {
                     // Step (1): Create call object:
@@ -1249,7 +1643,8 @@ int main_2(int argc, char **argv)
                     for (const auto &arg: patch->args)
                         sig.push_back(arg.kind);
                     const Call &call = makeCall(&elf, patch->filename,
-                        patch->entry, patch->abi, patch->jmp, patch->pos, sig);
+                        patch->entry, patch->abi, patch->jmp, patch->pos, sig,
+                        patch->save);
                     patch->call = &call;
 
                     // Step (2): Create the trampoline:
@@ -1268,10 +1663,30 @@ int main_2(int argc, char **argv)
     }
     if (have_empty)
         sendEmptyTrampolineMessage(out);
-    if (have_print)
+    bool have_print_buffer = (have_print && option_print_buffer != nullptr);
+    if (have_print_buffer)
+    {
+        // Buffered print is an ID-only trace (to the --print-buffer FILE):
+        sendTraceTrampolineMessage(out, "$print", elf.type, /*flags=*/0x0);
+        option_trace_file = option_print_buffer;
+    }
+    else if (have_print)
         sendPrintTrampolineMessage(out, elf.type);
+    if (have_print_buffer || have_trace.size() > 0)
+    {
+        sendTraceRuntimeElfMessages(out, option_trace_file.c_str());
+        if (!option_dry_run)
+        {
+            std::string sites(option_output == "-"? "a.out": option_output);
+            sites += ".sites";
+            openTraceSites(sites.c_str());
+        }
+    }
     if (have_trap)
         sendTrapTrampolineMessage(out);
+    if (!option_toggle.empty())
+        sendToggleRuntimeElfMessages(out, option_toggle.c_str(), elf.type,
+            actions.size());
 
     /*
      * Disassemble the ELF file.
@@ -1286,108 +1701,193 @@ int main_2(int argc, char **argv)
     initDisassembler();
     std::vector<Instr> Is;
     std::vector<Desync> desyncs;
+    uint64_t key = 0;
+    unsigned cached = 0x0;
+    phaseSwitch(PHASE_DISASM);
+    if (option_cache != "")
+    {
+        // The cache key covers the binary and all disassembly options:
+        key = cacheHash(CACHE_HASH_INIT, elf.data, elf.size);
+        key = cacheHash(key, STRING(VERSION), sizeof(STRING(VERSION)));
+        key = cacheHash(key, &option_plt, sizeof(option_plt));
+        key = cacheHash(key, &option_sync, sizeof(option_sync));
+        key = cacheHash(key, &option_threshold, sizeof(option_threshold));
+        key = cacheHash(key, &option_recursive, sizeof(option_recursive));
+        key = cacheHash(key, excludes.data(),
+            excludes.size() * sizeof(Exclude));
+        if (use_disasm)
+            key = cacheHashFile(key, option_use_disasm.c_str());
+        if (option_use_targets != "")
+            key = cacheHashFile(key, option_use_targets.c_str());
+        cached = loadCache(option_cache.c_str(), key, elf, Is, desyncs);
+    }
     // Step (1): Find the locations of all instructions:
-    for (const auto *shdr: elf.exes)
-    {
-        const char *section   = elf.strs + shdr->sh_name;
-        if (!option_plt &&
-                (strcmp(section, ".plt") == 0 ||
-                 strcmp(section, ".plt.got") == 0 ||
-                 strcmp(section, ".plt.sec") == 0))
-            continue;   // Exclude .plt.* by default
-        size_t section_size   = (size_t)shdr->sh_size;
-        off_t section_offset  = (off_t)shdr->sh_offset;
-        intptr_t section_addr = (intptr_t)shdr->sh_addr;
-
-        const uint8_t *start = elf.data + section_offset;
-        const uint8_t *code  = start, *end = start + section_size;
-        size_t size          = section_size;
-        off_t offset         = section_offset;
-        intptr_t address     = section_addr;
-
-        int sync = 0;
-        bool first = true;
-        while (true)
+    CodeMap map;
+    if ((cached & CACHE_DISASM) == 0)
+    {
+        // Step (1a): Recursive traversal (if enabled):
+        bool recursive = (option_recursive && !use_disasm);
+        if (recursive)
+        {
+            initCodeMap(&elf, map);
+            for (const auto &exclude: excludes)
+                markCodeMap(map, exclude.lo, exclude.hi, CODE_DATA);
+            buildCodeMap(&elf, option_threshold, map);
+        }
+
+        // Step (1b): Linear sweep:
+        for (const auto *shdr: elf.exes)
         {
-            size_t skip = exclude(excludes, address);
-            skip += (use_disasm? nextInstr(disasm, address + skip): 0);
-            if (skip > 0)
+            const char *section   = elf.strs + shdr->sh_name;
+            if (!option_plt &&
+                    (strcmp(section, ".plt") == 0 ||
+                     strcmp(section, ".plt.got") == 0 ||
+                     strcmp(section, ".plt.sec") == 0))
+                continue;   // Exclude .plt.* by default
+            size_t section_size   = (size_t)shdr->sh_size;
+            off_t section_offset  = (off_t)shdr->sh_offset;
+            intptr_t section_addr = (intptr_t)shdr->sh_addr;
+
+            const uint8_t *start = elf.data + section_offset;
+            const uint8_t *code  = start, *end = start + section_size;
+            size_t size          = section_size;
+            off_t offset         = section_offset;
+            intptr_t address     = section_addr;
+
+            int sync = 0;
+            bool first = true;
+            while (true)
             {
-                address += skip;
-                offset  += skip;
-                size     = (skip > size? 0: size - skip);
-                code    += skip;
-                sync     = 0;
-                first    = true;
-            }
+                size_t skip = exclude(excludes, address);
+                skip += (use_disasm? nextInstr(disasm, address + skip): 0);
+                if (skip > 0)
+                {
+                    address += skip;
+                    offset  += skip;
+                    size     = (skip > size? 0: size - skip);
+                    code    += skip;
+                    sync     = 0;
+                    first    = true;
+                }
 
-            Instr I;
-            const uint8_t *bytes = code;
-            if (!decode(&code, &size, &offset, &address, &I))
-                break;
-            I.first = first;
-            first = false;
+                Instr I;
+                const uint8_t *bytes = code;
+                if (!decode(&code, &size, &offset, &address, &I))
+                    break;
+                I.first = first;
+                first = false;
+
+                // Known (reachable) code is never treated as data, and also
+                // re-synchronizes the sweep.  Conversely, an instruction that
+                // overlaps known code must be data.
+                bool known = false, overlap = false;
+                if (recursive)
+                {
+                    known = ((getCodeMap(map, I.address) & CODE_START) != 0);
+                    for (size_t i = 0; !known && !overlap && i < I.size; i++)
+                        overlap = ((getCodeMap(map, I.address + i) &
+                            (i == 0? CODE_BODY: CODE_START)) != 0);
+                    sync = (known && sync < 0? 0: sync);
+                }
 
-            int score = (use_disasm? 0: suspiciousness(bytes, I.size));
-            if (option_debug && !I.data)
-            {
-                InstrInfo J;
-                getInstrInfo(&elf, &I, &J);
-                debug("%s0x%lx%s: disassemble %s%s%s%s",
-                    (option_is_tty? "\33[31m": ""),
-                    J.address,
-                    (option_is_tty? "\33[0m": ""),
-                    (option_is_tty? "\33[32m": ""),
-                    J.string.instr,
-                    (option_is_tty? "\33[0m": ""),
-                    (score >= option_threshold? " <data?>": ""));
-            }
+                int score = (use_disasm || known? 0:
+                    suspiciousness(bytes, I.size));
+                if (option_debug && !I.data)
+                {
+                    InstrInfo J;
+                    getInstrInfo(&elf, &I, &J);
+                    debug("%s0x%lx%s: disassemble %s%s%s%s",
+                        (option_is_tty? "\33[31m": ""),
+                        J.address,
+                        (option_is_tty? "\33[0m": ""),
+                        (option_is_tty? "\33[32m": ""),
+                        J.string.instr,
+                        (option_is_tty? "\33[0m": ""),
+                        (score >= option_threshold? " <data?>": ""));
+                }
 
-            if (I.data && use_disasm)
-                error("failed to decode instruction at address 0x%lx; "
-                    "the \"%s\" disassmebly file may be inaccurate",
-                    I.address, option_use_disasm.c_str());
+                if (I.data && use_disasm)
+                    error("failed to decode instruction at address 0x%lx; "
+                        "the \"%s\" disassmebly file may be inaccurate",
+                        I.address, option_use_disasm.c_str());
 
-            if (I.data || score >= option_threshold)
-            {
-                // Data has been detected in the code segment.  We attempt to
-                // handle this by nuking +/- option_sync instructions which
-                // may also be data.  This a very crude heuristic, so the
-                // user will be warned (below).
-                intptr_t lo = I.address, hi = lo + I.size;
-                for (int i = 0; Is.size() > 0 && i < option_sync; i++)
+                if (I.data || score >= option_threshold || overlap)
                 {
-                    const Instr J = Is.back();
-                    Is.pop_back();
-                    lo = J.address;
-                    if (J.first)
-                        break;
-                    if (J.sus)
-                        i = 0;
+                    // Data has been detected in the code segment.  We attempt
+                    // to handle this by nuking +/- option_sync instructions
+                    // which may also be data.  This a very crude heuristic, so
+                    // the user will be warned (below).
+                    intptr_t lo = I.address, hi = lo + I.size;
+                    for (int i = 0; Is.size() > 0 && i < option_sync; i++)
+                    {
+                        const Instr J = Is.back();
+                        if (recursive &&
+                                (getCodeMap(map, J.address) & CODE_START) != 0)
+                            break;      // Never nuke known code
+                        Is.pop_back();
+                        lo = J.address;
+                        if (J.first)
+                            break;
+                        if (J.sus)
+                            i = 0;
+                    }
+                    intptr_t next = (!recursive? INTPTR_MAX:
+                        nextCodeMap(map, I.address + 1,
+                            std::min(section_addr + (intptr_t)section_size,
+                                (intptr_t)I.address + 16 * option_sync)));
+                    if (next != INTPTR_MAX)
+                    {
+                        // The data is followed by known code (within the
+                        // range that would otherwise be nuked), so skip the
+                        // data directly.  If the data is also preceded by
+                        // known code, it is cleanly delimited and no
+                        // warning is necessary.
+                        intptr_t delta = next - address;
+                        address += delta;
+                        offset  += delta;
+                        code    += delta;
+                        size     = (size_t)((intptr_t)size - delta);
+                        sync     = 0;
+                        map.data.push_back({lo, next});
+                        if (lo == (intptr_t)I.address)
+                            continue;
+                        hi = next;
+                    }
+                    if (desyncs.size() > 0 && lo <= desyncs.back().hi)
+                        desyncs.back().hi = hi;
+                    else if (sync >= 0)
+                        desyncs.push_back({lo, hi, (intptr_t)I.address, section,
+                            *bytes});
+                    sync = (next != INTPTR_MAX? 0: -option_sync);
+                    continue;
+                }
+                I.sus = (score > 0);
+                if (++sync >= 0)
+                    Is.push_back(I);
+                else
+                {
+                    if (I.sus)
+                        sync = -option_sync;
+                    desyncs.back().hi = I.address + I.size;
                 }
-                if (desyncs.size() > 0 && lo <= desyncs.back().hi)
-                    desyncs.back().hi = hi;
-                else if (sync >= 0)
-                    desyncs.push_back({lo, hi, (intptr_t)I.address, section,
-                        *bytes});
-                sync = -option_sync;
-                continue;
             }
-            I.sus = (score > 0);
-            if (++sync >= 0)
-                Is.push_back(I);
-            else
+            if (code < end)
+                error("failed to disassemble the \"%s\" section 0x%lx..0x%lx; "
+                    "could only disassemble the range 0x%lx..0x%lx",
+                    section, section_addr, section_addr + section_size,
+                    section_addr, section_addr + (code - start));
+        }
+        if (recursive && option_debug)
+        {
+            size_t total = 0;
+            for (const auto &range: map.data)
             {
-                if (I.sus)
-                    sync = -option_sync;
-                desyncs.back().hi = I.address + I.size;
+                debug("data-in-code 0x%lx..0x%lx", range.first, range.second);
+                total += range.second - range.first;
             }
+            debug("found %zu data-in-code range(s) (%zu bytes)",
+                map.data.size(), total);
         }
-        if (code < end)
-            error("failed to disassemble the \"%s\" section 0x%lx..0x%lx; "
-                "could only disassemble the range 0x%lx..0x%lx",
-                section, section_addr, section_addr + section_size,
-                section_addr, section_addr + (code - start));
     }
     disasm.clear();
     Is.shrink_to_fit();
@@ -1395,25 +1895,57 @@ int main_2(int argc, char **argv)
     size_t count = Is.size();
 
     // Step (1a): CFG Analysis (if necessary).
-    if (option_targets)
+    struct timespec analysis_start;
+    clock_gettime(CLOCK_MONOTONIC, &analysis_start);
+    phaseSwitch(PHASE_CFG);
+    unsigned have = cached | CACHE_DISASM;
+    if (option_targets && (have & CACHE_TARGETS) == 0)
     {
         if (option_use_targets != "")
             parseTargets(option_use_targets.c_str(), Is.data(), Is.size(),
                 elf.targets);
         else
             buildTargets(&elf, Is.data(), Is.size(), elf.targets);
+        have |= CACHE_TARGETS;
     }
-    if (option_bbs)
+    if (option_bbs && (have & CACHE_BBS) == 0)
+    {
         buildBBs(&elf, Is.data(), Is.size(), elf.targets, elf.bbs);
-    if (option_fs)
+        have |= CACHE_BBS;
+    }
+    if (option_fs && (have & CACHE_FS) == 0)
+    {
         buildFs(&elf, Is.data(), Is.size(), elf.targets, elf.fs);
-    if (option_lines)
-        buildLines(&elf, Is.data(), Is.size(), elf.lines);
+        have |= CACHE_FS;
+    }
+    phaseSwitch(PHASE_LINES);
+    if (option_lines && (have & CACHE_LINES) == 0)
+    {
+        // Lazy lines cannot be cached, so default to eager with --cache:
+        bool lazy = (option_dwarf == ""? option_cache == "":
+            option_dwarf == "lazy");
+        buildLines(&elf, Is.data(), Is.size(), elf.lines, lazy,
+            option_dwarf_threads);
+        if (!lazy)
+            have |= CACHE_LINES;
+    }
+    if (option_debug)
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        debug("analysis: targets=%zu, bbs=%zu, funcs=%zu, lines=%zu, "
+            "time=%.3fs, maxrss=%ldKB", elf.targets.size(), elf.bbs.size(),
+            elf.fs.size(), elf.lines.size(), elapsed(analysis_start),
+            usage.ru_maxrss);
+    }
+    if (option_cache != "" && have != cached)
+        saveCache(option_cache.c_str(), key, have, elf, Is, desyncs);
     if (option_dump_all)
         dumpInfo(option_output, Is.data(), Is.size(), elf.targets,
             elf.bbs, elf.fs);
 
     // Step (2): Find all matching instructions:
+    phaseSwitch(PHASE_MATCHING);
     std::vector<Action *> matching;
     MatchingCache Ms;
     for (size_t i = 0; i < count; i++)
@@ -1474,6 +2006,30 @@ int main_2(int argc, char **argv)
     notifyPlugins(out, &elf, Is, EVENT_MATCHING_COMPLETE);
 
     // Step (3): Send all composite trampolines:
+    phaseSwitch(PHASE_TRAMPOLINES);
+    for (const auto &I: Is)
+    {
+        if (!I.patch)
+            continue;
+        const Matching *M = Ms.matchings[I.matching];
+        for (const auto *action: M->actions)
+            for (const auto *patch: action->patch)
+                patch->num_sites += (patch->sample != 0 ||
+                    patch->period != 0? 1: 0);
+    }
+    for (const auto *action: actions)
+    {
+        for (const auto *patch: action->patch)
+        {
+            if (patch->num_sites > 0)
+                patch->counters = sendSampleCountersMessage(out, elf.type,
+                    patch->num_sites);
+        }
+    }
+    bool toggle = !option_toggle.empty();
+    std::map<const Action *, size_t> toggles;
+    for (size_t i = 0; toggle && i < actions.size(); i++)
+        toggles.insert({actions[i], i});
     size_t tid = 0;
     std::map<const Matching *, size_t, MatchingCmp> tmps;
     std::vector<Metadata> metadata;
@@ -1490,41 +2046,83 @@ int main_2(int argc, char **argv)
         fputs("[\".Ltrampoline\",", out);
 
         // BEFORE trampolines:
+        // (with --toggle, each action's patches are gated by its enable
+        //  byte, and a break may be disabled, so nothing is skipped)
         bool seen_break = false;
         for (const auto *action: M->actions)
         {
+            bool gate = false;
             for (size_t j = 0, n = action->patch.size(); j < n; j++)
             {
                 if (action->patch[j]->pos != POS_BEFORE || seen_break)
                     continue;
+                if (toggle && !gate)
+                    sendToggleGate(out, toggles[action], 'b');
+                gate = toggle;
                 seen_break = sendTrampoline(out, action, j, &cxt, metadata);
+                seen_break = seen_break && !toggle;
             }
+            if (gate)
+                sendToggleGateEnd(out, toggles[action], 'b');
         }
 
         // REPLACE trampoline:
+        // (with --toggle and several replace actions, every enabled action
+        //  runs, and the instruction is skipped if any are enabled)
         bool seen_replace = false;
+        std::vector<size_t> replaces;
+        for (const auto *action: M->actions)
+        {
+            for (const auto *patch: action->patch)
+            {
+                if (toggle && patch->pos == POS_REPLACE)
+                {
+                    replaces.push_back(toggles[action]);
+                    break;
+                }
+            }
+        }
         for (const auto *action: M->actions)
         {
+            bool gate = false;
             for (size_t j = 0, n = action->patch.size(); j < n; j++)
             {
                 if (action->patch[j]->pos != POS_REPLACE || seen_break)
                     continue;
+                if (toggle && !gate)
+                    sendToggleGate(out, toggles[action], 'r');
+                gate = toggle;
                 seen_replace = true;
                 seen_break = sendTrampoline(out, action, j, &cxt, metadata);
+                seen_break = seen_break && !toggle;
             }
+            if (gate)
+                sendToggleGateEnd(out, toggles[action], 'r',
+                    (replaces.size() == 1? ".Lreplaced": nullptr));
         }
         if (!seen_replace && !seen_break)
             fprintf(out, "\"$instr\",");
+        else if (replaces.size() == 1)
+            fprintf(out, "\"$instr\",\".Lreplaced\",");
+        else if (replaces.size() > 1)
+            sendToggleReplaced(out, replaces);
 
         // AFTER trampolines:
         for (const auto *action: M->actions)
         {
+            bool gate = false;
             for (size_t j = 0, n = action->patch.size(); j < n; j++)
             {
                 if (action->patch[j]->pos != POS_AFTER || seen_break)
                     continue;
+                if (toggle && !gate)
+                    sendToggleGate(out, toggles[action], 'a');
+                gate = toggle;
                 seen_break = sendTrampoline(out, action, j, &cxt, metadata);
+                seen_break = seen_break && !toggle;
             }
+            if (gate)
+                sendToggleGateEnd(out, toggles[action], 'a');
         }
         if (!seen_break)
             fputs("\"$BREAK\",", out);
@@ -1558,6 +2156,7 @@ int main_2(int argc, char **argv)
     /*
      * Send instructions & patches.  Note: this MUST be done in reverse!
      */
+    phaseSwitch(PHASE_METADATA);
     debug("--------------------------------------");
     intptr_t id = -1;
     for (ssize_t i = (ssize_t)count - 1; i >= 0; i--)
@@ -1621,6 +2220,22 @@ int main_2(int argc, char **argv)
         sendSeparator(out, /*last=*/true);
         sendMessageFooter(out, /*sync=*/true);
     }
+    if (option_dry_run)
+    {
+        std::vector<size_t> sizes;
+        for (const auto *M: Ms.matchings)
+            sizes.push_back(estimateTrampolineSize(M));
+        PredictParams params;
+        params.CFR          = option_CFR;
+        params.B0           = option_100;
+        params.order        = (option_optimization_level != '0' &&
+                               option_optimization_level != '1');
+        params.mapping_size = (size_t)atol(mapping_size[
+                                option_compression_level]);
+        params.granularity  = (option_optimization_level == '3' ||
+                               option_optimization_level == 's'? 4096: 128);
+        predictPatching(&elf, Is, sizes, params);
+    }
     notifyPlugins(out, &elf, Is, EVENT_PATCHING_COMPLETE);
     Is.clear();
 
@@ -1644,11 +2259,24 @@ int main_2(int argc, char **argv)
         option_format = "binary";
     }
     sendEmitMessage(out, option_output.c_str(), option_format.c_str());
+    closeTraceSites();
 
     /*
      * Wait for E9Patch to complete.
      */
+    phaseSwitch(PHASE_BACKEND);
     waitBackend(backend);
+    if (option_stats_json)
+    {
+        fputs("{\"tool\":\"e9tool\",\"version\":\"" STRING(VERSION) "\","
+            "\"input_binary\":", stdout);
+        printJSONString(stdout, filename);
+        printf(",\"num_instrs\":%zu,\"num_patched\":%zu,",
+            count, (size_t)(id + 1));
+        printPhaseStats(stdout);
+        printf("}\n");
+        fflush(stdout);
+    }
 
     /*
      * Finalize all plugins.
@@ -86,6 +86,17 @@ enum CallABI
     ABI_NAKED,                      // Naked ABI
 };
 
+/*
+ * Call extended state save mode.
+ */
+enum CallSave
+{
+    SAVE_AUTO,                      // Cheapest mode for the call target
+    SAVE_GPR,                       // General purpose registers only
+    SAVE_SSE,                       // + caller-save %xmm registers
+    SAVE_XSAVE,                     // + full extended state (xsave)
+};
+
 /*
  * Jump kind
  */
@@ -2366,7 +2377,36 @@ typedef uint8_t TargetKind;
 #define TARGET_DIRECT   0x01        // Direct call/jump
 #define TARGET_INDIRECT 0x02        // Indirect call/jump
 #define TARGET_FUNCTION 0x04        // Target is called
-typedef std::map<intptr_t, TargetKind> Targets;
+
+/*
+ * Jump/call targets, indexed by instruction index.
+ */
+struct Targets
+{
+    std::vector<TargetKind> kinds;  // Instruction index -> kind (0 = none)
+    size_t count = 0;               // Number of targets
+
+    size_t size() const
+    {
+        return count;
+    }
+    TargetKind get(size_t idx) const
+    {
+        return (idx < kinds.size()? kinds[idx]: 0);
+    }
+    void set(size_t idx, TargetKind kind)
+    {
+        if (idx >= kinds.size())
+            kinds.resize(idx+1, 0);
+        count += (kinds[idx] == 0 && kind != 0? 1: 0);
+        kinds[idx] |= kind;
+    }
+    void swap(Targets &targets)
+    {
+        kinds.swap(targets.kinds);
+        std::swap(count, targets.count);
+    }
+};
 
 struct BB
 {
@@ -2412,7 +2452,22 @@ struct Line
         ;
     }
 };
-typedef std::map<intptr_t, Line> Lines;
+
+/*
+ * Source line information.
+ */
+struct LineLoader;
+struct Lines
+{
+    std::vector<Line> lines;        // Lines (sorted by address)
+    std::vector<uint32_t> index;    // Instruction index -> line index + 1
+                                    // (or 0 if no line)
+    LineLoader *loader = nullptr;   // Lazy loader (or nullptr if eager)
+    size_t size() const
+    {
+        return lines.size();
+    }
+};
 
 /*
  * Low-level functions that send fragments of JSONRPC messages:
@@ -2501,7 +2556,7 @@ extern intptr_t getELFObject(const ELF *elf, const char *name,
  */
 extern const Call &makeCall(const ELF *elf, const char *filename,
     const char *entry, CallABI abi, CallJump jmp, PatchPos pos,
-    const std::vector<ArgumentKind> &args);
+    const std::vector<ArgumentKind> &args, CallSave save = SAVE_AUTO);
 extern void getInstrInfo(const ELF *elf, const Instr *I, InstrInfo *info,
     void *raw = nullptr);
 extern const char *getRegName(Register r);
@@ -2509,6 +2564,7 @@ extern ssize_t findInstr(const Instr *Is, size_t size, intptr_t address);
 extern const BB *findBB(const BBs &bbs, size_t idx);
 extern const F *findF(const Fs &fs, size_t idx);
 extern const Line *findLine(const Lines &Ls, intptr_t address);
+extern const Line *findInstrLine(const Lines &Ls, size_t idx);
 extern void buildTargets(const ELF *elf, const Instr *Is, size_t size,
     Targets &targets);
 extern void buildBBs(const ELF *elf, const Instr *Is, size_t size,
@@ -2516,7 +2572,7 @@ extern void buildBBs(const ELF *elf, const Instr *Is, size_t size,
 extern void buildFs(const ELF *elf, const Instr *Is, size_t size,
     const Targets &targets, Fs &fs);
 extern void buildLines(const ELF *elf, const Instr *Is, size_t size,
-    Lines &Ls);
+    Lines &Ls, bool lazy = false, unsigned nthreads = 0);
 extern intptr_t getSymbol(const ELF *elf, const char *symbol);
 extern void NO_RETURN error(const char *msg, ...);
 extern void warning(const char *msg, ...);
@@ -0,0 +1,218 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Trace patches.  Both `trace' patches and buffered `print' patches
+ * (--print-buffer) call the ring buffer runtime in e9trace_elf.cpp, which
+ * writes the binary trace.  The trace is decoded offline by e9tracedump
+ * using the "sites" side table written by E9Tool.
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/mman.h>
+
+#include "e9misc.h"
+#include "e9trace.h"
+#include "e9tool.h"
+
+#include "e9trace_elf.c"
+
+using namespace e9tool;
+
+#define PAGE_SIZE               4096
+
+static FILE *sites = nullptr;
+static intptr_t sites_last = -1;
+
+/*
+ * Write a row to the "sites" side table.
+ */
+static void sendTraceSite(intptr_t id, const InstrInfo *I)
+{
+    if (sites == nullptr || id == sites_last)
+        return;
+    fprintf(sites, "%zd\t%lx\t%s\n", (ssize_t)id, I->address,
+        I->string.instr);
+    sites_last = id;
+}
+
+/*
+ * Send the trace runtime messages (see e9trace_elf.cpp).
+ */
+void sendTraceRuntimeElfMessages(FILE *out, const char *filename)
+{
+    static_assert(sizeof(TraceData) <= PAGE_SIZE, "trace data too big");
+    static_assert(sizeof(e9trace_elf_bin) <= TRACE_RT_CODE_MAX,
+        "trace runtime too big");
+    static_assert(TRACE_RT_CODE_ADDR - TRACE_RT_DATA_ADDR == PAGE_SIZE,
+        "trace runtime data must immediately precede the code");
+
+    size_t len = strlen(filename);
+    if (len >= TRACE_PATH_MAX)
+        error("failed to create trace runtime; trace filename \"%s\" is "
+            "too long (max=%u)", filename, TRACE_PATH_MAX-1);
+
+    uint8_t data[PAGE_SIZE] = {0};
+    TraceData *tdata = (TraceData *)data;
+    tdata->fd = -1;
+    tdata->drop.magic = TRACE_MAGIC_DROP;
+    memcpy(tdata->path, filename, len);
+
+    sendReserveMessage(out, TRACE_RT_DATA_ADDR, data, sizeof(data),
+        PROT_READ | PROT_WRITE);
+    sendReserveMessage(out, TRACE_RT_CODE_ADDR, e9trace_elf_bin,
+        sizeof(e9trace_elf_bin), PROT_READ | PROT_EXEC, /*init=*/0x0,
+        /*fini=*/TRACE_RT_CODE_ADDR + TRACE_RT_FINI_OFFSET);
+}
+
+/*
+ * Send a trace "trampoline" message.  Here `flags' are the optional record
+ * fields (TRACE_FLAG_*).
+ */
+unsigned sendTraceTrampolineMessage(FILE *out, const char *name,
+    BinaryType type, unsigned flags)
+{
+    switch (type)
+    {
+        case BINARY_TYPE_PE_EXE: case BINARY_TYPE_PE_DLL:
+            error("trace trampolines are not-yet-implemented for Windows PE "
+                "binaries");
+        default:
+            break;
+    }
+
+    sendMessageHeader(out, "trampoline");
+    sendParamHeader(out, "name");
+    sendString(out, name);
+    sendSeparator(out);
+    sendParamHeader(out, "template");
+    putc('[', out);
+
+    // lea -0x4000(%rsp),%rsp
+    // push %rax
+    // push %rdx
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d},",
+        0x48, 0x8d, 0xa4, 0x24, -0x4000);
+    fprintf(out, "%u,%u,", 0x50, 0x52);
+
+    // lea MEM,%rax
+    // push %rax
+    if ((flags & TRACE_FLAG_MEM) != 0)
+        fprintf(out, "\"$MEM@%s\",", name+1);
+
+    // rdtsc
+    // lea -0x8(%rsp),%rsp
+    // mov %eax,(%rsp)
+    // mov %edx,0x4(%rsp)
+    if ((flags & TRACE_FLAG_TIME) != 0)
+    {
+        fprintf(out, "%u,%u,", 0x0f, 0x31);
+        fprintf(out, "%u,%u,%u,%u,%u,", 0x48, 0x8d, 0x64, 0x24, 0xf8);
+        fprintf(out, "%u,%u,%u,", 0x89, 0x04, 0x24);
+        fprintf(out, "%u,%u,%u,%u,", 0x89, 0x54, 0x24, 0x04);
+    }
+
+    // push $ID
+    // mov $FLAGS,%eax
+    // callq record
+    // lea SIZE(%rsp),%rsp
+    // pop %rdx
+    // pop %rax
+    // lea 0x4000(%rsp),%rsp
+    fprintf(out, "%u,\"$ID@%s\",", 0x68, name+1);
+    fprintf(out, "%u,\"$FLAGS@%s\",", 0xb8, name+1);
+    fprintf(out, "%u,{\"rel32\":%d},", 0xe8,
+        TRACE_RT_CODE_ADDR + TRACE_RT_RECORD_OFFSET);
+    fprintf(out, "%u,%u,%u,%u,\"$SIZE@%s\",", 0x48, 0x8d, 0xa4, 0x24,
+        name+1);
+    fprintf(out, "%u,%u,", 0x5a, 0x58);
+    fprintf(out, "%u,%u,%u,%u,{\"int32\":%d}",
+        0x48, 0x8d, 0xa4, 0x24, 0x4000);
+
+    fputc(']', out);
+    sendSeparator(out, /*last=*/true);
+    return sendMessageFooter(out, /*sync=*/true);
+}
+
+/*
+ * Send the trace trampoline metadata (except "$MEM").  Here `flags' are the
+ * record fields for this site.
+ */
+void sendTraceMetadata(FILE *out, const char *name, intptr_t id,
+    const InstrInfo *I, unsigned flags)
+{
+    if (id > INT32_MAX)
+        error("failed to emit trace metadata; site ID %zd is too big",
+            (ssize_t)id);
+    name++;
+    sendDefinitionHeader(out, name, "ID");
+    fprintf(out, "{\"int32\":%d}", (int32_t)id);
+    sendDefinitionFooter(out);
+
+    sendDefinitionHeader(out, name, "FLAGS");
+    fprintf(out, "{\"int32\":%u}", flags);
+    sendDefinitionFooter(out);
+
+    size_t size = sizeof(uint64_t);
+    size += ((flags & TRACE_FLAG_TIME) != 0? sizeof(uint64_t): 0);
+    size += ((flags & TRACE_FLAG_MEM) != 0? sizeof(uint64_t): 0);
+    sendDefinitionHeader(out, name, "SIZE");
+    fprintf(out, "{\"int32\":%zu}", size);
+    sendDefinitionFooter(out);
+
+    sendDefinitionHeader(out, name, "DATA");        // No data
+    sendDefinitionFooter(out);
+
+    sendTraceSite(id, I);
+}
+
+/*
+ * Open the "sites" side table.  Each line has the form:
+ *
+ *      ID<TAB>ADDRESS<TAB>ASM
+ */
+void openTraceSites(const char *filename)
+{
+    closeTraceSites();
+    sites = fopen(filename, "w");
+    if (sites == nullptr)
+        error("failed to open sites file \"%s\" for writing: %s", filename,
+            strerror(errno));
+    sites_last = -1;
+}
+
+/*
+ * Close the "sites" side table.
+ */
+void closeTraceSites(void)
+{
+    if (sites == nullptr)
+        return;
+    if (fclose(sites) != 0)
+        error("failed to close sites file: %s", strerror(errno));
+    sites = nullptr;
+}
@@ -0,0 +1,93 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __E9TRACE_H
+#define __E9TRACE_H
+
+#include <cstdint>
+
+/*
+ * Trace runtime layout (see e9trace_elf.cpp).  The runtime is shared by
+ * `trace' patches and buffered `print' patches (--print-buffer), and is
+ * placed just below the first instrumentation binary (see makeCall()).  The
+ * data page is placed immediately before the code.
+ */
+#define TRACE_RT_DATA_ADDR      0x6fff0000  // Runtime data (rw-)
+#define TRACE_RT_CODE_ADDR      0x6fff1000  // Runtime code (r-x)
+#define TRACE_RT_CODE_MAX       0xf000      // Max runtime code size
+#define TRACE_RT_RECORD_OFFSET  0x0         // record() entry
+#define TRACE_RT_FINI_OFFSET    0x8         // fini() entry
+#define TRACE_RT_RING_SIZE      0x40000     // Per-thread raw ring size
+#define TRACE_RT_OUT_SIZE       0x10000     // Per-thread encode buffer
+#define TRACE_PATH_MAX          0x7e0       // Max output path length
+#define TRACE_BUCKETS           256         // Max #threads
+
+/*
+ * Trace record flags.  Each record is the site ID, optionally followed by
+ * the timestamp (rdtsc) and the memory operand address.
+ */
+#define TRACE_FLAG_TIME         0x1
+#define TRACE_FLAG_MEM          0x2
+
+/*
+ * Trace file chunk header.  Each chunk is followed by `count' bytes of
+ * encoded records.
+ */
+#define TRACE_MAGIC_TRACE       0x52543945  // "E9TR": `count' encoded bytes
+#define TRACE_MAGIC_DROP        0x44503945  // "E9PD": `tid' = #dropped
+
+struct TraceChunk
+{
+    uint32_t magic;                         // TRACE_MAGIC_*
+    uint32_t tid;                           // Thread ID
+    uint32_t count;                         // Size of the records
+};
+
+/*
+ * Trace runtime data page.
+ */
+struct TraceData
+{
+    int32_t fd;                             // Trace file (initially -1)
+    TraceChunk drop;                        // Dropped records chunk
+    char path[TRACE_PATH_MAX];              // Trace file path
+    uintptr_t rings[TRACE_BUCKETS];         // Per-thread rings
+};
+
+#ifndef E9TRACE_FORMAT_ONLY
+
+#include <cstdio>
+
+#include "e9tool.h"
+
+extern void sendTraceRuntimeElfMessages(FILE *out, const char *filename);
+extern unsigned sendTraceTrampolineMessage(FILE *out, const char *name,
+    e9tool::BinaryType type, unsigned flags);
+extern void sendTraceMetadata(FILE *out, const char *name, intptr_t id,
+    const e9tool::InstrInfo *I, unsigned flags);
+extern void openTraceSites(const char *filename);
+extern void closeTraceSites(void);
+
+#endif  /* E9TRACE_FORMAT_ONLY */
+
+#endif
@@ -0,0 +1,414 @@
+/*
+ * e9trace_elf.cpp
+ * Copyright (C) 2023 National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * NOTE: As a special exception, this file is under the MIT license.  The
+ *       rest of the E9Patch/E9Tool source code is under the GPLv3 license.
+ */
+
+/*
+ * Runtime for `trace' patches and buffered `print' patches (--print-buffer).
+ * This is linked into the patched binary (see sendTraceRuntimeElfMessages())
+ * at TRACE_RT_CODE_ADDR, with the data page (struct TraceData) immediately
+ * before the code.
+ *
+ * Each trace trampoline pushes a fixed-size record (site ID, then the
+ * optional timestamp and memory address) and calls record(), which copies
+ * the record into the calling thread's ring.  Rings are private to each
+ * thread, so no locks are needed.  When a ring is full (or at exit), the
+ * records are delta+varint encoded and written to the trace file as
+ * TRACE_MAGIC_TRACE chunks.  Chunks are self-contained, i.e., the deltas
+ * are reset at the start of each chunk.
+ *
+ * Rings are found using the thread pointer (%fs:0x0).  Since libc reuses
+ * the thread control blocks of exited threads, a ring also remembers the
+ * kernel's clear_child_tid word for its owner, which is reset by the kernel
+ * when the thread exits, and is set to the new thread ID when the block is
+ * reused (or in the child after a fork()).  If the word no longer matches,
+ * the ring is flushed on behalf of the exited thread (or discarded in a
+ * forked child, since the parent still owns the records) and handed over to
+ * the calling thread.
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <syscall.h>
+
+#define E9TRACE_FORMAT_ONLY
+#include "e9trace.h"
+
+#define NO_INLINE           __attribute__((__noinline__))
+
+#define PAGE_SIZE           4096
+
+#define TRACE_RING_HDR      32              // sizeof(TraceRing) - buf
+#define TRACE_RING_WORDS                                                \
+    ((TRACE_RT_RING_SIZE - TRACE_RING_HDR) / sizeof(uint64_t))
+#define TRACE_VARINT_MAX    10              // Max varint size
+#define TRACE_RECORD_MAX    (3 * TRACE_VARINT_MAX)
+
+/*
+ * Per-thread ring.  The encode buffer (TRACE_RT_OUT_SIZE) immediately
+ * follows the ring in the same mapping.
+ */
+struct TraceRing
+{
+    uintptr_t owner;                        // Owner's thread pointer
+    const int32_t *tidp;                    // Owner's clear_child_tid word
+    uint32_t tid;                           // Owner's thread ID
+    uint32_t pid;                           // Owner's process ID
+    uint32_t used;                          // #words used
+    uint32_t pad;
+    uint64_t buf[TRACE_RING_WORDS];         // Raw records
+};
+static_assert(offsetof(TraceRing, buf) == TRACE_RING_HDR,
+    "unexpected TraceRing header size");
+
+extern "C"
+{
+    void trace_record(const uint64_t *record, unsigned flags);
+    void trace_fini(const void *config);
+}
+
+/*
+ * Trace runtime entry points.
+ */
+asm (
+    ".section .text.entry,\"x\",@progbits\n"
+
+    "trace_entry:\n"    // record() offset = +0
+    "\tjmp trace_record_entry\n"
+
+    ".align 8\n"        // fini() offset = +8
+    "\tjmp trace_fini\n"
+
+    /*
+     * record(): %eax = record flags, and the record is at 8(%rsp).  All
+     * registers except %rax (saved by the trampoline) are preserved,
+     * including %rflags (which is saved using seto+lahf, since pushfq
+     * is slow).
+     */
+    "trace_record_entry:\n"
+    "\tpush %rdx\n"
+    "\tmov %eax,%edx\n"
+    "\tseto %al\n"
+    "\tlahf\n"
+    "\tpush %rax\n"
+    "\tpush %rcx\n"
+    "\tpush %rsi\n"
+    "\tpush %rdi\n"
+    "\tpush %r8\n"
+    "\tpush %r9\n"
+    "\tpush %r10\n"
+    "\tpush %r11\n"
+    "\tlea 0x50(%rsp),%rdi\n"
+    "\tmov %edx,%esi\n"
+    "\tcallq trace_record\n"
+    "\tpop %r11\n"
+    "\tpop %r10\n"
+    "\tpop %r9\n"
+    "\tpop %r8\n"
+    "\tpop %rdi\n"
+    "\tpop %rsi\n"
+    "\tpop %rcx\n"
+    "\tpop %rax\n"
+    "\tadd $0x7f,%al\n"
+    "\tsahf\n"
+    "\tpop %rdx\n"
+    "\tretq\n"
+
+    ".section .text\n"
+);
+
+/*
+ * System calls.
+ */
+static intptr_t trace_syscall(long number, intptr_t arg1 = 0,
+    intptr_t arg2 = 0, intptr_t arg3 = 0, intptr_t arg4 = 0,
+    intptr_t arg5 = 0, intptr_t arg6 = 0)
+{
+    register intptr_t r10 asm("r10") = arg4;
+    register intptr_t r8  asm("r8")  = arg5;
+    register intptr_t r9  asm("r9")  = arg6;
+    intptr_t result;
+    asm volatile (
+        "syscall"
+        : "=a"(result)
+        : "a"(number), "D"(arg1), "S"(arg2), "d"(arg3), "r"(r10), "r"(r8),
+            "r"(r9)
+        : "rcx", "r11", "memory");
+    return result;
+}
+
+/*
+ * Get the data page.
+ */
+static TraceData *trace_data(void)
+{
+    uint8_t *base;
+    asm ("lea trace_entry(%%rip),%0" : "=r"(base));
+    return (TraceData *)(base -
+        (TRACE_RT_CODE_ADDR - TRACE_RT_DATA_ADDR));
+}
+
+/*
+ * Get the trace file descriptor (opened lazily).
+ */
+static int trace_fd(TraceData *data)
+{
+    int fd = __atomic_load_n(&data->fd, __ATOMIC_ACQUIRE);
+    if (fd >= 0)
+        return fd;
+    fd = (int)trace_syscall(SYS_open, (intptr_t)data->path,
+        O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    int32_t expected = -1;
+    if (!__atomic_compare_exchange_n(&data->fd, &expected, fd, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        // Lost the race:
+        trace_syscall(SYS_close, fd);
+        fd = expected;
+    }
+    return fd;
+}
+
+/*
+ * Write a chunk to the trace file.
+ */
+static void trace_write(TraceData *data, const uint8_t *buf, size_t len)
+{
+    int fd = trace_fd(data);
+    if (fd < 0)
+        return;
+    while (len > 0)
+    {
+        intptr_t r = trace_syscall(SYS_write, fd, (intptr_t)buf, len);
+        if (r == -EINTR)
+            continue;
+        if (r <= 0)
+            return;
+        buf += r;
+        len -= r;
+    }
+}
+
+/*
+ * Varint encoding.
+ */
+static uint8_t *trace_varint(uint8_t *out, uint64_t x)
+{
+    while (x >= 0x80)
+    {
+        *out++ = (uint8_t)x | 0x80;
+        x >>= 7;
+    }
+    *out++ = (uint8_t)x;
+    return out;
+}
+static uint64_t trace_zigzag(int64_t x)
+{
+    return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+
+/*
+ * Encode and write all records in a ring.
+ */
+static NO_INLINE void trace_flush(TraceData *data, TraceRing *ring)
+{
+    uint32_t pid = (uint32_t)trace_syscall(SYS_getpid);
+    if (ring->pid != pid)
+    {
+        // Inherited from the parent (which will write the records), and
+        // the clear_child_tid word was not available to detect the fork():
+        ring->used = 0;
+        ring->pid  = pid;
+        ring->tid  = (uint32_t)trace_syscall(SYS_gettid);
+        return;
+    }
+    uint8_t *chunk = (uint8_t *)ring + TRACE_RT_RING_SIZE;
+    uint8_t *start = chunk + sizeof(TraceChunk), *out = start;
+    uint8_t *end   = chunk + TRACE_RT_OUT_SIZE - TRACE_RECORD_MAX;
+    uint32_t prev_id = 0;
+    uint64_t prev_time = 0, prev_mem = 0;
+    for (uint32_t i = 0; i < ring->used; )
+    {
+        uint64_t word = ring->buf[i++];
+        uint32_t id = (uint32_t)word;
+        unsigned flags = (unsigned)(word >> 32);
+        out = trace_varint(out,
+            (trace_zigzag((int64_t)id - (int64_t)prev_id) << 2) | flags);
+        prev_id = id;
+        if (flags & TRACE_FLAG_TIME)
+        {
+            uint64_t time = ring->buf[i++];
+            out = trace_varint(out, trace_zigzag(time - prev_time));
+            prev_time = time;
+        }
+        if (flags & TRACE_FLAG_MEM)
+        {
+            uint64_t mem = ring->buf[i++];
+            out = trace_varint(out, trace_zigzag(mem - prev_mem));
+            prev_mem = mem;
+        }
+        if (out >= end || i >= ring->used)
+        {
+            TraceChunk *hdr = (TraceChunk *)chunk;
+            hdr->magic = TRACE_MAGIC_TRACE;
+            hdr->tid   = ring->tid;
+            hdr->count = (uint32_t)(out - start);
+            trace_write(data, chunk, out - chunk);
+            out = start;
+            prev_id = 0; prev_time = 0; prev_mem = 0;
+        }
+    }
+    ring->used = 0;
+}
+
+/*
+ * Initialize a ring for the calling thread `tp'.
+ */
+static void trace_ring_init(TraceRing *ring, uintptr_t tp)
+{
+    ring->owner = tp;
+    ring->tid   = (uint32_t)trace_syscall(SYS_gettid);
+    ring->pid   = (uint32_t)trace_syscall(SYS_getpid);
+    ring->used  = 0;
+    int32_t *tidp = nullptr;
+    if (trace_syscall(SYS_prctl, PR_GET_TID_ADDRESS, (intptr_t)&tidp) < 0 ||
+            tidp == nullptr || (uint32_t)*tidp != ring->tid)
+        tidp = (int32_t *)&ring->tid;       // Cannot detect reuse
+    ring->tidp = tidp;
+}
+
+/*
+ * Check if the ring is owned by the calling thread `tp'.
+ */
+static bool trace_ring_owned(const TraceRing *ring, uintptr_t tp)
+{
+    return (ring->owner == tp && (uint32_t)*ring->tidp == ring->tid);
+}
+
+/*
+ * Find or allocate the ring for thread `tp' (slow path).  Returns nullptr if
+ * there are too many threads.
+ */
+static NO_INLINE TraceRing *trace_ring_slow(TraceData *data, uintptr_t tp,
+    uint32_t h)
+{
+    for (unsigned i = 0; i < TRACE_BUCKETS; i++)
+    {
+        uintptr_t *slot = data->rings + ((h + i) % TRACE_BUCKETS);
+        TraceRing *ring = (TraceRing *)__atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (ring != nullptr)
+        {
+            if (ring->owner != tp)
+                continue;
+            if (!trace_ring_owned(ring, tp))
+            {
+                // The previous owner has exited, or this is a fork()'ed
+                // child (in which case the flush discards the records):
+                trace_flush(data, ring);
+                trace_ring_init(ring, tp);
+            }
+            return ring;
+        }
+        intptr_t r = trace_syscall(SYS_mmap, 0,
+            TRACE_RT_RING_SIZE + TRACE_RT_OUT_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (r < 0 && r > -PAGE_SIZE)
+            return nullptr;
+        ring = (TraceRing *)r;
+        trace_ring_init(ring, tp);
+        uintptr_t expected = 0;
+        if (__atomic_compare_exchange_n(slot, &expected, (uintptr_t)ring,
+                false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return ring;
+        // Lost the race for this slot; try the next one:
+        trace_syscall(SYS_munmap, r, TRACE_RT_RING_SIZE + TRACE_RT_OUT_SIZE);
+    }
+    return nullptr;
+}
+
+/*
+ * Get the calling thread's ring.
+ */
+static TraceRing *trace_ring(TraceData *data)
+{
+    uintptr_t tp;
+    asm ("mov %%fs:0x0,%0" : "=r"(tp));
+    uint32_t h = ((uint32_t)(tp >> 12) * 0x9e3779b1u) >> 24;
+    TraceRing *ring = (TraceRing *)__atomic_load_n(data->rings + h,
+        __ATOMIC_ACQUIRE);
+    if (ring != nullptr && trace_ring_owned(ring, tp))
+        return ring;
+    return trace_ring_slow(data, tp, h);
+}
+
+/*
+ * Append a record to the calling thread's ring.
+ */
+void trace_record(const uint64_t *record, unsigned flags)
+{
+    TraceData *data = trace_data();
+    TraceRing *ring = trace_ring(data);
+    if (ring == nullptr)
+    {
+        __atomic_add_fetch(&data->drop.tid, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    unsigned n = 1 + (flags & TRACE_FLAG_TIME? 1: 0) +
+        (flags & TRACE_FLAG_MEM? 1: 0);
+    if (ring->used + n > TRACE_RING_WORDS)
+        trace_flush(data, ring);
+    uint64_t *buf = ring->buf + ring->used;
+    buf[0] = (uint32_t)record[0] | ((uint64_t)flags << 32);
+    for (unsigned i = 1; i < n; i++)
+        buf[i] = record[i];
+    ring->used += n;
+}
+
+/*
+ * Flush all rings at exit.  Rings inherited from a parent process are
+ * discarded by trace_flush().
+ */
+void trace_fini(const void *config)
+{
+    TraceData *data = trace_data();
+    for (unsigned i = 0; i < TRACE_BUCKETS; i++)
+    {
+        TraceRing *ring = (TraceRing *)__atomic_load_n(data->rings + i,
+            __ATOMIC_ACQUIRE);
+        if (ring != nullptr && ring->used > 0)
+            trace_flush(data, ring);
+    }
+    if (data->drop.tid > 0)
+    {
+        trace_write(data, (const uint8_t *)&data->drop, sizeof(data->drop));
+        data->drop.tid = 0;
+    }
+}
@@ -0,0 +1,250 @@
+/*
+ *        ___  _              _
+ *   ___ / _ \| |_ ___   ___ | |
+ *  / _ \ (_) | __/ _ \ / _ \| |
+ * |  __/\__, | || (_) | (_) | |
+ *  \___|  /_/ \__\___/ \___/|_|
+ *
+ * Copyright (C) 2022 National University of Singapore
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * E9TraceDump: decode the binary traces written by the trace runtime (see
+ * e9trace_elf.cpp).  The SITES file written by E9Tool maps each site ID back
+ * to the original instruction.
+ */
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#define E9TRACE_FORMAT_ONLY
+#include "e9trace.h"
+
+/*
+ * Instrumentation site.
+ */
+struct Site
+{
+    uint64_t address;                       // Instruction address
+    std::string asm_str;                    // Instruction string
+};
+
+static void usage(FILE *stream, const char *progname)
+{
+    fprintf(stream,
+        "usage: %s [OPTIONS] SITES TRACE\n"
+        "\n"
+        "Decode TRACE (written by `print' patches with --print-buffer or\n"
+        "by `trace' patches) using the SITES file written by E9Tool.\n"
+        "Records are printed in the form:\n"
+        "\n"
+        "\t[TIME] ADDRESS: ASM [MEM]\n"
+        "\n"
+        "OPTIONS:\n"
+        "\n"
+        "\t-t\n"
+        "\t\tPrefix each record with the thread ID.\n"
+        "\n"
+        "\t-h\n"
+        "\t\tPrint this message and exit.\n"
+        "\n", progname);
+}
+
+#define error(msg, ...)                                                 \
+    do {                                                                \
+        fprintf(stderr, "error: " msg "\n", ##__VA_ARGS__);             \
+        exit(EXIT_FAILURE);                                             \
+    } while (false)
+
+/*
+ * Load the sites file.
+ */
+static void loadSites(const char *filename, std::vector<Site> &sites)
+{
+    FILE *stream = fopen(filename, "r");
+    if (stream == nullptr)
+        error("failed to open file \"%s\" for reading: %s", filename,
+            strerror(errno));
+    char *line = nullptr;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, stream)) >= 0)
+    {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (len > 0 && line[len-1] == '\n')
+            line[len-1] = '\0';
+        char *end = nullptr;
+        unsigned long id = strtoul(line, &end, 10);
+        if (end == line || *end != '\t' || id > UINT32_MAX)
+            error("failed to parse sites file \"%s\"", filename);
+        char *addr = end + 1;
+        uint64_t address = strtoull(addr, &end, 16);
+        if (end == addr || *end != '\t')
+            error("failed to parse sites file \"%s\"", filename);
+        if (id >= sites.size())
+            sites.resize(id + 1);
+        sites[id].address = address;
+        sites[id].asm_str = end + 1;
+    }
+    free(line);
+    fclose(stream);
+}
+
+/*
+ * Get a site.
+ */
+static const Site *getSite(const std::vector<Site> &sites, uint32_t id)
+{
+    if (id >= sites.size() || sites[id].asm_str.empty())
+        return nullptr;
+    return &sites[id];
+}
+
+/*
+ * Decode a varint.
+ */
+static uint64_t getVarint(const uint8_t *&ptr, const uint8_t *end,
+    const char *filename)
+{
+    uint64_t x = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        if (ptr >= end)
+            break;
+        uint8_t b = *ptr++;
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+            return x;
+    }
+    error("failed to parse trace file \"%s\"; bad varint", filename);
+}
+static int64_t unZigzag(uint64_t x)
+{
+    return (int64_t)(x >> 1) ^ -(int64_t)(x & 0x1);
+}
+
+/*
+ * Dump a trace chunk.
+ */
+static void dumpTraceChunk(const TraceChunk &chunk, const uint8_t *buf,
+    const std::vector<Site> &sites, bool option_tid, const char *filename)
+{
+    const uint8_t *ptr = buf, *end = buf + chunk.count;
+    uint32_t id = 0;
+    uint64_t time = 0, mem = 0;
+    while (ptr < end)
+    {
+        uint64_t x = getVarint(ptr, end, filename);
+        unsigned flags = (unsigned)(x & 0x3);
+        id += (uint32_t)unZigzag(x >> 2);
+        if ((flags & TRACE_FLAG_TIME) != 0)
+            time += (uint64_t)unZigzag(getVarint(ptr, end, filename));
+        if ((flags & TRACE_FLAG_MEM) != 0)
+            mem += (uint64_t)unZigzag(getVarint(ptr, end, filename));
+
+        if (option_tid)
+            printf("[%u] ", chunk.tid);
+        if ((flags & TRACE_FLAG_TIME) != 0)
+            printf("%" PRIu64 " ", time);
+        const Site *site = getSite(sites, id);
+        if (site != nullptr)
+            printf("%" PRIx64 ": %s", site->address, site->asm_str.c_str());
+        else
+            printf("<unknown site %u>", id);
+        if ((flags & TRACE_FLAG_MEM) != 0)
+            printf(" [0x%" PRIx64 "]", mem);
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool option_tid = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "th")) >= 0)
+    {
+        switch (opt)
+        {
+            case 't':
+                option_tid = true;
+                break;
+            case 'h':
+                usage(stdout, argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                usage(stderr, argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        usage(stderr, argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::vector<Site> sites;
+    loadSites(argv[optind], sites);
+
+    const char *filename = argv[optind+1];
+    FILE *stream = fopen(filename, "r");
+    if (stream == nullptr)
+        error("failed to open file \"%s\" for reading: %s", filename,
+            strerror(errno));
+    std::vector<uint8_t> buf;
+    size_t dropped = 0;
+    TraceChunk chunk;
+    while (fread(&chunk, sizeof(chunk), 1, stream) == 1)
+    {
+        size_t size = 0;
+        switch (chunk.magic)
+        {
+            case TRACE_MAGIC_TRACE:
+                if (chunk.count > TRACE_RT_OUT_SIZE)
+                    error("failed to parse trace file \"%s\"; bad chunk "
+                        "size (%u)", filename, chunk.count);
+                size = chunk.count;
+                break;
+            case TRACE_MAGIC_DROP:
+                dropped += chunk.tid;
+                continue;
+            default:
+                error("failed to parse trace file \"%s\"; bad chunk magic "
+                    "(0x%.8X)", filename, chunk.magic);
+        }
+        buf.resize(size);
+        if (size > 0 && fread(buf.data(), size, 1, stream) != 1)
+            error("failed to parse trace file \"%s\"; truncated chunk",
+                filename);
+        dumpTraceChunk(chunk, buf.data(), sites, option_tid, filename);
+    }
+    if (ferror(stream))
+        error("failed to read trace file \"%s\": %s", filename,
+            strerror(errno));
+    fclose(stream);
+    if (dropped > 0)
+        fprintf(stderr, "warning: %zu record(s) were dropped (too many "
+            "threads)\n", dropped);
+    return EXIT_SUCCESS;
+}
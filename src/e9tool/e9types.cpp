@@ -24,6 +24,7 @@
 #include <cstdint>
 #include <climits>
 
+#include <algorithm>
 #include <map>
 #include <vector>
 
@@ -190,8 +191,19 @@ void getSymbolString(const char *name, TypeSig sig, std::string &str)
 static bool insertSymbol(Symbols &symbols, const char *name, TypeSig sig,
     intptr_t addr)
 {
-    Symbol key(strDup(name), sig);
-    return symbols.insert({key, addr}).second;
+    auto i = symbols.find(name);
+    if (i == symbols.end())
+        i = symbols.emplace(strDup(name), SymbolSigs()).first;
+    SymbolSigs &sigs = i->second;
+    auto j = std::lower_bound(sigs.begin(), sigs.end(), sig,
+        [](const std::pair<TypeSig, intptr_t> &entry, TypeSig sig) -> bool
+        {
+            return (entry.first < sig);
+        });
+    if (j != sigs.end() && j->first == sig)
+        return false;
+    sigs.insert(j, {sig, addr});
+    return true;
 }
 
 /*
@@ -334,34 +346,36 @@ intptr_t lookupSymbol(const ELF *elf, const char *name, TypeSig sig)
         }
     }
 
-    Symbol key(name, sig);
-    auto i = symbols.find(key);
-    if (i != symbols.end())
-    {
-        intptr_t addr = i->second;
-        if (addr == INTPTR_MIN)
-            return addr;        // Missing
-        if (addr < 0)
-            return -addr;       // Derived
-        else
-            return addr;        // Original
-    }
-
-    // Attempt to find the optimal coercion:
-    Symbol min(name, TYPESIG_MIN), max(name, TYPESIG_MAX);
-    auto j = symbols.lower_bound(min);
-    auto jend = symbols.upper_bound(max);
+    auto i = symbols.find(name);
     long score = LONG_MAX;
     intptr_t addr = INTPTR_MIN;
-    for (; j != jend; j++)
+    if (i != symbols.end())
     {
-        long nscore = coercible(sig, j->first.sig);
-        if (nscore < 0)
-            continue;       // Not coercible.
-        if (j->second != INTPTR_MIN && nscore < score)
+        const SymbolSigs &sigs = i->second;
+        for (const auto &entry: sigs)
+        {
+            if (entry.first != sig)
+                continue;
+            addr = entry.second;
+            if (addr == INTPTR_MIN)
+                return addr;    // Missing
+            if (addr < 0)
+                return -addr;   // Derived
+            else
+                return addr;    // Original
+        }
+
+        // Attempt to find the optimal coercion:
+        for (const auto &entry: sigs)
         {
-            score = nscore;
-            addr  = std::abs(j->second);
+            long nscore = coercible(sig, entry.first);
+            if (nscore < 0)
+                continue;       // Not coercible.
+            if (entry.second != INTPTR_MIN && nscore < score)
+            {
+                score = nscore;
+                addr  = std::abs(entry.second);
+            }
         }
     }
 
@@ -377,15 +391,15 @@ void lookupSymbolWarnings(const ELF *elf, const InstrInfo *I, const char *name,
     TypeSig sig)
 {
     Symbols &symbols = elf->symbols;
-    Symbol min(name, TYPESIG_MIN), max(name, TYPESIG_MAX);
-    auto j = symbols.lower_bound(min);
-    auto jend = symbols.upper_bound(max);
-    for (; j != jend; j++)
+    auto i = symbols.find(name);
+    if (i == symbols.end())
+        return;
+    for (const auto &entry: i->second)
     {
-        if (j->second < 0 || coercible(sig, j->first.sig) >= 0)
+        if (entry.second < 0 || coercible(sig, entry.first) >= 0)
             continue;
         std::string str;
-        getSymbolString(j->first, str);
+        getSymbolString(i->first, entry.first, str);
         warning(CONTEXT_FORMAT "failed to match symbol candidate \"%s\"",
             CONTEXT(I), str.c_str());
     }
@@ -119,6 +119,59 @@ bool decode(const uint8_t **code, size_t *size, off_t *offset,
     return true;
 }
 
+/*
+ * Disassemble an instruction and classify its control-flow as one of
+ * CATEGORY_CALL, CATEGORY_JUMP (possibly CATEGORY_CONDITIONAL), or
+ * CATEGORY_RETURN (any instruction with no fall-through, including hlt,
+ * ud2 and int3), or 0 otherwise.  The `target' is set to the direct
+ * call/jump target, or INTPTR_MIN.  Returns the instruction length, or 0 if
+ * the instruction cannot be decoded.
+ */
+size_t decodeFlow(const uint8_t *code, size_t size, intptr_t address,
+    uint16_t &category, intptr_t &target)
+{
+    ZydisDecodedInstruction D_0;
+    ZydisDecodedInstruction *D = &D_0;
+    ZyanStatus result = ZydisDecoderDecodeInstruction(&decoder, nullptr,
+        code, size, D);
+    if (!ZYAN_SUCCESS(result))
+        return 0;
+
+    category = 0;
+    target   = INTPTR_MIN;
+    switch (D->meta.category)
+    {
+        case ZYDIS_CATEGORY_RET:
+            category = CATEGORY_RETURN;
+            break;
+        case ZYDIS_CATEGORY_CALL:
+            category = CATEGORY_CALL;
+            break;
+        case ZYDIS_CATEGORY_UNCOND_BR:
+            category = CATEGORY_JUMP;
+            break;
+        case ZYDIS_CATEGORY_COND_BR:
+            category = CATEGORY_CONDITIONAL | CATEGORY_JUMP;
+            break;
+        default:
+            switch (D->mnemonic)
+            {
+                case ZYDIS_MNEMONIC_HLT: case ZYDIS_MNEMONIC_INT3:
+                case ZYDIS_MNEMONIC_UD0: case ZYDIS_MNEMONIC_UD1:
+                case ZYDIS_MNEMONIC_UD2:
+                    category = CATEGORY_RETURN;
+                    break;
+                default:
+                    break;
+            }
+            return (size_t)D->length;
+    }
+    if (category != CATEGORY_RETURN && D->raw.imm[0].is_relative)
+        target = address + (intptr_t)D->length +
+            (intptr_t)D->raw.imm[0].value.s;
+    return (size_t)D->length;
+}
+
 /*
  * Decompress an instruction.
  */
@@ -2310,6 +2363,166 @@ static uint16_t convert(ZydisInstructionCategory category, ZydisISAExt isa)
     }
 }
 
+/*
+ * Determine the cheapest extended state save mode that is sufficient for all
+ * code in the given (instrumentation) binary.
+ */
+CallSave getCallSave(const ELF *elf)
+{
+    CallSave save = SAVE_GPR;
+    for (const auto *shdr: elf->exes)
+    {
+        const uint8_t *code = elf->data + shdr->sh_offset;
+        size_t size = shdr->sh_size;
+        while (size > 0)
+        {
+            ZydisDecodedInstruction D;
+            ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
+            ZyanStatus result = ZydisDecoderDecodeFull(&decoder, code, size,
+                &D, operands, ZYDIS_MAX_OPERAND_COUNT, 0);
+            if (!ZYAN_SUCCESS(result))
+            {
+                code++; size--;
+                continue;
+            }
+            code += D.length;
+            size -= D.length;
+            switch (D.mnemonic)
+            {
+                case ZYDIS_MNEMONIC_FXSAVE: case ZYDIS_MNEMONIC_FXSAVE64:
+                case ZYDIS_MNEMONIC_FXRSTOR: case ZYDIS_MNEMONIC_FXRSTOR64:
+                case ZYDIS_MNEMONIC_XSAVE: case ZYDIS_MNEMONIC_XSAVE64:
+                case ZYDIS_MNEMONIC_XRSTOR: case ZYDIS_MNEMONIC_XRSTOR64:
+                    // Code that manages the extended state itself (e.g.,
+                    // dlcall()) does not clobber it.
+                    continue;
+                case ZYDIS_MNEMONIC_LDMXCSR:
+                    return SAVE_XSAVE;
+                default:
+                    break;
+            }
+            if (D.encoding != ZYDIS_INSTRUCTION_ENCODING_LEGACY)
+                return SAVE_XSAVE;      // VEX/EVEX/3DNow!/etc.
+            for (unsigned i = 0; i < D.operand_count; i++)
+            {
+                if (operands[i].type != ZYDIS_OPERAND_TYPE_REGISTER ||
+                        (operands[i].actions & ZYDIS_OPERAND_ACTION_MASK_WRITE)
+                            == 0)
+                    continue;
+                switch (ZydisRegisterGetClass(operands[i].reg.value))
+                {
+                    case ZYDIS_REGCLASS_XMM:
+                        save = SAVE_SSE;
+                        break;
+                    case ZYDIS_REGCLASS_X87: case ZYDIS_REGCLASS_MMX:
+                    case ZYDIS_REGCLASS_YMM: case ZYDIS_REGCLASS_ZMM:
+                    case ZYDIS_REGCLASS_MASK:
+                        return SAVE_XSAVE;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+    return save;
+}
+
+/*
+ * Get the inline fast path for the given entry point (if any).  The fast
+ * path is the code of the symbol "ENTRY.inline" in the instrumentation
+ * binary, minus the terminating `ret'.  Since the code is copied verbatim
+ * into each trampoline, it must be position independent.
+ */
+bool getFastPath(const ELF *elf, const char *entry, std::vector<uint8_t> &code)
+{
+    std::string name(entry);
+    name += ".inline";
+    const Elf64_Sym *sym = getELFDynSym(elf, name.c_str());
+    if (sym == nullptr)
+        sym = getELFSym(elf, name.c_str());
+    if (sym == nullptr || sym->st_shndx == SHN_UNDEF)
+        return false;
+
+    const Elf64_Shdr *shdr = nullptr;
+    for (const auto *exe: elf->exes)
+    {
+        if (sym->st_value >= exe->sh_addr &&
+                sym->st_value + sym->st_size <= exe->sh_addr + exe->sh_size)
+        {
+            shdr = exe;
+            break;
+        }
+    }
+    if (shdr == nullptr || sym->st_size == 0)
+        error("failed to inline \"%s\" from binary \"%s\"; symbol "
+            "is not executable code with a known size", name.c_str(),
+            elf->filename);
+
+    const uint8_t *start = elf->data + shdr->sh_offset +
+        (sym->st_value - shdr->sh_addr);
+    size_t size = sym->st_size;
+    intptr_t end = (intptr_t)size - 1;      // Offset of the `ret'
+    intptr_t offset = 0;
+    bool ret = false;
+    while (offset < (intptr_t)size)
+    {
+        ZydisDecodedInstruction D;
+        ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
+        ZyanStatus result = ZydisDecoderDecodeFull(&decoder, start + offset,
+            size - offset, &D, operands, ZYDIS_MAX_OPERAND_COUNT, 0);
+        if (!ZYAN_SUCCESS(result))
+            error("failed to inline \"%s\" from binary \"%s\"; failed to "
+                "decode instruction at offset +%ld", name.c_str(),
+                elf->filename, offset);
+        const char *bad = nullptr;
+        switch (D.meta.category)
+        {
+            case ZYDIS_CATEGORY_RET:
+                if (offset != end || D.length != 1 ||
+                        D.mnemonic != ZYDIS_MNEMONIC_RET)
+                    bad = "`ret' must be the last instruction";
+                ret = true;
+                break;
+            case ZYDIS_CATEGORY_CALL: case ZYDIS_CATEGORY_SYSCALL:
+            case ZYDIS_CATEGORY_INTERRUPT:
+                bad = "calls, system calls and interrupts are not allowed";
+                break;
+            case ZYDIS_CATEGORY_UNCOND_BR: case ZYDIS_CATEGORY_COND_BR:
+            {
+                if (!D.raw.imm[0].is_relative)
+                {
+                    bad = "indirect jumps are not allowed";
+                    break;
+                }
+                intptr_t target = offset + (intptr_t)D.length +
+                    (intptr_t)D.raw.imm[0].value.s;
+                if (target < 0 || target > end)
+                    bad = "jumps must target the snippet itself";
+                break;
+            }
+            default:
+                break;
+        }
+        for (unsigned i = 0; bad == nullptr && i < D.operand_count; i++)
+        {
+            if (operands[i].type == ZYDIS_OPERAND_TYPE_MEMORY &&
+                    operands[i].mem.base == ZYDIS_REGISTER_RIP)
+                bad = "%rip-relative memory operands are not allowed";
+        }
+        if (bad != nullptr)
+            error("failed to inline \"%s\" from binary \"%s\"; "
+                "unsupported instruction at offset +%ld (%s)", name.c_str(),
+                elf->filename, offset, bad);
+        offset += D.length;
+    }
+    if (!ret)
+        error("failed to inline \"%s\" from binary \"%s\"; the last "
+            "instruction must be `ret'", name.c_str(), elf->filename);
+
+    code.assign(start, start + end);
+    return true;
+}
+
 /*
  * Assigns a "suspiciousness" score to instructions.
  */
@@ -19,12 +19,19 @@
 
 #include <cstdint>
 
+#include <vector>
+
 #include "e9tool.h"
 
 extern void initDisassembler(void);
 extern bool decode(const uint8_t **code, size_t *size, off_t *offset,
     intptr_t *address, e9tool::Instr *I);
+extern size_t decodeFlow(const uint8_t *code, size_t size, intptr_t address,
+    uint16_t &category, intptr_t &target);
 extern int suspiciousness(const uint8_t *bytes, size_t size);
+extern e9tool::CallSave getCallSave(const e9tool::ELF *elf);
+extern bool getFastPath(const e9tool::ELF *elf, const char *entry,
+    std::vector<uint8_t> &code);
 extern const e9tool::OpInfo *getOperand(const e9tool::InstrInfo *I, int idx,
     e9tool::OpType type, e9tool::Access access);
 
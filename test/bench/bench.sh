@@ -0,0 +1,68 @@
+#!/bin/bash
+#
+# Common definitions for the benchmark scripts.
+#
+# Usage: . ./bench.sh
+#
+
+if [ -t 1 ]
+then
+    YELLOW="\033[33m"
+    OFF="\033[0m"
+else
+    YELLOW=
+    OFF=
+fi
+
+set -e
+mkdir -p tmp
+
+#
+# Compile bench_stdlib.c into tmp/NAME.o, using the same CFLAGS as
+# e9compile.sh.
+#
+# Usage: bench_stdlib NAME [CFLAGS ...]
+#
+bench_stdlib()
+{
+    local NAME=$1
+    shift
+
+    gcc -fno-stack-protector -fno-builtin -fno-exceptions -fpie -O2 \
+        -Wno-unused-function -U_FORTIFY_SOURCE -mno-mmx -mno-sse -mno-avx \
+        -mno-avx2 -mno-avx512f -msoft-float -mstringop-strategy=loop \
+        -fno-tree-vectorize -fomit-frame-pointer -I ../../examples/ "$@" \
+        -c bench_stdlib.c -o tmp/$NAME.o
+}
+
+#
+# Measure the per-hit cost (in cycles) of call trampolines over tmp/loop.
+#
+# Usage: bench_loop ITERATIONS UNIT LABEL CALL [LABEL CALL ...]
+#
+# Each CALL (e.g., `entry<clean>()') calls examples/nop.c from the loop's
+# marker instruction, and is reported as LABEL.
+#
+bench_loop()
+{
+    local N=$1
+    local UNIT=$2
+    shift 2
+
+    gcc -O2 -o tmp/loop loop.c
+    ../../e9compile.sh ../../examples/nop.c >/dev/null 2>&1
+    mv nop nop.o tmp/
+
+    local BASE=`tmp/loop $N`
+    echo -e "${YELLOW}baseline${OFF}: $BASE cycles/iteration"
+    while [ $# -ge 2 ]
+    do
+        ../../e9tool tmp/loop -M 'asm=/.*0xe9e9e9e9.*/' -P "$2@tmp/nop" \
+            -o tmp/loop.$1 >/dev/null 2>&1
+        local COST=`tmp/loop.$1 $N`
+        local DELTA=$(awk "BEGIN {printf \"%.2f\", $COST - $BASE}")
+        echo -e "${YELLOW}$1${OFF}: $COST cycles/iteration" \
+            "(+$DELTA per $UNIT)"
+        shift 2
+    done
+}
@@ -0,0 +1,118 @@
+/*
+ * The examples/stdlib.c allocator and string functions (and, with
+ * -DBENCH_CFI, the examples/cfi.c target bitmap, or with -DBENCH_BOUNDS,
+ * the examples/bounds.c check), exported for the microbenchmarks.
+ */
+
+#if defined(BENCH_CFI)
+#include "../../examples/cfi.c"
+#elif defined(BENCH_BOUNDS)
+#include "../../examples/bounds.c"
+#else
+#include "stdlib.c"
+#endif
+
+/*
+ * Allocator (malloc.sh).
+ */
+void *e9_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void *e9_realloc(void *ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+void e9_free(void *ptr)
+{
+    free(ptr);
+}
+
+/*
+ * String functions (string.sh).  Force the SIMD level (2=SSE2, 3=AVX2).
+ * Returns the level actually used, or 1 if SIMD support was not compiled in.
+ */
+int e9_string_level(int level)
+{
+#ifdef STRING_SIMD
+    int max = string_cpuid();
+    string_level = (level < STRING_SSE2? STRING_SSE2:
+        level > max? max: level);
+    return string_level;
+#else
+    return STRING_WORD;
+#endif
+}
+
+void *e9_memset(void *dst, int c, size_t n)
+{
+    return memset(dst, c, n);
+}
+
+void *e9_memcpy(void *dst, const void *src, size_t n)
+{
+    return memcpy(dst, src, n);
+}
+
+void *e9_memmove(void *dst, const void *src, size_t n)
+{
+    return memmove(dst, src, n);
+}
+
+int e9_memcmp(const void *a, const void *b, size_t n)
+{
+    return memcmp(a, b, n);
+}
+
+void *e9_memchr(const void *a, int c, size_t n)
+{
+    return memchr(a, c, n);
+}
+
+size_t e9_strlen(const char *s)
+{
+    return strlen(s);
+}
+
+size_t e9_strnlen(const char *s, size_t n)
+{
+    return strnlen(s, n);
+}
+
+#ifdef BENCH_CFI
+/*
+ * CFI target bitmap (cfi.sh).
+ */
+void e9_cfi_init(char *progname)
+{
+    char *argv[] = {progname, NULL};
+    char *envp[] = {NULL};
+    init(1, argv, envp);
+}
+
+int e9_cfi_check(uintptr_t target)
+{
+    return (int)target_check(target);
+}
+#endif
+
+#ifdef BENCH_BOUNDS
+/*
+ * Bounds check (bounds.sh).  Steps (1) and (2) of check(), i.e., returns
+ * non-zero iff check() would return without reporting a memory error.
+ */
+int e9_bounds_check(const void *base, const void *access, size_t sz)
+{
+    const size_t *meta = (size_t *)redfat_base(base, access);
+    if (meta == NULL)
+        return 1;
+    size_t size = *meta;
+    const uint8_t *lb = (uint8_t *)meta + REDZONE;
+    const uint8_t *ub = lb + size;
+    const uint8_t *access8 = (uint8_t *)access;
+    return (access8 >= lb && access8 + sz <= ub &&
+        size < redfat_size(access));
+}
+#endif
@@ -0,0 +1,156 @@
+/*
+ * Correctness test and microbenchmark for the examples/bounds.c inline fast
+ * path (check.inline).  Synthetic RedFat regions and size/magic tables are
+ * mapped at the addresses used by libredfat.so, then the fast path is
+ * compared against the C logic of check() for random (valid and invalid)
+ * accesses, including free objects, corrupted size metadata and non-RedFat
+ * pointers.  Finally, the average cycles per check are compared.
+ *
+ * Usage: bounds [ACCESSES]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <x86intrin.h>
+
+extern int e9_bounds_check(const void *base, const void *access, size_t sz);
+extern long e9_bounds_inline(const void *loc, const void *base,
+    const void *access, size_t sz, const char *_asm) asm("check.inline");
+
+#define SIZES       ((size_t *)0x100000)
+#define MAGICS      ((uint64_t *)0x180000)
+#define TABLE_SIZE  0x10000
+#define REGION_SIZE 34359738368ull
+#define REGIONS     16
+#define WINDOW      (1 << 20)
+
+static uint64_t seed = 1;
+static uint64_t rnd(void)
+{
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    return seed >> 16;
+}
+
+static void *map(uintptr_t addr, size_t size)
+{
+    void *ptr = mmap((void *)addr, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE,
+        -1, 0);
+    if (ptr != (void *)addr)
+    {
+        fprintf(stderr, "error: failed to map %p\n", (void *)addr);
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+/*
+ * Region `idx' holds objects of size 16*(idx+1) within a window at the
+ * start of the region.  Each object's size metadata is random, free (0), or
+ * corrupt (>= the region size).
+ */
+static void init(void)
+{
+    map((uintptr_t)SIZES, TABLE_SIZE);
+    map((uintptr_t)MAGICS, TABLE_SIZE);
+    for (size_t idx = 1; idx <= REGIONS; idx++)
+    {
+        size_t size = 16 * (idx + 1);
+        SIZES[idx]  = size;
+        MAGICS[idx] = UINT64_MAX / size + 1;
+        uintptr_t lo = idx * REGION_SIZE;
+        map(lo, WINDOW);
+        uintptr_t obj = (lo + size - 1) / size * size;
+        for (; obj + size <= lo + WINDOW; obj += size)
+        {
+            uint64_t r = rnd();
+            *(size_t *)obj = (r % 10 == 0? 0:
+                r % 20 == 1? size + r % 64: (r >> 8) % (size - 16 + 1));
+        }
+    }
+}
+
+/*
+ * Generate a random access (base, access, sz) relative to an object.
+ */
+static void generate(uintptr_t *base, uintptr_t *access, size_t *sz)
+{
+    uint64_t r = rnd();
+    *sz = (size_t)1 << (r % 5);
+    r >>= 3;
+    if (r % 32 == 0)
+    {
+        // Non-RedFat pointer (region 0):
+        *base   = (rnd() % REGION_SIZE);
+        *access = *base + rnd() % 64;
+        return;
+    }
+    size_t idx  = 1 + (r >> 5) % REGIONS;
+    size_t size = SIZES[idx];
+    uintptr_t lo = idx * REGION_SIZE;
+    uintptr_t obj = (lo + size - 1) / size * size;
+    size_t n = (lo + WINDOW - obj) / size;
+    obj += (2 + rnd() % (n - 4)) * size;
+    *base   = obj + rnd() % size;
+    *access = *base + rnd() % (4 * size) - 2 * size;
+}
+
+int main(int argc, char **argv)
+{
+    long N = (argc > 1? atol(argv[1]): 10000000);
+    init();
+
+    long valid = 0, mismatches = 0;
+    for (long i = 0; i < N; i++)
+    {
+        uintptr_t base, access;
+        size_t sz;
+        generate(&base, &access, &sz);
+        int c = e9_bounds_check((void *)base, (void *)access, sz);
+        int f = (e9_bounds_inline(NULL, (void *)base, (void *)access, sz,
+            NULL) != 0);
+        valid += c;
+        if (c != f && mismatches++ < 10)
+            fprintf(stderr, "error: mismatch for base=%p access=%p sz=%zu "
+                "(C=%d, inline=%d)\n", (void *)base, (void *)access, sz, c,
+                f);
+    }
+    printf("%ld accesses (%ld valid, %ld invalid), %ld mismatches\n", N,
+        valid, N - valid, mismatches);
+    if (mismatches != 0)
+        return EXIT_FAILURE;
+
+    // Benchmark a valid access:
+    uintptr_t lo = REGION_SIZE, base = 0;
+    size_t size = SIZES[1];
+    for (uintptr_t obj = (lo + size - 1) / size * size; base == 0;
+            obj += size)
+    {
+        size_t len = *(size_t *)obj;
+        if (len >= 8 && len < size)
+            base = obj + 16;
+    }
+    const int M = 10000000;
+    uint64_t t0 = __rdtsc();
+    for (int i = 0; i < M; i++)
+    {
+        asm volatile ("" : "+r"(base));
+        if (!e9_bounds_check((void *)base, (void *)base, 8))
+            abort();
+    }
+    uint64_t t1 = __rdtsc();
+    for (int i = 0; i < M; i++)
+    {
+        asm volatile ("" : "+r"(base));
+        if (e9_bounds_inline(NULL, (void *)base, (void *)base, 8, NULL) == 0)
+            abort();
+    }
+    uint64_t t2 = __rdtsc();
+    printf("C: %.1f cycles/check, inline: %.1f cycles/check\n",
+        (double)(t1 - t0) / M, (double)(t2 - t1) / M);
+    return 0;
+}
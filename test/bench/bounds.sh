@@ -0,0 +1,13 @@
+#!/bin/bash
+#
+# Check the examples/bounds.c inline fast path (check.inline) against the C
+# logic of check() on random accesses, and compare the cycles per check.
+#
+# Usage: ./bounds.sh [ACCESSES]
+#
+
+. ./bench.sh
+
+bench_stdlib bounds_stdlib -DBENCH_BOUNDS
+gcc -O2 bounds.c tmp/bounds_stdlib.o -o tmp/bounds
+tmp/bounds "$@"
@@ -0,0 +1,178 @@
+/*
+ * Microbenchmark for the examples/cfi.c target check.  A synthetic code
+ * segment is dumped in the same format as E9Tool's --dump-all option, then
+ * the startup cost and the average cycles per check are compared for
+ * (1) parsing "TARGETs.csv" into a sorted array and binary searching it
+ * (the previous cfi.c), and (2) mapping "TARGETs.bitmap" and testing a bit.
+ *
+ * Usage: cfi [SIZE ...]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <x86intrin.h>
+
+extern void e9_cfi_init(char *progname);
+extern int e9_cfi_check(uintptr_t target);
+
+#define BASE        0x400000
+#define CHECKS      (1 << 22)
+#define VALID       0
+
+static uint64_t seed = 1;
+static uint64_t rnd(void)
+{
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    return seed >> 16;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Dump instructions with random lengths over [BASE..BASE+size), where ~1/8
+ * are indirect targets.
+ */
+static void dump(const char *progname, size_t size)
+{
+    char filename[BUFSIZ];
+    snprintf(filename, sizeof(filename), "%s.TARGETs.csv", progname);
+    FILE *csv = fopen(filename, "w");
+    snprintf(filename, sizeof(filename), "%s.TARGETs.bitmap", progname);
+    FILE *bitmap = fopen(filename, "w");
+    if (csv == NULL || bitmap == NULL)
+    {
+        fprintf(stderr, "error: failed to open output files\n");
+        exit(EXIT_FAILURE);
+    }
+    uint8_t *bits = (uint8_t *)calloc((size + 7) / 8, 1);
+    fputs("target,direct?,indirect?,function?\n", csv);
+    for (size_t i = 0; i < size; i += 1 + rnd() % 8)
+    {
+        if (rnd() % 8 != 0)
+            continue;
+        fprintf(csv, "%p,0,1,0\n", (void *)(uintptr_t)(BASE + i));
+        bits[i / 8] |= (uint8_t)(1 << (i % 8));
+    }
+    uint64_t hdr[4] = {0, BASE, BASE + size, 0};
+    memcpy(hdr, "E9BITMAP", sizeof(hdr[0]));
+    fwrite(hdr, sizeof(hdr), 1, bitmap);
+    fwrite(bits, (size + 7) / 8, 1, bitmap);
+    fclose(csv);
+    fclose(bitmap);
+    free(bits);
+}
+
+/*
+ * The previous cfi.c implementation.
+ */
+static uintptr_t *targets = NULL;
+static size_t num_targets = 0;
+static void csv_init(const char *progname)
+{
+    char filename[BUFSIZ];
+    snprintf(filename, sizeof(filename), "%s.TARGETs.csv", progname);
+    FILE *stream = fopen(filename, "r");
+    char c;
+    while ((c = getc(stream)) != '\n' && c != EOF)
+        ;
+    size_t max = 0;
+    uintptr_t target, direct, indirect, func;
+    while (fscanf(stream, "%zx,%zu,%zu,%zu", &target, &direct, &indirect,
+            &func) == 4)
+    {
+        if (!indirect)
+            continue;
+        if (num_targets >= max)
+        {
+            max = (max == 0? 16: 2 * max);
+            targets = (uintptr_t *)realloc(targets, max * sizeof(uintptr_t));
+        }
+        targets[num_targets++] = target;
+    }
+    fclose(stream);
+}
+static int csv_check(uintptr_t target)
+{
+    ssize_t lo = 0, hi = num_targets-1;
+    while (lo <= hi)
+    {
+        ssize_t mid = (lo + hi) / 2;
+        if (targets[mid] < target)
+            lo = mid+1;
+        else if (targets[mid] > target)
+            hi = mid-1;
+        else
+            return VALID;
+    }
+    return !VALID;
+}
+
+static void bench(size_t size)
+{
+    char progname[BUFSIZ];
+    snprintf(progname, sizeof(progname), "tmp/cfi.%zu", size);
+    dump(progname, size);
+
+    uintptr_t *checks = (uintptr_t *)malloc(CHECKS * sizeof(uintptr_t));
+    for (size_t i = 0; i < CHECKS; i++)
+        checks[i] = BASE + rnd() % size;
+
+    double t0 = now();
+    csv_init(progname);
+    double t1 = now();
+    e9_cfi_init(progname);
+    double t2 = now();
+
+    size_t errs = 0;
+    for (size_t i = 0; i < CHECKS; i++)
+        errs += ((csv_check(checks[i]) == VALID) !=
+                 (e9_cfi_check(checks[i]) == VALID));
+    if (errs != 0)
+    {
+        fprintf(stderr, "error: bitmap and CSV disagree (%zu)\n", errs);
+        exit(EXIT_FAILURE);
+    }
+
+    int (*volatile f)(uintptr_t) = csv_check;
+    int (*volatile g)(uintptr_t) = e9_cfi_check;
+    size_t valid = 0;
+    uint64_t c0 = __rdtsc();
+    for (size_t i = 0; i < CHECKS; i++)
+        valid += (f(checks[i]) == VALID);
+    uint64_t c1 = __rdtsc();
+    for (size_t i = 0; i < CHECKS; i++)
+        valid += (g(checks[i]) == VALID);
+    uint64_t c2 = __rdtsc();
+
+    printf("%10zu %10zu %10.2f %10.2f %10.1f %10.1f\n", size, num_targets,
+        (t1 - t0) * 1e3, (t2 - t1) * 1e3, (double)(c1 - c0) / CHECKS,
+        (double)(c2 - c1) / CHECKS);
+    free(targets);
+    targets = NULL;
+    num_targets = 0;
+    free(checks);
+}
+
+int main(int argc, char **argv)
+{
+    printf("%10s %10s %10s %10s %10s %10s\n", "code", "targets", "csv(ms)",
+        "bitmap(ms)", "csv(cyc)", "bitmap(cyc)");
+    if (argc <= 1)
+    {
+        bench(1 << 16);
+        bench(1 << 20);
+        bench(1 << 24);
+    }
+    for (int i = 1; i < argc; i++)
+        bench((size_t)atoll(argv[i]));
+    return 0;
+}
@@ -0,0 +1,14 @@
+#!/bin/bash
+#
+# Compare the startup cost (in ms) and the average cycles per check of the
+# examples/cfi.c target bitmap versus binary search over the TARGETs.csv
+# file (the previous implementation).
+#
+# Usage: ./cfi.sh [SIZE ...]
+#
+
+. ./bench.sh
+
+bench_stdlib cfi_stdlib -DBENCH_CFI
+gcc -O2 cfi.c tmp/cfi_stdlib.o -o tmp/cfi
+tmp/cfi "$@"
@@ -0,0 +1,22 @@
+/*
+ * Microbenchmark target.  Executes a marker instruction N times and prints
+ * the average number of cycles per iteration.  The marker instruction is
+ * `mov $0xe9e9e9e9,%r11d'.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <x86intrin.h>
+
+int main(int argc, char **argv)
+{
+    long n = (argc > 1? atol(argv[1]): 10000000);
+    uint64_t t0 = __rdtsc();
+    for (long i = 0; i < n; i++)
+        asm volatile ("mov $0xe9e9e9e9,%%r11d" : : : "r11");
+    uint64_t t1 = __rdtsc();
+    printf("%.2f\n", (double)(t1 - t0) / (double)n);
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Multithreaded malloc()/free() microbenchmark for the examples/stdlib.c
+ * allocator.  Each thread repeatedly frees and replaces a random slot in a
+ * private working set with a random-sized allocation (mostly small), and
+ * checks that each object still holds its fill pattern before it is freed.
+ * Prints the throughput in millions of operations per second.
+ *
+ * Usage: malloc THREADS [ITERATIONS]
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern void *e9_malloc(size_t size);
+extern void *e9_realloc(void *ptr, size_t size);
+extern void e9_free(void *ptr);
+
+#define SLOTS       1024
+
+static long iterations;
+
+static void *worker(void *arg)
+{
+    uint8_t *slot[SLOTS] = {NULL};
+    size_t size[SLOTS] = {0};
+    uint64_t seed = (uintptr_t)arg * 0x9E3779B97F4A7C15ull + 1;
+    for (long i = 0; i < iterations; i++)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        unsigned j = (unsigned)(seed >> 40) % SLOTS;
+        uint8_t tag = (uint8_t)(seed >> 20);
+        size_t n = ((seed >> 8) & 0xF) == 0? 1025 + (seed >> 48) % 4096:
+            1 + (seed >> 48) % 256;
+        if (slot[j] != NULL)
+        {
+            if (slot[j][0] != slot[j][size[j]-1])
+            {
+                fprintf(stderr, "error: heap corruption detected\n");
+                abort();
+            }
+            if (((seed >> 12) & 0x7) == 0)
+            {
+                slot[j] = (uint8_t *)e9_realloc(slot[j], n);
+                if (slot[j] == NULL)
+                    abort();
+                size[j] = n;
+                slot[j][0] = slot[j][n-1] = tag;
+                continue;
+            }
+            e9_free(slot[j]);
+        }
+        slot[j] = (uint8_t *)e9_malloc(n);
+        if (slot[j] == NULL)
+            abort();
+        size[j] = n;
+        slot[j][0] = slot[j][n-1] = tag;
+    }
+    for (unsigned j = 0; j < SLOTS; j++)
+        e9_free(slot[j]);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = (argc > 1? atoi(argv[1]): 1);
+    iterations  = (argc > 2? atol(argv[2]): 1000000);
+    if (threads < 1 || threads > 256)
+    {
+        fprintf(stderr, "usage: %s THREADS [ITERATIONS]\n", argv[0]);
+        return 1;
+    }
+    pthread_t tids[256];
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; i++)
+        pthread_create(&tids[i], NULL, worker, (void *)(uintptr_t)(i + 1));
+    for (int i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) +
+        (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%.2f\n", (double)threads * (double)iterations / secs / 1e6);
+    return 0;
+}
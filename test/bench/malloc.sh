@@ -0,0 +1,23 @@
+#!/bin/bash
+#
+# Measure the multithreaded malloc()/free() throughput of the instrumentation
+# stdlib.c allocator, with and without the per-thread caches.
+#
+# Usage: ./malloc.sh [ITERATIONS]
+#
+
+. ./bench.sh
+N=${1:-1000000}
+
+bench_stdlib malloc_cache
+bench_stdlib malloc_nocache -DMALLOC_NO_CACHE
+gcc -O2 -pthread malloc.c tmp/malloc_cache.o -o tmp/malloc_cache
+gcc -O2 -pthread malloc.c tmp/malloc_nocache.o -o tmp/malloc_nocache
+
+for T in 1 2 4 8 16
+do
+    CACHE=`tmp/malloc_cache $T $N`
+    NOCACHE=`tmp/malloc_nocache $T $N`
+    echo -e "${YELLOW}threads=$T${OFF}: $CACHE Mops/s" \
+        "(without caches: $NOCACHE Mops/s)"
+done
@@ -0,0 +1,15 @@
+#!/bin/bash
+#
+# Measure the per-hit cost (in cycles) of sampled call trampolines, i.e.,
+# `call<sample=N>' (countdown) and `call<period=N>' (rdtsc), compared with
+# an unsampled call.
+#
+# Usage: ./sample.sh [ITERATIONS]
+#
+
+. ./bench.sh
+
+bench_loop ${1:-10000000} hit \
+    none          'entry()' \
+    sample=1000   'entry<sample=1000>()' \
+    period=100000 'entry<period=100000>()'
@@ -0,0 +1,215 @@
+/*
+ * Correctness test and microbenchmark for the examples/stdlib.c string
+ * functions.  The functions are first checked against glibc for all small
+ * sizes, alignments and overlaps (including buffers that end at an unmapped
+ * page), then the throughput of each function is compared with glibc.
+ *
+ * Usage: string [LEVEL]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+extern int e9_string_level(int level);
+extern void *e9_memset(void *dst, int c, size_t n);
+extern void *e9_memcpy(void *dst, const void *src, size_t n);
+extern void *e9_memmove(void *dst, const void *src, size_t n);
+extern int e9_memcmp(const void *a, const void *b, size_t n);
+extern void *e9_memchr(const void *a, int c, size_t n);
+extern size_t e9_strlen(const char *s);
+extern size_t e9_strnlen(const char *s, size_t n);
+
+#define MAX     320
+#define ALIGN   64
+
+static uint64_t seed = 1;
+static unsigned rnd(void)
+{
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    return (unsigned)(seed >> 33);
+}
+
+static void fill(uint8_t *buf, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        buf[i] = 1 + rnd() % 255;
+}
+
+static int sign(int x)
+{
+    return (x > 0) - (x < 0);
+}
+
+#define CHECK(cond, fmt, ...)                                               \
+    do {                                                                    \
+        if (!(cond))                                                        \
+        {                                                                   \
+            fprintf(stderr, "error: " fmt "\n", ##__VA_ARGS__);             \
+            exit(EXIT_FAILURE);                                             \
+        }                                                                   \
+    } while (0)
+
+static void test(void)
+{
+    static uint8_t a[2 * MAX + 2 * ALIGN], b[2 * MAX + 2 * ALIGN],
+        c[2 * MAX + 2 * ALIGN];
+    for (size_t n = 0; n <= MAX; n++)
+    {
+        for (size_t i = 0; i < ALIGN; i += (n > 64? 7: 1))
+        {
+            size_t j = rnd() % ALIGN;
+
+            // memset/memcpy:
+            fill(a, sizeof(a)); memcpy(b, a, sizeof(a));
+            int x = (int)rnd() - (1 << 30);
+            e9_memset(a + i, x, n); memset(b + i, x, n);
+            CHECK(memcmp(a, b, sizeof(a)) == 0, "memset(%zu, %zu)", i, n);
+            fill(c, sizeof(c));
+            e9_memcpy(a + i, c + j, n); memcpy(b + i, c + j, n);
+            CHECK(memcmp(a, b, sizeof(a)) == 0, "memcpy(%zu, %zu, %zu)", i,
+                j, n);
+
+            // memmove (overlapping):
+            size_t k = MAX / 2 + i, l = MAX / 2 + rnd() % (2 * ALIGN);
+            e9_memmove(a + k, a + l, n); memmove(b + k, b + l, n);
+            CHECK(memcmp(a, b, sizeof(a)) == 0, "memmove(%zu, %zu, %zu)",
+                k, l, n);
+
+            // memcmp:
+            memcpy(c + j, a + i, n);
+            CHECK(e9_memcmp(a + i, c + j, n) == 0, "memcmp(%zu, %zu, %zu)",
+                i, j, n);
+            if (n > 0)
+            {
+                size_t d = rnd() % n;
+                c[j + d] = (uint8_t)rnd();
+                CHECK(sign(e9_memcmp(a + i, c + j, n)) ==
+                        sign(memcmp(a + i, c + j, n)),
+                    "memcmp(%zu, %zu, %zu) [%zu]", i, j, n, d);
+            }
+
+            // memchr:
+            x = (n > 0 && rnd() % 4 != 0? a[i + rnd() % n]:
+                (int)rnd() - (1 << 30));
+            CHECK(e9_memchr(a + i, x, n) == memchr(a + i, x, n),
+                "memchr(%zu, %d, %zu)", i, x, n);
+
+            // strlen/strnlen:
+            a[i + n] = '\0';
+            CHECK(e9_strlen((char *)a + i) == n, "strlen(%zu, %zu)", i, n);
+            size_t m = rnd() % (MAX + 8);
+            CHECK(e9_strnlen((char *)a + i, m) == strnlen((char *)a + i, m),
+                "strnlen(%zu, %zu, %zu)", i, n, m);
+        }
+    }
+
+    // Buffers that end at an unmapped page:
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t *mem = (uint8_t *)mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(mem != MAP_FAILED, "mmap failed");
+    CHECK(mprotect(mem + page, page, PROT_NONE) == 0, "mprotect failed");
+    uint8_t *end = mem + page;
+    memset(mem, 'x', page);
+    for (size_t n = 0; n <= MAX; n++)
+    {
+        end[-1] = '\0';
+        CHECK(e9_strlen((char *)end - n - 1) == n, "strlen(page, %zu)", n);
+        CHECK(e9_strnlen((char *)end - n - 1, SIZE_MAX) == n,
+            "strnlen(page, %zu)", n);
+        end[-1] = 'x';
+        CHECK(e9_memchr(end - n, 'y', n) == NULL, "memchr(page, %zu)", n);
+        CHECK(e9_memcmp(end - n, mem, n) == 0, "memcmp(page, %zu)", n);
+        e9_memcpy(end - n, mem, n);
+        e9_memset(end - n, 'x', n);
+    }
+    munmap(mem, 2 * page);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef size_t (*bench_t)(void *dst, void *src, size_t n, int glibc);
+
+static size_t bench_memset(void *dst, void *src, size_t n, int glibc)
+{
+    return (size_t)(glibc? memset(dst, 0x11, n): e9_memset(dst, 0x11, n));
+}
+static size_t bench_memcpy(void *dst, void *src, size_t n, int glibc)
+{
+    return (size_t)(glibc? memcpy(dst, src, n): e9_memcpy(dst, src, n));
+}
+static size_t bench_memcmp(void *dst, void *src, size_t n, int glibc)
+{
+    return (size_t)(glibc? memcmp(dst, src, n): e9_memcmp(dst, src, n));
+}
+static size_t bench_memchr(void *dst, void *src, size_t n, int glibc)
+{
+    return (size_t)(glibc? memchr(src, 0, n): e9_memchr(src, 0, n));
+}
+static size_t bench_strlen(void *dst, void *src, size_t n, int glibc)
+{
+    return (glibc? strlen((char *)dst): e9_strlen((char *)dst));
+}
+
+static const struct
+{
+    const char *name;
+    bench_t bench;
+} benches[] =
+{
+    {"memset", bench_memset},
+    {"memcpy", bench_memcpy},
+    {"memcmp", bench_memcmp},
+    {"memchr", bench_memchr},
+    {"strlen", bench_strlen},
+};
+
+static double bench(bench_t f, uint8_t *dst, uint8_t *src, size_t n,
+    int glibc)
+{
+    size_t iters = ((size_t)1 << 28) / (n + 16);
+    memset(src, 0x22, n);
+    memset(dst, 0x22, n);
+    dst[n] = '\0';
+    size_t (*volatile g)(void *, void *, size_t, int) = f;
+    double t0 = now();
+    for (size_t i = 0; i < iters; i++)
+        g(dst, src, n, glibc);
+    double t1 = now();
+    return (double)iters * n / (t1 - t0) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int level = e9_string_level(argc > 1? atoi(argv[1]): 0);
+    test();
+    printf("level=%d: correctness OK\n", level);
+
+    static const size_t sizes[] = {16, 64, 256, 4096, 65536};
+    uint8_t *src = (uint8_t *)aligned_alloc(64, 65536 + 64);
+    uint8_t *dst = (uint8_t *)aligned_alloc(64, 65536 + 64);
+    printf("%-8s", "GB/s");
+    for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+        printf(" %15zu", sizes[j]);
+    printf("\n");
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+    {
+        printf("%-8s", benches[i].name);
+        for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+            printf(" %6.2f (%6.2f)",
+                bench(benches[i].bench, dst, src, sizes[j], 0),
+                bench(benches[i].bench, dst, src, sizes[j], 1));
+        printf("\n");
+    }
+    return 0;
+}
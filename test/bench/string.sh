@@ -0,0 +1,25 @@
+#!/bin/bash
+#
+# Check the instrumentation stdlib.c string functions against glibc, and
+# measure their throughput in GB/s (glibc in parentheses), for the
+# word-at-a-time, SSE2 and AVX2 (if supported) implementations.
+#
+# Usage: ./string.sh
+#
+
+. ./bench.sh
+
+bench_stdlib string_word
+bench_stdlib string_simd -DSTRING_SIMD
+gcc -O2 -fno-builtin string.c tmp/string_word.o -o tmp/string_word
+gcc -O2 -fno-builtin string.c tmp/string_simd.o -o tmp/string_simd
+
+echo -e "${YELLOW}word-at-a-time${OFF}:"
+tmp/string_word
+echo -e "${YELLOW}SSE2${OFF}:"
+tmp/string_simd 2
+if grep -q avx2 /proc/cpuinfo
+then
+    echo -e "${YELLOW}AVX2${OFF}:"
+    tmp/string_simd 3
+fi
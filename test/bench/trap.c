@@ -0,0 +1,162 @@
+/*
+ * Microbenchmark for the loader's trap dispatch.  For N trap sites, compare
+ * the average number of cycles needed to find the trampoline for a trapping
+ * instruction using (1) binary search over a sorted array, and (2) the
+ * hashed trap table emitted by E9Patch.  The cost of a SIGILL round trip is
+ * also measured for reference.
+ *
+ * Usage: trap [N ...]
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include <x86intrin.h>
+
+#include "e9loader.h"
+
+#define LOOKUPS     (1 << 22)
+
+static uint64_t seed = 1;
+static uint64_t rnd(void)
+{
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    return seed >> 16;
+}
+
+static int compare(const void *a, const void *b)
+{
+    intptr_t x = ((const struct e9_trap_s *)a)->rip;
+    intptr_t y = ((const struct e9_trap_s *)b)->rip;
+    return (x < y? -1: x > y);
+}
+
+static intptr_t search(const struct e9_trap_s *traps, size_t n, intptr_t key)
+{
+    int64_t lo = 0, hi = (int64_t)n - 1;
+    while (lo <= hi)
+    {
+        int64_t mid = (lo + hi) / 2;
+        if (key < traps[mid].rip)
+            hi = mid - 1;
+        else if (key > traps[mid].rip)
+            lo = mid + 1;
+        else
+            return traps[mid].trampoline;
+    }
+    return -1;
+}
+
+static intptr_t lookup(const struct e9_trap_s *table, uint32_t mask,
+    intptr_t key)
+{
+    for (uint32_t i = e9_trap_hash(key); ; i++)
+    {
+        const struct e9_trap_s *trap = table + (i & mask);
+        if (trap->rip == key)
+            return trap->trampoline;
+        if (trap->rip == 0x0)
+            return -1;
+    }
+}
+
+static void bench(size_t n)
+{
+    // Trap sites are distinct addresses in a 256MB text segment:
+    struct e9_trap_s *traps =
+        (struct e9_trap_s *)malloc(n * sizeof(struct e9_trap_s));
+    for (size_t i = 0; i < n; i++)
+    {
+        traps[i].rip        = 0x400000 + (rnd() % (1 << 28));
+        traps[i].trampoline = (intptr_t)i;
+    }
+    qsort(traps, n, sizeof(struct e9_trap_s), compare);
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++)
+        if (m == 0 || traps[i].rip != traps[m-1].rip)
+            traps[m++] = traps[i];
+    n = m;
+
+    // Build the table (as per e9elf.cpp):
+    size_t num_buckets = 1;
+    while (2 * num_buckets < 3 * n)
+        num_buckets *= 2;
+    uint32_t mask = (uint32_t)(num_buckets - 1);
+    struct e9_trap_s *table =
+        (struct e9_trap_s *)calloc(num_buckets, sizeof(struct e9_trap_s));
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t j = e9_trap_hash(traps[i].rip);
+        while (table[j & mask].rip != 0x0)
+            j++;
+        table[j & mask] = traps[i];
+    }
+
+    // Random hits:
+    intptr_t *keys = (intptr_t *)malloc(LOOKUPS * sizeof(intptr_t));
+    for (size_t i = 0; i < LOOKUPS; i++)
+        keys[i] = traps[rnd() % n].rip;
+
+    intptr_t sum0 = 0, sum1 = 0;
+    uint64_t t0 = __rdtsc();
+    for (size_t i = 0; i < LOOKUPS; i++)
+        sum0 += search(traps, n, keys[i]);
+    uint64_t t1 = __rdtsc();
+    for (size_t i = 0; i < LOOKUPS; i++)
+        sum1 += lookup(table, mask, keys[i]);
+    uint64_t t2 = __rdtsc();
+    if (sum0 != sum1)
+    {
+        fprintf(stderr, "error: lookup mismatch for N=%zu\n", n);
+        exit(EXIT_FAILURE);
+    }
+    printf("%-10zu %10.1f %10.1f\n", n, (double)(t1 - t0) / LOOKUPS,
+        (double)(t2 - t1) / LOOKUPS);
+
+    free(keys);
+    free(table);
+    free(traps);
+}
+
+static void handler(int sig, siginfo_t *info, void *ctx)
+{
+    ((ucontext_t *)ctx)->uc_mcontext.gregs[REG_RIP] += 2;   // Skip ud2
+}
+
+static double sigill(void)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handler;
+    action.sa_flags     = SA_SIGINFO | SA_NODEFER;
+    sigaction(SIGILL, &action, NULL);
+    const size_t iters = 100000;
+    uint64_t t0 = __rdtsc();
+    for (size_t i = 0; i < iters; i++)
+        asm volatile ("ud2");
+    uint64_t t1 = __rdtsc();
+    return (double)(t1 - t0) / iters;
+}
+
+int main(int argc, char **argv)
+{
+    printf("%-10s %10s %10s\n", "N", "bsearch", "hash");
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+            bench((size_t)atol(argv[i]));
+    }
+    else
+    {
+        bench(10);
+        bench(10000);
+        bench(1000000);
+    }
+    printf("(SIGILL round trip = %.1f cycles)\n", sigill());
+    return 0;
+}
@@ -0,0 +1,12 @@
+#!/bin/bash
+#
+# Measure the loader's trap dispatch lookup cost (in cycles) for 10, 10k and
+# 1M trap sites, binary search versus the hashed trap table.
+#
+# Usage: ./trap.sh
+#
+
+set -e
+mkdir -p tmp
+gcc -O2 -I ../../src/e9patch/ trap.c -o tmp/trap
+tmp/trap
@@ -0,0 +1,14 @@
+#!/bin/bash
+#
+# Measure the per-call cost (in cycles) of the call trampoline extended
+# state save modes (gpr, sse, xsave).
+#
+# Usage: ./xstate.sh [ITERATIONS]
+#
+
+. ./bench.sh
+
+bench_loop ${1:-10000000} call \
+    gpr   'entry<clean,gpr>()' \
+    sse   'entry<clean,sse>()' \
+    xsave 'entry<clean,xsave>()'
@@ -95,6 +95,50 @@ bug_call_rsp_0x2:
     callq *-136(%rsp)
 .Lbug_call_rsp_end:
 
+bug_fde:
+    mov $0x4,%eax
+    .cfi_startproc          # Unnamed function: only the .eh_frame FDE marks
+    mov $0x5,%eax           # this as a function entry
+    mov $0x6,%eax
+    .cfi_endproc
+
+bug_sample:
+    mov $10,%ecx
+.Lsample_loop:
+    mov $0x77,%r9d          # Sampled on hits 1, 4, 7, 10 for sample=3
+    dec %ecx
+    jnz .Lsample_loop
+
+bug_period:
+    mov $2,%ecx
+.Lperiod_loop:
+    mov $0x7fffffff,%eax
+    add $0x1,%eax           # OF=1, SF=1, ZF=0, CF=0
+    mov $0x88,%r9d          # Sampled on the first hit only
+    jno .Lexit
+    jns .Lexit
+    jz .Lexit
+    jc .Lexit
+    xor %eax,%eax
+    stc                     # OF=0, SF=0, ZF=1, CF=1
+    mov $0x88,%r9d
+    jo .Lexit
+    js .Lexit
+    jnz .Lexit
+    jnc .Lexit
+    dec %ecx
+    jnz .Lperiod_loop
+
+bug_toggle:
+    xor %eax,%eax
+    mov $0x99,%eax          # Must execute if replace/break/exit is disabled
+    mov $0xaa,%r9d
+    cmp $0x99,%eax
+    jne .Lexit
+
+bug_xstate:
+    call .Lbug_xstate       # Out-of-line: keeps the jumps to .Lexit short
+
 # Additional bugs can be added here:
 
 .Lprint:
@@ -113,11 +157,35 @@ bug_call_rsp_0x2:
     ud2
     jmp .Lexit
 
+.Lbug_xstate:
+    lea .Lxstate(%rip),%rax
+.irp r,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15
+    vmovdqu \r*32(%rax),%ymm\r
+.endr
+    mov $0xbb,%r9d          # Clobbers %ymm0-15 (and %mxcsr for xsave)
+.irp r,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15
+    vpcmpeqb \r*32(%rax),%ymm\r,%ymm\r
+    vpmovmskb %ymm\r,%edx
+    cmp $-1,%edx
+    jne .Lexit
+.endr
+    push %rax
+    stmxcsr (%rsp)
+    pop %rax
+    cmp $0x1f80,%eax        # Default %mxcsr
+    jne .Lexit
+    ret
+
 .global data2
 .type data2, @object
 data2:
 .Lstring:
     .ascii "PASSED\n"
+.Lxstate:
+.irp r,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15
+    .fill 16,1,0x10+\r
+    .fill 16,1,0x80+\r
+.endr
 
 .section .bss
 .align 16
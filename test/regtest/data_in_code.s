@@ -0,0 +1,50 @@
+# Copyright (C) 2022 National University of Singapore
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Data-in-code that desynchronizes a linear sweep.  This is kept separate
+# from "bugs" since the desync handler also drops the preceding instructions.
+
+.globl _start
+.type  _start, @function
+_start:
+
+.globl entry
+.type entry, @object
+entry:
+    jmp .Lcode
+    .byte 0x48, 0xb8        # movabs prefix: hides the code below from a
+                            # linear sweep
+.Lcode:
+    mov $0x1,%eax
+    mov $0x2,%ecx
+    mov $0x3,%edx
+
+    xor %eax,%eax   # SYS_write
+    inc %eax
+    mov %eax,%edi
+    inc %rdi
+    lea .Lstring(%rip),%rsi
+    mov $7, %rdx
+    syscall
+
+    mov $60,%eax    # SYS_exit
+    xor %edi,%edi
+    syscall
+
+.global data2
+.type data2, @object
+data2:
+.Lstring:
+    .ascii "PASSED\n"
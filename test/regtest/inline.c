@@ -0,0 +1,55 @@
+/*
+ * Inline fast path tests (see getFastPath()).
+ */
+
+#include "stdlib.c"
+
+#define INLINE(name, code)                                              \
+    asm (                                                               \
+        ".globl " #name ".inline\n"                                     \
+        ".type " #name ".inline,@function\n"                            \
+        #name ".inline:\n"                                              \
+        code                                                            \
+        ".size " #name ".inline,.-" #name ".inline\n"                   \
+    )
+
+/*
+ * call odd(addr,asm)@inline: only called for even addresses, since the fast
+ * path returns (addr & 1).
+ */
+void odd(intptr_t addr, const char *_asm)
+{
+    fprintf(stderr, "%s\n", _asm);
+}
+INLINE(odd,
+    "\tmov %rdi,%rax\n"
+    "\tand $1,%eax\n"
+    "\tret\n");
+
+/*
+ * Invalid fast paths (rejected by E9Tool):
+ */
+void bad_ret(void) { }
+INLINE(bad_ret,     "\tret\n\tnop\n\tret\n");
+void bad_call(void) { }
+INLINE(bad_call,    "\tcall bad_call\n\tret\n");
+void bad_syscall(void) { }
+INLINE(bad_syscall, "\tsyscall\n\tret\n");
+void bad_int3(void) { }
+INLINE(bad_int3,    "\tint3\n\tret\n");
+void bad_ijmp(void) { }
+INLINE(bad_ijmp,    "\tjmp *%rax\n\tret\n");
+void bad_jmp(void) { }
+INLINE(bad_jmp,     "\tjmp .+0x10\n\tret\n");
+void bad_rip(void) { }
+INLINE(bad_rip,     "\tmov 0x0(%rip),%rax\n\tret\n");
+void bad_noret(void) { }
+INLINE(bad_noret,   "\txor %eax,%eax\n");
+void bad_decode(void) { }
+INLINE(bad_decode,  "\t.byte 0x06\n\tret\n");
+void bad_size(void) { }
+asm (
+    ".globl bad_size.inline\n"
+    "bad_size.inline:\n"                // No .size
+    "\tret\n"
+);
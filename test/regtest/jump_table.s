@@ -0,0 +1,90 @@
+# Copyright (C) 2022 National University of Singapore
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# A bounded PIC jump table (the gcc/clang `switch' idiom).  The cases are
+# only reachable through the table.  The table has an extra out-of-bounds
+# entry (.Lnot_case) that is reached only by falling through, so it is a
+# basic block entry only if the table bounds were not recovered.
+
+.globl _start
+.type  _start, @function
+_start:
+
+.globl entry
+.type entry, @object
+entry:
+    xor %ebx,%ebx
+.Lloop:
+    mov %ebx,%edi
+    call dispatch
+    inc %ebx
+    cmp $4,%ebx
+    jb .Lloop
+
+    xor %eax,%eax   # SYS_write
+    inc %eax
+    mov %eax,%edi
+    inc %rdi
+    lea .Lstring(%rip),%rsi
+    mov $7, %rdx
+    syscall
+
+    mov $60,%eax    # SYS_exit
+    xor %edi,%edi
+    syscall
+
+.globl dispatch
+.type dispatch, @function
+dispatch:
+    cmp $2,%edi
+    ja .Ldefault
+    lea .Ltable(%rip),%rdx
+    movslq (%rdx,%rdi,4),%rax
+    add %rdx,%rax
+    jmp *%rax
+
+.globl cases
+.type cases, @function
+cases:
+.Lcase0:
+    mov $0x10,%ecx
+.Lcase1:
+    mov $0x11,%ecx
+.Lcase2:
+    mov $0x12,%ecx
+.Lnot_case:
+    mov $0x14,%ecx
+    ret
+.Ldefault:
+    mov $0x13,%ecx
+    ret
+
+.globl cases_end
+.type cases_end, @object
+cases_end:
+
+.section .rodata
+.align 4
+.Ltable:
+    .long .Lcase0-.Ltable
+    .long .Lcase1-.Ltable
+    .long .Lcase2-.Ltable
+    .long .Lnot_case-.Ltable
+
+.globl data2
+.type data2, @object
+data2:
+.Lstring:
+    .ascii "PASSED\n"
@@ -0,0 +1 @@
+./jump_table_cfr.exe && grep -o 'num_patched_T0.*' jump_table_cfr.log
@@ -441,6 +441,11 @@ void print(const char *_asm, const void *ptr)
     fprintf(stderr, "%s: %p\n", _asm, ptr);
 }
 
+void trace(const char *_asm)
+{
+    fprintf(stderr, "trace: %s\n", _asm);
+}
+
 void write(const char *str)
 {
     fputs(str, stderr);
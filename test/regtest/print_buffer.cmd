@@ -0,0 +1 @@
+rm -f print_buffer.trace && ./print_buffer.exe 3 fork && ../../e9tracedump print_buffer.exe.sites print_buffer.trace | sed 's/^[0-9a-f]*: //'
@@ -46,7 +46,34 @@ static bool option_tty = false;
     while (false)
 
 /*
- * Run a single test case.
+ * Check if the patching log contains the expected error (the first line of
+ * the ".err" file).
+ */
+static bool checkError(const std::string &err, const std::string &log)
+{
+    FILE *ERR = fopen(err.c_str(), "r");
+    if (ERR == nullptr)
+        error("failed to open file \"%s\" for reading: %s", err.c_str(),
+            strerror(errno));
+    std::string expected;
+    char c;
+    while ((c = getc(ERR)) != '\n' && c != EOF)
+        expected += c;
+    fclose(ERR);
+    FILE *LOG = fopen(log.c_str(), "r");
+    if (LOG == nullptr)
+        error("failed to open file \"%s\" for reading: %s", log.c_str(),
+            strerror(errno));
+    std::string output;
+    while ((c = getc(LOG)) != EOF)
+        output += c;
+    fclose(LOG);
+    return (output.find(expected) != std::string::npos);
+}
+
+/*
+ * Run a single test case.  If the test has an ".err" file, then patching is
+ * expected to fail with the given error.
  */
 static bool runTest(const struct dirent *test, const std::string &options)
 {
@@ -64,6 +91,8 @@ static bool runTest(const struct dirent *test, const std::string &options)
     cmd += ".cmd";
     std::string diff(basename);
     diff += ".diff";
+    std::string err(basename);
+    err += ".err";
 
     // Step (0): reset
     unlink(out.c_str());
@@ -100,6 +129,22 @@ static bool runTest(const struct dirent *test, const std::string &options)
     }
     printf("\n\t%s\n", command.c_str());
     int r = system(command.c_str());
+    if (access(err.c_str(), F_OK) == 0)
+    {
+        if (r == 0 || !checkError(err, log))
+        {
+            printf("%s%s%s: %sFAILED%s (patching did not fail with the "
+                "expected error, see %s)\n",
+                (option_tty? YELLOW: ""), basename.c_str(),
+                (option_tty? WHITE: ""), (option_tty? RED: ""),
+                (option_tty? WHITE: ""), log.c_str());
+            return false;
+        }
+        printf("%s%s%s: %spassed%s\n",
+            (option_tty? YELLOW: ""), basename.c_str(), (option_tty? WHITE: ""),
+            (option_tty? GREEN: ""), (option_tty? WHITE: ""));
+        return true;
+    }
     if (r != 0)
     {
         printf("%s%s%s: %sFAILED%s (patching failed with status %d, see %s)\n",
@@ -0,0 +1,100 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Fixture for the `trace' and `--print-buffer' tests.  The traced sites are
+ * written in assembly so that the decoded trace does not depend on the
+ * compiler.  trace_load() reads 0x100(%rdi), so the recorded `mem' address
+ * is the fixed buffer address.
+ */
+
+asm (
+    ".globl entry\n"
+    ".set entry,0x0\n"
+
+    ".text\n"
+    ".globl trace_load\n"
+    ".type trace_load,@function\n"
+    "trace_load:\n"
+    "\tmovl 0x100(%rdi),%eax\n"
+    "\tretq\n"
+
+    ".globl trace_child\n"
+    ".type trace_child,@function\n"
+    "trace_child:\n"
+    "\tmov $0x14,%eax\n"
+    "\tretq\n"
+
+    ".globl trace_parent\n"
+    ".type trace_parent,@function\n"
+    "trace_parent:\n"
+    "\tmov $0x15,%eax\n"
+    "\tretq\n"
+);
+
+extern int trace_load(const int *ptr);
+extern void trace_child(void);
+extern void trace_parent(void);
+
+#define BUF_ADDR    ((void *)0x20000000)
+#define BUF_SIZE    (1 << 20)
+
+/*
+ * Usage: test_trace [N [fork]]
+ *
+ * Calls trace_load() N times (reading 0x20000000, 0x20000008, ...), then
+ * optionally forks a child that calls trace_child() and exits, before
+ * calling trace_parent().
+ */
+int main(int argc, char **argv)
+{
+    long n = (argc > 1? atol(argv[1]): 10);
+    bool fork_mode = (argc > 2 && strcmp(argv[2], "fork") == 0);
+
+    int *buf = (int *)mmap(BUF_ADDR, BUF_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (buf != (int *)BUF_ADDR)
+    {
+        fprintf(stderr, "failed to map buffer\n");
+        return EXIT_FAILURE;
+    }
+
+    int sum = 0;
+    for (long i = 0; i < n; i++)
+    {
+        const int *ptr = buf + 2 * (i % (BUF_SIZE / (2 * sizeof(int))));
+        sum += trace_load((const int *)((const char *)ptr - 0x100));
+    }
+
+    if (fork_mode)
+    {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            fprintf(stderr, "failed to fork\n");
+            return EXIT_FAILURE;
+        }
+        if (pid == 0)
+        {
+            trace_child();
+            exit(EXIT_SUCCESS);
+        }
+        int status;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+                WEXITSTATUS(status) != EXIT_SUCCESS)
+        {
+            fprintf(stderr, "child failed\n");
+            return EXIT_FAILURE;
+        }
+        trace_parent();
+    }
+
+    return sum;
+}
@@ -0,0 +1 @@
+printf '\000' >toggle_2.ctl && ./toggle_2.exe
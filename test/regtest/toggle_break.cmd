@@ -0,0 +1 @@
+printf '\000' >toggle_break.ctl && ./toggle_break.exe
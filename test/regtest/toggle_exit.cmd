@@ -0,0 +1 @@
+printf '\000' >toggle_exit.ctl && ./toggle_exit.exe
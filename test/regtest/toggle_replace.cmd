@@ -0,0 +1 @@
+printf '\000' >toggle_replace.ctl && ./toggle_replace.exe
@@ -0,0 +1 @@
+printf '\001\001' >toggle_replace_2.ctl && ./toggle_replace_2.exe
@@ -0,0 +1 @@
+printf '\000\000' >toggle_replace_3.ctl && ./toggle_replace_3.exe
@@ -0,0 +1 @@
+rm -f trace_flush.trace && ./trace_flush.exe 100000 && ../../e9tracedump trace_flush.exe.sites trace_flush.trace | sed 's/^[0-9a-f]*: //' | uniq -c
@@ -0,0 +1 @@
+rm -f trace_fork.trace && ./trace_fork.exe 3 fork && ../../e9tracedump -t trace_fork.exe.sites trace_fork.trace | awk '!($1 in T) { T[$1] = "[T" (++n) "]" } { $1 = T[$1]; sub(/ [0-9a-f]*: /, " "); print }'
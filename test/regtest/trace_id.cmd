@@ -0,0 +1 @@
+rm -f trace_id.trace && ./trace_id.exe 3 && ../../e9tracedump trace_id.exe.sites trace_id.trace | sed 's/^[0-9a-f]*: //'
@@ -0,0 +1 @@
+rm -f trace_mem.trace && ./trace_mem.exe 3 && ../../e9tracedump trace_mem.exe.sites trace_mem.trace | sed 's/^[0-9a-f]*: //'
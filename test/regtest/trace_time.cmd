@@ -0,0 +1 @@
+rm -f trace_time.trace && ./trace_time.exe 3 && ../../e9tracedump trace_time.exe.sites trace_time.trace | awk '$1 < t { print "time went backwards" } { t = $1; sub(/^[0-9]* [0-9a-f]*: /, "TIME "); print }'
@@ -0,0 +1,36 @@
+/*
+ * Extended CPU state tests (see the <sse> and <xsave> call options).
+ *
+ * Since this file contains SIMD instructions, the default <clean> call mode
+ * selects xsave for all functions.
+ */
+
+#include "stdlib.c"
+
+/*
+ * call clobber_sse<clean,sse>(asm)@xstate: clobbers %xmm0-15 using legacy SSE
+ * instructions, which preserve the upper halves of %ymm0-15.
+ */
+void clobber_sse(const char *_asm)
+{
+    asm volatile (
+        ".irp r,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n"
+        "\tpcmpeqb %%xmm\\r,%%xmm\\r\n"
+        ".endr\n" : : : "memory");
+    fprintf(stderr, "%s\n", _asm);
+}
+
+/*
+ * call clobber_avx<clean,xsave>(asm)@xstate: clobbers %ymm0-15 and %mxcsr.
+ */
+void clobber_avx(const char *_asm)
+{
+    uint32_t mxcsr = 0x7f80;        // Round toward zero
+    asm volatile (
+        ".irp r,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n"
+        "\tvpcmpeqb %%ymm\\r,%%ymm\\r,%%ymm\\r\n"
+        ".endr\n"
+        "\tldmxcsr %0\n" : : "m"(mxcsr) : "memory");
+    fprintf(stderr, "%s\n", _asm);
+}
+